@@ -15,6 +15,7 @@
 #include <memory>
 #include <numeric>
 #include <queue>
+#include <string_view>
 #include <vector>
 
 #include "glog/logging.h"
@@ -42,7 +43,7 @@ class Vertex {
   std::shared_ptr<std::vector<int>> adj_;
 };
 
-int ReadInt(const std::string& line, size_t& ptr) {
+int ReadInt(const std::string_view& line, size_t& ptr) {
   int ret = 0;
   while (ptr < line.size() && !isdigit(line.at(ptr)))
     ++ptr;
@@ -54,7 +55,7 @@ int ReadInt(const std::string& line, size_t& ptr) {
   return ret;
 }
 
-DatasetPartition<Vertex> ParseLine(const std::string& line) {
+DatasetPartition<Vertex> ParseLine(const std::string_view& line) {
   size_t ptr = 0;
   int id, k;
   auto adj = std::make_shared<std::vector<int>>();
@@ -78,7 +79,7 @@ class ConnectedComponent : public Job {
 
     // Load data, partition by id, and sort within partition
     auto graph = TextSourceDataset(input, tg, n_partitions)
-                     .FlatMap([](const std::string& line) { return ParseLine(line); })
+                     .FlatMap([](const std::string_view& line) { return ParseLine(line); })
                      .PartitionBy([](const Vertex& v) { return v.GetId(); }, n_partitions);
     graph.UpdatePartition([](DatasetPartition<Vertex>& data) {
       std::sort(data.begin(), data.end(), [](const Vertex& a, const Vertex& b) { return a.GetId() < b.GetId(); });
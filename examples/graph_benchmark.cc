@@ -0,0 +1,103 @@
+// Copyright 2020 HDL
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cctype>
+#include <limits>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "glog/logging.h"
+
+#include "common/engine.h"
+#include "graph/algorithms.h"
+#include "graph/graph.h"
+
+using AdjList = std::pair<int, std::vector<int>>;
+using axe::graph::Graph;
+
+int ReadInt(const std::string_view& line, size_t& ptr) {
+  int ret = 0;
+  while (ptr < line.size() && !isdigit(line.at(ptr)))
+    ++ptr;
+  CHECK(ptr < line.size()) << "Invalid Input";
+  while (ptr < line.size() && isdigit(line.at(ptr))) {
+    ret = ret * 10 + line.at(ptr) - '0';
+    ++ptr;
+  }
+  return ret;
+}
+
+/** Parse a line of "id k neighbor_1 ... neighbor_k". **/
+void ParseLine(const std::string_view& line, Emitter<AdjList>& out) {
+  size_t ptr = 0;
+  AdjList vertex;
+  vertex.first = ReadInt(line, ptr);
+  int k = ReadInt(line, ptr);
+  vertex.second.reserve(k);
+  for (int i = 0; i < k; ++i) {
+    vertex.second.push_back(ReadInt(line, ptr));
+  }
+  out.emit_move(std::move(vertex));
+}
+
+/** Runs PageRank, connected components or single-source shortest paths with the vertex-centric graph API. **/
+class GraphBenchmark : public Job {
+ public:
+  void Run(TaskGraph* tg, const std::shared_ptr<Properties>& config) const override {
+    auto input = config->GetOrSet("graph", "/graph/google-adj");
+    auto algorithm = config->GetOrSet("algorithm", "pagerank");
+    int n_partitions = std::stoi(config->GetOrSet("parallelism", "20"));
+    int n_iters = std::stoi(config->GetOrSet("n_iters", "10"));
+    bool use_mirrors = config->GetOrSet("mirrors", "true") == "true";
+    int parse_threads = std::stoi(config->GetOrSet("parse_threads", "1"));
+    bool track_convergence = config->GetOrSet("track_convergence", "false") == "true";
+
+    auto records = TextSourceDataset(input, tg, n_partitions)
+                       .SetParseThreads(parse_threads, false)
+                       .FlatMap([](const std::string_view& line, Emitter<AdjList>& out) { ParseLine(line, out); });
+    auto graph = Graph<int>::FromRecords(&records, [](const AdjList& v) { return v.first; },
+                                         [](const AdjList& v) -> const std::vector<int>& { return v.second; }, n_partitions);
+    graph.UseMirrors(use_mirrors);
+
+    if (algorithm == "pagerank") {
+      graph.Run(axe::graph::PageRank<int>(), n_iters, track_convergence)->ApplyRead([](const auto& data) {
+        auto top = std::max_element(data.begin(), data.end(), [](const auto& a, const auto& b) { return a.value < b.value; });
+        if (top != data.end()) {
+          LOG(INFO) << "top rank in partition: id " << top->id << ", rank " << top->value;
+        }
+      });
+    } else if (algorithm == "cc") {
+      graph.Run(axe::graph::ConnectedComponents<int>(), n_iters, track_convergence)->ApplyRead([](const auto& data) {
+        LOG(INFO) << std::count_if(data.begin(), data.end(), [](const auto& v) { return v.id == v.value; }) << " components rooted in partition";
+      });
+    } else if (algorithm == "sssp") {
+      int source = std::stoi(config->GetOrSet("source", "0"));
+      graph.Run(axe::graph::ShortestPaths<int>(source), n_iters, track_convergence)->ApplyRead([](const auto& data) {
+        auto reached = std::count_if(data.begin(), data.end(), [](const auto& v) { return v.value < std::numeric_limits<double>::infinity(); });
+        LOG(INFO) << reached << " of " << data.size() << " vertices in partition reached";
+      });
+    } else {
+      LOG(FATAL) << "Unknown algorithm " << algorithm << ", expect pagerank, cc or sssp";
+    }
+    axe::common::JobDriver::ReversePrintTaskGraph(*tg);
+  }
+};
+
+int main(int argc, char** argv) {
+  axe::common::JobDriver::Run(argc, argv, GraphBenchmark());
+  return 0;
+}
@@ -15,12 +15,21 @@
 #include <memory>
 #include <numeric>
 #include <queue>
+#include <string_view>
 #include <vector>
 
 #include "glog/logging.h"
 
 #include "common/engine.h"
 
+// Rank updates are shuffled in runs sorted by vertex id, which the compact encoding stores as small id deltas
+namespace axe {
+namespace base {
+template <>
+struct use_compact_encoding<std::pair<int, double>> : std::true_type {};
+}  // namespace base
+}  // namespace axe
+
 class Vertex {
  public:
   Vertex() : adj_(std::make_shared<std::vector<int>>()) {}
@@ -44,7 +53,7 @@ class Vertex {
   std::shared_ptr<std::vector<int>> adj_;
 };
 
-int ReadInt(const std::string& line, size_t& ptr) {
+int ReadInt(const std::string_view& line, size_t& ptr) {
   int ret = 0;
   while (ptr < line.size() && !isdigit(line.at(ptr)))
     ++ptr;
@@ -56,7 +65,7 @@ int ReadInt(const std::string& line, size_t& ptr) {
   return ret;
 }
 
-DatasetPartition<Vertex> ParseLine(const std::string& line) {
+void ParseLine(const std::string_view& line, Emitter<Vertex>& out) {
   size_t ptr = 0;
   int id, k;
   auto adj = std::make_shared<std::vector<int>>();
@@ -66,9 +75,7 @@ DatasetPartition<Vertex> ParseLine(const std::string& line) {
   for (int i = 0; i < k; ++i) {
     adj->push_back(ReadInt(line, ptr));
   }
-  DatasetPartition<Vertex> ret;
-  ret.push_back(Vertex(id, adj));
-  return ret;
+  out.emit_move(Vertex(id, adj));
 }
 
 class PageRank : public Job {
@@ -80,7 +87,7 @@ class PageRank : public Job {
 
     // Load data, partition by id, and sort within partition
     auto graph = TextSourceDataset(input, tg, n_partitions)
-                     .FlatMap([](const std::string& line) { return ParseLine(line); },
+                     .FlatMap([](const std::string_view& line, Emitter<Vertex>& out) { ParseLine(line, out); },
                               [](const std::vector<double>& input) {
                                 double ret = 0;
                                 for (double x : input) {
@@ -16,6 +16,7 @@
 
 #include "glog/logging.h"
 
+#include "base/buffer_allocator.h"
 #include "common/closure.h"
 #include "common/dataset/dataset_partition.h"
 #include "common/dataset/source_dataset.h"
@@ -51,6 +52,8 @@ auto ParseLine(const std::string_view& line) {
 class ReadJob : public Job {
  public:
   void Run(TaskGraph* tg, const std::shared_ptr<Properties>& config) const override {
+    // back the input blocks as given by the buffer_* properties of this worker
+    axe::base::BufferAllocator::Get().Configure(config.get());
     // load dataset A
     auto dataA =
         TextSourceDataset(config->Get("graph"), tg, std::stoi(config->GetOrSet("parallelism", "10"))).FlatMap([](const std::string_view& line) {
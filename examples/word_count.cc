@@ -15,27 +15,34 @@
 #include <cctype>
 #include <memory>
 #include <string>
+#include <string_view>
+#include <unordered_map>
 #include <utility>
 
 #include "glog/logging.h"
 
+#include "base/arena.h"
 #include "base/tokenizer.h"
 #include "common/engine.h"
 
 using axe::base::Tokenizer;
 
-void ParseLine(DatasetPartition<std::pair<std::string, int>>& collection, const std::string& line) {
+void ParseLine(DatasetPartition<std::pair<std::string, int>>& collection, const std::string_view& line) {
   if (line.empty()) {
     return;
   }
-  axe::base::WhiteSpaceTokenizer tokenizer(line);
-  std::string tok;
-  std::unordered_map<std::string, int> word_count;
-  while (tokenizer.next(tok)) {
-    word_count[std::move(tok)] += 1;
+  axe::base::SimdTokenizer tokenizer(line);
+  std::string_view tok;
+  // the per-line map lives in the task arena and is released in bulk after the line. Its keys are views into the line,
+  // so a word is copied only once, when it is added to the collection
+  using WordCountMap = std::unordered_map<std::string_view, int, std::hash<std::string_view>, std::equal_to<std::string_view>,
+                                          axe::base::ArenaAllocator<std::pair<const std::string_view, int>>>;
+  WordCountMap word_count(16, WordCountMap::allocator_type());
+  while (tokenizer.next(&tok)) {
+    word_count[tok] += 1;
   }
   for (auto& pair : word_count) {
-    collection.push_back(pair);
+    collection.push_back(std::make_pair(std::string(pair.first), pair.second));
   }
 }
 
@@ -43,8 +50,8 @@ class WordCountJob : public Job {
  public:
   void Run(TaskGraph* tg, const std::shared_ptr<Properties>& config) const override {
     TextSourceDataset(config->Get("input"), tg, std::stoi(config->Get("parallelism")))
-        .FlatMap([](const std::string& line) {
-          DatasetPartition<std::pair<std::string, int>> ret;
+        .FlatMap([](const std::string_view& line) {
+          DatasetPartition<std::pair<std::string, int>> ret(axe::base::Arena::Current());
           ParseLine(ret, line);
           return ret;
         })
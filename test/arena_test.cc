@@ -0,0 +1,153 @@
+// Copyright 2020 HDL
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "base/arena.h"
+
+namespace axe {
+namespace base {
+namespace {
+
+TEST(Arena, AllocateIsAligned) {
+  Arena arena(256);
+  arena.Allocate(1, 1);
+  auto ptr = arena.Allocate(sizeof(uint64_t), alignof(uint64_t));
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(ptr) % alignof(uint64_t), 0);
+  EXPECT_EQ(arena.GetAllocatedBytes(), 1 + sizeof(uint64_t));
+  EXPECT_EQ(arena.GetNumBlocks(), 1);
+}
+
+TEST(Arena, LargeRequestGetsItsOwnBlock) {
+  Arena arena(64);
+  auto ptr = static_cast<char*>(arena.Allocate(1000));
+  std::memset(ptr, 1, 1000);
+  EXPECT_GE(arena.GetReservedBytes(), 1000);
+  EXPECT_EQ(arena.GetNumBlocks(), 1);
+}
+
+TEST(Arena, RewindReusesMemory) {
+  Arena arena(128);
+  arena.Allocate(16, 1);
+  auto mark = arena.GetMark();
+  auto first = arena.Allocate(32, 1);
+  for (int i = 0; i < 10; ++i) {
+    arena.Allocate(100, 1);
+  }
+  size_t blocks = arena.GetNumBlocks();
+  EXPECT_GT(blocks, 1);
+  arena.Rewind(mark);
+  // the same bytes are handed out again, and the blocks are kept for reuse
+  EXPECT_EQ(arena.Allocate(32, 1), first);
+  EXPECT_EQ(arena.GetNumBlocks(), blocks);
+}
+
+TEST(Arena, ScopeRewindsOnExit) {
+  Arena arena(128);
+  arena.Allocate(8, 1);
+  void* inner;
+  {
+    Arena::Scope scope(&arena);
+    inner = arena.Allocate(64, 1);
+    arena.Allocate(64, 1);
+  }
+  EXPECT_EQ(arena.GetMark().used, 8);
+  EXPECT_EQ(arena.Allocate(64, 1), inner);
+  Arena::Scope no_op(nullptr);
+}
+
+TEST(Arena, RewindKeepsSharedAllocations) {
+  Arena arena(128);
+  auto mark = arena.GetMark();
+  std::shared_ptr<char> owner;
+  auto shared = static_cast<char*>(arena.AllocateShared(32, 1, &owner));
+  std::memset(shared, 'x', 32);
+  arena.Rewind(mark);
+  // the shared bytes are not handed out again while the owner is alive
+  auto next = static_cast<char*>(arena.Allocate(32, 1));
+  EXPECT_TRUE(next >= shared + 32 || next + 32 <= shared);
+  std::memset(next, 'y', 32);
+  EXPECT_EQ(shared[0], 'x');
+  EXPECT_EQ(shared[31], 'x');
+}
+
+TEST(Arena, SharedAllocationOutlivesArena) {
+  std::shared_ptr<char> owner;
+  char* shared;
+  {
+    Arena arena(64);
+    shared = static_cast<char*>(arena.AllocateShared(16, 1, &owner));
+    std::memset(shared, 'z', 16);
+  }
+  EXPECT_EQ(owner.use_count(), 1);
+  EXPECT_EQ(shared[15], 'z');
+}
+
+TEST(Arena, TryExtendGrowsLastAllocation) {
+  Arena arena(128);
+  auto ptr = arena.Allocate(16, 1);
+  EXPECT_TRUE(arena.TryExtend(ptr, 16, 48));
+  EXPECT_EQ(arena.GetAllocatedBytes(), 48);
+  auto next = static_cast<char*>(arena.Allocate(1, 1));
+  EXPECT_EQ(next, static_cast<char*>(ptr) + 48);
+  // only the last allocation can grow
+  EXPECT_FALSE(arena.TryExtend(ptr, 48, 64));
+  // nor can it shrink or go past the block
+  EXPECT_FALSE(arena.TryExtend(next, 1, 0));
+  EXPECT_FALSE(arena.TryExtend(next, 1, 1000));
+  EXPECT_FALSE(arena.TryExtend(nullptr, 0, 8));
+}
+
+TEST(Arena, TryExtendOfSharedAllocationIsKeptByRewind) {
+  Arena arena(128);
+  auto mark = arena.GetMark();
+  std::shared_ptr<char> owner;
+  auto shared = static_cast<char*>(arena.AllocateShared(16, 1, &owner));
+  ASSERT_TRUE(arena.TryExtend(shared, 16, 40));
+  arena.Rewind(mark);
+  auto next = static_cast<char*>(arena.Allocate(8, 1));
+  EXPECT_TRUE(next >= shared + 40 || next + 8 <= shared);
+}
+
+TEST(Arena, ActivateSetsCurrentArena) {
+  EXPECT_EQ(Arena::Current(), nullptr);
+  Arena outer, inner;
+  {
+    Arena::Activate activate_outer(&outer);
+    EXPECT_EQ(Arena::Current(), &outer);
+    {
+      Arena::Activate activate_inner(&inner);
+      EXPECT_EQ(Arena::Current(), &inner);
+    }
+    EXPECT_EQ(Arena::Current(), &outer);
+    std::vector<int, ArenaAllocator<int>> values;
+    for (int i = 0; i < 100; ++i) {
+      values.push_back(i);
+    }
+    EXPECT_EQ(values.get_allocator().GetArena(), &outer);
+    EXPECT_GT(outer.GetAllocatedBytes(), 100 * sizeof(int));
+  }
+  EXPECT_EQ(Arena::Current(), nullptr);
+  std::vector<int, ArenaAllocator<int>> heap_values(10, 1);
+  EXPECT_EQ(heap_values.get_allocator().GetArena(), nullptr);
+}
+
+}  // namespace
+}  // namespace base
+}  // namespace axe
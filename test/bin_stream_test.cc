@@ -0,0 +1,167 @@
+// Copyright 2020 HDL
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "base/bin_stream.h"
+
+namespace axe {
+namespace base {
+namespace {
+
+struct Point {
+  int32_t x;
+  int32_t y;
+};
+
+struct WithMember {
+  int32_t value;
+  BinStream& serialize(BinStream& stream) const { return stream << value; }
+  BinStream& deserialize(BinStream& stream) { return stream >> value; }
+};
+
+/** Trivially copyable, but written as its value plus one byte by the friend operators. **/
+struct WithFriend {
+  int32_t value;
+  friend BinStream& operator<<(BinStream& stream, const WithFriend& x) { return stream << x.value << static_cast<uint8_t>(7); }
+  friend BinStream& operator>>(BinStream& stream, WithFriend& x) {
+    uint8_t tag;
+    stream >> x.value >> tag;
+    EXPECT_EQ(tag, 7);
+    return stream;
+  }
+};
+
+}  // namespace
+}  // namespace base
+}  // namespace axe
+
+namespace user {
+
+/** Trivially copyable, with free operators in its own namespace. **/
+struct Celsius {
+  double degrees;
+};
+
+inline axe::base::BinStream& operator<<(axe::base::BinStream& stream, const Celsius& x) { return stream << static_cast<float>(x.degrees); }
+inline axe::base::BinStream& operator>>(axe::base::BinStream& stream, Celsius& x) {
+  float degrees;
+  stream >> degrees;
+  x.degrees = degrees;
+  return stream;
+}
+
+}  // namespace user
+
+namespace axe {
+namespace base {
+namespace {
+
+TEST(BinStream, PackableTypes) {
+  EXPECT_TRUE(is_packable<int>::value);
+  EXPECT_TRUE(is_packable<double>::value);
+  EXPECT_TRUE(is_packable<Point>::value);
+  EXPECT_TRUE((is_packable<std::pair<int, Point>>::value));
+  EXPECT_FALSE(is_packable<std::string>::value);
+  EXPECT_FALSE(is_packable<WithMember>::value);
+  EXPECT_FALSE(is_packable<WithFriend>::value);
+  EXPECT_FALSE(is_packable<user::Celsius>::value);
+  EXPECT_FALSE((is_packable<std::pair<int, user::Celsius>>::value));
+  EXPECT_TRUE((is_memcpy_packable<std::pair<int, int>>::value));
+  EXPECT_FALSE((is_memcpy_packable<std::pair<int8_t, int64_t>>::value));
+}
+
+/** SerializeRange must write the bytes of n calls of operator<<, and DeserializeRange must read them back. **/
+template <typename T>
+void ExpectRangeRoundTrip(const std::vector<T>& values) {
+  BinStream one_by_one;
+  for (auto& value : values) {
+    one_by_one << value;
+  }
+  BinStream range;
+  SerializeRange(range, values.data(), values.size());
+  ASSERT_EQ(range.size(), one_by_one.size());
+  EXPECT_EQ(range.to_string(), one_by_one.to_string());
+
+  std::vector<T> out(values.size());
+  DeserializeRange(range, out.data(), out.size());
+  EXPECT_EQ(range.size(), 0);
+  ASSERT_EQ(out.size(), values.size());
+}
+
+TEST(BinStream, RangeOfMemcpyPackable) {
+  std::vector<Point> values;
+  for (int32_t i = 0; i < 100; ++i) {
+    values.push_back({i, -i});
+  }
+  ExpectRangeRoundTrip(values);
+  BinStream stream;
+  SerializeRange(stream, values.data(), values.size());
+  std::vector<Point> out(values.size());
+  DeserializeRange(stream, out.data(), out.size());
+  for (size_t i = 0; i < values.size(); ++i) {
+    EXPECT_EQ(out[i].x, values[i].x);
+    EXPECT_EQ(out[i].y, values[i].y);
+  }
+}
+
+TEST(BinStream, RangeOfPaddedPairs) {
+  std::vector<std::pair<int8_t, int64_t>> values;
+  for (int i = 0; i < 100; ++i) {
+    values.emplace_back(static_cast<int8_t>(i), int64_t(1) << (i % 63));
+  }
+  ExpectRangeRoundTrip(values);
+  BinStream stream;
+  SerializeRange(stream, values.data(), values.size());
+  EXPECT_EQ(stream.size(), values.size() * (sizeof(int8_t) + sizeof(int64_t)));
+  std::vector<std::pair<int8_t, int64_t>> out(values.size());
+  DeserializeRange(stream, out.data(), out.size());
+  EXPECT_EQ(out, values);
+}
+
+TEST(BinStream, RangeUsesFreeOperators) {
+  std::vector<WithFriend> friends{{1}, {2}, {3}};
+  ExpectRangeRoundTrip(friends);
+  BinStream stream;
+  SerializeRange(stream, friends.data(), friends.size());
+  EXPECT_EQ(stream.size(), friends.size() * (sizeof(int32_t) + sizeof(uint8_t)));
+
+  std::vector<user::Celsius> temperatures{{-3.5}, {0}, {21.25}};
+  ExpectRangeRoundTrip(temperatures);
+  BinStream celsius;
+  celsius << temperatures;
+  EXPECT_EQ(celsius.size(), sizeof(size_t) + temperatures.size() * sizeof(float));
+  std::vector<user::Celsius> out;
+  celsius >> out;
+  ASSERT_EQ(out.size(), temperatures.size());
+  for (size_t i = 0; i < out.size(); ++i) {
+    EXPECT_EQ(out[i].degrees, temperatures[i].degrees);
+  }
+}
+
+TEST(BinStream, EmptyRange) {
+  BinStream stream;
+  SerializeRange(stream, static_cast<const int*>(nullptr), 0);
+  EXPECT_EQ(stream.size(), 0);
+  DeserializeRange(stream, static_cast<int*>(nullptr), 0);
+}
+
+}  // namespace
+}  // namespace base
+}  // namespace axe
@@ -0,0 +1,129 @@
+// Copyright 2020 HDL
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cstdint>
+#include <cstring>
+
+#include "gtest/gtest.h"
+
+#include "base/buffer_allocator.h"
+#include "base/properties.h"
+
+namespace axe {
+namespace base {
+namespace {
+
+/** Configures the process-wide allocator for one test and restores its policy afterwards. **/
+class ScopedPolicy {
+ public:
+  explicit ScopedPolicy(const BufferAllocationPolicy& policy) : saved_(BufferAllocator::Get().GetPolicy()) {
+    BufferAllocator::Get().Configure(policy);
+  }
+  ~ScopedPolicy() { BufferAllocator::Get().Configure(saved_); }
+
+ private:
+  BufferAllocationPolicy saved_;
+};
+
+TEST(BufferAllocationPolicy, Parse) {
+  auto policy = BufferAllocationPolicy::Parse("huge_pages=transparent,numa=local,threshold=4096");
+  EXPECT_EQ(policy.huge_pages, BufferAllocationPolicy::kTransparent);
+  EXPECT_TRUE(policy.numa_local);
+  EXPECT_EQ(policy.large_threshold, 4096);
+  EXPECT_EQ(policy.DebugString(), "huge_pages=transparent,numa=local,threshold=4096");
+  EXPECT_FALSE(BufferAllocationPolicy::Parse("").Enabled());
+  EXPECT_DEATH(BufferAllocationPolicy::Parse("huge_pages=always"), "huge_pages");
+  EXPECT_DEATH(BufferAllocationPolicy::Parse("numa"), "key=value");
+}
+
+TEST(BufferAllocationPolicy, PropertiesOverrideTheGivenKeysOnly) {
+  Properties properties;
+  properties.Add("buffer_numa", "local");
+  auto base = BufferAllocationPolicy::Parse("huge_pages=explicit,threshold=8192");
+  auto policy = BufferAllocationPolicy::FromProperties(&properties, base);
+  EXPECT_EQ(policy.huge_pages, BufferAllocationPolicy::kExplicit);
+  EXPECT_TRUE(policy.numa_local);
+  EXPECT_EQ(policy.large_threshold, 8192);
+
+  properties.Add("buffer_huge_pages", "none");
+  properties.Add("buffer_large_threshold", "1024");
+  policy = BufferAllocationPolicy::FromProperties(&properties, base);
+  EXPECT_EQ(policy.huge_pages, BufferAllocationPolicy::kNone);
+  EXPECT_EQ(policy.large_threshold, 1024);
+}
+
+TEST(BufferAllocator, ConfiguredFromProperties) {
+  ScopedPolicy scoped(BufferAllocationPolicy());
+  Properties properties;
+  properties.Add("buffer_huge_pages", "transparent");
+  properties.Add("buffer_large_threshold", "65536");
+  BufferAllocator::Get().Configure(&properties);
+  EXPECT_TRUE(BufferAllocator::Get().IsLarge(65536));
+  EXPECT_FALSE(BufferAllocator::Get().IsLarge(65535));
+  EXPECT_EQ(BufferAllocator::Get().GetPolicy().huge_pages, BufferAllocationPolicy::kTransparent);
+  // without properties the policy is kept
+  BufferAllocator::Get().Configure(static_cast<Properties*>(nullptr));
+  EXPECT_TRUE(BufferAllocator::Get().IsLarge(65536));
+}
+
+TEST(BufferAllocator, SmallBuffersComeFromTheHeap) {
+  ScopedPolicy scoped(BufferAllocationPolicy::Parse("huge_pages=transparent,threshold=65536"));
+  auto before = BufferAllocator::Get().GetStats();
+  auto buffer = BufferAllocator::Get().Allocate(100);
+  std::memset(buffer.get(), 1, 100);
+  auto after = BufferAllocator::Get().GetStats();
+  EXPECT_EQ(after.heap_buffers, before.heap_buffers + 1);
+  EXPECT_EQ(after.large_buffers, before.large_buffers);
+}
+
+TEST(BufferAllocator, TransparentHugePagesAreAligned) {
+  ScopedPolicy scoped(BufferAllocationPolicy::Parse("huge_pages=transparent,threshold=65536"));
+  auto before = BufferAllocator::Get().GetStats();
+  size_t bytes = BufferAllocator::kHugePageSize + 100;
+  auto buffer = BufferAllocator::Get().Allocate(bytes);
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(buffer.get()) % BufferAllocator::kHugePageSize, 0);
+  std::memset(buffer.get(), 1, bytes);
+  auto after = BufferAllocator::Get().GetStats();
+  EXPECT_EQ(after.large_buffers, before.large_buffers + 1);
+  EXPECT_EQ(after.large_bytes, before.large_bytes + bytes);
+  EXPECT_EQ(after.huge_page_hits + after.huge_page_misses, before.huge_page_hits + before.huge_page_misses + 1);
+}
+
+TEST(BufferAllocator, ExplicitHugePagesFallBackToNormalPages) {
+  ScopedPolicy scoped(BufferAllocationPolicy::Parse("huge_pages=explicit,threshold=4096"));
+  auto buffer = BufferAllocator::Get().Allocate(10000);
+  ASSERT_NE(buffer.get(), nullptr);
+  std::memset(buffer.get(), 1, 10000);
+}
+
+TEST(BufferAllocator, InvalidNodeIsAMiss) {
+  ScopedPolicy scoped(BufferAllocationPolicy::Parse("numa=local,threshold=4096"));
+  for (int node : {-2, 64, 1000}) {
+    auto before = BufferAllocator::Get().GetStats();
+    auto buffer = BufferAllocator::Get().Allocate(8192, node);
+    std::memset(buffer.get(), 1, 8192);
+    auto after = BufferAllocator::Get().GetStats();
+    EXPECT_EQ(after.numa_misses, before.numa_misses + 1) << "node " << node;
+    EXPECT_EQ(after.numa_hits, before.numa_hits) << "node " << node;
+  }
+  // the node of the calling thread is either bound or counted as a miss
+  auto before = BufferAllocator::Get().GetStats();
+  auto buffer = BufferAllocator::Get().Allocate(8192);
+  auto after = BufferAllocator::Get().GetStats();
+  EXPECT_EQ(after.numa_hits + after.numa_misses, before.numa_hits + before.numa_misses + 1);
+}
+
+}  // namespace
+}  // namespace base
+}  // namespace axe
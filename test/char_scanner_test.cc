@@ -0,0 +1,158 @@
+// Copyright 2020 HDL
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cstdint>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "base/char_scanner.h"
+#include "base/tokenizer.h"
+
+namespace axe {
+namespace base {
+namespace {
+
+/** Exposes the matching of each instruction set. **/
+class TestCharScanner : public CharScanner {
+ public:
+  using CharScanner::MatchScalar;
+#ifdef URSA_CHAR_SCANNER_X86
+  using CharScanner::HasAvx2;
+  using CharScanner::MatchAvx2;
+  using CharScanner::MatchSse2;
+#endif
+};
+
+/** Random bytes with frequent line ends, commas and spaces. **/
+std::string RandomText(std::mt19937* rng, size_t n) {
+  const std::string alphabet = "ab,\n \t\xff\x80";
+  std::string ret(n, ' ');
+  for (auto& c : ret) {
+    c = alphabet[(*rng)() % alphabet.size()];
+  }
+  return ret;
+}
+
+std::vector<size_t> Positions(std::string_view str, char c) {
+  std::vector<size_t> ret;
+  for (size_t i = 0; i < str.size(); ++i) {
+    if (str[i] == c) {
+      ret.push_back(i);
+    }
+  }
+  return ret;
+}
+
+TEST(CharScanner, VectorMatchAgreesWithScalar) {
+  std::mt19937 rng(1);
+  for (std::string_view chars : {std::string_view("\n"), std::string_view(","), std::string_view(" \t\n\v\f\r"),
+                                 std::string_view("\xff\x80", 2)}) {
+    for (size_t size : {64, 128, 1024}) {
+      auto text = RandomText(&rng, size);
+      std::vector<uint64_t> scalar(size / 64), masks(size / 64);
+      TestCharScanner::MatchScalar(text.data(), size, chars, scalar.data());
+#ifdef URSA_CHAR_SCANNER_X86
+      TestCharScanner::MatchSse2(text.data(), size, chars, masks.data());
+      EXPECT_EQ(masks, scalar) << "SSE2, size " << size;
+      if (TestCharScanner::HasAvx2()) {
+        TestCharScanner::MatchAvx2(text.data(), size, chars, masks.data());
+        EXPECT_EQ(masks, scalar) << "AVX2, size " << size;
+      }
+#endif
+      // any size, with a tail shorter than a mask word
+      for (size_t n : {size_t(0), size_t(1), size - 1, size}) {
+        std::vector<uint64_t> expected((n + 63) / 64), got((n + 63) / 64);
+        TestCharScanner::MatchScalar(text.data(), n, chars, expected.data());
+        CharScanner::Match(text.data(), n, chars, got.data());
+        EXPECT_EQ(got, expected) << "size " << n;
+      }
+    }
+  }
+}
+
+TEST(CharScanner, FindAllAndFindNextAtEveryOffset) {
+  std::mt19937 rng(2);
+  auto text = RandomText(&rng, 3000);
+  auto expected = Positions(text, '\n');
+  std::vector<uint32_t> all;
+  CharScanner::FindAll(text, '\n', &all);
+  EXPECT_EQ(std::vector<size_t>(all.begin(), all.end()), expected);
+
+  // the line ends of every suffix, which start at any alignment
+  for (size_t begin = 0; begin < 200; ++begin) {
+    auto suffix = std::string_view(text).substr(begin);
+    std::vector<size_t> got;
+    CharScanner::FindAll(suffix, '\n', &got);
+    EXPECT_EQ(got, Positions(suffix, '\n')) << "from " << begin;
+  }
+  auto next = expected.begin();
+  for (size_t pos = 0; pos <= text.size(); ++pos) {
+    while (next != expected.end() && *next < pos) {
+      ++next;
+    }
+    ASSERT_EQ(CharScanner::FindNext(text, pos, '\n'), next == expected.end() ? std::string_view::npos : *next) << "from " << pos;
+  }
+}
+
+TEST(CharScanner, FindNextFarAway) {
+  std::string text(5000, 'a');
+  EXPECT_EQ(CharScanner::FindNext(text, 0, '\n'), std::string_view::npos);
+  text[4321] = '\n';
+  EXPECT_EQ(CharScanner::FindNext(text, 0, '\n'), 4321);
+  EXPECT_EQ(CharScanner::FindNext(text, 4321, '\n'), 4321);
+  EXPECT_EQ(CharScanner::FindNext(text, 4322, '\n'), std::string_view::npos);
+}
+
+std::vector<std::string_view> Tokens(SimdTokenizer tokenizer) {
+  std::vector<std::string_view> ret;
+  std::string_view token;
+  while (tokenizer.next(&token)) {
+    ret.push_back(token);
+  }
+  return ret;
+}
+
+TEST(SimdTokenizer, Whitespace) {
+  EXPECT_EQ(Tokens(SimdTokenizer("")), std::vector<std::string_view>());
+  EXPECT_EQ(Tokens(SimdTokenizer(" \t\n ")), std::vector<std::string_view>());
+  EXPECT_EQ(Tokens(SimdTokenizer("  the quick\tbrown\n\nfox ")), (std::vector<std::string_view>{"the", "quick", "brown", "fox"}));
+}
+
+TEST(SimdTokenizer, CsvKeepsEmptyFields) {
+  EXPECT_EQ(Tokens(SimdTokenizer("a,,b,", ",", false)), (std::vector<std::string_view>{"a", "", "b", ""}));
+  EXPECT_EQ(Tokens(SimdTokenizer("a,,b,", ",")), (std::vector<std::string_view>{"a", "b"}));
+  EXPECT_EQ(Tokens(SimdTokenizer("1;2,3", ",;", false)), (std::vector<std::string_view>{"1", "2", "3"}));
+}
+
+TEST(SimdTokenizer, AgreesWithSplittingAcrossChunks) {
+  std::mt19937 rng(3);
+  auto text = RandomText(&rng, 5 * CharScanner::kChunkBytes + 17);
+  std::vector<std::string_view> expected;
+  size_t begin = 0;
+  for (size_t i = 0; i <= text.size(); ++i) {
+    if (i == text.size() || text[i] == ',') {
+      expected.push_back(std::string_view(text).substr(begin, i - begin));
+      begin = i + 1;
+    }
+  }
+  EXPECT_EQ(Tokens(SimdTokenizer(text, ",", false)), expected);
+}
+
+}  // namespace
+}  // namespace base
+}  // namespace axe
@@ -0,0 +1,112 @@
+// Copyright 2020 HDL
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "common/dataset/column_sort.h"
+
+namespace axe {
+namespace common {
+namespace {
+
+/** The rows in sorted order by CompareRows, with a stable sort. **/
+std::vector<uint32_t> SortByComparison(const std::vector<SortColumn>& columns, size_t size) {
+  std::vector<uint32_t> ret(size);
+  std::iota(ret.begin(), ret.end(), 0);
+  std::stable_sort(ret.begin(), ret.end(), [&columns](uint32_t l, uint32_t r) { return ColumnSorter::CompareRows(columns, l, r) < 0; });
+  return ret;
+}
+
+TEST(ColumnSorter, StringPrefixTiesAreNotOrderedByLaterColumns) {
+  StringPartition s(std::vector<std::string>{"aaaaaaaaaaaaZ", "aaaaaaaaaaaaA"});
+  DatasetPartition<int32_t> b(std::vector<int32_t>{1, 2});
+  std::vector<SortColumn> columns{SortColumn(&s), SortColumn(&b)};
+  ASSERT_GT(ColumnSorter::CompareRows(columns, 0, 1), 0);
+  EXPECT_EQ(ColumnSorter::GetSortedIndex(columns), (std::vector<uint32_t>{1, 0}));
+}
+
+TEST(ColumnSorter, IntegersThenStrings) {
+  DatasetPartition<int64_t> a(std::vector<int64_t>{2, 1, 2, 1});
+  StringPartition s(std::vector<std::string>{"b", "z", "a", "y"});
+  std::vector<SortColumn> columns{SortColumn(&a, true), SortColumn(&s)};
+  EXPECT_EQ(ColumnSorter::GetSortedIndex(columns), (std::vector<uint32_t>{2, 0, 3, 1}));
+}
+
+TEST(ColumnSorter, NullsFirstOrLast) {
+  DatasetPartition<int32_t> a(std::vector<int32_t>{3, 1, 2, 0});
+  a.SetNull({1, 3});
+  EXPECT_EQ(ColumnSorter::GetSortedIndex({SortColumn(&a)}), (std::vector<uint32_t>{1, 3, 2, 0}));
+  EXPECT_EQ(ColumnSorter::GetSortedIndex({SortColumn(&a, false, false)}), (std::vector<uint32_t>{2, 0, 1, 3}));
+  EXPECT_EQ(ColumnSorter::GetSortedIndex({SortColumn(&a, true, false)}), (std::vector<uint32_t>{0, 2, 1, 3}));
+}
+
+TEST(ColumnSorter, KeysWiderThanTheLimit) {
+  // five 8-byte columns exceed the 32-byte key, the last one is compared in full
+  std::vector<DatasetPartition<uint64_t>> values(5, DatasetPartition<uint64_t>(std::vector<uint64_t>{7, 7, 7}));
+  values[4][0] = 3;
+  values[4][2] = 1;
+  std::vector<SortColumn> columns;
+  for (auto& column : values) {
+    columns.emplace_back(&column);
+  }
+  EXPECT_EQ(ColumnSorter::GetSortedIndex(columns), (std::vector<uint32_t>{2, 0, 1}));
+}
+
+/** Random columns of few distinct values, in every order of a string, a dictionary string, an integer and a double
+ * column, with nulls and descending columns, sort the same as the full comparison.
+ */
+TEST(ColumnSorter, MatchesFullComparison) {
+  const size_t n = 2000;
+  std::mt19937 rng(7);
+  StringPartition strings;
+  DictionaryStringPartition dictionary;
+  DatasetPartition<int32_t> ints(n);
+  DatasetPartition<double> doubles(n);
+  std::vector<uint32_t> nulls;
+  for (size_t i = 0; i < n; ++i) {
+    // long common prefixes, so that many rows tie on the encoded string prefix
+    strings.push_back(std::string(ColumnSorter::kStringPrefixBytes, 'x') + std::to_string(rng() % 5));
+    dictionary.push_back("d" + std::to_string(rng() % 4));
+    ints[i] = static_cast<int32_t>(rng() % 5) - 2;
+    doubles[i] = (rng() % 3) * 0.5;
+    if (rng() % 10 == 0) {
+      nulls.push_back(i);
+    }
+  }
+  ints.SetNull(nulls);
+  std::vector<const Partition*> all{&strings, &dictionary, &ints, &doubles};
+  std::vector<size_t> order{0, 1, 2, 3};
+  do {
+    for (int descending = 0; descending < 2; ++descending) {
+      std::vector<SortColumn> columns;
+      for (auto i : order) {
+        columns.emplace_back(all[i], descending && i % 2 == 0, i != 2 || descending);
+      }
+      EXPECT_EQ(ColumnSorter::GetSortedIndex(columns), SortByComparison(columns, n))
+          << "columns " << order[0] << order[1] << order[2] << order[3] << ", descending " << descending;
+    }
+  } while (std::next_permutation(order.begin(), order.end()));
+}
+
+}  // namespace
+}  // namespace common
+}  // namespace axe
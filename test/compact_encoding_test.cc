@@ -0,0 +1,185 @@
+// Copyright 2020 HDL
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cstdint>
+#include <limits>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "base/bin_stream.h"
+#include "base/compact_encoding.h"
+
+namespace axe {
+namespace base {
+namespace {
+
+template <typename T>
+std::vector<T> RoundTrip(const std::vector<T>& in, size_t* encoded_bytes = nullptr) {
+  BinStream stream;
+  SerializeCompactRun(stream, in.data(), in.size());
+  if (encoded_bytes != nullptr) {
+    *encoded_bytes = stream.size();
+  }
+  std::vector<T> out;
+  DeserializeCompactRun<T>(stream, &out);
+  EXPECT_EQ(stream.size(), 0);
+  return out;
+}
+
+TEST(CompactEncoding, VarintRoundTrip) {
+  std::vector<uint64_t> values = {0, 1, 127, 128, 300, 16383, 16384, uint64_t(1) << 35, std::numeric_limits<uint64_t>::max()};
+  for (auto value : values) {
+    char buffer[kMaxVarintSize];
+    auto end = PutVarint(buffer, value);
+    uint64_t decoded = 0;
+    EXPECT_EQ(GetVarint(buffer, end, &decoded), end);
+    EXPECT_EQ(decoded, value);
+  }
+  char buffer[kMaxVarintSize];
+  auto end = PutVarint(buffer, 300);
+  EXPECT_EQ(end - buffer, 2);
+  uint64_t decoded;
+  EXPECT_DEATH(GetVarint(buffer, buffer + 1, &decoded), "CompactEncoding");
+}
+
+TEST(CompactEncoding, ZigZag) {
+  for (int64_t value : {int64_t(0), int64_t(-1), int64_t(1), int64_t(-64), std::numeric_limits<int64_t>::min(),
+                        std::numeric_limits<int64_t>::max()}) {
+    EXPECT_EQ(ZigZagDecode(ZigZagEncode(value)), value);
+  }
+  EXPECT_EQ(ZigZagEncode(-1), 1);
+  EXPECT_EQ(ZigZagEncode(1), 2);
+}
+
+TEST(CompactEncoding, SortedKeysAreDeltaEncoded) {
+  std::vector<uint64_t> in;
+  for (uint64_t i = 0; i < 1000; ++i) {
+    in.push_back(1000000000 + i * 3);
+  }
+  size_t bytes;
+  EXPECT_EQ(RoundTrip(in, &bytes), in);
+  // the count, the first key, then one byte per delta
+  EXPECT_LT(bytes, 2 + kMaxVarintSize + in.size());
+}
+
+TEST(CompactEncoding, SignedAndExtremeIntegers) {
+  std::vector<int32_t> ints = {0, -1, 5, std::numeric_limits<int32_t>::min(), std::numeric_limits<int32_t>::max(), -7, 3};
+  EXPECT_EQ(RoundTrip(ints), ints);
+  std::vector<int64_t> longs = {std::numeric_limits<int64_t>::max(), std::numeric_limits<int64_t>::min(), 0, -1};
+  EXPECT_EQ(RoundTrip(longs), longs);
+  std::vector<uint8_t> bytes = {255, 0, 128, 1};
+  EXPECT_EQ(RoundTrip(bytes), bytes);
+}
+
+TEST(CompactEncoding, PairsAndRawRecords) {
+  std::mt19937 rng(7);
+  std::vector<std::pair<int, double>> pairs;
+  for (int i = 0; i < 500; ++i) {
+    pairs.emplace_back(static_cast<int>(rng() % 1000) - 500, rng() / 7.);
+  }
+  EXPECT_EQ(RoundTrip(pairs), pairs);
+  std::vector<double> doubles = {1.5, -2.25, 0, 1e300};
+  EXPECT_EQ(RoundTrip(doubles), doubles);
+  EXPECT_TRUE(RoundTrip(std::vector<int>()).empty());
+}
+
+TEST(CompactEncoding, RunsAppendToTheOutput) {
+  std::vector<int> a = {3, 1, 2}, b = {-5, 10};
+  BinStream stream;
+  SerializeCompactRun(stream, a.data(), a.size());
+  SerializeCompactRun(stream, b.data(), b.size());
+  std::vector<int> out;
+  DeserializeCompactRun<int>(stream, &out);
+  DeserializeCompactRun<int>(stream, &out);
+  EXPECT_EQ(out, std::vector<int>({3, 1, 2, -5, 10}));
+}
+
+TEST(CompactEncoding, CorruptCountIsRejectedBeforeResizing) {
+  BinStream stream;
+  char buffer[kMaxVarintSize];
+  stream.push_back_bytes(buffer, PutVarint(buffer, uint64_t(1) << 60) - buffer);
+  int record = 1;
+  stream.push_back_bytes(reinterpret_cast<const char*>(&record), sizeof(record));
+  std::vector<int> out;
+  EXPECT_DEATH(DeserializeCompactRun<int>(stream, &out), "CompactEncoding");
+}
+
+TEST(CompactEncoding, TruncatedRunIsRejected) {
+  using Record = std::pair<int, double>;
+  std::vector<Record> in = {{1, 1.}, {2, 2.}};
+  BinStream stream;
+  SerializeCompactRun(stream, in.data(), in.size());
+  stream.pop_back_bytes(3);
+  std::vector<Record> out;
+  EXPECT_DEATH(DeserializeCompactRun<Record>(stream, &out), "CompactEncoding");
+}
+
+TEST(CompactEncoding, ContainersHaveVarintLengths) {
+  using Record = std::pair<int, std::vector<int>>;
+  std::vector<Record> in = {{1, {1, 2, 3}}, {2, {}}, {5, {-1, 1000000}}};
+  size_t bytes;
+  EXPECT_EQ(RoundTrip(in, &bytes), in);
+  // the count, then per record the key delta, the length and the varint elements
+  EXPECT_EQ(bytes, 1 + (1 + 1 + 3) + (1 + 1) + (1 + 1 + 1 + 3));
+
+  std::vector<std::pair<std::string, std::vector<double>>> named = {{"a", {1.5}}, {"", {}}, {std::string(300, 'x'), {2., 3.}}};
+  EXPECT_EQ(RoundTrip(named), named);
+}
+
+TEST(CompactEncoding, CorruptLengthIsRejected) {
+  using Record = std::pair<int, std::vector<int>>;
+  std::vector<Record> in = {{1, {1, 2, 3}}};
+  BinStream stream;
+  SerializeCompactRun(stream, in.data(), in.size());
+  // the length of the vector claims more elements than the bytes left
+  stream.get_buffer()[2] = 100;
+  std::vector<Record> out;
+  EXPECT_DEATH(DeserializeCompactRun<Record>(stream, &out), "CompactEncoding");
+}
+
+TEST(CompactEncoding, SortedIndexedRunsAreSmaller) {
+  std::mt19937 rng(11);
+  std::vector<std::pair<int64_t, int>> records;
+  for (int i = 0; i < 1000; ++i) {
+    records.emplace_back(static_cast<int64_t>(rng() % 10000), i % 100);
+  }
+  std::vector<size_t> index;
+  for (size_t i = 0; i < records.size(); i += 2) {
+    index.push_back(i);
+  }
+  BinStream unsorted;
+  SerializeCompactRun(unsorted, records.data(), index.data(), index.size());
+  SortCompactRun(records.data(), index.data(), index.size());
+  BinStream sorted;
+  SerializeCompactRun(sorted, records.data(), index.data(), index.size());
+  EXPECT_LT(sorted.size(), unsorted.size() * 3 / 4);
+
+  std::vector<std::pair<int64_t, int>> out;
+  DeserializeCompactRun<std::pair<int64_t, int>>(sorted, &out);
+  ASSERT_EQ(out.size(), index.size());
+  for (size_t i = 0; i < out.size(); ++i) {
+    EXPECT_EQ(out[i], records[index[i]]);
+    if (i > 0) {
+      EXPECT_LE(out[i - 1].first, out[i].first);
+    }
+  }
+}
+
+}  // namespace
+}  // namespace base
+}  // namespace axe
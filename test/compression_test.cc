@@ -0,0 +1,200 @@
+// Copyright 2020 HDL
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "base/bin_stream.h"
+#include "base/compression.h"
+
+namespace axe {
+namespace base {
+namespace {
+
+std::string Compressible(size_t size) {
+  std::string ret;
+  for (size_t i = 0; ret.size() < size; ++i) {
+    ret += "key-" + std::to_string(i % 50) + ",value;";
+  }
+  ret.resize(size);
+  return ret;
+}
+
+std::string Random(std::mt19937* rng, size_t size) {
+  std::string ret(size, 0);
+  for (auto& c : ret) {
+    c = static_cast<char>((*rng)());
+  }
+  return ret;
+}
+
+std::string LZRoundTrip(const std::string& in, size_t* compressed_size = nullptr) {
+  LZCodec codec;
+  std::vector<char> compressed(codec.MaxCompressedSize(in.size()));
+  size_t size = codec.Compress(in.data(), in.size(), compressed.data());
+  EXPECT_LE(size, compressed.size());
+  if (compressed_size != nullptr) {
+    *compressed_size = size;
+  }
+  std::string out(in.size(), 0);
+  EXPECT_TRUE(codec.Decompress(compressed.data(), size, &out[0], out.size()));
+  return out;
+}
+
+/** A message of a 4-byte header and the compression flag followed by payload, compressed by compressor. **/
+BinStream MakeMessage(MessageCompressor* compressor, uint32_t header, const std::string& payload) {
+  BinStream stream;
+  stream << header << MessageCompressor::kUncompressed;
+  stream.push_back_bytes(payload.data(), payload.size());
+  compressor->Compress(&stream, sizeof(header) + sizeof(uint8_t));
+  return stream;
+}
+
+/** Read the header of a message and return the decompressed payload. **/
+std::string ReadMessage(BinStream* stream, uint32_t expected_header) {
+  uint32_t header;
+  *stream >> header;
+  EXPECT_EQ(header, expected_header);
+  MessageCompressor::Decompress(stream);
+  return std::string(stream->get_remained_buffer(), stream->size());
+}
+
+TEST(LZCodec, RoundTripCompressible) {
+  for (size_t size : {1, 4, 15, 16, 100, 4096, 300000}) {
+    auto in = Compressible(size);
+    size_t compressed_size;
+    EXPECT_EQ(LZRoundTrip(in, &compressed_size), in);
+    if (size >= 4096) {
+      EXPECT_LT(compressed_size, in.size() / 4);
+    }
+  }
+}
+
+TEST(LZCodec, RoundTripLongRunsAndLiterals) {
+  // match and literal lengths past the 15 and 255 continuation bytes
+  std::mt19937 rng(1);
+  std::string in = std::string(1000, 'a') + Random(&rng, 600) + std::string(70000, 'b') + Random(&rng, 20);
+  EXPECT_EQ(LZRoundTrip(in), in);
+}
+
+TEST(LZCodec, RoundTripRandomAndEmpty) {
+  std::mt19937 rng(2);
+  for (size_t size : {0, 3, 64, 5000}) {
+    auto in = Random(&rng, size);
+    size_t compressed_size;
+    EXPECT_EQ(LZRoundTrip(in, &compressed_size), in);
+    EXPECT_LE(compressed_size, LZCodec().MaxCompressedSize(size));
+  }
+}
+
+TEST(LZCodec, RejectsCorruptedInput) {
+  LZCodec codec;
+  auto in = Compressible(2000);
+  std::vector<char> compressed(codec.MaxCompressedSize(in.size()));
+  size_t size = codec.Compress(in.data(), in.size(), compressed.data());
+  std::string out(in.size(), 0);
+  EXPECT_FALSE(codec.Decompress(compressed.data(), size / 2, &out[0], out.size()));
+  EXPECT_FALSE(codec.Decompress(compressed.data(), size, &out[0], out.size() - 1));
+  // a match before the start of the output
+  const char bad[] = {0x10, 'x', 0x05, 0x00};
+  EXPECT_FALSE(codec.Decompress(bad, sizeof(bad), &out[0], 5));
+}
+
+TEST(CompressionCodecRegistry, LZIsBuiltIn) {
+  auto codec = CompressionCodecRegistry::GetCodec(LZCodec::kId);
+  ASSERT_NE(codec, nullptr);
+  EXPECT_EQ(codec->GetName(), "lz");
+  EXPECT_EQ(CompressionCodecRegistry::GetCodec("lz"), codec);
+  EXPECT_EQ(CompressionCodecRegistry::GetCodec("none"), nullptr);
+  EXPECT_EQ(CompressionCodecRegistry::GetCodec(uint8_t(0)), nullptr);
+}
+
+TEST(MessageCompressor, RoundTripKeepsHeader) {
+  MessageCompressor compressor(std::make_shared<LZCodec>());
+  auto payload = Compressible(10000);
+  auto stream = MakeMessage(&compressor, 7, payload);
+  EXPECT_LT(stream.size(), payload.size() / 2);
+  EXPECT_EQ(ReadMessage(&stream, 7), payload);
+  EXPECT_LT(compressor.GetRatio(), 0.5);
+}
+
+TEST(MessageCompressor, SmallAndEmptyPayloadsAreSentAsIs) {
+  MessageCompressor compressor(std::make_shared<LZCodec>());
+  for (auto& payload : {std::string(), Compressible(100)}) {
+    auto stream = MakeMessage(&compressor, 3, payload);
+    EXPECT_EQ(stream.size(), sizeof(uint32_t) + 1 + payload.size());
+    EXPECT_EQ(ReadMessage(&stream, 3), payload);
+  }
+  EXPECT_EQ(compressor.GetRatio(), 1.);
+}
+
+TEST(MessageCompressor, PayloadSentAsIsIsNotMoved) {
+  MessageCompressor compressor(std::make_shared<LZCodec>());
+  std::mt19937 rng(4);
+  for (auto& payload : {Compressible(100), Random(&rng, 5000)}) {
+    BinStream stream;
+    stream << uint32_t(5) << MessageCompressor::kUncompressed;
+    stream.push_back_bytes(payload.data(), payload.size());
+    auto buffer = stream.get_buffer();
+    auto size = stream.size();
+    compressor.Compress(&stream, sizeof(uint32_t) + sizeof(uint8_t));
+    EXPECT_EQ(stream.get_buffer(), buffer);
+    EXPECT_EQ(stream.size(), size);
+    EXPECT_EQ(ReadMessage(&stream, 5), payload);
+  }
+}
+
+TEST(MessageCompressor, FlagMustBeReserved) {
+  MessageCompressor compressor(std::make_shared<LZCodec>());
+  auto payload = Compressible(1000);
+  BinStream stream;
+  stream << uint32_t(5) << uint8_t(9);
+  stream.push_back_bytes(payload.data(), payload.size());
+  EXPECT_DEATH(compressor.Compress(&stream, sizeof(uint32_t) + sizeof(uint8_t)), "flag");
+}
+
+TEST(MessageCompressor, DisablesAndResumesPerWindow) {
+  const size_t min_samples = 4;
+  MessageCompressor compressor(std::make_shared<LZCodec>(), 0.9, min_samples, 16);
+  std::mt19937 rng(3);
+  for (size_t i = 0; i < min_samples; ++i) {
+    auto payload = Random(&rng, 1000);
+    auto stream = MakeMessage(&compressor, 1, payload);
+    EXPECT_EQ(ReadMessage(&stream, 1), payload);
+  }
+  EXPECT_TRUE(compressor.IsDisabled());
+  // while disabled, one payload in every min_samples is compressed to measure the next window
+  size_t sent = 0;
+  while (compressor.IsDisabled()) {
+    ASSERT_LE(sent, min_samples * min_samples) << "compression is not resumed on compressible payloads";
+    auto payload = Compressible(1000);
+    auto stream = MakeMessage(&compressor, 2, payload);
+    EXPECT_EQ(ReadMessage(&stream, 2), payload);
+    ++sent;
+  }
+  EXPECT_EQ(sent, min_samples * min_samples);
+  auto payload = Compressible(1000);
+  auto stream = MakeMessage(&compressor, 2, payload);
+  EXPECT_LT(stream.size(), payload.size() / 2);
+  EXPECT_EQ(ReadMessage(&stream, 2), payload);
+}
+
+}  // namespace
+}  // namespace base
+}  // namespace axe
@@ -0,0 +1,154 @@
+// Copyright 2020 HDL
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "base/bin_stream.h"
+#include "common/dataset/csr_partition.h"
+
+namespace axe {
+namespace common {
+namespace {
+
+using Csr = CsrPartition<int64_t, int32_t>;
+
+/** Vertex i has id 10 * i and the neighbors 0 .. i - 1. **/
+Csr MakeCsr(size_t n) {
+  Csr csr;
+  for (size_t i = 0; i < n; ++i) {
+    std::vector<int32_t> neighbors(i);
+    for (size_t j = 0; j < i; ++j) {
+      neighbors[j] = j;
+    }
+    csr.push_back(10 * i, neighbors);
+  }
+  return csr;
+}
+
+void ExpectVertex(const CsrVertex<int64_t, int32_t>& vertex, int64_t id, const std::vector<int32_t>& neighbors) {
+  EXPECT_EQ(vertex.GetId(), id);
+  EXPECT_EQ(std::vector<int32_t>(vertex.begin(), vertex.end()), neighbors);
+}
+
+std::vector<int32_t> Iota(int32_t n) {
+  std::vector<int32_t> ret(n);
+  for (int32_t i = 0; i < n; ++i) {
+    ret[i] = i;
+  }
+  return ret;
+}
+
+TEST(CsrPartition, RecordsAreViewsIntoContiguousArrays) {
+  auto csr = MakeCsr(5);
+  ASSERT_EQ(csr.size(), 5);
+  EXPECT_EQ(csr.GetNumNeighbors(), 10);
+  size_t i = 0;
+  for (auto it = csr.begin(); it != csr.end(); ++it, ++i) {
+    ExpectVertex(*it, 10 * i, Iota(i));
+  }
+  // the neighbor lists follow each other in one array
+  EXPECT_EQ(csr.GetNeighbors(3), csr.GetNeighbors(2) + 2);
+  EXPECT_EQ(csr.GetDegree(0), 0);
+  EXPECT_THROW(csr.at(5), std::out_of_range);
+}
+
+TEST(CsrPartition, PushBackPackedRecord) {
+  Csr csr;
+  std::vector<char> packed(sizeof(int64_t) + 3 * sizeof(int32_t));
+  int64_t id = 42;
+  int32_t neighbors[] = {7, 8, 9};
+  std::memcpy(packed.data(), &id, sizeof(id));
+  std::memcpy(packed.data() + sizeof(id), neighbors, sizeof(neighbors));
+  csr.push_back(packed.data(), packed.size());
+  ASSERT_EQ(csr.size(), 1);
+  ExpectVertex(csr[0], 42, {7, 8, 9});
+  EXPECT_DEATH(csr.push_back(packed.data(), packed.size() - 1), "CsrPartition");
+}
+
+TEST(CsrPartition, PushBackOwnRecord) {
+  auto csr = MakeCsr(4);
+  // the neighbors of the pushed record live in the array that grows
+  for (int i = 0; i < 100; ++i) {
+    csr.push_back(csr[3]);
+  }
+  ExpectVertex(csr[103], 30, {0, 1, 2});
+}
+
+TEST(CsrPartition, SliceSharesArraysUntilModified) {
+  auto csr = MakeCsr(6);
+  auto slice = std::dynamic_pointer_cast<Csr>(csr.Slice(2, 3));
+  ASSERT_EQ(slice->size(), 3);
+  EXPECT_EQ(slice->GetIds(), csr.GetIds() + 2);
+  EXPECT_EQ(slice->GetNeighbors(0), csr.GetNeighbors(2));
+  ExpectVertex((*slice)[2], 40, Iota(4));
+
+  slice->push_back(99, {1});
+  EXPECT_NE(slice->GetIds(), csr.GetIds() + 2);
+  ASSERT_EQ(slice->size(), 4);
+  ExpectVertex((*slice)[0], 20, Iota(2));
+  ExpectVertex((*slice)[3], 99, {1});
+  // the source is untouched
+  ASSERT_EQ(csr.size(), 6);
+  ExpectVertex(csr[5], 50, Iota(5));
+}
+
+TEST(CsrPartition, PermuteFilterAndAppend) {
+  auto csr = MakeCsr(4);
+  csr.ApplyPermutation(std::vector<uint32_t>{3, 1, 0, 2});
+  ExpectVertex(csr[0], 30, Iota(3));
+  ExpectVertex(csr[1], 10, Iota(1));
+  ExpectVertex(csr[3], 20, Iota(2));
+  EXPECT_EQ(csr.GetSortedIndex(), (std::vector<uint32_t>{2, 1, 3, 0}));
+
+  auto filtered = std::dynamic_pointer_cast<Csr>(csr.Filter({true, false, false, true}, 2));
+  ASSERT_EQ(filtered->size(), 2);
+  ExpectVertex((*filtered)[1], 20, Iota(2));
+
+  auto other = MakeCsr(3);
+  filtered->AppendPartition(other.Slice(1, 2));
+  ASSERT_EQ(filtered->size(), 4);
+  ExpectVertex((*filtered)[2], 10, Iota(1));
+  ExpectVertex((*filtered)[3], 20, Iota(2));
+  EXPECT_EQ(filtered->GetNumNeighbors(), 3 + 2 + 1 + 2);
+}
+
+TEST(CsrPartition, SerializeSliceWithNulls) {
+  auto csr = MakeCsr(6);
+  csr.SetNull({1, 4});
+  auto slice = csr.Slice(1, 4);
+  base::BinStream stream;
+  std::dynamic_pointer_cast<Csr>(slice)->serialize(stream);
+
+  Csr read;
+  read.deserialize(stream);
+  EXPECT_EQ(stream.size(), 0);
+  ASSERT_EQ(read.size(), 4);
+  for (size_t i = 0; i < 4; ++i) {
+    ExpectVertex(read[i], 10 * (i + 1), Iota(i + 1));
+  }
+  EXPECT_TRUE(read.IsNull(0));
+  EXPECT_FALSE(read.IsNull(1));
+  EXPECT_TRUE(read.IsNull(3));
+  EXPECT_EQ(read.Print(0), "NULL");
+  EXPECT_EQ(read.Print(1), "20 (2 neighbors)");
+}
+
+}  // namespace
+}  // namespace common
+}  // namespace axe
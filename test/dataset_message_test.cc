@@ -0,0 +1,270 @@
+// Copyright 2020 HDL
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "base/bin_stream.h"
+#include "base/compression.h"
+#include "common/constants.h"
+#include "common/data_store.h"
+#include "common/dataset/dataset.h"
+#include "common/flags.h"
+#include "common/instance_id.h"
+#include "common/shuffle_metrics.h"
+#include "common/task_context.h"
+#include "common/task_desc/task_desc.h"
+
+namespace axe {
+namespace common {
+namespace {
+
+template <typename Val>
+struct MessageReader : public Dataset<Val> {
+  using Dataset<Val>::DeserializeMessages;
+};
+
+struct alignas(16) Wide {
+  int64_t low;
+  int64_t high;
+  bool operator==(const Wide& other) const { return low == other.low && high == other.high; }
+  bool operator<(const Wide& other) const { return low < other.low || (low == other.low && high < other.high); }
+};
+
+/** Read the header of a message as the channel service of the receiver does. **/
+void ReceiveHeader(BinStream* message, DataIdType msg_id, ShardIdType dst) {
+  JobProcessEventType event_type;
+  DataIdType header_msg_id;
+  ShardIdType src, header_dst;
+  std::shared_ptr<InstanceId> instance_id;
+  *message >> event_type >> header_msg_id >> src >> instance_id >> header_dst;
+  ASSERT_EQ(event_type, JobProcessEventType::JPReceiveData);
+  ASSERT_EQ(header_msg_id, msg_id);
+  ASSERT_EQ(header_dst, dst);
+}
+
+/** Send values in one message and check that the receiver views them in the received buffer. **/
+template <typename Val>
+void ExpectViewTaken(const std::vector<Val>& values, const std::shared_ptr<InstanceId>& instance_id) {
+  auto message = AbstractDataset::CreateMessage(3, 1, instance_id, 2);
+  auto payload_offset = message->size();
+  EXPECT_EQ(payload_offset % AbstractDataset::kMessageAlignment, 0);
+  base::SerializeRange(*message, values.data(), values.size());
+  auto payload = message->get_buffer() + payload_offset;
+
+  ReceiveHeader(message.get(), 3, 2);
+  DatasetPartition<std::shared_ptr<BinStream>> msg;
+  msg.push_back(message);
+  AbstractDataset::PrepareMessages(&msg);
+  ASSERT_TRUE(DatasetPartition<Val>::CanView(*message, values.size()));
+
+  DatasetPartition<Val> data;
+  MessageReader<Val>::DeserializeMessages(msg, &data);
+  ASSERT_EQ(data.size(), values.size());
+  EXPECT_EQ(static_cast<void*>(data.data()), static_cast<void*>(payload));
+  EXPECT_EQ(message->size(), 0);
+  for (size_t i = 0; i < values.size(); ++i) {
+    EXPECT_EQ(std::memcmp(&data[i], &values[i], sizeof(Val)), 0);
+  }
+}
+
+TEST(DatasetMessage, PayloadIsAlignedForAnyHeader) {
+  auto instance_id = std::make_shared<InstanceId>();
+  for (int depth = 0; depth < 20; ++depth) {
+    auto message = AbstractDataset::CreateMessage(3, 1, instance_id, 2);
+    EXPECT_EQ(message->size() % AbstractDataset::kMessageAlignment, 0) << "instance depth " << depth;
+    instance_id->Append(depth);
+  }
+}
+
+TEST(DatasetMessage, ReceivedRecordsAreViewedInPlace) {
+  std::vector<int64_t> longs;
+  std::vector<std::pair<int32_t, int32_t>> pairs;
+  std::vector<Wide> wides;
+  for (int i = 0; i < 1000; ++i) {
+    longs.push_back(i * 7);
+    pairs.emplace_back(i, -i);
+    wides.push_back({i, -i});
+  }
+  for (auto& instance : {std::vector<int>(), std::vector<int>{1}, std::vector<int>{1, 2, 3}}) {
+    auto instance_id = std::make_shared<InstanceId>(instance);
+    ExpectViewTaken(longs, instance_id);
+    ExpectViewTaken(pairs, instance_id);
+    ExpectViewTaken(wides, instance_id);
+  }
+}
+
+TEST(DatasetMessage, RecordsFromSeveralSendersAreCopied) {
+  DatasetPartition<std::shared_ptr<BinStream>> msg;
+  std::vector<int64_t> values{1, 2, 3};
+  for (ShardIdType src = 0; src < 2; ++src) {
+    auto message = AbstractDataset::CreateMessage(3, src, std::make_shared<InstanceId>(), 0);
+    base::SerializeRange(*message, values.data(), values.size());
+    ReceiveHeader(message.get(), 3, 0);
+    msg.push_back(message);
+  }
+  AbstractDataset::PrepareMessages(&msg);
+  DatasetPartition<int64_t> data;
+  MessageReader<int64_t>::DeserializeMessages(msg, &data);
+  EXPECT_EQ(std::vector<int64_t>(data.begin(), data.end()), (std::vector<int64_t>{1, 2, 3, 1, 2, 3}));
+}
+
+/** A compressible payload for destination 0 and a payload too small to compress for destination 1. **/
+DatasetPartition<std::shared_ptr<BinStream>> MakeShuffleMessages(const std::shared_ptr<base::MessageCompressor>& compressor, size_t* header_size,
+                                                                 size_t* raw_bytes) {
+  auto msg = AbstractDataset::CreateMessagePartition(2, 3, 0, std::make_shared<InstanceId>());
+  *header_size = msg.at(0)->size();
+  std::vector<int64_t> compressible(10000), small{1, 2, 3};
+  for (size_t i = 0; i < compressible.size(); ++i) {
+    compressible[i] = i % 10;
+  }
+  base::SerializeRange(*msg.at(0), compressible.data(), compressible.size());
+  base::SerializeRange(*msg.at(1), small.data(), small.size());
+  *raw_bytes = (compressible.size() + small.size()) * sizeof(int64_t);
+  AbstractDataset::CompressMessages(compressor, *header_size, &msg);
+  return msg;
+}
+
+TEST(DatasetMessage, CompressedAndUncompressedMessagesAreRead) {
+  auto compressor = std::make_shared<base::MessageCompressor>(base::CompressionCodecRegistry::GetCodec("lz"));
+  size_t header_size, raw_bytes;
+  auto msg = MakeShuffleMessages(compressor, &header_size, &raw_bytes);
+  EXPECT_LT(msg.at(0)->size(), header_size + 10000 * sizeof(int64_t) / 4);
+  EXPECT_EQ(msg.at(1)->size(), header_size + 3 * sizeof(int64_t));
+
+  for (ShardIdType dst = 0; dst < 2; ++dst) {
+    ReceiveHeader(msg.at(dst).get(), 3, dst);
+    DatasetPartition<std::shared_ptr<BinStream>> received;
+    received.push_back(msg.at(dst));
+    AbstractDataset::PrepareMessages(&received);
+    DatasetPartition<int64_t> data;
+    MessageReader<int64_t>::DeserializeMessages(received, &data);
+    ASSERT_EQ(data.size(), dst == 0 ? 10000 : 3);
+    for (size_t i = 0; i < data.size(); ++i) {
+      EXPECT_EQ(data[i], dst == 0 ? static_cast<int64_t>(i % 10) : static_cast<int64_t>(i + 1));
+    }
+    // the decompressed payload gets a buffer of its own, which is aligned as well
+    EXPECT_EQ(static_cast<const void*>(data.data()), static_cast<const void*>(msg.at(dst)->get_buffer() + (dst == 0 ? 0 : header_size)));
+  }
+}
+
+/** The resource usage estimator of the job manager sizes the network tasks by the message sizes that TaskContext
+ * reports when the serialize task inserts its messages, which are taken after CompressMessages.
+ */
+TEST(DatasetMessage, ReportedMessageSizesAreCompressed) {
+  auto report = FLAGS_enable_message_size_report;
+  FLAGS_enable_message_size_report = true;
+  auto compressor = std::make_shared<base::MessageCompressor>(base::CompressionCodecRegistry::GetCodec("lz"));
+  size_t header_size, raw_bytes;
+  auto msg = std::make_shared<DatasetPartition<std::shared_ptr<BinStream>>>(MakeShuffleMessages(compressor, &header_size, &raw_bytes));
+
+  DataStore data_store;
+  TaskContext tc(std::make_shared<TaskDesc>(0, 1, 0, CPU), &data_store);
+  tc.InsertDatasetPartition(3, msg);
+  ASSERT_EQ(tc.GetDataMemory().size(), 1);
+  auto& record = tc.GetDataMemory().front();
+  EXPECT_EQ(record.data_id, 3);
+  ASSERT_EQ(record.sizes.size(), 2);
+  EXPECT_EQ(record.sizes[0], msg->at(0)->size());
+  EXPECT_EQ(record.sizes[1], msg->at(1)->size());
+  EXPECT_LT(record.GetSize(), raw_bytes / 4);
+  FLAGS_enable_message_size_report = report;
+}
+
+TEST(DatasetMessage, SendTimeIsStampedForTheReceiver) {
+  auto report = FLAGS_enable_message_size_report;
+  FLAGS_enable_message_size_report = true;
+  ShuffleMetrics::Get().Clear();
+  ShuffleMetrics::Get().RegisterEdge(3, 4, "Test-serialize");
+  auto compressor = std::make_shared<base::MessageCompressor>(base::CompressionCodecRegistry::GetCodec("lz"));
+  size_t header_size, raw_bytes;
+  auto msg = MakeShuffleMessages(compressor, &header_size, &raw_bytes);
+
+  // messages are stamped only when reported
+  auto unstamped = std::make_shared<BinStream>(msg.at(1)->get_buffer(), msg.at(1)->size());
+  ReceiveHeader(unstamped.get(), 3, 1);
+  DatasetPartition<std::shared_ptr<BinStream>> received{unstamped};
+  EXPECT_EQ(AbstractDataset::PrepareMessages(&received), 0);
+
+  DataStore data_store;
+  TaskContext tc(std::make_shared<TaskDesc>(0, 1, 0, CPU), &data_store);
+  auto before_us = AbstractDataset::WallClockUs();
+  AbstractDataset::ReportShuffleSend(&tc, 3, {10000, 3}, msg, header_size, std::chrono::steady_clock::now());
+  auto after_us = AbstractDataset::WallClockUs();
+  for (ShardIdType dst = 0; dst < 2; ++dst) {
+    ReceiveHeader(msg.at(dst).get(), 3, dst);
+  }
+  auto start_time = std::chrono::steady_clock::now();
+  auto last_sent_us = AbstractDataset::PrepareMessages(&msg);
+  EXPECT_GE(last_sent_us, before_us);
+  EXPECT_LE(last_sent_us, after_us);
+  DatasetPartition<int64_t> data;
+  MessageReader<int64_t>::DeserializeMessages(msg, &data);
+  EXPECT_EQ(data.size(), 10003);
+  AbstractDataset::ReportShuffleReceive(&tc, 4, data.size(), raw_bytes, start_time, last_sent_us);
+
+  auto edges = ShuffleMetrics::Get().Summarize();
+  ASSERT_EQ(edges.size(), 1);
+  EXPECT_EQ(edges[0].name, "Test-serialize");
+  EXPECT_EQ(edges[0].shuffled_id, 4);
+  EXPECT_EQ(edges[0].records, 10003);
+  EXPECT_GE(edges[0].transfer_ms, 0);
+  EXPECT_LE(edges[0].transfer_ms, (AbstractDataset::WallClockUs() - before_us) / 1000.0);
+  ShuffleMetrics::Get().Clear();
+  FLAGS_enable_message_size_report = report;
+}
+
+TEST(DatasetMessage, MessagesArePushedThroughTheChannelOnly) {
+  std::vector<int64_t> values(1000, 7);
+  DataStore data_store;
+  TaskContext tc(std::make_shared<TaskDesc>(0, 1, 0, CPU), &data_store);
+  auto msg = AbstractDataset::CreateMessagePartition(2, 3, 0, std::make_shared<InstanceId>());
+  auto header_size = msg.at(0)->size();
+  base::SerializeRange(*msg.at(0), values.data(), values.size());
+  base::SerializeRange(*msg.at(1), values.data(), 10);
+
+  // without the channel of the job simulator, the messages keep accumulating
+  EXPECT_FALSE(AbstractDataset::CanPushMessages(1000));
+  AbstractDataset::PushFullMessages(&tc, 1000, nullptr, header_size, 3, &msg);
+  EXPECT_EQ(msg.at(0)->size(), header_size + values.size() * sizeof(int64_t));
+
+  std::vector<std::pair<ShardIdType, std::shared_ptr<BinStream>>> pushed;
+  auto sink = [&](DataIdType msg_id, ShardIdType dst, const std::shared_ptr<BinStream>& message) {
+    EXPECT_EQ(msg_id, 3);
+    pushed.emplace_back(dst, message);
+  };
+  TaskContext::SetMessageChannel(sink, [](DataIdType, ShardIdType) { return std::vector<std::shared_ptr<BinStream>>(); });
+  EXPECT_FALSE(AbstractDataset::CanPushMessages(0));
+  EXPECT_TRUE(AbstractDataset::CanPushMessages(1000));
+  auto full = msg.at(0);
+  AbstractDataset::PushFullMessages(&tc, 1000, nullptr, header_size, 3, &msg);
+  TaskContext::SetMessageChannel(nullptr, nullptr);
+
+  ASSERT_EQ(pushed.size(), 1);
+  EXPECT_EQ(pushed[0].first, 0);
+  EXPECT_EQ(pushed[0].second, full);
+  EXPECT_EQ(msg.at(0)->size(), header_size);
+  EXPECT_EQ(msg.at(1)->size(), header_size + 10 * sizeof(int64_t));
+  auto pushed_memory = tc.GetPushedMessageMemory(3);
+  ASSERT_EQ(pushed_memory.size(), 1);
+  EXPECT_EQ(pushed_memory[0], full->size());
+}
+
+}  // namespace
+}  // namespace common
+}  // namespace axe
@@ -0,0 +1,137 @@
+// Copyright 2020 HDL
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "base/bin_stream.h"
+#include "common/dataset/dictionary_string_partition.h"
+
+namespace axe {
+namespace common {
+namespace {
+
+/** A partition of n rows cycling through n_values distinct strings, with every null_every-th row null. **/
+std::shared_ptr<DictionaryStringPartition> MakePartition(size_t n, size_t n_values, size_t null_every = 0) {
+  auto ret = std::make_shared<DictionaryStringPartition>();
+  std::vector<uint32_t> nulls;
+  for (size_t i = 0; i < n; ++i) {
+    ret->push_back("value-" + std::to_string(i % n_values));
+    if (null_every != 0 && i % null_every == 0) {
+      nulls.push_back(i);
+    }
+  }
+  if (!nulls.empty()) {
+    ret->SetNull(nulls);
+  }
+  return ret;
+}
+
+DictionaryStringPartition RoundTrip(const DictionaryStringPartition& partition, size_t* bytes = nullptr) {
+  base::BinStream stream;
+  partition.serialize(stream);
+  if (bytes != nullptr) {
+    *bytes = stream.size();
+  }
+  DictionaryStringPartition ret;
+  ret.deserialize(stream);
+  EXPECT_EQ(stream.size(), 0);
+  return ret;
+}
+
+void ExpectSameRows(const DictionaryStringPartition& expected, const DictionaryStringPartition& actual) {
+  ASSERT_EQ(expected.size(), actual.size());
+  EXPECT_EQ(expected.HasNull(), actual.HasNull());
+  for (size_t i = 0; i < expected.size(); ++i) {
+    EXPECT_EQ(expected[i], actual[i]) << "row " << i;
+    EXPECT_EQ(expected.IsNull(i), actual.IsNull(i)) << "row " << i;
+  }
+}
+
+/** The serialized size: the strings in use with their lengths, the codes in width bytes, and the null flag words. **/
+size_t ExpectedBytes(const DictionaryStringPartition& partition, size_t width) {
+  std::vector<bool> used(partition.GetDictionary()->size(), false);
+  size_t ret = sizeof(uint64_t) + sizeof(uint64_t) + sizeof(uint8_t) + width * partition.size() + sizeof(bool);
+  for (auto code : partition.GetCodes()) {
+    if (!used[code]) {
+      used[code] = true;
+      ret += sizeof(uint32_t) + (*partition.GetDictionary())[code].size();
+    }
+  }
+  return ret + (partition.HasNull() ? BitmapOps::NumWords(partition.size()) * sizeof(uint64_t) : 0);
+}
+
+TEST(DictionaryStringPartitionTest, RoundTripEmpty) {
+  DictionaryStringPartition empty;
+  size_t bytes;
+  auto ret = RoundTrip(empty, &bytes);
+  EXPECT_EQ(ret.size(), 0);
+  EXPECT_EQ(bytes, ExpectedBytes(empty, 1));
+}
+
+TEST(DictionaryStringPartitionTest, RoundTripCodeWidths) {
+  // 1-byte codes up to 256 strings in use, 2-byte codes up to 65536, 4-byte codes beyond
+  for (auto width_and_values : std::vector<std::pair<size_t, size_t>>{{1, 7}, {1, 256}, {2, 257}, {2, 65536}, {4, 65537}}) {
+    auto partition = MakePartition(70000, width_and_values.second);
+    size_t bytes;
+    auto ret = RoundTrip(*partition, &bytes);
+    ExpectSameRows(*partition, ret);
+    EXPECT_EQ(bytes, ExpectedBytes(*partition, width_and_values.first)) << width_and_values.second << " strings";
+    EXPECT_EQ(ret.GetDictionary()->size(), width_and_values.second);
+  }
+}
+
+TEST(DictionaryStringPartitionTest, RoundTripNullFlags) {
+  for (size_t n : {1, 63, 64, 65, 1000}) {
+    auto partition = MakePartition(n, 5, 3);
+    ASSERT_TRUE(partition->HasNull());
+    ExpectSameRows(*partition, RoundTrip(*partition));
+  }
+}
+
+TEST(DictionaryStringPartitionTest, RoundTripRenumbersUsedStrings) {
+  // a slice uses a few strings of the shared dictionary, and only those are written, numbered by first use
+  auto partition = MakePartition(1000, 100, 7);
+  auto slice = std::static_pointer_cast<DictionaryStringPartition>(partition->Slice(205, 10));
+  size_t bytes;
+  auto ret = RoundTrip(*slice, &bytes);
+  ExpectSameRows(*slice, ret);
+  EXPECT_EQ(bytes, ExpectedBytes(*slice, 1));
+  EXPECT_EQ(ret.GetDictionary()->size(), 10);
+  for (size_t i = 0; i < ret.size(); ++i) {
+    EXPECT_EQ(ret.GetCode(i), i);
+  }
+}
+
+TEST(DictionaryStringPartitionTest, CompareAndSortByRanks) {
+  auto partition = MakePartition(500, 37);
+  auto ret = RoundTrip(*partition);
+  auto index = ret.GetSortedIndex();
+  ASSERT_EQ(index.size(), ret.size());
+  for (size_t i = 1; i < index.size(); ++i) {
+    EXPECT_LE(ret[index[i - 1]], ret[index[i]]);
+    EXPECT_LE(ret.Compare(index[i - 1], index[i]), 0);
+  }
+  for (size_t i = 0; i + 1 < ret.size(); ++i) {
+    int expected = ret[i] < ret[i + 1] ? -1 : (ret[i + 1] < ret[i] ? 1 : 0);
+    EXPECT_EQ(ret.Compare(i, i + 1), expected);
+  }
+}
+
+}  // namespace
+}  // namespace common
+}  // namespace axe
@@ -0,0 +1,114 @@
+// Copyright 2020 HDL
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <dirent.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <map>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "common/dataset/external_shuffle_writer.h"
+
+namespace axe {
+namespace common {
+namespace {
+
+using Record = std::pair<int, int64_t>;
+
+ExternalShuffleWriter<Record>::Less KeyLess() {
+  return [](const Record& a, const Record& b) { return a.first < b.first; };
+}
+
+/** The number of spill files of this process left in dir. **/
+size_t CountSpillFiles(const std::string& dir) {
+  auto prefix = "shuffle-spill-" + std::to_string(getpid()) + "-";
+  size_t count = 0;
+  auto handle = opendir(dir.c_str());
+  for (auto entry = readdir(handle); entry != nullptr; entry = readdir(handle)) {
+    count += std::string(entry->d_name).compare(0, prefix.size(), prefix) == 0;
+  }
+  closedir(handle);
+  return count;
+}
+
+TEST(ExternalShuffleWriter, SpilledRunsAreMergedAndCombined) {
+  const size_t num_destinations = 4;
+  std::mt19937 rng(5);
+  std::vector<std::map<int, int64_t>> expected(num_destinations);
+  std::vector<std::vector<Record>> output(num_destinations);
+  auto dir = testing::TempDir();
+  {
+    ExternalShuffleWriter<Record> writer(num_destinations, 100 * sizeof(Record), dir, KeyLess(),
+                                         [](Record& a, const Record& b) { a.second += b.second; });
+    for (int i = 0; i < 20000; ++i) {
+      Record record(static_cast<int>(rng() % 3000), i);
+      auto dst = record.first % num_destinations;
+      expected[dst][record.first] += record.second;
+      writer.Add(dst, record);
+    }
+    EXPECT_GT(writer.GetNumSpills(), 10);
+    EXPECT_GT(writer.GetSpilledBytes(), 0);
+    EXPECT_EQ(CountSpillFiles(dir), writer.GetNumSpills());
+    writer.Finish([&](size_t dst, const Record* data, size_t n) {
+      EXPECT_LE(n, ExternalShuffleWriter<Record>::kChunkSize);
+      output.at(dst).insert(output[dst].end(), data, data + n);
+    });
+  }
+  EXPECT_EQ(CountSpillFiles(dir), 0);
+  for (size_t dst = 0; dst < num_destinations; ++dst) {
+    EXPECT_EQ(output[dst], std::vector<Record>(expected[dst].begin(), expected[dst].end())) << "destination " << dst;
+  }
+}
+
+TEST(ExternalShuffleWriter, WithoutCombinerEveryRecordIsKeptInKeyOrder) {
+  std::mt19937 rng(6);
+  std::vector<Record> input, output;
+  ExternalShuffleWriter<Record> writer(1, 64 * sizeof(Record), testing::TempDir(), KeyLess());
+  for (int i = 0; i < 5000; ++i) {
+    input.emplace_back(static_cast<int>(rng() % 100), i);
+    writer.Add(0, input.back());
+  }
+  EXPECT_GT(writer.GetNumSpills(), 0);
+  writer.Finish([&](size_t, const Record* data, size_t n) { output.insert(output.end(), data, data + n); });
+  // records of equal keys come out in the order they were added, as every run is stably sorted and merged by run
+  std::stable_sort(input.begin(), input.end(), KeyLess());
+  EXPECT_EQ(output, input);
+}
+
+TEST(ExternalShuffleWriter, NoSpillBelowTheLimit) {
+  std::vector<Record> output;
+  ExternalShuffleWriter<Record> writer(2, 1 << 20, testing::TempDir(), KeyLess(), [](Record& a, const Record& b) { a.second += b.second; });
+  for (int i = 0; i < 100; ++i) {
+    writer.Add(1, Record(i % 10, 1));
+  }
+  writer.Finish([&](size_t dst, const Record* data, size_t n) {
+    EXPECT_EQ(dst, 1);
+    output.insert(output.end(), data, data + n);
+  });
+  EXPECT_EQ(writer.GetNumSpills(), 0);
+  ASSERT_EQ(output.size(), 10);
+  for (int key = 0; key < 10; ++key) {
+    EXPECT_EQ(output[key], Record(key, 10));
+  }
+}
+
+}  // namespace
+}  // namespace common
+}  // namespace axe
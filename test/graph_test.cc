@@ -0,0 +1,225 @@
+// Copyright 2020 HDL
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "graph/algorithms.h"
+#include "graph/graph.h"
+
+namespace axe {
+namespace graph {
+namespace {
+
+/** Runs a vertex program on one partition with the superstep semantics of Graph::Run: active vertices scatter,
+ * messages to the same target are combined, and every vertex applies its combined message or nullptr.
+ */
+template <typename Program, typename Id, typename Neighbor>
+std::vector<VertexState<Id, typename Program::Value>> RunLocally(const Program& program, const CsrPartition<Id, Neighbor>& topology,
+                                                                 int supersteps) {
+  using Message = typename Program::Message;
+  std::vector<VertexState<Id, typename Program::Value>> states;
+  for (auto vertex : topology) {
+    states.push_back({vertex.GetId(), typename Program::Value(), true});
+    program.Init(vertex, &states.back().value, &states.back().active);
+  }
+  for (int step = 0; step < supersteps; ++step) {
+    std::map<Id, Message> combined;
+    auto emit = [&combined](const Id& target, const Message& message) {
+      auto pos = combined.find(target);
+      if (pos == combined.end()) {
+        combined.emplace(target, message);
+      } else {
+        Program::Combine(pos->second, message);
+      }
+    };
+    for (size_t i = 0; i < states.size(); ++i) {
+      if (states[i].active) {
+        program.Scatter(topology[i], states[i].value, emit);
+      }
+    }
+    for (auto& state : states) {
+      auto pos = combined.find(state.id);
+      state.active = program.Apply(state.id, &state.value, pos == combined.end() ? nullptr : &pos->second);
+    }
+  }
+  return states;
+}
+
+template <typename Id, typename Neighbor>
+void AddVertex(CsrPartition<Id, Neighbor>* topology, typename std::common_type<Id>::type id, const std::vector<Neighbor>& neighbors) {
+  topology->push_back(id, neighbors);
+}
+
+TEST(Graph, NeighborTraits) {
+  EXPECT_EQ(NeighborTraits<int>::GetId(3), 3);
+  EXPECT_EQ(NeighborTraits<int>::GetWeight(3), 1);
+  std::pair<int, float> weighted(3, 2.5);
+  EXPECT_EQ((NeighborTraits<std::pair<int, float>>::GetId(weighted)), 3);
+  EXPECT_EQ((NeighborTraits<std::pair<int, float>>::GetWeight(weighted)), 2.5);
+}
+
+TEST(Graph, PageRankOfACycleStaysOne) {
+  CsrPartition<int, int> topology;
+  AddVertex(&topology, 0, {1});
+  AddVertex(&topology, 1, {2});
+  AddVertex(&topology, 2, {0});
+  for (auto& state : RunLocally(PageRank<int>(), topology, 10)) {
+    EXPECT_DOUBLE_EQ(state.value, 1);
+    EXPECT_TRUE(state.active);
+  }
+}
+
+TEST(Graph, PageRankOfAStar) {
+  // 1, 2 and 3 link to 0, and 0 links back to each of them
+  CsrPartition<int, int> topology;
+  AddVertex(&topology, 0, {1, 2, 3});
+  for (int i = 1; i <= 3; ++i) {
+    AddVertex(&topology, i, {0});
+  }
+  auto states = RunLocally(PageRank<int>(0.5), topology, 50);
+  // rank(0) = 0.5 + 0.5 * 3 * rank(leaf), rank(leaf) = 0.5 + 0.5 * rank(0) / 3
+  EXPECT_NEAR(states[0].value, 5.0 / 3, 1e-9);
+  for (int i = 1; i <= 3; ++i) {
+    EXPECT_NEAR(states[i].value, 7.0 / 9, 1e-9);
+  }
+}
+
+TEST(Graph, ConnectedComponentsConverge) {
+  // {0, 1, 2} and {3, 4}, with symmetric edges
+  CsrPartition<int64_t, int64_t> topology;
+  AddVertex(&topology, 0, {2});
+  AddVertex(&topology, 1, {2});
+  AddVertex(&topology, 2, {0, 1});
+  AddVertex(&topology, 3, {4});
+  AddVertex(&topology, 4, {3});
+  auto states = RunLocally(ConnectedComponents<int64_t>(), topology, 5);
+  std::vector<int64_t> labels;
+  for (auto& state : states) {
+    labels.push_back(state.value);
+    EXPECT_FALSE(state.active) << "vertex " << state.id;
+  }
+  EXPECT_EQ(labels, (std::vector<int64_t>{0, 0, 0, 3, 3}));
+}
+
+TEST(Graph, ShortestPathsUseEdgeWeights) {
+  using Edge = std::pair<int, double>;
+  CsrPartition<int, Edge> topology;
+  AddVertex(&topology, 0, {Edge(1, 4), Edge(2, 1)});
+  AddVertex(&topology, 1, {Edge(3, 1)});
+  AddVertex(&topology, 2, {Edge(1, 2), Edge(3, 5)});
+  AddVertex(&topology, 3, {});
+  AddVertex(&topology, 4, {Edge(0, 1)});
+  auto states = RunLocally(ShortestPaths<int, Edge>(0), topology, 5);
+  EXPECT_EQ(states[0].value, 0);
+  EXPECT_EQ(states[1].value, 3);
+  EXPECT_EQ(states[2].value, 1);
+  EXPECT_EQ(states[3].value, 4);
+  EXPECT_EQ(states[4].value, std::numeric_limits<double>::infinity());
+  for (auto& state : states) {
+    EXPECT_FALSE(state.active) << "vertex " << state.id;
+  }
+}
+
+/** The messages a vertex sends along its edges through Scatter, and through its mirrors with MakePayload and
+ * EdgeMessage, which Graph::UseMirrors requires to be the same.
+ */
+template <typename Program, typename Id, typename Neighbor>
+void ExpectSameMessagesThroughMirrors(const Program& program, const CsrPartition<Id, Neighbor>& topology, int supersteps) {
+  using Message = typename Program::Message;
+  for (auto& state : RunLocally(program, topology, supersteps)) {
+    size_t i = 0;
+    for (; topology.GetId(i) != state.id; ++i) {
+    }
+    auto vertex = topology[i];
+    std::vector<std::pair<Id, Message>> along_edges, through_mirrors;
+    auto emit = [&along_edges](const Id& target, const Message& message) { along_edges.emplace_back(target, message); };
+    program.Scatter(vertex, state.value, emit);
+    typename Program::Payload payload;
+    if (program.MakePayload(vertex, state.value, &payload)) {
+      for (auto& edge : vertex) {
+        Message message;
+        if (program.EdgeMessage(vertex.GetId(), payload, edge, &message)) {
+          through_mirrors.emplace_back(NeighborTraits<Neighbor>::GetId(edge), message);
+        }
+      }
+    }
+    EXPECT_EQ(along_edges, through_mirrors) << "vertex " << state.id << " after " << supersteps << " supersteps";
+  }
+}
+
+TEST(Graph, ProgramsSupportMirrors) {
+  EXPECT_TRUE(HasMirrorScatter<PageRank<int>>::value);
+  EXPECT_TRUE(HasMirrorScatter<ConnectedComponents<int>>::value);
+  EXPECT_TRUE((HasMirrorScatter<ShortestPaths<int, std::pair<int, double>>>::value));
+  EXPECT_FALSE((HasMirrorScatter<VertexState<int, int>>::value));
+}
+
+TEST(Graph, MirrorsSendTheSameMessages) {
+  CsrPartition<int, int> topology;
+  AddVertex(&topology, 0, {1, 2, 3});
+  AddVertex(&topology, 1, {0, 2});
+  AddVertex(&topology, 2, {0});
+  AddVertex(&topology, 3, {});
+  AddVertex(&topology, 4, {3, 0});
+  for (int supersteps = 0; supersteps < 4; ++supersteps) {
+    ExpectSameMessagesThroughMirrors(PageRank<int>(), topology, supersteps);
+    ExpectSameMessagesThroughMirrors(ConnectedComponents<int>(), topology, supersteps);
+  }
+
+  using Edge = std::pair<int, double>;
+  CsrPartition<int, Edge> weighted;
+  AddVertex(&weighted, 0, {Edge(1, 4), Edge(2, 1)});
+  AddVertex(&weighted, 1, {Edge(2, 0.5)});
+  AddVertex(&weighted, 2, {Edge(0, 3)});
+  for (int supersteps = 0; supersteps < 4; ++supersteps) {
+    ExpectSameMessagesThroughMirrors(ShortestPaths<int, Edge>(0), weighted, supersteps);
+  }
+}
+
+TEST(Graph, ShardAndRoutesAreSerializedTogether) {
+  GraphShard<int, int> shard;
+  AddVertex(&shard.topology, 5, {1, 2});
+  AddVertex(&shard.topology, 7, {3});
+  AddVertex(&shard.routes, 5, {0u, 2u});
+  AddVertex(&shard.routes, 7, {1u});
+  base::BinStream stream;
+  shard.serialize(stream);
+  MirrorRoute<int, int> route{2, 5, {1, 2}};
+  route.serialize(stream);
+
+  GraphShard<int, int> read_shard;
+  read_shard.deserialize(stream);
+  MirrorRoute<int, int> read_route;
+  read_route.deserialize(stream);
+  EXPECT_EQ(stream.size(), 0);
+  EXPECT_EQ(read_shard.FirstId(), 5);
+  ASSERT_EQ(read_shard.topology.size(), 2);
+  EXPECT_EQ(std::vector<int>(read_shard.topology[0].begin(), read_shard.topology[0].end()), (std::vector<int>{1, 2}));
+  ASSERT_EQ(read_shard.routes.size(), 2);
+  EXPECT_EQ(std::vector<uint32_t>(read_shard.routes[0].begin(), read_shard.routes[0].end()), (std::vector<uint32_t>{0, 2}));
+  EXPECT_EQ(read_route.dst, 2);
+  EXPECT_EQ(read_route.source, 5);
+  EXPECT_EQ(read_route.edges, (std::vector<int>{1, 2}));
+}
+
+}  // namespace
+}  // namespace graph
+}  // namespace axe
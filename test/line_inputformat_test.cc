@@ -0,0 +1,379 @@
+// Copyright 2020 HDL
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <random>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "common/dataset/dataset_partition.h"
+#include "common/dataset/emitter.h"
+#include "common/io/input/line_inputformat.h"
+#include "common/io/input/mmap_file_splitter.h"
+#include "common/io/input/nfs_range_file_splitter.h"
+
+namespace axe {
+namespace common {
+namespace {
+
+/** Exposes the line reading steps of LineInputFormat. **/
+class TestLineInputFormat : public LineInputFormat {
+ public:
+  using LineInputFormat::LineInputFormat;
+  using LineInputFormat::ParseChunks;
+  using LineInputFormat::ParseWorkers;
+  using LineInputFormat::ReadLineTail;
+
+  std::string& LastPart() { return last_part_; }
+};
+
+/** A splitter that reads whole blocks only, as the splitters that are not RangeReaders. **/
+class BlockOnlySplitter : public FileSplitter {
+ public:
+  explicit BlockOnlySplitter(size_t block_size) : mmap_(block_size) {}
+
+  void Load(const std::string& url) override {}
+  std::string FetchBlock(const std::string& fn, size_t offset, bool is_next = false) override {
+    return std::string(FetchBlockView(fn, offset, is_next));
+  }
+  std::string_view FetchBlockView(const std::string& fn, size_t offset, bool is_next = false) override {
+    return mmap_.FetchBlockView(fn, offset, is_next);
+  }
+
+ private:
+  MmapFileSplitter mmap_;
+};
+
+std::string WriteFile(const std::string& name, const std::string& content) {
+  auto path = ::testing::TempDir() + name;
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+  file << content;
+  return path;
+}
+
+/** Lines of random lengths, with a few longer than the first tail window. **/
+std::vector<std::string> MakeLines(size_t n, size_t seed) {
+  std::mt19937 rng(seed);
+  std::vector<std::string> lines;
+  for (size_t i = 0; i < n; ++i) {
+    size_t len = rng() % 500 == 0 ? 200 * 1024 : rng() % 40;
+    lines.push_back(std::to_string(i) + std::string(len, 'a' + i % 26));
+  }
+  return lines;
+}
+
+std::string Join(const std::vector<std::string>& lines, bool trailing_line_end) {
+  std::string ret;
+  for (auto& line : lines) {
+    ret += line + "\n";
+  }
+  if (!trailing_line_end && !ret.empty()) {
+    ret.pop_back();
+  }
+  return ret;
+}
+
+std::vector<std::string> ReadLines(std::shared_ptr<FileSplitter> splitter, const std::string& path, size_t file_size,
+                                   size_t block_size, size_t threads) {
+  std::vector<std::pair<std::string, size_t>> block_descs;
+  for (size_t offset = 0; offset < file_size; offset += block_size) {
+    block_descs.push_back({path, offset});
+  }
+  LineInputFormat input(std::move(splitter), path);
+  input.SetParseThreads(threads);
+  auto lines = input.ReadData(block_descs, [](std::string_view line) {
+    DatasetPartition<std::string> ret;
+    ret.push_back(std::string(line));
+    return ret;
+  });
+  return std::vector<std::string>(lines.begin(), lines.end());
+}
+
+static_assert(std::is_same<LineType<std::function<int(std::string_view)>>, std::string_view>::value,
+              "a line executor taking a string_view gets views into the block");
+static_assert(std::is_same<LineType<std::function<int(const std::string&)>>, std::string>::value,
+              "a line executor taking a string gets copies of the lines");
+static_assert(std::is_same<LineType<std::function<int(std::string)>>, std::string>::value,
+              "a line executor taking a string by value gets copies of the lines");
+
+TEST(LineInputFormat, StringAndStringViewExecutorsReadTheSameLines) {
+  auto lines = MakeLines(3000, 4);
+  auto content = Join(lines, false);
+  auto path = WriteFile("string_and_string_view.txt", content);
+  const size_t block_size = 4096;
+  std::vector<std::pair<std::string, size_t>> block_descs;
+  for (size_t offset = 0; offset < content.size(); offset += block_size) {
+    block_descs.push_back({path, offset});
+  }
+  for (size_t threads : {1, 2}) {
+    LineInputFormat by_view(std::make_shared<MmapFileSplitter>(block_size), path);
+    by_view.SetParseThreads(threads);
+    auto views = by_view.ReadData(block_descs, [](std::string_view line) {
+      DatasetPartition<std::string> ret;
+      ret.push_back(std::string(line));
+      return ret;
+    });
+    LineInputFormat by_copy(std::make_shared<MmapFileSplitter>(block_size), path);
+    by_copy.SetParseThreads(threads);
+    auto copies = by_copy.ReadData(block_descs, [](const std::string& line) {
+      DatasetPartition<std::string> ret;
+      ret.push_back(line);
+      return ret;
+    });
+    EXPECT_EQ(std::vector<std::string>(views.begin(), views.end()), lines) << threads << " threads";
+    EXPECT_EQ(std::vector<std::string>(copies.begin(), copies.end()), lines) << threads << " threads";
+  }
+}
+
+TEST(Emitter, AppendsToThePartition) {
+  DatasetPartition<std::string> out;
+  out.push_back("kept");
+  Emitter<std::string> emitter(&out);
+  emitter.reserve(10);
+  EXPECT_GE(out.capacity(), 11);
+  emitter.emit("a");
+  std::string b = "b";
+  emitter.emit_move(std::move(b));
+  EXPECT_EQ(emitter.size(), 3);
+  EXPECT_EQ(std::vector<std::string>(out.begin(), out.end()), std::vector<std::string>({"kept", "a", "b"}));
+}
+
+TEST(Emitter, DetectsEmitterFunctions) {
+  auto emit = [](std::string_view line, Emitter<int>& out) { out.emit(line.size()); };
+  auto emit_pair = [](const std::string& line, Emitter<std::pair<int, int>>& out) { out.emit({0, 0}); };
+  auto returns = [](std::string_view line) { return DatasetPartition<int>(); };
+  auto generic = [](auto line, auto& out) {};
+  EXPECT_TRUE(IsEmitterFunction<decltype(emit)>::value);
+  EXPECT_TRUE((std::is_same<EmitterValue<decltype(emit)>::type, int>::value));
+  EXPECT_TRUE((std::is_same<EmitterValue<decltype(emit_pair)>::type, std::pair<int, int>>::value));
+  EXPECT_FALSE(IsEmitterFunction<decltype(returns)>::value);
+  // a generic lambda has no single call operator to detect the record type from
+  EXPECT_FALSE(IsEmitterFunction<decltype(generic)>::value);
+}
+
+TEST(LineInputFormat, ReadDataToEmitsEveryLine) {
+  auto lines = MakeLines(3000, 5);
+  auto content = Join(lines, true);
+  auto path = WriteFile("read_data_to.txt", content);
+  const size_t block_size = 4096;
+  std::vector<std::pair<std::string, size_t>> block_descs;
+  for (size_t offset = 0; offset < content.size(); offset += block_size) {
+    block_descs.push_back({path, offset});
+  }
+  std::vector<std::string> expected;
+  for (auto& line : lines) {
+    expected.push_back(line);
+    expected.push_back(line);
+  }
+  for (size_t threads : {1, 3}) {
+    LineInputFormat input(std::make_shared<MmapFileSplitter>(block_size), path);
+    input.SetParseThreads(threads);
+    DatasetPartition<std::string> out;
+    // two records per line, one of them moved
+    input.ReadDataTo<std::string>(block_descs, [](std::string_view line, Emitter<std::string>& emitter) {
+      emitter.emit(std::string(line));
+      emitter.emit_move(std::string(line));
+    }, &out);
+    EXPECT_EQ(std::vector<std::string>(out.begin(), out.end()), expected) << threads << " threads";
+  }
+}
+
+TEST(LineInputFormat, ReadDataToReservesForTheNextBlock) {
+  std::vector<std::string> lines(4096, "0123456");  // 8 bytes a line, 512 lines a block
+  auto content = Join(lines, true);
+  auto path = WriteFile("read_data_to_reserve.txt", content);
+  const size_t block_size = 4096;
+  std::vector<std::pair<std::string, size_t>> block_descs;
+  for (size_t offset = 0; offset < content.size(); offset += block_size) {
+    block_descs.push_back({path, offset});
+  }
+  LineInputFormat input(std::make_shared<MmapFileSplitter>(block_size), path);
+  DatasetPartition<int> out;
+  size_t first_capacity_seen = 0;
+  input.ReadDataTo<int>(block_descs, [&out, &first_capacity_seen](std::string_view line, Emitter<int>& emitter) {
+    // a record of the second block finds room for the whole block
+    if (emitter.size() == 600 && first_capacity_seen == 0) {
+      first_capacity_seen = out.capacity();
+    }
+    emitter.emit(line.size());
+  }, &out);
+  EXPECT_EQ(out.size(), lines.size());
+  EXPECT_GE(first_capacity_seen, 1024);
+}
+
+TEST(LineInputFormat, ReadLineTailCompletesLineAcrossBlockEnd) {
+  std::string content = "first\nsecond line\nthird";
+  auto path = WriteFile("read_line_tail.txt", content);
+  TestLineInputFormat input(std::make_shared<MmapFileSplitter>(8), path);
+  // the block [0, 8) ends inside "second line"
+  input.LastPart() = "se";
+  EXPECT_TRUE(input.ReadLineTail(path, 8));
+  EXPECT_EQ(input.LastPart(), "second line");
+  // the last line has no line end
+  input.LastPart() = "th";
+  EXPECT_TRUE(input.ReadLineTail(path, content.size() - 3));
+  EXPECT_EQ(input.LastPart(), "third");
+  // nothing follows the end of the file
+  input.LastPart() = "";
+  EXPECT_FALSE(input.ReadLineTail(path, content.size()));
+  EXPECT_EQ(input.LastPart(), "");
+}
+
+TEST(LineInputFormat, ReadLineTailLongerThanWindow) {
+  std::string tail(300 * 1024, 'x');
+  std::string content = "head\n" + tail + "\nnext\n";
+  auto path = WriteFile("read_long_line_tail.txt", content);
+  std::vector<std::shared_ptr<FileSplitter>> splitters = {std::make_shared<MmapFileSplitter>(4096), std::make_shared<BlockOnlySplitter>(4096)};
+  for (auto& splitter : splitters) {
+    TestLineInputFormat input(splitter, path);
+    input.LastPart() = "";
+    EXPECT_TRUE(input.ReadLineTail(path, 5));
+    EXPECT_EQ(input.LastPart(), tail);
+  }
+}
+
+TEST(NFSRangeFileSplitter, ReadsRangesOfTheOpenFile) {
+  std::string content = "0123456789abcdefghij";
+  auto path = WriteFile("nfs_range.txt", content);
+  auto other = WriteFile("nfs_range_other.txt", "other file");
+  NFSRangeFileSplitter splitter(8);
+  EXPECT_EQ(splitter.FetchRangeView(path, 0, 4), "0123");
+  EXPECT_EQ(splitter.FetchRangeView(path, 4, 8), "456789ab");
+  EXPECT_EQ(splitter.FetchRangeView(path, 15, 100), "fghij");
+  EXPECT_EQ(splitter.FetchRangeView(other, 6, 4), "file");
+  EXPECT_EQ(splitter.FetchRangeView(path, 10, 2), "ab");
+  EXPECT_TRUE(splitter.FetchRangeView(path, content.size(), 4).empty());
+  EXPECT_TRUE(splitter.FetchRangeView(path + ".missing", 0, 4).empty());
+}
+
+TEST(LineInputFormat, SplittersOfProtocolReadRanges) {
+  auto lines = MakeLines(2000, 6);
+  auto content = Join(lines, true);
+  auto path = WriteFile("lines_of_protocol.txt", content);
+  LineInputFormat input(path, NFS);
+  EXPECT_NE(dynamic_cast<RangeReader*>(input.GetFileSplitter()), nullptr);
+  auto read = input.ReadData(std::vector<std::pair<std::string, size_t>>{{path, 0}}, [](std::string_view line) {
+    DatasetPartition<std::string> ret;
+    ret.push_back(std::string(line));
+    return ret;
+  });
+  EXPECT_EQ(std::vector<std::string>(read.begin(), read.end()), lines);
+}
+
+TEST(LineInputFormat, LinesAcrossBlockEnds) {
+  for (bool trailing_line_end : {true, false}) {
+    auto lines = MakeLines(2000, 1);
+    auto content = Join(lines, trailing_line_end);
+    auto path = WriteFile("lines_across_block_ends.txt", content);
+    for (size_t block_size : {size_t(4096), size_t(64 * 1024 + 3), size_t(1024 * 1024), content.size()}) {
+      for (size_t threads : {1, 3}) {
+        EXPECT_EQ(ReadLines(std::make_shared<MmapFileSplitter>(block_size), path, content.size(), block_size, threads), lines)
+            << "block size " << block_size << ", " << threads << " threads";
+        EXPECT_EQ(ReadLines(std::make_shared<BlockOnlySplitter>(block_size), path, content.size(), block_size, threads), lines)
+            << "block only, block size " << block_size << ", " << threads << " threads";
+      }
+    }
+  }
+}
+
+TEST(LineInputFormat, LinesAcrossTinyBlocks) {
+  // blocks shorter than the lines, so that some blocks have no line start
+  std::vector<std::string> lines = {"", "a", "bc", "", "defghijklmnop", "q", "rstuvwxyz0123456789", ""};
+  for (bool trailing_line_end : {true, false}) {
+    auto content = Join(lines, trailing_line_end);
+    auto path = WriteFile("lines_across_tiny_blocks.txt", content);
+    auto expected = lines;
+    if (!trailing_line_end) {
+      expected.pop_back();
+    }
+    for (size_t block_size : {1, 2, 3, 7}) {
+      for (size_t threads : {1, 2}) {
+        EXPECT_EQ(ReadLines(std::make_shared<MmapFileSplitter>(block_size), path, content.size(), block_size, threads), expected)
+            << "block size " << block_size << ", " << threads << " threads";
+      }
+    }
+  }
+}
+
+TEST(LineInputFormat, ParseChunksKeepsLineOrder) {
+  auto lines = MakeLines(100000, 2);
+  auto text = Join(lines, true);
+  ASSERT_GT(text.size(), 16 * 64 * 1024);
+  auto path = WriteFile("parse_chunks.txt", text);
+  auto parse = [](std::string_view line, DatasetPartition<std::string>* out) { out->push_back(std::string(line)); };
+
+  TestLineInputFormat input(std::make_shared<MmapFileSplitter>(), path);
+  input.SetParseThreads(4, true);
+  TestLineInputFormat::ParseWorkers workers(3, false);
+  DatasetPartition<std::string> ordered;
+  input.ParseChunks<std::string_view>(text, parse, &workers, &ordered);
+  EXPECT_EQ(std::vector<std::string>(ordered.begin(), ordered.end()), lines);
+  // the workers are reused for the next block
+  DatasetPartition<std::string> again;
+  input.ParseChunks<std::string_view>(text, parse, &workers, &again);
+  EXPECT_EQ(std::vector<std::string>(again.begin(), again.end()), lines);
+
+  input.SetParseThreads(4, false);
+  DatasetPartition<std::string> unordered;
+  input.ParseChunks<std::string_view>(text, parse, &workers, &unordered);
+  std::vector<std::string> got(unordered.begin(), unordered.end()), expected = lines;
+  std::sort(got.begin(), got.end());
+  std::sort(expected.begin(), expected.end());
+  EXPECT_EQ(got, expected);
+}
+
+TEST(LineInputFormat, ParseChunksCallsTheExecutorConcurrentlyInOrder) {
+  auto text = Join(MakeLines(20000, 3), true);
+  ASSERT_GT(text.size(), 8 * 64 * 1024);
+  TestLineInputFormat input(std::make_shared<MmapFileSplitter>(), WriteFile("parse_concurrent.txt", ""));
+  input.SetParseThreads(4, true);
+  TestLineInputFormat::ParseWorkers workers(3, false);
+  std::atomic<int> active(0), max_active(0);
+  DatasetPartition<size_t> out;
+  input.ParseChunks<std::string_view>(text, [&active, &max_active](std::string_view line, DatasetPartition<size_t>* ret) {
+    int now = ++active;
+    for (int seen = max_active; seen < now && !max_active.compare_exchange_weak(seen, now);) {
+    }
+    std::this_thread::sleep_for(std::chrono::microseconds(20));
+    ret->push_back(line.size());
+    --active;
+  }, &workers, &out);
+  EXPECT_GT(max_active, 1);
+}
+
+TEST(LineInputFormat, ParseChunksOfShortText) {
+  TestLineInputFormat input(std::make_shared<MmapFileSplitter>(), WriteFile("parse_short.txt", ""));
+  input.SetParseThreads(4, true);
+  TestLineInputFormat::ParseWorkers workers(3, false);
+  DatasetPartition<std::string> out;
+  input.ParseChunks<std::string_view>("a\n\nbc\n", [](std::string_view line, DatasetPartition<std::string>* ret) {
+    ret->push_back(std::string(line));
+  }, &workers, &out);
+  EXPECT_EQ(std::vector<std::string>(out.begin(), out.end()), std::vector<std::string>({"a", "", "bc"}));
+}
+
+}  // namespace
+}  // namespace common
+}  // namespace axe
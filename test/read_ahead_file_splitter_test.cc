@@ -0,0 +1,180 @@
+// Copyright 2020 HDL
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "common/io/input/mmap_file_splitter.h"
+#include "common/io/input/read_ahead_file_splitter.h"
+
+namespace axe {
+namespace common {
+namespace {
+
+/** Counters shared by the splitters a factory creates. **/
+struct Counters {
+  std::atomic<size_t> splitters{0};
+  std::atomic<size_t> reads{0};
+  std::mutex mutex;
+  std::set<std::thread::id> threads;
+};
+
+/** A splitter of an in-memory file that reads every block into the same buffer, so that a block is overwritten by the
+ * next fetch, as with a splitter that reuses its buffer.
+ */
+class MemorySplitter : public FileSplitter {
+ public:
+  MemorySplitter(const std::string& content, size_t block_size, Counters* counters)
+      : content_(content), block_size_(block_size), counters_(counters) {
+    ++counters_->splitters;
+  }
+
+  void Load(const std::string& url) override {}
+  std::string FetchBlock(const std::string& fn, size_t offset, bool is_next = false) override {
+    return std::string(FetchBlockView(fn, offset, is_next));
+  }
+  std::string_view FetchBlockView(const std::string& fn, size_t offset, bool is_next = false) override {
+    ++counters_->reads;
+    {
+      std::lock_guard<std::mutex> lock(counters_->mutex);
+      counters_->threads.insert(std::this_thread::get_id());
+    }
+    if (is_next) {
+      offset += block_size_;
+    }
+    if (offset >= content_.size()) {
+      return std::string_view();
+    }
+    buffer_ = content_.substr(offset, block_size_);
+    return buffer_;
+  }
+
+ private:
+  const std::string& content_;
+  const size_t block_size_;
+  Counters* counters_;
+  std::string buffer_;
+};
+
+std::string MakeContent(size_t size) {
+  std::string ret(size, ' ');
+  for (size_t i = 0; i < size; ++i) {
+    ret[i] = 'a' + (i * 7 + i / 100) % 26;
+  }
+  return ret;
+}
+
+std::vector<Block> Blocks(const std::string& fn, size_t size, size_t block_size) {
+  std::vector<Block> ret;
+  for (size_t offset = 0; offset < size; offset += block_size) {
+    ret.push_back({fn, offset});
+  }
+  return ret;
+}
+
+TEST(ReadAheadFileSplitter, FetchesTheScheduledBlocksOnOneReader) {
+  const size_t block_size = 1000;
+  auto content = MakeContent(20 * block_size + 123);
+  for (size_t depth : {1, 2, 5}) {
+    Counters counters;
+    ReadAheadFileSplitter splitter([&] { return std::make_shared<MemorySplitter>(content, block_size, &counters); }, depth);
+    auto blocks = Blocks("f", content.size(), block_size);
+    splitter.Schedule(blocks);
+    for (auto& block : blocks) {
+      auto view = splitter.FetchBlockView(block.first, block.second);
+      // the block is copied out of the buffer of the splitter, which the reader overwrites with the next blocks
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      EXPECT_EQ(view, std::string_view(content).substr(block.second, block_size)) << "depth " << depth;
+    }
+    // one splitter for the reader thread and one for the direct reads, whatever the depth
+    EXPECT_EQ(counters.splitters, 2);
+    EXPECT_EQ(counters.reads, blocks.size());
+    EXPECT_EQ(counters.threads.size(), 1);
+    EXPECT_EQ(counters.threads.count(std::this_thread::get_id()), 0);
+  }
+}
+
+TEST(ReadAheadFileSplitter, ReadsAtMostDepthBlocksAhead) {
+  const size_t block_size = 100;
+  auto content = MakeContent(30 * block_size);
+  auto blocks = Blocks("f", content.size(), block_size);
+  for (size_t depth : {1, 3}) {
+    Counters counters;
+    ReadAheadFileSplitter splitter([&] { return std::make_shared<MemorySplitter>(content, block_size, &counters); }, depth);
+    splitter.Schedule(blocks);
+    for (size_t i = 0; i < blocks.size(); ++i) {
+      splitter.FetchBlockView(blocks[i].first, blocks[i].second);
+      size_t expected = std::min(blocks.size(), i + 1 + depth);
+      for (int wait = 0; wait < 5000 && counters.reads < expected; ++wait) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+      // the reader fills the pipeline and stops there
+      std::this_thread::sleep_for(std::chrono::milliseconds(2));
+      ASSERT_EQ(counters.reads, expected) << "depth " << depth << ", block " << i;
+    }
+  }
+}
+
+TEST(ReadAheadFileSplitter, SkippedUnscheduledAndRescheduledBlocks) {
+  const size_t block_size = 100;
+  auto content = MakeContent(10 * block_size);
+  Counters counters;
+  ReadAheadFileSplitter splitter([&] { return std::make_shared<MemorySplitter>(content, block_size, &counters); }, 2);
+  auto blocks = Blocks("f", content.size(), block_size);
+  auto expect_block = [&content](std::string_view view, size_t offset) {
+    EXPECT_EQ(view, std::string_view(content).substr(offset, block_size)) << "offset " << offset;
+  };
+  splitter.Schedule(blocks);
+  expect_block(splitter.FetchBlockView("f", 0), 0);
+  expect_block(splitter.FetchBlockView("f", 500), 500);  // skips blocks 1 to 4
+  expect_block(splitter.FetchBlockView("f", 500, true), 600);
+  expect_block(splitter.FetchBlockView("f", 50), 50);  // not scheduled
+  expect_block(splitter.FetchBlockView("f", 600), 600);
+  EXPECT_EQ(splitter.FetchRangeView("f", 950, 100), std::string_view(content).substr(950));
+
+  splitter.Schedule({{"f", 900}, {"f", 100}});
+  expect_block(splitter.FetchBlockView("f", 900), 900);
+  expect_block(splitter.FetchBlockView("f", 100), 100);
+  // past the end of the file
+  splitter.Schedule({{"f", 2000}});
+  EXPECT_TRUE(splitter.FetchBlockView("f", 2000).empty());
+}
+
+TEST(ReadAheadFileSplitter, HoldsMappedBlocks) {
+  const size_t block_size = 4096;
+  auto content = MakeContent(8 * block_size + 5);
+  auto path = ::testing::TempDir() + "read_ahead_mmap.txt";
+  std::ofstream(path, std::ios::binary | std::ios::trunc) << content;
+  ReadAheadFileSplitter splitter([block_size] { return std::make_shared<MmapFileSplitter>(block_size); }, 3);
+  splitter.Load(path);
+  auto blocks = Blocks(path, content.size(), block_size);
+  splitter.Schedule(blocks);
+  for (auto& block : blocks) {
+    EXPECT_EQ(splitter.FetchBlockView(block.first, block.second), std::string_view(content).substr(block.second, block_size));
+  }
+}
+
+}  // namespace
+}  // namespace common
+}  // namespace axe
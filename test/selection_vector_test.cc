@@ -0,0 +1,150 @@
+// Copyright 2020 HDL
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "common/dataset/dataset_partition.h"
+#include "common/dataset/selection_vector.h"
+
+namespace axe {
+namespace common {
+namespace {
+
+using Rows = std::vector<SelectionVector::index_type>;
+
+std::vector<bool> RandomMask(std::mt19937* rng, size_t n) {
+  std::vector<bool> ret(n);
+  for (size_t i = 0; i < n; ++i) {
+    ret[i] = (*rng)() % 3 != 0;
+  }
+  return ret;
+}
+
+Rows MaskRows(const std::vector<bool>& mask) {
+  Rows ret;
+  for (size_t i = 0; i < mask.size(); ++i) {
+    if (mask[i]) {
+      ret.push_back(i);
+    }
+  }
+  return ret;
+}
+
+TEST(SelectionVector, AllSelectsEveryRow) {
+  EXPECT_TRUE(SelectionVector::All(0).empty());
+  EXPECT_EQ(SelectionVector::All(4).GetRows(), (Rows{0, 1, 2, 3}));
+}
+
+TEST(SelectionVector, FromMaskAndToMaskRoundTrip) {
+  std::mt19937 rng(3);
+  for (size_t n : {0, 1, 63, 64, 65, 130, 1000}) {
+    auto mask = RandomMask(&rng, n);
+    auto selection = SelectionVector::FromMask(mask);
+    EXPECT_EQ(selection.GetRows(), MaskRows(mask)) << "n = " << n;
+    EXPECT_EQ(selection.ToMask(n), mask) << "n = " << n;
+  }
+}
+
+TEST(SelectionVector, RefineKeepsTheRowsThatPassEveryPredicate) {
+  auto selection = SelectionVector::All(20);
+  selection.Refine([](SelectionVector::index_type row) { return row % 2 == 0; });
+  selection.Refine([](SelectionVector::index_type row) { return row % 3 == 0; });
+  EXPECT_EQ(selection.GetRows(), (Rows{0, 6, 12, 18}));
+  // a predicate only sees the rows that are still selected
+  Rows seen;
+  selection.Refine([&seen](SelectionVector::index_type row) {
+    seen.push_back(row);
+    return row > 10;
+  });
+  EXPECT_EQ(seen, (Rows{0, 6, 12, 18}));
+  EXPECT_EQ(selection.GetRows(), (Rows{12, 18}));
+}
+
+TEST(SelectionVector, RefineByMaskAndIntersect) {
+  std::mt19937 rng(5);
+  const size_t n = 300;
+  auto lhs = RandomMask(&rng, n);
+  auto rhs = RandomMask(&rng, n);
+  std::vector<bool> both(n);
+  for (size_t i = 0; i < n; ++i) {
+    both[i] = lhs[i] && rhs[i];
+  }
+  auto refined = SelectionVector::FromMask(lhs);
+  refined.Refine(rhs);
+  EXPECT_EQ(refined.GetRows(), MaskRows(both));
+
+  auto intersected = SelectionVector::FromMask(lhs);
+  intersected.Intersect(SelectionVector::FromMask(rhs));
+  EXPECT_EQ(intersected.GetRows(), MaskRows(both));
+
+  intersected.Intersect(SelectionVector());
+  EXPECT_TRUE(intersected.empty());
+}
+
+TEST(SelectionVector, CompactAndApplySelectionKeepTheNullFlags) {
+  std::vector<int64_t> values(100);
+  std::vector<uint32_t> nulls;
+  for (size_t i = 0; i < values.size(); ++i) {
+    values[i] = i;
+    if (i % 7 == 0) {
+      nulls.push_back(i);
+    }
+  }
+  DatasetPartition<int64_t> partition(values);
+  partition.SetNull(nulls);
+
+  auto selection = SelectionVector::All(partition.size());
+  partition.Refine(&selection, [](int64_t value) { return value % 2 == 0; });
+  partition.RefineNotNull(&selection);
+  Rows expected;
+  for (size_t i = 0; i < values.size(); i += 2) {
+    if (i % 7 != 0) {
+      expected.push_back(i);
+    }
+  }
+  ASSERT_EQ(selection.GetRows(), expected);
+
+  // keep the null rows in a second selection to check that their flags move with them
+  auto with_nulls = SelectionVector::All(partition.size());
+  partition.Refine(&with_nulls, [](int64_t value) { return value % 3 == 0; });
+  auto compact = std::dynamic_pointer_cast<DatasetPartition<int64_t>>(partition.Compact(with_nulls));
+  ASSERT_EQ(compact->size(), with_nulls.size());
+  for (size_t i = 0; i < compact->size(); ++i) {
+    EXPECT_EQ((*compact)[i], with_nulls[i]);
+    EXPECT_EQ(compact->IsNull(i), with_nulls[i] % 7 == 0) << "row " << i;
+  }
+
+  partition.ApplySelection(with_nulls);
+  ASSERT_EQ(partition.size(), with_nulls.size());
+  for (size_t i = 0; i < partition.size(); ++i) {
+    EXPECT_EQ(partition[i], with_nulls[i]);
+    EXPECT_EQ(partition.IsNull(i), with_nulls[i] % 7 == 0) << "row " << i;
+  }
+}
+
+TEST(SelectionVector, RefineNotNullKeepsEverythingWithoutNulls) {
+  DatasetPartition<int64_t> partition(std::vector<int64_t>{1, 2, 3});
+  auto selection = SelectionVector::All(partition.size());
+  partition.RefineNotNull(&selection);
+  EXPECT_EQ(selection.GetRows(), (Rows{0, 1, 2}));
+}
+
+}  // namespace
+}  // namespace common
+}  // namespace axe
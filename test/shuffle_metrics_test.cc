@@ -0,0 +1,77 @@
+// Copyright 2020 HDL
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cstdint>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "common/shuffle_metrics.h"
+
+namespace axe {
+namespace common {
+namespace {
+
+TEST(ShuffleMetrics, RegisteredEdgesJoinSendsAndReceives) {
+  auto& metrics = ShuffleMetrics::Get();
+  metrics.Clear();
+  metrics.RegisterEdge(10, 11, "ReduceBy-serialize");
+  metrics.RecordSend(10, 0, {3, 1}, {30, 10}, 1.0);
+  metrics.RecordSend(10, 1, {1, 1}, {10, 10}, 2.0);
+  metrics.RecordReceive(11, 0, 4, 40, 0.5, 5.0);
+  metrics.RecordReceive(11, 1, 2, 20, 1.5, 7.0);
+
+  auto edges = metrics.Summarize();
+  ASSERT_EQ(edges.size(), 1);
+  auto& edge = edges[0];
+  EXPECT_EQ(edge.name, "ReduceBy-serialize");
+  EXPECT_EQ(edge.msg_id, 10);
+  EXPECT_EQ(edge.shuffled_id, 11);
+  EXPECT_EQ(edge.records, 6);
+  EXPECT_EQ(edge.bytes, 60);
+  EXPECT_EQ(edge.bytes_per_dst, (std::vector<uint64_t>{40, 20}));
+  EXPECT_EQ(edge.pairs.size(), 4);
+  EXPECT_DOUBLE_EQ(edge.serialize_ms, 3.0);
+  EXPECT_DOUBLE_EQ(edge.max_serialize_ms, 2.0);
+  EXPECT_DOUBLE_EQ(edge.deserialize_ms, 2.0);
+  EXPECT_DOUBLE_EQ(edge.max_deserialize_ms, 1.5);
+  EXPECT_DOUBLE_EQ(edge.transfer_ms, 12.0);
+  EXPECT_DOUBLE_EQ(edge.max_transfer_ms, 7.0);
+  EXPECT_DOUBLE_EQ(edge.max_over_mean, 40.0 * 2 / 60);
+  metrics.Clear();
+}
+
+TEST(ShuffleMetrics, UnregisteredEdgeKeepsItsMessageId) {
+  auto& metrics = ShuffleMetrics::Get();
+  metrics.Clear();
+  metrics.RecordSend(20, 0, {1}, {8}, 1.0);
+  auto edges = metrics.Summarize();
+  ASSERT_EQ(edges.size(), 1);
+  EXPECT_EQ(edges[0].name, "");
+  EXPECT_EQ(edges[0].shuffled_id, 20);
+  EXPECT_DOUBLE_EQ(edges[0].transfer_ms, 0);
+  metrics.Clear();
+}
+
+TEST(ShuffleMetrics, Skew) {
+  EXPECT_DOUBLE_EQ(ShuffleMetrics::Skew({}), 0);
+  EXPECT_DOUBLE_EQ(ShuffleMetrics::Skew({5, 5, 5}), 0);
+  EXPECT_DOUBLE_EQ(ShuffleMetrics::Skew({0, 10}), 1);
+  EXPECT_DOUBLE_EQ(ShuffleMetrics::MaxOverMean({0, 10}), 2);
+  EXPECT_DOUBLE_EQ(ShuffleMetrics::MaxOverMean({0, 0}), 0);
+}
+
+}  // namespace
+}  // namespace common
+}  // namespace axe
@@ -0,0 +1,82 @@
+// Copyright 2020 HDL
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <fstream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "common/dataset/source_dataset.h"
+
+namespace axe {
+namespace common {
+namespace {
+
+/** Exposes how TextSourceDataset reads its blocks. **/
+struct TestTextSource : public TextSourceDataset {
+  using TextSourceDataset::MakeInputFormat;
+  using TextSourceDataset::ReadOptions;
+  using TextSourceDataset::SplitterFactory;
+};
+
+std::string WriteFile(const std::string& name, const std::string& content) {
+  auto path = ::testing::TempDir() + name;
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+  file << content;
+  return path;
+}
+
+TEST(TextSourceDataset, NfsFilesAreReadUnlessMmapIsSet) {
+  TestTextSource::ReadOptions options;
+  auto splitter = TestTextSource::SplitterFactory(NFS, options)();
+  EXPECT_NE(dynamic_cast<NFSFileSplitter*>(splitter.get()), nullptr);
+  EXPECT_EQ(dynamic_cast<MmapFileSplitter*>(splitter.get()), nullptr);
+
+  options.mmap = true;
+  splitter = TestTextSource::SplitterFactory(NFS, options)();
+  EXPECT_NE(dynamic_cast<MmapFileSplitter*>(splitter.get()), nullptr);
+}
+
+TEST(TextSourceDataset, ReadsTheSameLinesWithAnyReadOptions) {
+  std::vector<std::string> lines;
+  std::string content;
+  for (size_t i = 0; i < 1000; ++i) {
+    lines.push_back(std::to_string(i * i));
+    content += lines.back() + "\n";
+  }
+  auto path = WriteFile("text_source_mmap.txt", content);
+  for (bool mmap : {false, true}) {
+    for (size_t read_ahead : {0, 1, 3}) {
+      TestTextSource::ReadOptions options;
+      options.mmap = mmap;
+      options.read_ahead = read_ahead;
+      auto input = TestTextSource::MakeInputFormat(path, NFS, options);
+      EXPECT_EQ(dynamic_cast<ReadAheadFileSplitter*>(input.GetFileSplitter()) != nullptr, read_ahead != 0);
+      auto read = input.ReadData(std::vector<std::pair<std::string, size_t>>{{path, 0}}, [](std::string_view line) {
+        DatasetPartition<std::string> ret;
+        ret.push_back(std::string(line));
+        return ret;
+      });
+      EXPECT_EQ(std::vector<std::string>(read.begin(), read.end()), lines) << (mmap ? "mmap" : "read") << ", read-ahead " << read_ahead;
+    }
+  }
+}
+
+}  // namespace
+}  // namespace common
+}  // namespace axe
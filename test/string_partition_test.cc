@@ -0,0 +1,133 @@
+// Copyright 2020 HDL
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "common/dataset/string_partition.h"
+
+namespace axe {
+namespace common {
+namespace {
+
+/** String i is i repeated i % 7 + 1 times, e.g. "3333". **/
+std::string MakeString(size_t i) { return std::string(i % 7 + 1, '0' + i % 10); }
+
+StringPartition MakePartition(size_t n) {
+  StringPartition sp;
+  for (size_t i = 0; i < n; ++i) {
+    sp.push_back(MakeString(i));
+  }
+  return sp;
+}
+
+TEST(StringPartition, PositionsAndOffsetsAre64Bit) {
+  EXPECT_EQ(sizeof(StringPartition::size_type), 8);
+  EXPECT_EQ(sizeof(StringPartition::offset_type), 8);
+  EXPECT_EQ(sizeof(StringPartition::iterator::size_type), 8);
+  EXPECT_TRUE((std::is_same<StringPartition::iterator, SegmentedStringPartitionIterator>::value));
+}
+
+TEST(StringPartition, AppendsNeverMoveStrings) {
+  StringPartition sp;
+  sp.push_back("first");
+  auto first = sp[0];
+  for (size_t i = 0; i < 10000; ++i) {
+    sp.push_back(MakeString(i));
+  }
+  EXPECT_GT(sp.GetNumSegments(), 1);
+  // the view taken before the payload grew still points at the string
+  EXPECT_EQ(first.data(), sp[0].data());
+  EXPECT_EQ(first, "first");
+  for (size_t i = 0; i < 10000; ++i) {
+    ASSERT_EQ(sp[i + 1], MakeString(i)) << "string " << i + 1;
+  }
+}
+
+TEST(StringPartition, IteratorsVisitEverySegment) {
+  auto sp = MakePartition(5000);
+  ASSERT_GT(sp.GetNumSegments(), 1);
+  size_t i = 0;
+  for (auto it = sp.begin(); it != sp.end(); ++it, ++i) {
+    ASSERT_EQ(*it, MakeString(i));
+  }
+  EXPECT_EQ(i, 5000);
+  i = 0;
+  for (auto it = sp.Begin(), end = sp.End(); !(*it == *end); ++*it, ++i) {
+    auto ptr = it->GetPtr();
+    ASSERT_EQ(std::string(static_cast<const char*>(ptr.first), ptr.second), MakeString(i));
+  }
+  EXPECT_EQ(i, 5000);
+}
+
+TEST(StringPartition, CopyCompactsAndSliceCopiesAcrossSegments) {
+  auto sp = MakePartition(5000);
+  StringPartition copy(sp);
+  EXPECT_EQ(copy.GetNumSegments(), 1);
+  EXPECT_EQ(copy.GetPayloadSize(), sp.GetPayloadSize());
+  EXPECT_EQ(copy[4999], MakeString(4999));
+
+  auto slice = std::dynamic_pointer_cast<StringPartition>(sp.Slice(100, 4800));
+  ASSERT_EQ(slice->size(), 4800);
+  for (size_t i = 0; i < slice->size(); ++i) {
+    ASSERT_EQ((*slice)[i], MakeString(i + 100));
+  }
+}
+
+TEST(StringPartition, FilterPermuteAndTruncate) {
+  auto sp = MakePartition(3000);
+  std::vector<bool> to_keep(3000);
+  for (size_t i = 0; i < to_keep.size(); ++i) {
+    to_keep[i] = i % 3 == 0;
+  }
+  sp.SetNull({3, 4});
+  sp.ApplyFilter(to_keep);
+  ASSERT_EQ(sp.size(), 1000);
+  EXPECT_EQ(sp[999], MakeString(2997));
+  EXPECT_TRUE(sp.IsNull(1));
+  EXPECT_FALSE(sp.IsNull(2));
+
+  std::vector<size_t> reverse(sp.size());
+  for (size_t i = 0; i < reverse.size(); ++i) {
+    reverse[i] = reverse.size() - 1 - i;
+  }
+  sp.ApplyPermutation(reverse);
+  EXPECT_EQ(sp[0], MakeString(2997));
+  EXPECT_TRUE(sp.IsNull(998));
+
+  sp.resize(10);
+  ASSERT_EQ(sp.size(), 10);
+  EXPECT_EQ(sp[9], MakeString(2997 - 27));
+  sp.push_back("tail");
+  EXPECT_EQ(sp[10], "tail");
+}
+
+TEST(StringPartition, SortedIndexBreaksPrefixTies) {
+  StringPartition sp;
+  std::string prefix(StringPartition::kSortPrefixBytes, 'p');
+  sp.push_back(prefix + "b");
+  sp.push_back("a");
+  sp.push_back(prefix + "a");
+  sp.push_back(prefix);
+  EXPECT_EQ(sp.GetSortedIndex(), (std::vector<uint32_t>{1, 3, 2, 0}));
+}
+
+}  // namespace
+}  // namespace common
+}  // namespace axe
@@ -0,0 +1,218 @@
+// Copyright 2020 HDL
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "common/dataset/dataset_partition.h"
+#include "common/dataset/validity_bitmap.h"
+
+namespace axe {
+namespace common {
+namespace {
+
+std::vector<bool> RandomBools(std::mt19937* rng, size_t n, int one_in = 2) {
+  std::vector<bool> ret(n);
+  for (size_t i = 0; i < n; ++i) {
+    ret[i] = (*rng)() % one_in != 0;
+  }
+  return ret;
+}
+
+TEST(BitmapOps, PackAndUnpackRoundTrip) {
+  std::mt19937 rng(1);
+  for (size_t n : {0, 1, 63, 64, 65, 200}) {
+    auto bools = RandomBools(&rng, n);
+    auto words = PackBools(bools, n);
+    EXPECT_EQ(words.size(), BitmapOps::NumWords(n));
+    std::vector<bool> out;
+    UnpackBools(words.data(), 0, n, &out);
+    EXPECT_EQ(out, bools);
+  }
+  // the flags past the end of the vector take the fill value
+  auto words = PackBools({false}, 3, true);
+  EXPECT_EQ(words[0], 0x6);
+  EXPECT_EQ(PackBools({true}, 3, false)[0], 0x1);
+}
+
+TEST(BitmapOps, CopyAtAnyBitOffset) {
+  std::mt19937 rng(2);
+  for (int trial = 0; trial < 300; ++trial) {
+    size_t n = rng() % 300 + 1, src_pos = rng() % 129, dst_pos = rng() % 129;
+    auto src = RandomBools(&rng, src_pos + n);
+    auto dst = RandomBools(&rng, dst_pos + n + 1);
+    auto expected = dst;
+    for (size_t i = 0; i < n; ++i) {
+      expected[dst_pos + i] = src[src_pos + i];
+    }
+    auto src_words = PackBools(src, src.size());
+    auto dst_words = PackBools(dst, dst.size());
+    BitmapOps::Copy(src_words.data(), src_pos, dst_words.data(), dst_pos, n);
+    std::vector<bool> out;
+    UnpackBools(dst_words.data(), 0, dst.size(), &out);
+    ASSERT_EQ(out, expected) << "n " << n << " from " << src_pos << " to " << dst_pos;
+  }
+}
+
+TEST(BitmapOps, CountAtAnyBitOffset) {
+  std::mt19937 rng(3);
+  for (int trial = 0; trial < 300; ++trial) {
+    size_t n = rng() % 300, pos = rng() % 129;
+    auto bools = RandomBools(&rng, pos + n);
+    size_t expected = 0;
+    for (size_t i = 0; i < n; ++i) {
+      expected += bools[pos + i];
+    }
+    ASSERT_EQ(BitmapOps::Count(PackBools(bools, bools.size()).data(), pos, n), expected);
+  }
+}
+
+TEST(BitmapOps, CompressKeepsMaskedBitsInOrder) {
+  std::mt19937 rng(4);
+  for (int trial = 0; trial < 300; ++trial) {
+    size_t n = rng() % 300;
+    auto bools = RandomBools(&rng, n);
+    auto keep = RandomBools(&rng, n, 3);
+    std::vector<bool> expected;
+    for (size_t i = 0; i < n; ++i) {
+      if (keep[i]) {
+        expected.push_back(bools[i]);
+      }
+    }
+    std::vector<uint64_t> words(BitmapOps::NumWords(expected.size()));
+    size_t kept = BitmapOps::Compress(PackBools(bools, n).data(), PackBools(keep, n, false).data(), n, words.data());
+    ASSERT_EQ(kept, expected.size());
+    std::vector<bool> out;
+    UnpackBools(words.data(), 0, kept, &out);
+    ASSERT_EQ(out, expected);
+  }
+}
+
+TEST(ValidityBitmap, SliceSharesWordsAndCopiesOnWrite) {
+  std::mt19937 rng(5);
+  auto bools = RandomBools(&rng, 200);
+  auto bitmap = ValidityBitmap::FromBools(bools);
+  auto slice = bitmap.Slice(37, 100);
+  EXPECT_EQ(slice.GetWords(), bitmap.GetWords());
+  for (size_t i = 0; i < slice.size(); ++i) {
+    ASSERT_EQ(slice.IsValid(i), bools[37 + i]);
+  }
+  slice.SetValid(0, !slice.IsValid(0));
+  EXPECT_NE(slice.IsValid(0), bitmap.IsValid(37));
+  EXPECT_EQ(bitmap.IsValid(37), bools[37]);
+}
+
+TEST(ValidityBitmap, AndOrAppendOfSlices) {
+  std::mt19937 rng(6);
+  auto bools = RandomBools(&rng, 300);
+  auto bitmap = ValidityBitmap::FromBools(bools);
+  auto left = bitmap.Slice(5, 120), right = bitmap.Slice(70, 120);
+  auto both = left, either = left, appended = left;
+  both.And(right);
+  either.Or(right);
+  appended.Append(right);
+  ASSERT_EQ(appended.size(), 240);
+  for (size_t i = 0; i < 120; ++i) {
+    EXPECT_EQ(both.IsValid(i), bools[5 + i] && bools[70 + i]);
+    EXPECT_EQ(either.IsValid(i), bools[5 + i] || bools[70 + i]);
+    EXPECT_EQ(appended.IsValid(i), bools[5 + i]);
+    EXPECT_EQ(appended.IsValid(120 + i), bools[70 + i]);
+  }
+}
+
+TEST(ValidityBitmap, GatherFilterAndCount) {
+  std::mt19937 rng(7);
+  auto bools = RandomBools(&rng, 250);
+  auto slice = ValidityBitmap::FromBools(bools).Slice(11, 230);
+  std::vector<uint32_t> permutation(slice.size());
+  for (auto& index : permutation) {
+    index = rng() % slice.size();
+  }
+  auto gathered = slice.Gather(permutation);
+  for (size_t i = 0; i < permutation.size(); ++i) {
+    ASSERT_EQ(gathered.IsValid(i), bools[11 + permutation[i]]);
+  }
+  auto keep = RandomBools(&rng, slice.size());
+  auto filtered = slice.Filter(keep);
+  size_t j = 0, valid = 0;
+  for (size_t i = 0; i < slice.size(); ++i) {
+    valid += bools[11 + i];
+    if (keep[i]) {
+      ASSERT_EQ(filtered.IsValid(j++), bools[11 + i]);
+    }
+  }
+  EXPECT_EQ(filtered.size(), j);
+  EXPECT_EQ(slice.CountValid(), valid);
+  EXPECT_EQ(slice.CountNull(), slice.size() - valid);
+  std::vector<bool> out;
+  slice.ToBools(&out);
+  EXPECT_EQ(out, std::vector<bool>(bools.begin() + 11, bools.begin() + 241));
+}
+
+/** The null flags of a partition follow its values through permutations, filters, slices and appends. **/
+TEST(PartitionNullFlags, FollowTheValues) {
+  std::mt19937 rng(11);
+  const size_t n = 300;
+  std::vector<int64_t> values(n);
+  std::vector<uint32_t> nulls;
+  for (size_t i = 0; i < n; ++i) {
+    values[i] = i;
+    if (rng() % 3 == 0) {
+      nulls.push_back(i);
+    }
+  }
+  auto expect_nulls = [](const DatasetPartition<int64_t>& partition) {
+    for (size_t i = 0; i < partition.size(); ++i) {
+      ASSERT_EQ(partition.IsNull(i), partition[i] < 0) << "row " << i;
+    }
+  };
+  // null rows hold a negative value, so that the expected flag follows from the value
+  for (auto i : nulls) {
+    values[i] = -1 - static_cast<int64_t>(i);
+  }
+  DatasetPartition<int64_t> partition(values);
+  partition.SetNull(nulls);
+  expect_nulls(partition);
+
+  std::vector<uint32_t> permutation(n);
+  for (size_t i = 0; i < n; ++i) {
+    permutation[i] = (i * 7) % n;
+  }
+  partition.ApplyPermutation(permutation);
+  expect_nulls(partition);
+
+  auto keep = RandomBools(&rng, n);
+  auto filtered = std::dynamic_pointer_cast<DatasetPartition<int64_t>>(partition.Filter(keep, std::count(keep.begin(), keep.end(), true)));
+  expect_nulls(*filtered);
+  partition.ApplyFilter(keep);
+  expect_nulls(partition);
+
+  auto slice = std::dynamic_pointer_cast<DatasetPartition<int64_t>>(partition.Slice(5, partition.size() - 10));
+  expect_nulls(*slice);
+  // appending a partition without nulls extends the flags as not null, and the other way round
+  auto no_nulls = std::make_shared<DatasetPartition<int64_t>>(std::vector<int64_t>{1, 2, 3});
+  slice->AppendPartition(no_nulls);
+  expect_nulls(*slice);
+  no_nulls->AppendPartition(slice);
+  expect_nulls(*no_nulls);
+  EXPECT_TRUE(no_nulls->HasNull());
+}
+
+}  // namespace
+}  // namespace common
+}  // namespace axe
@@ -0,0 +1,245 @@
+// Copyright 2020 HDL
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include "glog/logging.h"
+
+namespace axe {
+namespace base {
+
+/** Bump-pointer arena for short-lived allocations of a task.
+ *
+ * Memory is carved from blocks of block_size bytes (larger requests get a block of their own) and is never freed
+ * individually. A Scope rewinds the arena to where it was when the scope was opened, so per-record temporaries are
+ * released in bulk, and the blocks are freed with the arena.
+ *
+ * Allocations made with AllocateShared may outlive a rewind or the arena itself: the caller shares the ownership of
+ * the block, and a rewind does not reuse a block below the last such allocation while the block is still shared.
+ */
+class Arena : public std::enable_shared_from_this<Arena> {
+ public:
+  static const size_t kDefaultBlockSize = 64 * 1024;
+
+  /** A position in the arena to rewind to. **/
+  struct Mark {
+    size_t block;
+    size_t used;
+  };
+
+  /** Rewinds the arena on destruction. A null arena makes the scope a no-op. **/
+  class Scope {
+   public:
+    explicit Scope(Arena* arena) : arena_(arena) {
+      if (arena_ != nullptr) {
+        mark_ = arena_->GetMark();
+      }
+    }
+    ~Scope() {
+      if (arena_ != nullptr) {
+        arena_->Rewind(mark_);
+      }
+    }
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+   private:
+    Arena* arena_;
+    Mark mark_{0, 0};
+  };
+
+  /** Makes an arena the current arena of the calling thread until destruction. **/
+  class Activate {
+   public:
+    explicit Activate(Arena* arena) : previous_(CurrentRef()) { CurrentRef() = arena; }
+    ~Activate() { CurrentRef() = previous_; }
+    Activate(const Activate&) = delete;
+    Activate& operator=(const Activate&) = delete;
+
+   private:
+    Arena* previous_;
+  };
+
+  explicit Arena(size_t block_size = kDefaultBlockSize) : block_size_(block_size) { CHECK_GT(block_size_, 0); }
+
+  Arena(const Arena&) = delete;
+  Arena& operator=(const Arena&) = delete;
+
+  /** The arena of the task running on the calling thread, or nullptr. **/
+  static inline Arena* Current() { return CurrentRef(); }
+
+  void* Allocate(size_t bytes, size_t align = alignof(std::max_align_t)) {
+    while (current_ < blocks_.size()) {
+      auto& block = blocks_[current_];
+      size_t start = AlignedOffset(block, block.used, align);
+      if (start + bytes <= block.size) {
+        block.used = start + bytes;
+        allocated_bytes_ += bytes;
+        return block.data.get() + start;
+      }
+      if (current_ + 1 == blocks_.size() || bytes > block_size_) {
+        break;
+      }
+      ++current_;
+    }
+    // blocks after the current one are free, so a new block can go at the end
+    blocks_.push_back(Block{std::shared_ptr<char>(new char[std::max(block_size_, bytes + align)], std::default_delete<char[]>()),
+                            std::max(block_size_, bytes + align), 0, 0});
+    reserved_bytes_ += blocks_.back().size;
+    current_ = blocks_.size() - 1;
+    return Allocate(bytes, align);
+  }
+
+  /** Allocate memory that may be used after a rewind, as long as the caller keeps the block owner. **/
+  void* AllocateShared(size_t bytes, size_t align, std::shared_ptr<char>* owner) {
+    auto ptr = Allocate(bytes, align);
+    auto& block = blocks_[current_];
+    block.floor = block.used;
+    *owner = block.data;
+    return ptr;
+  }
+
+  /** Grow the last allocation in place from old_bytes to new_bytes, if the current block has room. **/
+  bool TryExtend(void* ptr, size_t old_bytes, size_t new_bytes) {
+    if (ptr == nullptr || current_ >= blocks_.size() || new_bytes < old_bytes) {
+      return false;
+    }
+    auto& block = blocks_[current_];
+    auto start = static_cast<char*>(ptr);
+    if (start < block.data.get() || start + old_bytes != block.data.get() + block.used || start + new_bytes > block.data.get() + block.size) {
+      return false;
+    }
+    size_t offset = start - block.data.get();
+    if (block.floor == block.used) {
+      block.floor = offset + new_bytes;
+    }
+    block.used = offset + new_bytes;
+    allocated_bytes_ += new_bytes - old_bytes;
+    return true;
+  }
+
+  inline Mark GetMark() const {
+    return current_ < blocks_.size() ? Mark{current_, blocks_[current_].used} : Mark{blocks_.size(), 0};
+  }
+
+  /** Release everything allocated after mark, except what is still shared through AllocateShared. **/
+  void Rewind(const Mark& mark) {
+    if (blocks_.empty()) {
+      return;
+    }
+    // blocks after the mark are dropped if shared, or kept for reuse otherwise
+    size_t kept = std::min(mark.block + 1, blocks_.size());
+    for (size_t i = kept; i < blocks_.size(); ++i) {
+      if (blocks_[i].data.use_count() > 1) {
+        reserved_bytes_ -= blocks_[i].size;
+        continue;
+      }
+      blocks_[i].used = blocks_[i].floor = 0;
+      blocks_[kept++] = std::move(blocks_[i]);
+    }
+    blocks_.resize(kept);
+    current_ = std::min(mark.block, blocks_.size() - 1);
+    auto& block = blocks_[current_];
+    size_t used = mark.block < blocks_.size() ? mark.used : 0;
+    if (block.data.use_count() > 1) {
+      used = std::max(used, block.floor);
+    } else {
+      block.floor = 0;
+    }
+    block.used = std::min(block.used, used);
+  }
+
+  inline void Reset() { Rewind(Mark{0, 0}); }
+
+  /** Bytes handed out since construction. **/
+  inline size_t GetAllocatedBytes() const { return allocated_bytes_; }
+  /** Bytes of the blocks held by the arena. **/
+  inline size_t GetReservedBytes() const { return reserved_bytes_; }
+  inline size_t GetNumBlocks() const { return blocks_.size(); }
+
+ private:
+  struct Block {
+    std::shared_ptr<char> data;
+    size_t size;
+    size_t used;
+    size_t floor;  // end of the last shared allocation
+  };
+
+  static inline Arena*& CurrentRef() {
+    static thread_local Arena* current = nullptr;
+    return current;
+  }
+
+  static inline size_t AlignedOffset(const Block& block, size_t offset, size_t align) {
+    auto address = reinterpret_cast<uintptr_t>(block.data.get()) + offset;
+    return offset + (align - address % align) % align;
+  }
+
+  std::vector<Block> blocks_;
+  size_t current_ = 0;
+  size_t block_size_;
+  size_t allocated_bytes_ = 0;
+  size_t reserved_bytes_ = 0;
+};
+
+/** Standard allocator over an arena, for the containers of user code. deallocate is a no-op, so the containers must
+ * not outlive the scope they are allocated in. Without an arena it falls back to the heap.
+ */
+template <typename T>
+class ArenaAllocator {
+ public:
+  using value_type = T;
+
+  explicit ArenaAllocator(Arena* arena = Arena::Current()) : arena_(arena) {}
+
+  template <typename U>
+  ArenaAllocator(const ArenaAllocator<U>& other) : arena_(other.GetArena()) {}
+
+  T* allocate(size_t n) {
+    if (arena_ == nullptr) {
+      return std::allocator<T>().allocate(n);
+    }
+    return static_cast<T*>(arena_->Allocate(n * sizeof(T), alignof(T)));
+  }
+
+  void deallocate(T* ptr, size_t n) {
+    if (arena_ == nullptr) {
+      std::allocator<T>().deallocate(ptr, n);
+    }
+  }
+
+  inline Arena* GetArena() const { return arena_; }
+
+  template <typename U>
+  bool operator==(const ArenaAllocator<U>& other) const {
+    return arena_ == other.GetArena();
+  }
+  template <typename U>
+  bool operator!=(const ArenaAllocator<U>& other) const {
+    return arena_ != other.GetArena();
+  }
+
+ private:
+  Arena* arena_;
+};
+
+}  // namespace base
+}  // namespace axe
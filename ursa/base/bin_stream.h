@@ -52,6 +52,16 @@ class BinStream {
 
   void append(const BinStream& m);
   void push_back_bytes(const char* src, size_t sz);
+  /// Grow the buffer by sz bytes and return the pointer to the new region, so that callers can fill it in place.
+  inline char* extend(size_t sz) {
+    auto old_size = buffer_.size();
+    buffer_.resize(old_size + sz);
+    return buffer_.data() + old_size;
+  }
+  /// Reserve room for another sz bytes.
+  inline void reserve(size_t sz) { buffer_.reserve(buffer_.size() + sz); }
+  /// Drop the last sz bytes, e.g. the unused part of a region returned by extend.
+  inline void pop_back_bytes(size_t sz) { buffer_.resize(buffer_.size() - sz); }
   virtual void* pop_front_bytes(size_t sz);
   virtual size_t size() const { return buffer_.size() - front_; }
 
@@ -101,6 +111,21 @@ class has_deserialize {
   static constexpr bool value = type::value;
 };
 
+/** Stand-in for a T in the overload resolution of has_free_serializer: it converts to T only, and the generic raw-byte
+ * operators below exclude it, so that a call with it finds the operators written for T (or a base of T) only.
+ */
+template <typename T>
+struct serializer_probe {
+  operator const T&() const;
+  operator T&();
+};
+
+template <typename T>
+struct is_serializer_probe : std::false_type {};
+
+template <typename T>
+struct is_serializer_probe<serializer_probe<T>> : std::true_type {};
+
 template <typename InputT>
 typename std::enable_if<has_serialize<InputT>::value, BinStream>::type& operator<<(BinStream& stream, const InputT& x) {
   x.serialize(stream);
@@ -114,30 +139,153 @@ typename std::enable_if<has_deserialize<OutputT>::value, BinStream>::type& opera
 }
 
 template <typename InputT>
-typename std::enable_if<!has_serialize<InputT>::value, BinStream>::type& operator<<(BinStream& stream, const InputT& x) {
+typename std::enable_if<!has_serialize<InputT>::value && !is_serializer_probe<InputT>::value, BinStream>::type& operator<<(BinStream& stream,
+                                                                                                                         const InputT& x) {
   static_assert(IS_TRIVIALLY_COPYABLE(InputT), "For non trivially copyable type, serialization functions are needed");
   stream.push_back_bytes((char*) &x, sizeof(InputT));
   return stream;
 }
 
 template <typename OutputT>
-typename std::enable_if<!has_deserialize<OutputT>::value, BinStream>::type& operator>>(BinStream& stream, OutputT& x) {
+typename std::enable_if<!has_deserialize<OutputT>::value && !is_serializer_probe<OutputT>::value, BinStream>::type& operator>>(BinStream& stream,
+                                                                                                                             OutputT& x) {
   static_assert(IS_TRIVIALLY_COPYABLE(OutputT), "For non trivially copyable type, serialization functions are needed");
   x = *(OutputT*) (stream.pop_front_bytes(sizeof(OutputT)));
   return stream;
 }
 
+/** Whether a free operator<< or operator>> is declared for T, e.g. a friend of T, so that T is not written as raw bytes. **/
+template <typename T>
+class has_free_serializer {
+ private:
+  template <typename U>
+  static constexpr auto check(int) -> decltype(std::declval<BinStream&>() << std::declval<const serializer_probe<U>&>(), std::true_type());
+
+  template <typename U>
+  static constexpr auto check(long) -> decltype(std::declval<BinStream&>() >> std::declval<serializer_probe<U>&>(), std::true_type());
+
+  template <typename>
+  static constexpr std::false_type check(...);
+
+  typedef decltype(check<T>(0)) type;
+
+ public:
+  static constexpr bool value = type::value;
+};
+
+/** Packer of the types whose BinStream encoding is their raw bytes, i.e. trivially copyable types without serialize
+ * functions or free operators, and std::pair of such types. A pair is packed field by field, the same as operator<<
+ * does, so its packed size may be smaller than sizeof when the pair has padding.
+ */
+template <typename T, typename Enable = void>
+struct is_packable : std::integral_constant<bool, IS_TRIVIALLY_COPYABLE(T) && !has_serialize<T>::value && !has_deserialize<T>::value &&
+                                                      !has_free_serializer<T>::value> {};
+
+template <typename FirstT, typename SecondT>
+struct is_packable<std::pair<FirstT, SecondT>> : std::integral_constant<bool, is_packable<FirstT>::value && is_packable<SecondT>::value> {};
+
+template <typename T>
+struct packer {
+  static constexpr size_t size = sizeof(T);
+  static constexpr bool is_memcpy = true;  // whether the packed bytes of an array are exactly its memory layout
+
+  static inline char* pack(char* dst, const T& x) {
+    std::memcpy(dst, &x, sizeof(T));
+    return dst + sizeof(T);
+  }
+  static inline const char* unpack(const char* src, T& x) {
+    std::memcpy(&x, src, sizeof(T));
+    return src + sizeof(T);
+  }
+};
+
+template <typename FirstT, typename SecondT>
+struct packer<std::pair<FirstT, SecondT>> {
+  static constexpr size_t size = packer<FirstT>::size + packer<SecondT>::size;
+  static constexpr bool is_memcpy = packer<FirstT>::is_memcpy && packer<SecondT>::is_memcpy && size == sizeof(std::pair<FirstT, SecondT>);
+
+  static inline char* pack(char* dst, const std::pair<FirstT, SecondT>& x) {
+    return packer<SecondT>::pack(packer<FirstT>::pack(dst, x.first), x.second);
+  }
+  static inline const char* unpack(const char* src, std::pair<FirstT, SecondT>& x) {
+    return packer<SecondT>::unpack(packer<FirstT>::unpack(src, x.first), x.second);
+  }
+};
+
+/** Packable types whose array layout in memory is exactly their packed bytes, so that a buffer can be read in place. **/
+template <typename T, bool = is_packable<T>::value>
+struct is_memcpy_packable : std::integral_constant<bool, packer<T>::is_memcpy> {};
+
+template <typename T>
+struct is_memcpy_packable<T, false> : std::false_type {};
+
+/** Serialize n contiguous values. Packable values are written with a single reserve and memcpy, producing the same
+ * bytes as n calls of operator<<.
+ */
+template <typename InputT>
+typename std::enable_if<is_packable<InputT>::value>::type SerializeRange(BinStream& stream, const InputT* data, size_t n) {
+  if (n == 0) {
+    return;
+  }
+  if (packer<InputT>::is_memcpy) {
+    stream.push_back_bytes(reinterpret_cast<const char*>(data), n * sizeof(InputT));
+    return;
+  }
+  char* dst = stream.extend(n * packer<InputT>::size);
+  for (size_t i = 0; i < n; ++i) {
+    dst = packer<InputT>::pack(dst, data[i]);
+  }
+}
+
+template <typename InputT>
+typename std::enable_if<!is_packable<InputT>::value>::type SerializeRange(BinStream& stream, const InputT* data, size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    stream << data[i];
+  }
+}
+
+/** Deserialize n values into the pre-sized destination dst. Packable values are read in a single pass. **/
+template <typename OutputT>
+typename std::enable_if<is_packable<OutputT>::value>::type DeserializeRange(BinStream& stream, OutputT* dst, size_t n) {
+  if (n == 0) {
+    return;
+  }
+  auto src = static_cast<const char*>(stream.pop_front_bytes(n * packer<OutputT>::size));
+  if (packer<OutputT>::is_memcpy) {
+    std::memcpy(reinterpret_cast<char*>(dst), src, n * sizeof(OutputT));
+    return;
+  }
+  for (size_t i = 0; i < n; ++i) {
+    src = packer<OutputT>::unpack(src, dst[i]);
+  }
+}
+
+template <typename OutputT>
+typename std::enable_if<!is_packable<OutputT>::value>::type DeserializeRange(BinStream& stream, OutputT* dst, size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    stream >> dst[i];
+  }
+}
+
 template <typename InputT>
 BinStream& operator<<(BinStream& stream, const std::vector<InputT>& v) {
   size_t len = v.size();
   stream << len;
-  for (int i = 0; i < v.size(); ++i)
-    stream << v[i];
+  SerializeRange(stream, v.data(), len);
   return stream;
 }
 
 template <typename OutputT>
-BinStream& operator>>(BinStream& stream, std::vector<OutputT>& v) {
+typename std::enable_if<is_packable<OutputT>::value, BinStream>::type& operator>>(BinStream& stream, std::vector<OutputT>& v) {
+  size_t len;
+  stream >> len;
+  v.resize(len);
+  DeserializeRange(stream, v.data(), len);
+  return stream;
+}
+
+template <typename OutputT>
+typename std::enable_if<!is_packable<OutputT>::value, BinStream>::type& operator>>(BinStream& stream, std::vector<OutputT>& v) {
   size_t len;
   stream >> len;
   v.clear();
@@ -272,8 +420,7 @@ template <typename InputT>
 BinStream& operator<<(BinStream& stream, const std::basic_string<InputT>& v) {
   size_t len = v.size();
   stream << len;
-  for (auto& elem : v)
-    stream << elem;
+  SerializeRange(stream, v.data(), len);
   return stream;
 }
 
@@ -287,8 +434,7 @@ BinStream& operator>>(BinStream& stream, std::basic_string<OutputT>& v) {
   } catch (std::exception e) {
     assert(false);
   }
-  for (auto& elem : v)
-    stream >> elem;
+  DeserializeRange(stream, &v[0], len);
   return stream;
 }
 
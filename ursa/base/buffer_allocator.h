@@ -0,0 +1,278 @@
+// Copyright 2020 HDL
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+
+#include "glog/logging.h"
+
+#include "base/properties.h"
+
+namespace axe {
+namespace base {
+
+/** How large buffers (input blocks, partition arrays) are backed. The default keeps every buffer on the heap. **/
+struct BufferAllocationPolicy {
+  enum HugePages { kNone = 0, kTransparent = 1, kExplicit = 2 };
+
+  HugePages huge_pages = kNone;
+  bool numa_local = false;                  // bind large buffers to the NUMA node of the consuming thread
+  size_t large_threshold = 2 * 1024 * 1024;  // buffers of at least this many bytes follow the policy
+
+  inline bool Enabled() const { return huge_pages != kNone || numa_local; }
+
+  /** Parse a policy of comma-separated key=value pairs, e.g. "huge_pages=transparent,numa=local,threshold=4194304".
+   *
+   * huge_pages is one of none, transparent and explicit. numa is local or none.
+   */
+  static BufferAllocationPolicy Parse(const std::string& spec) {
+    BufferAllocationPolicy policy;
+    std::stringstream ss(spec);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+      if (item.empty()) {
+        continue;
+      }
+      auto pos = item.find('=');
+      CHECK(pos != std::string::npos) << "[BufferAllocationPolicy] expect key=value, got " << item;
+      policy.Set(item.substr(0, pos), item.substr(pos + 1));
+    }
+    return policy;
+  }
+
+  /** Read the policy from the buffer_huge_pages, buffer_numa and buffer_large_threshold properties of a worker. The
+   * properties that are not given keep their value in base.
+   */
+  static BufferAllocationPolicy FromProperties(Properties* properties, const BufferAllocationPolicy& base) {
+    BufferAllocationPolicy policy = base;
+    policy.Set("huge_pages", properties->Get("buffer_huge_pages", HugePagesName(base.huge_pages)));
+    policy.Set("numa", properties->Get("buffer_numa", base.numa_local ? "local" : "none"));
+    policy.Set("threshold", properties->Get("buffer_large_threshold", std::to_string(base.large_threshold)));
+    return policy;
+  }
+
+  static BufferAllocationPolicy FromProperties(Properties* properties) { return FromProperties(properties, BufferAllocationPolicy()); }
+
+  std::string DebugString() const {
+    std::stringstream ss;
+    ss << "huge_pages=" << HugePagesName(huge_pages) << ",numa=" << (numa_local ? "local" : "none") << ",threshold=" << large_threshold;
+    return ss.str();
+  }
+
+ private:
+  static const char* HugePagesName(HugePages huge_pages) {
+    return huge_pages == kNone ? "none" : (huge_pages == kTransparent ? "transparent" : "explicit");
+  }
+
+  void Set(const std::string& key, const std::string& value) {
+    if (key == "huge_pages") {
+      CHECK(value == "none" || value == "transparent" || value == "explicit") << "[BufferAllocationPolicy] invalid huge_pages " << value;
+      huge_pages = value == "none" ? kNone : (value == "transparent" ? kTransparent : kExplicit);
+    } else if (key == "numa") {
+      CHECK(value == "none" || value == "local") << "[BufferAllocationPolicy] invalid numa " << value;
+      numa_local = value == "local";
+    } else if (key == "threshold") {
+      large_threshold = std::stoull(value);
+    } else {
+      LOG(FATAL) << "[BufferAllocationPolicy] unknown key " << key;
+    }
+  }
+};
+
+/** Hit and miss counters of the buffer allocator. **/
+struct BufferAllocationStats {
+  uint64_t heap_buffers = 0;         // buffers below the threshold, or with the policy disabled
+  uint64_t large_buffers = 0;        // buffers that followed the policy
+  uint64_t huge_page_hits = 0;       // large buffers backed by (or advised to use) huge pages
+  uint64_t huge_page_misses = 0;     // large buffers that fell back to normal pages
+  uint64_t numa_hits = 0;            // large buffers bound to the requested node
+  uint64_t numa_misses = 0;          // large buffers whose binding failed
+  uint64_t large_bytes = 0;
+
+  std::string DebugString() const {
+    std::stringstream ss;
+    ss << "heap " << heap_buffers << ", large " << large_buffers << " (" << large_bytes << " bytes), huge pages " << huge_page_hits << " hit / "
+       << huge_page_misses << " miss, numa " << numa_hits << " hit / " << numa_misses << " miss";
+    return ss.str();
+  }
+};
+
+/** Process-wide allocator of large buffers, following the BufferAllocationPolicy of the worker.
+ *
+ * Large buffers are mapped anonymously. With explicit huge pages they are mapped with MAP_HUGETLB, falling back to
+ * normal pages when the huge page pool is exhausted; with transparent huge pages they are aligned to the huge page
+ * size and advised with MADV_HUGEPAGE. With NUMA binding they are bound with mbind to the node of the consuming
+ * thread before they are first touched. Small buffers, and every buffer with the policy disabled, come from the heap.
+ *
+ * The policy is first read from the AXE_BUFFER_POLICY environment variable of the worker (see
+ * BufferAllocationPolicy::Parse), then from the properties of the worker's config file, with which the job simulator
+ * configures the allocator; jobs configure it in Job::Run, which every process of the job runs before its tasks.
+ */
+class BufferAllocator {
+ public:
+  static const int kCurrentNode = -1;
+  static const size_t kHugePageSize = 2 * 1024 * 1024;
+
+  static BufferAllocator& Get() {
+    static BufferAllocator allocator;
+    return allocator;
+  }
+
+  void Configure(const BufferAllocationPolicy& policy) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    policy_ = policy;
+    large_threshold_ = policy_.Enabled() ? policy_.large_threshold : SIZE_MAX;
+    LOG(INFO) << "[BufferAllocator] policy " << policy_.DebugString();
+  }
+
+  /** Apply the buffer_* properties of a worker (see BufferAllocationPolicy::FromProperties) over the current policy. **/
+  void Configure(Properties* properties) {
+    if (properties != nullptr) {
+      Configure(BufferAllocationPolicy::FromProperties(properties, GetPolicy()));
+    }
+  }
+
+  BufferAllocationPolicy GetPolicy() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return policy_;
+  }
+
+  /** Whether a buffer of the given size follows the policy rather than coming from the heap. **/
+  inline bool IsLarge(size_t bytes) const { return bytes >= large_threshold_; }
+
+  /** Allocate an uninitialized buffer of bytes, to be consumed by threads on node (by default the calling thread's). **/
+  std::shared_ptr<char> Allocate(size_t bytes, int node = kCurrentNode) {
+    auto policy = IsLarge(bytes) ? GetPolicy() : BufferAllocationPolicy();
+    if (!policy.Enabled() || bytes < policy.large_threshold) {
+      ++heap_buffers_;
+      return std::shared_ptr<char>(new char[bytes], std::default_delete<char[]>());
+    }
+    size_t mapped = 0;
+    char* data = Map(bytes, policy.huge_pages, &mapped);
+    if (policy.numa_local) {
+      Bind(data, mapped, node == kCurrentNode ? GetCurrentNode() : node);
+    }
+    ++large_buffers_;
+    large_bytes_ += bytes;
+    return std::shared_ptr<char>(data, [mapped](char* data) { munmap(data, mapped); });
+  }
+
+  BufferAllocationStats GetStats() const {
+    BufferAllocationStats stats;
+    stats.heap_buffers = heap_buffers_;
+    stats.large_buffers = large_buffers_;
+    stats.huge_page_hits = huge_page_hits_;
+    stats.huge_page_misses = huge_page_misses_;
+    stats.numa_hits = numa_hits_;
+    stats.numa_misses = numa_misses_;
+    stats.large_bytes = large_bytes_;
+    return stats;
+  }
+
+  /** The NUMA node of the CPU the calling thread runs on. **/
+  static int GetCurrentNode() {
+    unsigned cpu = 0, node = 0;
+    if (syscall(SYS_getcpu, &cpu, &node, nullptr) != 0) {
+      return 0;
+    }
+    return node;
+  }
+
+ private:
+  BufferAllocator() {
+    auto spec = std::getenv("AXE_BUFFER_POLICY");
+    if (spec != nullptr) {
+      Configure(BufferAllocationPolicy::Parse(spec));
+    }
+  }
+
+  char* Map(size_t bytes, BufferAllocationPolicy::HugePages huge_pages, size_t* mapped) {
+    if (huge_pages == BufferAllocationPolicy::kExplicit) {
+      *mapped = RoundUp(bytes, kHugePageSize);
+      void* data = mmap(nullptr, *mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+      if (data != MAP_FAILED) {
+        ++huge_page_hits_;
+        return static_cast<char*>(data);
+      }
+      ++huge_page_misses_;
+      DLOG(INFO) << "[BufferAllocator] no explicit huge pages for " << bytes << " bytes, fall back to normal pages";
+    }
+    if (huge_pages != BufferAllocationPolicy::kTransparent) {
+      *mapped = RoundUp(bytes, getpagesize());
+      void* data = mmap(nullptr, *mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      PCHECK(data != MAP_FAILED) << "[BufferAllocator] failed to map " << bytes << " bytes";
+      return static_cast<char*>(data);
+    }
+    // over-map by one huge page and trim, so that the buffer is aligned for transparent huge pages
+    *mapped = RoundUp(bytes, kHugePageSize);
+    void* raw = mmap(nullptr, *mapped + kHugePageSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    PCHECK(raw != MAP_FAILED) << "[BufferAllocator] failed to map " << bytes << " bytes";
+    auto start = reinterpret_cast<uintptr_t>(raw);
+    auto aligned = RoundUp(start, kHugePageSize);
+    if (aligned > start) {
+      munmap(raw, aligned - start);
+    }
+    if (start + kHugePageSize > aligned) {
+      munmap(reinterpret_cast<char*>(aligned + *mapped), start + kHugePageSize - aligned);
+    }
+    char* data = reinterpret_cast<char*>(aligned);
+    if (madvise(data, *mapped, MADV_HUGEPAGE) == 0) {
+      ++huge_page_hits_;
+    } else {
+      ++huge_page_misses_;
+    }
+    return data;
+  }
+
+  void Bind(char* data, size_t bytes, int node) {
+    const int kMpolPreferred = 1;  // MPOL_PREFERRED: fall back to other nodes instead of failing the page fault
+    if (node < 0 || node >= 64) {
+      ++numa_misses_;
+      return;
+    }
+    unsigned long mask = 1UL << node;  // NOLINT(runtime/int)
+    if (syscall(SYS_mbind, data, bytes, kMpolPreferred, &mask, 64, 0) == 0) {
+      ++numa_hits_;
+    } else {
+      ++numa_misses_;
+    }
+  }
+
+  static inline size_t RoundUp(size_t bytes, size_t unit) { return (bytes + unit - 1) / unit * unit; }
+
+  mutable std::mutex mutex_;
+  BufferAllocationPolicy policy_;
+  std::atomic<size_t> large_threshold_{SIZE_MAX};  // threshold of the policy, or SIZE_MAX when it is disabled
+  std::atomic<uint64_t> heap_buffers_{0};
+  std::atomic<uint64_t> large_buffers_{0};
+  std::atomic<uint64_t> huge_page_hits_{0};
+  std::atomic<uint64_t> huge_page_misses_{0};
+  std::atomic<uint64_t> numa_hits_{0};
+  std::atomic<uint64_t> numa_misses_{0};
+  std::atomic<uint64_t> large_bytes_{0};
+};
+
+}  // namespace base
+}  // namespace axe
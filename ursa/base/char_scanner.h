@@ -0,0 +1,155 @@
+// Copyright 2020 HDL
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstdint>
+
+#include <algorithm>
+#include <string_view>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define URSA_CHAR_SCANNER_X86
+#endif
+
+#include "glog/logging.h"
+
+namespace axe {
+namespace base {
+
+/** Finds the bytes of a small set of characters in a buffer, 64 bytes per mask word.
+ *
+ * The bytes are compared 32 at a time with AVX2 when the CPU supports it (checked once at run time, so the binary
+ * needs no -mavx2), 16 at a time with SSE2 otherwise, and one at a time on other architectures. The vector code runs
+ * over chunks of up to kChunkBytes bytes per call, and the callers walk the mask words with bit operations.
+ */
+class CharScanner {
+ public:
+  static constexpr size_t kChunkBytes = 1024;
+  static constexpr size_t kChunkWords = kChunkBytes / 64;
+  static constexpr size_t kMaxChars = 8;
+
+  /** Set bit i % 64 of masks[i / 64] if data[i] is one of chars, for i < size. **/
+  static void Match(const char* data, size_t size, std::string_view chars, uint64_t* masks) {
+    CHECK_LE(chars.size(), kMaxChars) << "[CharScanner] at most " << kMaxChars << " characters are matched at a time";
+    size_t full = 0;
+#ifdef URSA_CHAR_SCANNER_X86
+    full = size / 64 * 64;
+    if (HasAvx2()) {
+      MatchAvx2(data, full, chars, masks);
+    } else {
+      MatchSse2(data, full, chars, masks);
+    }
+#endif
+    MatchScalar(data + full, size - full, chars, masks + full / 64);
+  }
+
+  /** The position of the first c in str at or after pos, or std::string_view::npos. **/
+  static size_t FindNext(std::string_view str, size_t pos, char c) {
+    uint64_t masks[kChunkWords];
+    // start with a short window, since the next character is usually close, e.g. the end of a line
+    for (size_t window = 64; pos < str.size(); pos += window, window = std::min(window * 2, kChunkBytes)) {
+      size_t n = std::min(window, str.size() - pos);
+      Match(str.data() + pos, n, std::string_view(&c, 1), masks);
+      for (size_t w = 0; w * 64 < n; ++w) {
+        if (masks[w] != 0) {
+          return pos + w * 64 + __builtin_ctzll(masks[w]);
+        }
+      }
+    }
+    return std::string_view::npos;
+  }
+
+  /** Append the positions of all the c in str to offsets, in one pass. **/
+  template <typename Offset>
+  static void FindAll(std::string_view str, char c, std::vector<Offset>* offsets) {
+    uint64_t masks[kChunkWords];
+    for (size_t pos = 0; pos < str.size(); pos += kChunkBytes) {
+      size_t n = std::min(kChunkBytes, str.size() - pos);
+      Match(str.data() + pos, n, std::string_view(&c, 1), masks);
+      for (size_t w = 0; w * 64 < n; ++w) {
+        for (uint64_t bits = masks[w]; bits != 0; bits &= bits - 1) {
+          offsets->push_back(static_cast<Offset>(pos + w * 64 + __builtin_ctzll(bits)));
+        }
+      }
+    }
+  }
+
+ protected:
+  /** Match a byte at a time. **/
+  static void MatchScalar(const char* data, size_t size, std::string_view chars, uint64_t* masks) {
+    for (size_t begin = 0; begin < size; begin += 64) {
+      uint64_t mask = 0;
+      for (size_t i = begin; i < std::min(size, begin + 64); ++i) {
+        mask |= uint64_t(chars.find(data[i]) != std::string_view::npos) << (i - begin);
+      }
+      masks[begin / 64] = mask;
+    }
+  }
+
+#ifdef URSA_CHAR_SCANNER_X86
+  static bool HasAvx2() {
+#ifdef __AVX2__
+    return true;
+#else
+    static const bool has_avx2 = __builtin_cpu_supports("avx2");
+    return has_avx2;
+#endif
+  }
+
+  /** Match over size bytes, a multiple of 64. **/
+  static void MatchSse2(const char* data, size_t size, std::string_view chars, uint64_t* masks) {
+    __m128i needles[kMaxChars];
+    for (size_t k = 0; k < chars.size(); ++k) {
+      needles[k] = _mm_set1_epi8(chars[k]);
+    }
+    for (size_t i = 0; i < size; i += 64) {
+      uint64_t mask = 0;
+      for (size_t j = 0; j < 64; j += 16) {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + j));
+        __m128i hits = _mm_setzero_si128();
+        for (size_t k = 0; k < chars.size(); ++k) {
+          hits = _mm_or_si128(hits, _mm_cmpeq_epi8(bytes, needles[k]));
+        }
+        mask |= uint64_t(static_cast<uint16_t>(_mm_movemask_epi8(hits))) << j;
+      }
+      masks[i / 64] = mask;
+    }
+  }
+
+  __attribute__((target("avx2"))) static void MatchAvx2(const char* data, size_t size, std::string_view chars, uint64_t* masks) {
+    __m256i needles[kMaxChars];
+    for (size_t k = 0; k < chars.size(); ++k) {
+      needles[k] = _mm256_set1_epi8(chars[k]);
+    }
+    for (size_t i = 0; i < size; i += 64) {
+      uint64_t mask = 0;
+      for (size_t j = 0; j < 64; j += 32) {
+        __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i + j));
+        __m256i hits = _mm256_setzero_si256();
+        for (size_t k = 0; k < chars.size(); ++k) {
+          hits = _mm256_or_si256(hits, _mm256_cmpeq_epi8(bytes, needles[k]));
+        }
+        mask |= uint64_t(static_cast<uint32_t>(_mm256_movemask_epi8(hits))) << j;
+      }
+      masks[i / 64] = mask;
+    }
+  }
+#endif
+};
+
+}  // namespace base
+}  // namespace axe
@@ -0,0 +1,276 @@
+// Copyright 2020 HDL
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "glog/logging.h"
+
+#include "base/bin_stream.h"
+
+namespace axe {
+namespace base {
+
+/** Opt-in switch of the compact encoding for a message record type.
+ *
+ * Specialize to std::true_type for a record type to make the shuffle operators encode its runs with LEB128 varints
+ * and varint length prefixes, e.g.
+ *   namespace axe { namespace base {
+ *   template <> struct use_compact_encoding<std::pair<int, double>> : std::true_type {};
+ *   } }
+ * The record may be a packable type, or a std::pair, std::vector or std::string of such types. The specialization must
+ * be visible wherever the dataset operators of the type are instantiated.
+ */
+template <typename T>
+struct use_compact_encoding : std::false_type {};
+
+const size_t kMaxVarintSize = 10;
+
+inline char* PutVarint(char* dst, uint64_t value) {
+  while (value >= 0x80) {
+    *dst++ = static_cast<char>(value | 0x80);
+    value >>= 7;
+  }
+  *dst++ = static_cast<char>(value);
+  return dst;
+}
+
+inline const char* GetVarint(const char* src, const char* end, uint64_t* value) {
+  uint64_t result = 0;
+  for (int shift = 0; shift < 64 && src < end; shift += 7) {
+    auto byte = static_cast<uint8_t>(*src++);
+    result |= static_cast<uint64_t>(byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0) {
+      *value = result;
+      return src;
+    }
+  }
+  LOG(FATAL) << "[CompactEncoding] truncated or malformed varint";
+  return end;
+}
+
+inline uint64_t ZigZagEncode(int64_t value) { return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63); }
+inline int64_t ZigZagDecode(uint64_t value) { return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1); }
+
+/** Compact codec of a record: integers as varints (zigzag for signed ones), vectors and strings with a varint length
+ * prefix, other packable fields as raw bytes. bound(x) is an upper bound of the encoded size of x.
+ */
+template <typename T, typename Enable = void>
+struct compact_codec {
+  static_assert(is_packable<T>::value, "The compact encoding supports packable types, and std::pair, std::vector and std::string of them");
+
+  static inline size_t bound(const T&) { return sizeof(T); }
+  static inline char* encode(char* dst, const T& x) { return packer<T>::pack(dst, x); }
+  static inline const char* decode(const char* src, const char* end, T& x) {
+    CHECK_GE(end - src, static_cast<ptrdiff_t>(packer<T>::size)) << "[CompactEncoding] truncated record";
+    return packer<T>::unpack(src, x);
+  }
+};
+
+template <typename T>
+struct compact_codec<T, typename std::enable_if<std::is_integral<T>::value>::type> {
+  static inline uint64_t to_unsigned(T x) { return std::is_signed<T>::value ? ZigZagEncode(static_cast<int64_t>(x)) : static_cast<uint64_t>(x); }
+  static inline T from_unsigned(uint64_t x) { return std::is_signed<T>::value ? static_cast<T>(ZigZagDecode(x)) : static_cast<T>(x); }
+
+  static inline size_t bound(const T&) { return kMaxVarintSize; }
+  static inline char* encode(char* dst, const T& x) { return PutVarint(dst, to_unsigned(x)); }
+  static inline const char* decode(const char* src, const char* end, T& x) {
+    uint64_t value;
+    src = GetVarint(src, end, &value);
+    x = from_unsigned(value);
+    return src;
+  }
+};
+
+template <typename FirstT, typename SecondT>
+struct compact_codec<std::pair<FirstT, SecondT>> {
+  static inline size_t bound(const std::pair<FirstT, SecondT>& x) {
+    return compact_codec<FirstT>::bound(x.first) + compact_codec<SecondT>::bound(x.second);
+  }
+  static inline char* encode(char* dst, const std::pair<FirstT, SecondT>& x) {
+    return compact_codec<SecondT>::encode(compact_codec<FirstT>::encode(dst, x.first), x.second);
+  }
+  static inline const char* decode(const char* src, const char* end, std::pair<FirstT, SecondT>& x) {
+    return compact_codec<SecondT>::decode(compact_codec<FirstT>::decode(src, end, x.first), end, x.second);
+  }
+};
+
+/** Read a varint length prefix, which cannot exceed the bytes left as every element takes at least one byte. **/
+inline const char* GetLength(const char* src, const char* end, uint64_t* length) {
+  src = GetVarint(src, end, length);
+  CHECK_LE(*length, static_cast<uint64_t>(end - src)) << "[CompactEncoding] length exceeds the " << end - src << " bytes left";
+  return src;
+}
+
+template <typename T>
+struct compact_codec<std::vector<T>> {
+  static inline size_t bound(const std::vector<T>& v) {
+    size_t size = kMaxVarintSize;
+    for (auto& x : v) {
+      size += compact_codec<T>::bound(x);
+    }
+    return size;
+  }
+  static inline char* encode(char* dst, const std::vector<T>& v) {
+    dst = PutVarint(dst, v.size());
+    for (auto& x : v) {
+      dst = compact_codec<T>::encode(dst, x);
+    }
+    return dst;
+  }
+  static inline const char* decode(const char* src, const char* end, std::vector<T>& v) {
+    uint64_t length;
+    src = GetLength(src, end, &length);
+    v.resize(length);
+    for (auto& x : v) {
+      src = compact_codec<T>::decode(src, end, x);
+    }
+    return src;
+  }
+};
+
+template <>
+struct compact_codec<std::string> {
+  static inline size_t bound(const std::string& str) { return kMaxVarintSize + str.size(); }
+  static inline char* encode(char* dst, const std::string& str) {
+    dst = PutVarint(dst, str.size());
+    std::memcpy(dst, str.data(), str.size());
+    return dst + str.size();
+  }
+  static inline const char* decode(const char* src, const char* end, std::string& str) {
+    uint64_t length;
+    src = GetLength(src, end, &length);
+    str.assign(src, length);
+    return src + length;
+  }
+};
+
+/** Codec of a record within a run. Integer records and pairs keyed by an integer have their key delta-encoded against
+ * the previous record of the run, so sorted keys cost one or two bytes each. Other records use compact_codec.
+ */
+template <typename T, typename Enable = void>
+struct compact_run_codec {
+  static constexpr bool delta_coded = false;
+
+  static inline size_t bound(const T& x) { return compact_codec<T>::bound(x); }
+  static inline char* encode(char* dst, const T& x, uint64_t*) { return compact_codec<T>::encode(dst, x); }
+  static inline const char* decode(const char* src, const char* end, T& x, uint64_t*) { return compact_codec<T>::decode(src, end, x); }
+};
+
+template <typename T>
+struct compact_run_codec<T, typename std::enable_if<std::is_integral<T>::value>::type> {
+  static constexpr bool delta_coded = true;
+
+  static inline const T& key(const T& x) { return x; }
+  static inline size_t bound(const T&) { return kMaxVarintSize; }
+  // deltas are taken in wrapping 64-bit arithmetic, so they are exact for every integer type
+  static inline char* encode(char* dst, const T& x, uint64_t* prev_key) {
+    auto key = static_cast<uint64_t>(static_cast<typename std::conditional<std::is_signed<T>::value, int64_t, uint64_t>::type>(x));
+    dst = PutVarint(dst, ZigZagEncode(static_cast<int64_t>(key - *prev_key)));
+    *prev_key = key;
+    return dst;
+  }
+  static inline const char* decode(const char* src, const char* end, T& x, uint64_t* prev_key) {
+    uint64_t delta;
+    src = GetVarint(src, end, &delta);
+    *prev_key += static_cast<uint64_t>(ZigZagDecode(delta));
+    x = static_cast<T>(*prev_key);
+    return src;
+  }
+};
+
+template <typename KeyT, typename ValueT>
+struct compact_run_codec<std::pair<KeyT, ValueT>, typename std::enable_if<std::is_integral<KeyT>::value>::type> {
+  static constexpr bool delta_coded = true;
+
+  static inline const KeyT& key(const std::pair<KeyT, ValueT>& x) { return x.first; }
+  static inline size_t bound(const std::pair<KeyT, ValueT>& x) { return kMaxVarintSize + compact_codec<ValueT>::bound(x.second); }
+  static inline char* encode(char* dst, const std::pair<KeyT, ValueT>& x, uint64_t* prev_key) {
+    return compact_codec<ValueT>::encode(compact_run_codec<KeyT>::encode(dst, x.first, prev_key), x.second);
+  }
+  static inline const char* decode(const char* src, const char* end, std::pair<KeyT, ValueT>& x, uint64_t* prev_key) {
+    return compact_codec<ValueT>::decode(compact_run_codec<KeyT>::decode(src, end, x.first, prev_key), end, x.second);
+  }
+};
+
+/** Serialize the n records get(0), ..., get(n - 1) as one compact run: a varint record count followed by the compact
+ * records.
+ */
+template <typename Getter>
+void SerializeCompactRun(BinStream& stream, size_t n, Getter get) {
+  using InputT = typename std::decay<decltype(get(0))>::type;
+  size_t capacity = kMaxVarintSize;
+  for (size_t i = 0; i < n; ++i) {
+    capacity += compact_run_codec<InputT>::bound(get(i));
+  }
+  char* begin = stream.extend(capacity);
+  char* dst = PutVarint(begin, n);
+  uint64_t prev_key = 0;
+  for (size_t i = 0; i < n; ++i) {
+    dst = compact_run_codec<InputT>::encode(dst, get(i), &prev_key);
+  }
+  stream.pop_back_bytes(capacity - (dst - begin));
+}
+
+/** Serialize n contiguous records as one compact run. **/
+template <typename InputT>
+void SerializeCompactRun(BinStream& stream, const InputT* data, size_t n) {
+  SerializeCompactRun(stream, n, [data](size_t i) -> const InputT& { return data[i]; });
+}
+
+/** Serialize the records data[index[0]], ..., data[index[n - 1]] as one compact run. **/
+template <typename InputT, typename IndexT>
+void SerializeCompactRun(BinStream& stream, const InputT* data, const IndexT* index, size_t n) {
+  SerializeCompactRun(stream, n, [data, index](size_t i) -> const InputT& { return data[index[i]]; });
+}
+
+/** Order the indices of the records of a run by their delta-coded key, so that each key costs one or two bytes. No-op
+ * for records without a delta-coded key.
+ */
+template <typename InputT, typename IndexT>
+typename std::enable_if<compact_run_codec<InputT>::delta_coded>::type SortCompactRun(const InputT* data, IndexT* index, size_t n) {
+  std::sort(index, index + n,
+            [data](IndexT a, IndexT b) { return compact_run_codec<InputT>::key(data[a]) < compact_run_codec<InputT>::key(data[b]); });
+}
+
+template <typename InputT, typename IndexT>
+typename std::enable_if<!compact_run_codec<InputT>::delta_coded>::type SortCompactRun(const InputT*, IndexT*, size_t) {}
+
+/** Deserialize one compact run and append its records to out, which provides size(), resize() and data(). **/
+template <typename OutputT, typename Container>
+void DeserializeCompactRun(BinStream& stream, Container* out) {
+  const char* begin = stream.get_remained_buffer();
+  const char* end = begin + stream.size();
+  uint64_t n;
+  // every record takes at least one byte, so a larger count is corrupt and must not size the output
+  const char* src = GetLength(begin, end, &n);
+  auto offset = out->size();
+  out->resize(offset + n);
+  auto dst = out->data() + offset;
+  uint64_t prev_key = 0;
+  for (uint64_t i = 0; i < n; ++i) {
+    src = compact_run_codec<OutputT>::decode(src, end, dst[i], &prev_key);
+  }
+  stream.pop_front_bytes(src - begin);
+}
+
+}  // namespace base
+}  // namespace axe
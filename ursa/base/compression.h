@@ -0,0 +1,334 @@
+// Copyright 2020 HDL
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "glog/logging.h"
+
+#include "base/bin_stream.h"
+
+namespace axe {
+namespace base {
+
+/** Block compression codec. Ids identify the codec on the wire, and id 0 is reserved for uncompressed blocks. **/
+class CompressionCodec {
+ public:
+  virtual ~CompressionCodec() {}
+
+  virtual uint8_t GetId() const = 0;
+  virtual std::string GetName() const = 0;
+  /** The size of the dst buffer that Compress needs for size input bytes. **/
+  virtual size_t MaxCompressedSize(size_t size) const = 0;
+  /** Compress size bytes from src into dst, and return the compressed size. **/
+  virtual size_t Compress(const char* src, size_t size, char* dst) const = 0;
+  /** Decompress size bytes from src into dst, which holds exactly raw_size bytes. Return false if src is corrupted. **/
+  virtual bool Decompress(const char* src, size_t size, char* dst, size_t raw_size) const = 0;
+};
+
+/** LZ77 codec with an LZ4-style block format, tuned for speed rather than ratio.
+ *
+ * A block is a sequence of (token, literals, offset, match length) records. The high nibble of the token is the
+ * literal length and the low nibble is the match length minus 4, each continued in 255-valued bytes when it is 15.
+ * Offsets are 2 bytes little-endian. The last record has literals only.
+ */
+class LZCodec : public CompressionCodec {
+ public:
+  static constexpr uint8_t kId = 1;
+
+  uint8_t GetId() const override { return kId; }
+  std::string GetName() const override { return "lz"; }
+  size_t MaxCompressedSize(size_t size) const override { return size + size / 255 + 16; }
+
+  size_t Compress(const char* src, size_t size, char* dst) const override {
+    uint32_t table[kHashTableSize];
+    std::memset(table, 0, sizeof(table));
+    const char* ip = src;
+    const char* anchor = src;
+    const char* end = src + size;
+    char* op = dst;
+    while (ip + kMinMatch <= end) {
+      auto sequence = Load32(ip);
+      auto& slot = table[Hash(sequence)];
+      const char* ref = src + slot;
+      slot = static_cast<uint32_t>(ip - src);
+      if (ref < ip && ip - ref <= kMaxOffset && Load32(ref) == sequence) {
+        size_t match_len = kMinMatch;
+        while (ip + match_len < end && ref[match_len] == ip[match_len]) {
+          ++match_len;
+        }
+        char* token = op;
+        op = WriteLiterals(op, anchor, ip - anchor);
+        *op++ = static_cast<char>((ip - ref) & 0xff);
+        *op++ = static_cast<char>((ip - ref) >> 8);
+        op = WriteMatchLength(token, op, match_len - kMinMatch);
+        ip += match_len;
+        anchor = ip;
+      } else {
+        // skip faster over incompressible input
+        ip += 1 + ((ip - anchor) >> 6);
+      }
+    }
+    op = WriteLiterals(op, anchor, end - anchor);
+    return op - dst;
+  }
+
+  bool Decompress(const char* src, size_t size, char* dst, size_t raw_size) const override {
+    const char* ip = src;
+    const char* iend = src + size;
+    char* op = dst;
+    char* oend = dst + raw_size;
+    while (ip < iend) {
+      auto token = static_cast<uint8_t>(*ip++);
+      size_t literal_len = token >> 4;
+      if (literal_len == 15 && !ReadLength(&ip, iend, &literal_len)) {
+        return false;
+      }
+      if (literal_len > static_cast<size_t>(iend - ip) || literal_len > static_cast<size_t>(oend - op)) {
+        return false;
+      }
+      std::memcpy(op, ip, literal_len);
+      ip += literal_len;
+      op += literal_len;
+      if (ip == iend) {
+        break;
+      }
+      if (iend - ip < 2) {
+        return false;
+      }
+      size_t offset = static_cast<uint8_t>(ip[0]) | (static_cast<size_t>(static_cast<uint8_t>(ip[1])) << 8);
+      ip += 2;
+      size_t match_len = token & 0xf;
+      if (match_len == 15 && !ReadLength(&ip, iend, &match_len)) {
+        return false;
+      }
+      match_len += kMinMatch;
+      if (offset == 0 || offset > static_cast<size_t>(op - dst) || match_len > static_cast<size_t>(oend - op)) {
+        return false;
+      }
+      // the match may overlap its own output, so copy forward byte by byte
+      const char* ref = op - offset;
+      for (size_t i = 0; i < match_len; ++i) {
+        op[i] = ref[i];
+      }
+      op += match_len;
+    }
+    return op == oend;
+  }
+
+ private:
+  static const size_t kMinMatch = 4;
+  static const ptrdiff_t kMaxOffset = 65535;
+  static const int kHashBits = 12;
+  static const size_t kHashTableSize = 1 << kHashBits;
+
+  static inline uint32_t Load32(const char* p) {
+    uint32_t ret;
+    std::memcpy(&ret, p, sizeof(ret));
+    return ret;
+  }
+  static inline uint32_t Hash(uint32_t sequence) { return (sequence * 2654435761u) >> (32 - kHashBits); }
+
+  static inline char* WriteLength(char* op, size_t len) {
+    for (len -= 15; len >= 255; len -= 255) {
+      *op++ = static_cast<char>(255);
+    }
+    *op++ = static_cast<char>(len);
+    return op;
+  }
+
+  /** Write a token with the literal length and the literals. The match nibble is filled in by WriteMatchLength. **/
+  static inline char* WriteLiterals(char* op, const char* literals, size_t literal_len) {
+    *op++ = static_cast<char>((literal_len < 15 ? literal_len : 15) << 4);
+    if (literal_len >= 15) {
+      op = WriteLength(op, literal_len);
+    }
+    std::memcpy(op, literals, literal_len);
+    return op + literal_len;
+  }
+
+  static inline char* WriteMatchLength(char* token, char* op, size_t match_len) {
+    *token = static_cast<char>(*token | (match_len < 15 ? match_len : 15));
+    return match_len >= 15 ? WriteLength(op, match_len) : op;
+  }
+
+  static inline bool ReadLength(const char** ip, const char* iend, size_t* len) {
+    uint8_t byte;
+    do {
+      if (*ip >= iend) {
+        return false;
+      }
+      byte = static_cast<uint8_t>(*(*ip)++);
+      *len += byte;
+    } while (byte == 255);
+    return true;
+  }
+};
+
+/** Process-wide registry of compression codecs, looked up by wire id or by name. The LZ codec is built in. **/
+class CompressionCodecRegistry {
+ public:
+  static void Register(const std::shared_ptr<const CompressionCodec>& codec) {
+    CHECK(codec != nullptr);
+    CHECK_NE(codec->GetId(), 0) << "Codec id 0 is reserved for uncompressed blocks";
+    auto& registry = Get();
+    std::lock_guard<std::mutex> lock(registry.mutex_);
+    auto existing = registry.codecs_.find(codec->GetId());
+    CHECK(existing == registry.codecs_.end() || existing->second->GetName() == codec->GetName())
+        << "Codec id " << static_cast<int>(codec->GetId()) << " is already registered as " << existing->second->GetName();
+    registry.codecs_[codec->GetId()] = codec;
+  }
+
+  static std::shared_ptr<const CompressionCodec> GetCodec(uint8_t id) {
+    auto& registry = Get();
+    std::lock_guard<std::mutex> lock(registry.mutex_);
+    auto pos = registry.codecs_.find(id);
+    return pos == registry.codecs_.end() ? nullptr : pos->second;
+  }
+
+  static std::shared_ptr<const CompressionCodec> GetCodec(const std::string& name) {
+    auto& registry = Get();
+    std::lock_guard<std::mutex> lock(registry.mutex_);
+    for (auto& id_codec : registry.codecs_) {
+      if (id_codec.second->GetName() == name) {
+        return id_codec.second;
+      }
+    }
+    return nullptr;
+  }
+
+ private:
+  CompressionCodecRegistry() { codecs_[LZCodec::kId] = std::make_shared<LZCodec>(); }
+
+  static CompressionCodecRegistry& Get() {
+    static CompressionCodecRegistry registry;
+    return registry;
+  }
+
+  std::mutex mutex_;
+  std::map<uint8_t, std::shared_ptr<const CompressionCodec>> codecs_;
+};
+
+/** Compresses the payload of message streams in place and switches itself off when compression does not pay.
+ *
+ * The writer of a message reserves a flag byte set to kUncompressed right before the payload, so that a payload sent
+ * as is is never moved. A compressed payload is framed as [codec id][raw size][compressed bytes], with the codec id
+ * written over the flag. A payload is sent as is when it is small or compresses worse than max_ratio. The ratio is
+ * measured over windows of min_samples compressed payloads: compression is skipped while the ratio of the last window
+ * is worse than max_ratio, except for one payload in every min_samples, which is compressed to measure the next
+ * window, so that compression is resumed when the data becomes compressible again.
+ * One compressor is shared by the shards of a shuffle operator in a process, so the counters are atomic.
+ */
+class MessageCompressor {
+ public:
+  static constexpr uint8_t kUncompressed = 0;
+
+  explicit MessageCompressor(const std::shared_ptr<const CompressionCodec>& codec, double max_ratio = 0.9, size_t min_samples = 8,
+                             size_t min_payload_size = 256)
+      : codec_(codec), max_ratio_(max_ratio), min_samples_(min_samples), min_payload_size_(min_payload_size) {
+    CHECK(codec_ != nullptr);
+  }
+
+  /** Compress the bytes of an unread stream that follow its first payload_offset bytes, the last of which is the flag. **/
+  void Compress(BinStream* stream, size_t payload_offset) {
+    CHECK_GE(payload_offset, sizeof(kUncompressed));
+    CHECK_GE(stream->size(), payload_offset);
+    auto payload_size = stream->size() - payload_offset;
+    if (payload_size < min_payload_size_ || (disabled_.load(std::memory_order_relaxed) && ++n_skipped_ % min_samples_ != 0)) {
+      return;
+    }
+    char* flag = stream->get_buffer() + (stream->get_total_size() - stream->size()) + payload_offset - sizeof(kUncompressed);
+    CHECK_EQ(static_cast<uint8_t>(*flag), kUncompressed) << "The compression flag of the message is not reserved";
+    std::vector<char> compressed(codec_->MaxCompressedSize(payload_size));
+    auto compressed_size = codec_->Compress(stream->get_remained_buffer() + payload_offset, payload_size, compressed.data());
+    raw_bytes_ += payload_size;
+    if (compressed_size > max_ratio_ * payload_size) {
+      compressed_bytes_ += payload_size;
+    } else {
+      compressed_bytes_ += compressed_size;
+      *flag = static_cast<char>(codec_->GetId());
+      stream->pop_back_bytes(payload_size);
+      *stream << payload_size;
+      stream->push_back_bytes(compressed.data(), compressed_size);
+    }
+    Sample(payload_size, compressed_size);
+  }
+
+  /** Replace the remaining bytes of a received stream with the decompressed payload. **/
+  static void Decompress(BinStream* stream) {
+    CHECK_GE(stream->size(), sizeof(uint8_t)) << "Message without compression flag";
+    uint8_t codec_id;
+    *stream >> codec_id;
+    if (codec_id == kUncompressed) {
+      return;
+    }
+    auto codec = CompressionCodecRegistry::GetCodec(codec_id);
+    CHECK(codec != nullptr) << "Unknown compression codec id " << static_cast<int>(codec_id);
+    size_t raw_size;
+    *stream >> raw_size;
+    std::vector<char> raw(raw_size);
+    CHECK(codec->Decompress(stream->get_remained_buffer(), stream->size(), raw.data(), raw_size))
+        << "Corrupted " << codec->GetName() << " compressed message";
+    *stream = BinStream(std::move(raw));
+  }
+
+  inline double GetRatio() const { return raw_bytes_ == 0 ? 1. : static_cast<double>(compressed_bytes_) / raw_bytes_; }
+  inline bool IsDisabled() const { return disabled_; }
+
+ private:
+  /** Add a compressed payload to the window, and switch compression on or off by the ratio of each full window. **/
+  void Sample(size_t raw_size, size_t compressed_size) {
+    std::lock_guard<std::mutex> lock(window_mutex_);
+    window_raw_bytes_ += raw_size;
+    window_compressed_bytes_ += compressed_size;
+    if (++window_samples_ < min_samples_) {
+      return;
+    }
+    bool disable = window_compressed_bytes_ > max_ratio_ * window_raw_bytes_;
+    if (disable != disabled_) {
+      disabled_ = disable;
+      LOG(INFO) << "[MessageCompressor] " << (disable ? "disable " : "enable ") << codec_->GetName() << " compression, ratio "
+                << static_cast<double>(window_compressed_bytes_) / window_raw_bytes_ << " over the last " << min_samples_ << " payloads";
+    }
+    window_raw_bytes_ = 0;
+    window_compressed_bytes_ = 0;
+    window_samples_ = 0;
+  }
+
+  std::shared_ptr<const CompressionCodec> codec_;
+  double max_ratio_;
+  size_t min_samples_;
+  size_t min_payload_size_;
+  std::atomic<size_t> raw_bytes_{0};
+  std::atomic<size_t> compressed_bytes_{0};
+  std::atomic<size_t> n_skipped_{0};
+  std::atomic<bool> disabled_{false};
+
+  std::mutex window_mutex_;
+  size_t window_raw_bytes_ = 0;
+  size_t window_compressed_bytes_ = 0;
+  size_t window_samples_ = 0;
+};
+
+}  // namespace base
+}  // namespace axe
@@ -14,8 +14,14 @@
 
 #pragma once
 
+#include <cstdint>
+
+#include <algorithm>
 #include <memory>
 #include <string>
+#include <string_view>
+
+#include "base/char_scanner.h"
 
 namespace axe {
 namespace base {
@@ -71,5 +77,74 @@ class WhiteSpaceTokenizer : public Tokenizer {
   size_t last_ = 0;
 };
 
+/**
+ * Zero-copy tokenizer that finds the delimiters with CharScanner, a chunk of the string at a time. Unlike
+ * StrtokTokenizer, the string is neither copied nor modified, and the tokens are views into it.
+ *
+ * @param str the string to tokenize, which must outlive the tokens.
+ * @param delimiters at most CharScanner::kMaxChars delimiters, e.g. kWhitespace or ",".
+ * @param skip_empty whether to skip the empty tokens between adjacent delimiters, as strtok does. Keep them for CSV
+ * fields.
+ */
+class SimdTokenizer : public Tokenizer {
+ public:
+  static constexpr std::string_view kWhitespace = " \t\n\v\f\r";
+
+  explicit SimdTokenizer(std::string_view str, std::string_view delimiters = kWhitespace, bool skip_empty = true)
+      : str_(str), delimiters_(delimiters), skip_empty_(skip_empty) {}
+
+  /**
+   * Get the next token.
+   *
+   * @returns false if there are no more tokens.
+   */
+  bool next(std::string_view* token) {
+    while (pos_ <= str_.size()) {
+      size_t end = NextDelimiter(pos_);
+      auto candidate = str_.substr(pos_, end - pos_);
+      pos_ = end + 1;
+      if (!candidate.empty() || !skip_empty_) {
+        *token = candidate;
+        return true;
+      }
+    }
+    return false;
+  }
+
+ private:
+  /** The position of the first delimiter at or after pos, or the size of the string. **/
+  size_t NextDelimiter(size_t pos) {
+    while (pos < str_.size()) {
+      if (pos < chunk_begin_ || pos >= chunk_begin_ + chunk_size_) {
+        chunk_begin_ = pos / CharScanner::kChunkBytes * CharScanner::kChunkBytes;
+        chunk_size_ = std::min(CharScanner::kChunkBytes, str_.size() - chunk_begin_);
+        CharScanner::Match(str_.data() + chunk_begin_, chunk_size_, delimiters_, masks_);
+      }
+      size_t offset = pos - chunk_begin_;
+      uint64_t bits = masks_[offset / 64] & (~uint64_t(0) << (offset % 64));
+      for (size_t w = offset / 64;;) {
+        if (bits != 0) {
+          return chunk_begin_ + w * 64 + __builtin_ctzll(bits);
+        }
+        if (++w * 64 >= chunk_size_) {
+          break;
+        }
+        bits = masks_[w];
+      }
+      pos = chunk_begin_ + chunk_size_;
+    }
+    return str_.size();
+  }
+
+  std::string_view str_;
+  std::string_view delimiters_;
+  bool skip_empty_;
+
+  size_t pos_ = 0;  // start of the next token
+  size_t chunk_begin_ = 0;
+  size_t chunk_size_ = 0;
+  uint64_t masks_[CharScanner::kChunkWords];  // delimiter masks of [chunk_begin_, chunk_begin_ + chunk_size_)
+};
+
 }  // namespace base
 }  //  namespace axe
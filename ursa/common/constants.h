@@ -121,6 +121,7 @@ using TaskNameType = std::string;
 // HDFS Block
 using Block = std::pair<std::string, size_t>;
 enum FS : uint8_t { HDFS, NFS };
+const uint64_t kNFSBlockSize = 128 * 1024 * 1024;  // size of the blocks NFS files are split into
 
 }  // namespace common
 }  // namespace axe
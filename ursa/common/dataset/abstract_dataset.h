@@ -15,6 +15,10 @@
 #pragma once
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
 #include <functional>
 #include <memory>
 #include <string>
@@ -22,9 +26,12 @@
 
 #include "glog/logging.h"
 
+#include "base/arena.h"
 #include "base/bin_stream.h"
+#include "base/compression.h"
 #include "common/dataset/abstract_data.h"
 #include "common/dataset/dataset_partition.h"
+#include "common/shuffle_metrics.h"
 #include "common/task.h"
 #include "common/task_context.h"
 #include "common/task_graph.h"
@@ -41,17 +48,213 @@ auto hash(Key key) {
 
 class AbstractDataset {
  public:
+  /** Alignment of the message payloads in their stream buffer, so that the received records can be viewed in place. **/
+  static constexpr size_t kMessageAlignment = alignof(std::max_align_t);
+
   static DatasetPartition<std::shared_ptr<BinStream>> CreateMessagePartition(int num_partitions, DataIdType msg_id, ShardIdType shard_id,
                                                                              const std::shared_ptr<InstanceId>& instance_id) {
     DatasetPartition<std::shared_ptr<BinStream>> msg(num_partitions);
     for (ShardIdType i = 0; i < num_partitions; ++i) {
-      msg[i].reset(new BinStream());
-      *msg[i] << common::JobProcessEventType::JPReceiveData;
-      *msg[i] << msg_id << shard_id << instance_id << i;  // msg data id, sender shard id, msg instance id (timestamp), destination shard id
+      msg[i] = CreateMessage(msg_id, shard_id, instance_id, i);
     }
     return msg;
   }
 
+  static std::shared_ptr<BinStream> CreateMessage(DataIdType msg_id, ShardIdType shard_id, const std::shared_ptr<InstanceId>& instance_id,
+                                                  ShardIdType dst) {
+    auto msg = std::make_shared<BinStream>();
+    *msg << common::JobProcessEventType::JPReceiveData;
+    *msg << msg_id << shard_id << instance_id << dst;  // msg data id, sender shard id, msg instance id (timestamp), destination shard id
+    // the padding length, the padding, the send time (see StampMessage) and the compression flag, so that the payload
+    // starts aligned and is not moved when it is sent uncompressed; read by the receiver in PrepareMessages
+    auto preamble = msg->size() + 2 * sizeof(uint8_t) + sizeof(int64_t);
+    auto padding = static_cast<uint8_t>((kMessageAlignment - preamble % kMessageAlignment) % kMessageAlignment);
+    *msg << padding;
+    msg->extend(padding);
+    *msg << int64_t(0);
+    *msg << base::MessageCompressor::kUncompressed;
+    return msg;
+  }
+
+  /** Write the wall clock time into the send time slot of a message stream created by CreateMessage, right before it
+   * leaves the serialize task. The slot precedes the compression flag, which is the last of the header_size bytes.
+   */
+  static void StampMessage(BinStream* stream, size_t header_size) {
+    auto sent_us = WallClockUs();
+    std::memcpy(stream->get_buffer() + header_size - sizeof(uint8_t) - sizeof(int64_t), &sent_us, sizeof(sent_us));
+  }
+
+  static inline int64_t WallClockUs() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+  }
+
+  /** Compress the payload of every message stream, which follows the header_size bytes written by CreateMessage. No-op
+   * without compressor.
+   */
+  static void CompressMessages(const std::shared_ptr<base::MessageCompressor>& compressor, size_t header_size,
+                               DatasetPartition<std::shared_ptr<BinStream>>* msg) {
+    if (compressor == nullptr) {
+      return;
+    }
+    for (auto& binstream_ptr : *msg) {
+      compressor->Compress(binstream_ptr.get(), header_size);
+    }
+  }
+
+  /** Skip the padding of the received message streams, whose header was read by the channel service, and decompress
+   * the streams that were compressed by CompressMessages. Empty streams are skipped.
+   *
+   * Returns the latest send time stamped on the streams (see StampMessage), or 0 if none was stamped.
+   */
+  static int64_t PrepareMessages(DatasetPartition<std::shared_ptr<BinStream>>* msg) {
+    int64_t last_sent_us = 0;
+    for (auto& binstream_ptr : *msg) {
+      if (binstream_ptr->size() == 0) {
+        continue;
+      }
+      uint8_t padding;
+      *binstream_ptr >> padding;
+      if (padding != 0) {
+        binstream_ptr->pop_front_bytes(padding);
+      }
+      int64_t sent_us;
+      *binstream_ptr >> sent_us;
+      last_sent_us = std::max(last_sent_us, sent_us);
+      base::MessageCompressor::Decompress(binstream_ptr.get());
+    }
+    return last_sent_us;
+  }
+
+  /** Whether messages of threshold bytes can be pushed while the serialize task runs, which only the job simulator
+   * supports (see TaskContext::SetMessageChannel). Warns once per process if pushing is asked for elsewhere.
+   */
+  static bool CanPushMessages(size_t threshold) {
+    if (threshold == 0) {
+      return false;
+    }
+    if (TaskContext::HasMessageChannel()) {
+      return true;
+    }
+    static std::atomic<bool> warned{false};
+    if (!warned.exchange(true)) {
+      LOG(WARNING) << "[Shuffle] SetPushShuffle only takes effect in the job simulator, messages are shipped after the serialize task";
+    }
+    return false;
+  }
+
+  /** Push the message streams whose payload reached threshold bytes, and replace them with fresh streams.
+   *
+   * No-op unless CanPushMessages, in which case the streams keep accumulating.
+   */
+  static void PushFullMessages(TaskContext* tc, size_t threshold, const std::shared_ptr<base::MessageCompressor>& compressor, size_t header_size,
+                               DataIdType msg_id, DatasetPartition<std::shared_ptr<BinStream>>* msg) {
+    if (!CanPushMessages(threshold)) {
+      return;
+    }
+    for (ShardIdType dst = 0; dst < msg->size(); ++dst) {
+      auto& stream = msg->at(dst);
+      if (stream->size() - header_size < threshold) {
+        continue;
+      }
+      auto full = stream;
+      stream = CreateMessage(msg_id, tc->GetShardId(), tc->GetInstanceId(), dst);
+      if (compressor != nullptr) {
+        compressor->Compress(full.get(), header_size);
+      }
+      if (FLAGS_enable_message_size_report) {
+        StampMessage(full.get(), header_size);
+      }
+      tc->PushMessage(msg_id, dst, full);
+    }
+  }
+
+  /** Add to the received streams msg the messages of the message partition msg_id that were pushed to this shard and
+   * delivered by the message channel of the process, if any (see TaskContext::SetMessageChannel).
+   */
+  static void AppendPushedMessages(TaskContext* tc, DataIdType msg_id, DatasetPartition<std::shared_ptr<BinStream>>* msg) {
+    for (auto& pushed : tc->TakePushedMessages(msg_id)) {
+      msg->push_back(pushed);
+    }
+  }
+
+  static uint64_t GetMessageBytes(const DatasetPartition<std::shared_ptr<BinStream>>& msg) {
+    uint64_t bytes = 0;
+    for (auto& binstream_ptr : msg) {
+      bytes += binstream_ptr->size();
+    }
+    return bytes;
+  }
+
+  /** Report the records and payload bytes sent to each destination, including pushed messages, and the serialize time,
+   * and stamp the send time on the messages. Must be called before msg is inserted. No-op unless
+   * FLAGS_enable_message_size_report is set.
+   */
+  static void ReportShuffleSend(TaskContext* tc, DataIdType msg_id, const std::vector<uint64_t>& records,
+                                const DatasetPartition<std::shared_ptr<BinStream>>& msg, size_t header_size,
+                                std::chrono::steady_clock::time_point start_time) {
+    if (!FLAGS_enable_message_size_report) {
+      return;
+    }
+    std::vector<uint64_t> bytes(msg.size());
+    auto pushed_memory = tc->GetPushedMessageMemory(msg_id);
+    for (size_t dst = 0; dst < msg.size(); ++dst) {
+      bytes[dst] = msg.at(dst)->size() - header_size + (dst < pushed_memory.size() ? pushed_memory[dst] : 0);
+      StampMessage(msg.at(dst).get(), header_size);
+    }
+    ShuffleMetrics::Get().RecordSend(msg_id, tc->GetShardId(), records, bytes, ElapsedMs(start_time));
+  }
+
+  /** Report the records and received bytes of a deserialize task that started at start_time, and the transfer time
+   * from last_sent_us, as returned by PrepareMessages, to the start. No-op unless FLAGS_enable_message_size_report is set.
+   */
+  static void ReportShuffleReceive(TaskContext* tc, DataIdType shuffled_id, uint64_t records, uint64_t bytes,
+                                   std::chrono::steady_clock::time_point start_time, int64_t last_sent_us) {
+    if (!FLAGS_enable_message_size_report) {
+      return;
+    }
+    auto deserialize_ms = ElapsedMs(start_time);
+    double transfer_ms = 0;
+    if (last_sent_us != 0) {
+      transfer_ms = std::max(0.0, (WallClockUs() - last_sent_us) / 1000.0 - deserialize_ms);
+    }
+    ShuffleMetrics::Get().RecordReceive(shuffled_id, tc->GetShardId(), records, bytes, deserialize_ms, transfer_ms);
+  }
+
+  static inline double ElapsedMs(std::chrono::steady_clock::time_point start_time) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_time).count();
+  }
+
+  /** Compress the shuffle messages of the operators called on this dataset afterwards with the named codec.
+   *
+   * Compression is switched off automatically while the measured ratio is worse than max_ratio.
+   */
+  void SetMessageCompression(const std::string& codec_name = "lz", double max_ratio = 0.9) {
+    auto codec = base::CompressionCodecRegistry::GetCodec(codec_name);
+    CHECK(codec != nullptr) << "Unknown compression codec " << codec_name;
+    compressor_ = std::make_shared<base::MessageCompressor>(codec, max_ratio);
+  }
+  inline void DisableMessageCompression() { compressor_ = nullptr; }
+
+  /** Bound the map output that ReduceBy called on this dataset afterwards buffers in memory per task.
+   *
+   * Beyond memory_limit bytes, the buffered records are spilled as sorted and combined runs to
+   * FLAGS_worker_husky_scratch_dir, which are merged from disk into the messages. The serialize task then holds its
+   * input partition, at most memory_limit bytes of records and the serialized messages, instead of a full copy of the
+   * records on top. The messages stay in memory until the network task ships them, unless they are pushed (see
+   * SetPushShuffle). 0 disables spilling.
+   */
+  inline void SetShuffleMemoryLimit(size_t memory_limit) { shuffle_memory_limit_ = memory_limit; }
+
+  /** Push the shuffle messages of PartitionBy, RangeReduceBy and ReduceBy called on this dataset afterwards in chunks of
+   * about message_size bytes while the serialize task is running. 0 disables pushing.
+   *
+   * Simulator only: the pushed chunks are delivered by the in-memory message channel of the job simulator, which is
+   * useful to check the chunked messages and their metrics. Job processes ship the messages after the serialize task
+   * as without pushing, as their channel service cannot take messages from a running task, so network transfer does
+   * not overlap serialization.
+   */
+  inline void SetPushShuffle(size_t message_size) { push_threshold_ = message_size; }
+
   inline DataIdType GetId() const { return id_; }
   inline int GetParallelism() const { return parallelism_; }
   inline void SetParallelism(int parallelism) { parallelism_ = parallelism; }
@@ -128,9 +331,16 @@ class AbstractDataset {
     return task;
   }
 
+  /** Register the closure of a task. User code in the closure can allocate from the task arena through
+   * base::Arena::Current().
+   */
   template <typename Lambda>
   void RegisterClosure(TaskIdType tid, Lambda lambda) const {
-    task_graph_->RegisterClosure(tid, Closure::CreateClosure(lambda));
+    auto closure = [lambda](TaskContext* tc) {
+      base::Arena::Activate arena(tc->GetArena());
+      lambda(tc);
+    };
+    task_graph_->RegisterClosure(tid, Closure::CreateClosure(closure));
   }
 
  protected:
@@ -141,6 +351,9 @@ class AbstractDataset {
   std::vector<std::shared_ptr<Task>> read_precedence_;
   bool producer_is_set_ = false;
   int parallelism_ = 10;
+  std::shared_ptr<base::MessageCompressor> compressor_ = nullptr;  // shared by the shuffle operators created while it is set
+  size_t shuffle_memory_limit_ = 0;
+  size_t push_threshold_ = 0;
 };
 
 }  // namespace common
@@ -0,0 +1,190 @@
+// Copyright 2020 HDL
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include "glog/logging.h"
+
+#include "common/dataset/dataset_partition.h"
+#include "common/dataset/dictionary_string_partition.h"
+#include "common/dataset/normalized_key.h"
+#include "common/dataset/partition.h"
+#include "common/dataset/string_partition.h"
+
+namespace axe {
+namespace common {
+
+/** A column of a multi-column sort key and its order. **/
+struct SortColumn {
+  const Partition* column;
+  bool descending = false;
+  bool nulls_first = true;
+
+  SortColumn(const Partition* column, bool descending = false, bool nulls_first = true)
+      : column(column), descending(descending), nulls_first(nulls_first) {}
+};
+
+/** Sorts the rows of several aligned Partition columns by a multi-column key, with normalized keys.
+ *
+ * The columns are encoded in order into a fixed-width key of at most kMaxKeyBytes bytes per row: a null flag byte for
+ * a column with nulls, then the order-preserving encoding of the value (inverted for a descending column), i.e. the
+ * integer or floating-point value of a DatasetPartition (dates are columns of days since the epoch), the rank of the
+ * code of a DictionaryStringPartition, or a prefix of a StringPartition string. The keys are sorted as contiguous records, and
+ * only rows with equal keys are compared column by column, which happens when a string prefix or the key width cuts
+ * an encoding short, or for a column type without an encoding. Encoding stops at such a column: the later columns are
+ * left to the full comparison.
+ */
+class ColumnSorter {
+ public:
+  static constexpr size_t kMaxKeyBytes = 32;
+  static constexpr size_t kStringPrefixBytes = 12;
+
+  /** The rows of the columns in sorted order. The sort is stable. **/
+  static std::vector<uint32_t> GetSortedIndex(const std::vector<SortColumn>& columns) {
+    CHECK(!columns.empty()) << "[ColumnSorter] no sort column";
+    size_t size = columns.front().column->size();
+    for (auto& column : columns) {
+      CHECK_EQ(column.column->size(), size) << "[ColumnSorter] columns of different sizes";
+    }
+    std::vector<uint8_t> keys(size * kMaxKeyBytes, 0);
+    size_t width = 0;
+    bool exact = true;
+    for (auto& column : columns) {
+      if (!EncodeColumn(column, keys.data(), size, &width, &exact)) {
+        exact = false;
+        break;
+      }
+    }
+    auto full_compare = [&columns](uint32_t lhs, uint32_t rhs) { return CompareRows(columns, lhs, rhs); };
+    switch ((width + 7) / 8) {
+    case 0:
+    case 1:
+      return Sort<1>(keys, size, exact, full_compare);
+    case 2:
+      return Sort<2>(keys, size, exact, full_compare);
+    case 3:
+      return Sort<3>(keys, size, exact, full_compare);
+    default:
+      return Sort<kMaxKeyBytes / 8>(keys, size, exact, full_compare);
+    }
+  }
+
+  /** Three-way comparison of two rows by the columns. **/
+  static int CompareRows(const std::vector<SortColumn>& columns, size_t lhs, size_t rhs) {
+    for (auto& column : columns) {
+      bool lhs_null = column.column->IsNull(lhs), rhs_null = column.column->IsNull(rhs);
+      if (lhs_null || rhs_null) {
+        if (lhs_null && rhs_null) {
+          continue;
+        }
+        return lhs_null == column.nulls_first ? -1 : 1;
+      }
+      int cmp = column.column->Compare(lhs, rhs);
+      if (cmp != 0) {
+        return column.descending ? -cmp : cmp;
+      }
+    }
+    return 0;
+  }
+
+ private:
+  template <size_t Words, typename FullCompare>
+  static std::vector<uint32_t> Sort(const std::vector<uint8_t>& keys, size_t size, bool exact, FullCompare full_compare) {
+    std::vector<NormalizedKeyRecord<Words>> records(size);
+    for (uint32_t i = 0; i < size; ++i) {
+      records[i].Load(keys.data() + i * kMaxKeyBytes);
+      records[i].row = i;
+    }
+    return SortByNormalizedKeys(&records, exact, full_compare);
+  }
+
+  /** Append the encoding of a column to the keys. Returns false if the column has no encoding, or its encoding is cut
+   * short (a string prefix, or no room left), in which case no later column may be appended.
+   */
+  static bool EncodeColumn(const SortColumn& column, uint8_t* keys, size_t size, size_t* width, bool* exact) {
+    auto partition = column.column;
+    if (auto strings = dynamic_cast<const StringPartition*>(partition)) {
+      Encode(column, keys, size, kStringPrefixBytes, width, exact, [strings](size_t i, uint8_t* dst) {
+        auto view = (*strings)[i];
+        NormalizedKey::EncodeStringPrefix(view.data(), view.size(), dst, kStringPrefixBytes);
+      });
+      // rows with equal prefixes may differ in the rest of the strings, so the later columns must not order them
+      return false;
+    }
+    if (auto dictionary = dynamic_cast<const DictionaryStringPartition*>(partition)) {
+      auto& ranks = dictionary->GetDictionary()->GetRanks();
+      return Encode(column, keys, size, sizeof(uint32_t), width, exact,
+                    [&](size_t i, uint8_t* dst) { NormalizedKey::Encode(ranks[dictionary->GetCode(i)], dst); });
+    }
+    return EncodeArithmetic<int32_t>(column, keys, size, width, exact) || EncodeArithmetic<int64_t>(column, keys, size, width, exact) ||
+           EncodeArithmetic<uint32_t>(column, keys, size, width, exact) || EncodeArithmetic<uint64_t>(column, keys, size, width, exact) ||
+           EncodeArithmetic<double>(column, keys, size, width, exact) || EncodeArithmetic<float>(column, keys, size, width, exact) ||
+           EncodeArithmetic<int16_t>(column, keys, size, width, exact) || EncodeArithmetic<uint16_t>(column, keys, size, width, exact) ||
+           EncodeArithmetic<int8_t>(column, keys, size, width, exact) || EncodeArithmetic<uint8_t>(column, keys, size, width, exact);
+  }
+
+  template <typename T>
+  static bool EncodeArithmetic(const SortColumn& column, uint8_t* keys, size_t size, size_t* width, bool* exact) {
+    auto values = dynamic_cast<const DatasetPartition<T>*>(column.column);
+    if (values == nullptr) {
+      return false;
+    }
+    return Encode(column, keys, size, sizeof(T), width, exact, [values](size_t i, uint8_t* dst) { NormalizedKey::Encode((*values)[i], dst); });
+  }
+
+  /** Write the null flag and the value_bytes-byte encoding of each row, truncated to the room left in the keys. **/
+  template <typename Encoder>
+  static bool Encode(const SortColumn& column, uint8_t* keys, size_t size, size_t value_bytes, size_t* width, bool* exact, Encoder encoder) {
+    bool has_null = column.column->HasNull();
+    size_t bytes = value_bytes + has_null;
+    size_t room = kMaxKeyBytes - *width;
+    if (room == 0) {
+      return false;
+    }
+    if (bytes > room) {
+      *exact = false;  // keep the prefix that fits, the remaining bytes are left to the full comparison
+    }
+    uint8_t value[kMaxKeyBytes + 1];
+    for (size_t i = 0; i < size; ++i) {
+      uint8_t* dst = keys + i * kMaxKeyBytes + *width;
+      bool is_null = has_null && column.column->IsNull(i);
+      if (has_null) {
+        value[0] = is_null ? (column.nulls_first ? 0 : 2) : 1;
+      }
+      if (is_null) {
+        memset(value + has_null, 0, value_bytes);
+      } else {
+        encoder(i, value + has_null);
+        if (column.descending) {
+          for (size_t b = has_null; b < bytes; ++b) {
+            value[b] = ~value[b];
+          }
+        }
+      }
+      memcpy(dst, value, std::min(bytes, room));
+    }
+    *width += std::min(bytes, room);
+    return bytes <= room;
+  }
+};
+
+}  // namespace common
+}  // namespace axe
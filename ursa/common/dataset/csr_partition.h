@@ -0,0 +1,399 @@
+// Copyright 2020 HDL
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#include <algorithm>
+#include <memory>
+#include <numeric>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "glog/logging.h"
+
+#include "base/bin_stream.h"
+#include "common/dataset/partition.h"
+#include "common/dataset/validity_bitmap.h"
+
+namespace axe {
+namespace common {
+
+/** Read-only view of one record of a CsrPartition: a vertex id and its adjacency list. **/
+template <typename Id, typename Neighbor>
+class CsrVertex {
+ public:
+  CsrVertex(Id id, const Neighbor* begin, const Neighbor* end) : id_(id), begin_(begin), end_(end) {}
+
+  inline Id GetId() const { return id_; }
+  inline size_t size() const { return end_ - begin_; }
+  inline bool empty() const { return begin_ == end_; }
+  inline const Neighbor* begin() const { return begin_; }
+  inline const Neighbor* end() const { return end_; }
+  inline const Neighbor& operator[](size_t i) const { return begin_[i]; }
+
+ private:
+  Id id_;
+  const Neighbor* begin_;
+  const Neighbor* end_;
+};
+
+template <typename Id, typename Neighbor>
+class CsrPartition;
+
+template <typename Id, typename Neighbor>
+class CsrPartitionIterator : public PartitionIterator {
+ public:
+  using value_type = CsrVertex<Id, Neighbor>;
+  using size_type = size_t;
+
+  CsrPartitionIterator(size_type pos, const CsrPartition<Id, Neighbor>* csr) : pos_(pos), csr_(csr) {}
+
+  /** The raw record of an iterator is the vertex id, the same as CsrPartition::At. **/
+  std::pair<const void*, size_t> GetPtr() const override { return {csr_->GetIds() + pos_, sizeof(Id)}; }
+
+  value_type operator*() const { return (*csr_)[pos_]; }
+
+  void operator++() override { ++pos_; }
+  bool operator==(const CsrPartitionIterator& rhs) { return pos_ == rhs.pos_; }
+  bool operator!=(const CsrPartitionIterator& rhs) { return pos_ != rhs.pos_; }
+  bool operator<(const CsrPartitionIterator& rhs) { return pos_ < rhs.pos_; }
+
+ private:
+  size_type pos_;
+  const CsrPartition<Id, Neighbor>* csr_;
+};
+
+/** Partition of variable-length records in compressed sparse row (CSR) layout, e.g. the adjacency lists of a graph.
+ *
+ * The ids of the records, the offsets of their neighbor lists and all the neighbors are stored in three contiguous
+ * arrays, like the offsets-plus-blob layout of StringPartition. Iteration yields CsrVertex views without copying,
+ * serialization writes each array in bulk, and Slice shares the arrays with the source partition (a sliced or shared
+ * partition copies its records before it is modified).
+ *
+ * Through the Partition interface, a record is addressed by its id: At and the iterators return the id, Compare
+ * orders records by id, and push_back(const char*, uint32_t) takes a packed record, i.e. the id followed by the
+ * neighbors.
+ *
+ * @tparam Id       the vertex id type, trivially copyable and ordered
+ * @tparam Neighbor the neighbor type (e.g. a vertex id, or an (id, weight) pair), trivially copyable
+ */
+template <typename Id, typename Neighbor>
+class CsrPartition : public Partition {
+ public:
+  using value_type = CsrVertex<Id, Neighbor>;
+  using iterator = CsrPartitionIterator<Id, Neighbor>;
+  using const_iterator = CsrPartitionIterator<Id, Neighbor>;
+
+  CsrPartition() : storage_(std::make_shared<Storage>()) {}
+
+  /* Vector-like APIs */
+
+  void push_back(Id id, const Neighbor* neighbors, size_t n) {
+    auto& all = storage_->neighbors;
+    if (n != 0 && neighbors >= all.data() && neighbors < all.data() + all.size()) {
+      // copy a record of this partition before the arrays grow
+      std::vector<Neighbor> copy(neighbors, neighbors + n);
+      push_back(id, copy.data(), n);
+      return;
+    }
+    MakeUnique();
+    storage_->ids.push_back(id);
+    storage_->neighbors.insert(storage_->neighbors.end(), neighbors, neighbors + n);
+    storage_->offsets.push_back(storage_->neighbors.size());
+    ++size_;
+  }
+
+  inline void push_back(Id id, const std::vector<Neighbor>& neighbors) { push_back(id, neighbors.data(), neighbors.size()); }
+  inline void push_back(const value_type& vertex) { push_back(vertex.GetId(), vertex.begin(), vertex.size()); }
+
+  /** Push back a packed record: the id followed by its neighbors. **/
+  void push_back(const char* data, uint32_t length) override {
+    CHECK_GE(length, sizeof(Id));
+    CHECK_EQ((length - sizeof(Id)) % sizeof(Neighbor), 0) << "[CsrPartition] invalid packed record of " << length << " bytes";
+    Id id;
+    std::memcpy(&id, data, sizeof(Id));
+    auto n = (length - sizeof(Id)) / sizeof(Neighbor);
+    std::vector<Neighbor> neighbors(n);
+    if (n != 0) {
+      std::memcpy(neighbors.data(), data + sizeof(Id), n * sizeof(Neighbor));
+    }
+    push_back(id, neighbors);
+  }
+
+  /** Push back a vertex without neighbors, given its raw id. **/
+  void push_back(const std::pair<const void*, size_t>& val) override {
+    CHECK_EQ(val.second, sizeof(Id));
+    push_back(*static_cast<const Id*>(val.first), nullptr, 0);
+  }
+
+  void reserve(size_t size) override {
+    MakeUnique();
+    storage_->ids.reserve(size);
+    storage_->offsets.reserve(size + 1);
+  }
+
+  /** Reserve space for n neighbors in total. **/
+  void reserve_neighbors(size_t n) {
+    MakeUnique();
+    storage_->neighbors.reserve(n);
+  }
+
+  /** Resize to size records. Records appended have a default id and no neighbors. **/
+  void resize(size_t size) override {
+    MakeUnique();
+    if (size <= size_) {
+      storage_->ids.resize(size);
+      storage_->offsets.resize(size + 1);
+      storage_->neighbors.resize(storage_->offsets.back());
+      size_ = size;
+      return;
+    }
+    storage_->ids.resize(size, Id());
+    storage_->offsets.resize(size + 1, storage_->neighbors.size());
+    size_ = size;
+  }
+
+  void clear() override {
+    Partition::clear();
+    storage_ = std::make_shared<Storage>();
+    begin_ = 0;
+    size_ = 0;
+  }
+
+  void shrink_to_fit() override {
+    MakeUnique();
+    storage_->ids.shrink_to_fit();
+    storage_->offsets.shrink_to_fit();
+    storage_->neighbors.shrink_to_fit();
+  }
+
+  inline bool empty() const override { return size_ == 0; }
+  inline size_t size() const override { return size_; }
+
+  inline iterator begin() const { return iterator(0, this); }
+  inline iterator end() const { return iterator(size_, this); }
+
+  inline value_type operator[](size_t i) const { return value_type(GetIds()[i], GetNeighbors(i), GetNeighbors(i) + GetDegree(i)); }
+
+  value_type at(size_t i) const {
+    if (i >= size_) {
+      throw std::out_of_range("[CsrPartition] Index out of range when accessing " + std::to_string(i) + "-th position. size is " +
+                              std::to_string(size_));
+    }
+    return (*this)[i];
+  }
+
+  /* End of vector-like APIs */
+
+  /** The ids of the records, contiguous. **/
+  inline const Id* GetIds() const { return storage_->ids.data() + begin_; }
+  inline Id GetId(size_t i) const { return GetIds()[i]; }
+  inline const Neighbor* GetNeighbors(size_t i) const { return storage_->neighbors.data() + storage_->offsets[begin_ + i]; }
+  inline size_t GetDegree(size_t i) const { return storage_->offsets[begin_ + i + 1] - storage_->offsets[begin_ + i]; }
+  inline size_t GetNumNeighbors() const { return storage_->offsets[begin_ + size_] - storage_->offsets[begin_]; }
+
+  std::pair<const void*, size_t> At(size_t pos) override { return {GetIds() + pos, sizeof(Id)}; }
+
+  std::string Print(size_t pos) override {
+    if (IsNull(pos)) {
+      return "NULL";
+    }
+    std::stringstream ss;
+    ss << GetId(pos) << " (" << GetDegree(pos) << " neighbors)";
+    return ss.str();
+  }
+
+  int Compare(size_t lhs, size_t rhs) const override { return CompareId(GetId(lhs), GetId(rhs)); }
+  int Compare(size_t pos, const std::pair<const void*, size_t>& rhs) const override {
+    return CompareId(GetId(pos), *static_cast<const Id*>(rhs.first));
+  }
+
+  void ApplyPermutation(const std::vector<size_t>& permutation) override {
+    CHECK(permutation.size() == size_) << "Size of permutation is not equals to size_";
+    Permute(permutation);
+    PermuteNotNull(permutation);
+  }
+
+  void ApplyPermutation(const std::vector<uint32_t>& permutation) override {
+    CHECK(permutation.size() == size_) << "Size of permutation is not equals to size_";
+    Permute(permutation);
+    PermuteNotNull(permutation);
+  }
+
+  void ApplyFilter(const std::vector<bool>& to_keep) override {
+    CHECK_EQ(to_keep.size(), size_) << "Apply filter vector of size " << to_keep.size() << " to csr partition of size " << size_;
+    auto filtered = FilterRecords(to_keep);
+    storage_ = filtered.storage_;
+    begin_ = 0;
+    size_ = filtered.size_;
+    FilterNotNull(to_keep);
+  }
+
+  std::shared_ptr<Partition> Filter(const std::vector<bool>& to_keep, size_t size) const override {
+    CHECK_EQ(to_keep.size(), size_);
+    auto ret = std::make_shared<CsrPartition>(FilterRecords(to_keep));
+    CHECK_EQ(ret->size(), size);
+    ret->FilterNotNullFrom(*this, to_keep);
+    return ret;
+  }
+
+  void AppendPartition(const std::shared_ptr<Partition>& rhs) override {
+    auto csr_ptr = std::dynamic_pointer_cast<CsrPartition>(rhs);
+    CHECK(csr_ptr != nullptr) << "Cannot cast Partition to Csr Partition while appending";
+    MakeUnique();
+    auto base = storage_->neighbors.size();
+    auto rhs_base = csr_ptr->storage_->offsets[csr_ptr->begin_];
+    storage_->ids.insert(storage_->ids.end(), csr_ptr->GetIds(), csr_ptr->GetIds() + csr_ptr->size_);
+    storage_->neighbors.insert(storage_->neighbors.end(), csr_ptr->GetNeighbors(0), csr_ptr->GetNeighbors(0) + csr_ptr->GetNumNeighbors());
+    for (size_t i = 1; i <= csr_ptr->size_; ++i) {
+      storage_->offsets.push_back(base + csr_ptr->storage_->offsets[csr_ptr->begin_ + i] - rhs_base);
+    }
+    size_ += csr_ptr->size_;
+    AppendNotNull(*rhs);
+  }
+
+  std::shared_ptr<PartitionIterator> Begin() const override { return std::make_shared<iterator>(0, this); }
+  std::shared_ptr<PartitionIterator> End() const override { return std::make_shared<iterator>(size_, this); }
+
+  /** Zero-copy slice, sharing the arrays with this partition. **/
+  std::shared_ptr<Partition> Slice(size_t offset, size_t size) const override {
+    CHECK_LE(offset + size, size_);
+    auto ret = std::make_shared<CsrPartition>();
+    ret->storage_ = storage_;
+    ret->begin_ = begin_ + offset;
+    ret->size_ = size;
+    ret->SliceNotNull(*this, offset, size);
+    return ret;
+  }
+
+  std::vector<uint32_t> GetSortedIndex() const override {
+    std::vector<uint32_t> ret(size_);
+    std::iota(ret.begin(), ret.end(), 0);
+    std::sort(ret.begin(), ret.end(), [this](uint32_t l, uint32_t r) { return GetId(l) < GetId(r); });
+    return ret;
+  }
+
+  /** Memory usage in bytes. **/
+  double GetMemory() const override {
+    return storage_->ids.capacity() * sizeof(Id) + storage_->offsets.capacity() * sizeof(uint64_t) +
+           storage_->neighbors.capacity() * sizeof(Neighbor);
+  }
+
+  /** Bulk serialization: the record count, then the ids, offsets and neighbors as three arrays, then the null flags
+   * a word at a time if there are nulls.
+   */
+  base::BinStream& serialize(base::BinStream& stream) const {
+    stream << static_cast<uint64_t>(size_);
+    base::SerializeRange(stream, GetIds(), size_);
+    auto first = storage_->offsets[begin_];
+    if (first == 0) {
+      base::SerializeRange(stream, storage_->offsets.data() + begin_ + 1, size_);
+    } else {
+      std::vector<uint64_t> offsets(storage_->offsets.begin() + begin_ + 1, storage_->offsets.begin() + begin_ + size_ + 1);
+      for (auto& offset : offsets) {
+        offset -= first;
+      }
+      base::SerializeRange(stream, offsets.data(), size_);
+    }
+    base::SerializeRange(stream, GetNeighbors(0), GetNumNeighbors());
+    stream << has_null_;
+    if (has_null_) {
+      auto words = PackBools(not_null_, size_);
+      base::SerializeRange(stream, words.data(), words.size());
+    }
+    return stream;
+  }
+
+  base::BinStream& deserialize(base::BinStream& stream) {
+    uint64_t size;
+    stream >> size;
+    storage_ = std::make_shared<Storage>();
+    begin_ = 0;
+    size_ = size;
+    storage_->ids.resize(size);
+    base::DeserializeRange(stream, storage_->ids.data(), size);
+    storage_->offsets.resize(size + 1);
+    base::DeserializeRange(stream, storage_->offsets.data() + 1, size);
+    storage_->neighbors.resize(storage_->offsets.back());
+    base::DeserializeRange(stream, storage_->neighbors.data(), storage_->neighbors.size());
+    stream >> has_null_;
+    not_null_.clear();
+    if (has_null_) {
+      std::vector<uint64_t> words(BitmapOps::NumWords(size));
+      base::DeserializeRange(stream, words.data(), words.size());
+      UnpackBools(words.data(), 0, size, &not_null_);
+    }
+    return stream;
+  }
+
+ private:
+  struct Storage {
+    std::vector<Id> ids;
+    std::vector<uint64_t> offsets{0};
+    std::vector<Neighbor> neighbors;
+  };
+
+  static inline int CompareId(const Id& lhs, const Id& rhs) { return lhs < rhs ? -1 : (rhs < lhs ? 1 : 0); }
+
+  /** Copy the records in the window before a modification if the arrays are shared or hold other records. **/
+  void MakeUnique() {
+    if (storage_.use_count() == 1 && begin_ == 0 && size_ == storage_->ids.size()) {
+      return;
+    }
+    auto storage = std::make_shared<Storage>();
+    storage->ids.assign(GetIds(), GetIds() + size_);
+    storage->neighbors.assign(GetNeighbors(0), GetNeighbors(0) + GetNumNeighbors());
+    storage->offsets.reserve(size_ + 1);
+    auto first = storage_->offsets[begin_];
+    for (size_t i = 1; i <= size_; ++i) {
+      storage->offsets.push_back(storage_->offsets[begin_ + i] - first);
+    }
+    storage_ = std::move(storage);
+    begin_ = 0;
+  }
+
+  template <typename IndexT>
+  void Permute(const std::vector<IndexT>& permutation) {
+    CsrPartition res;
+    res.reserve(size_);
+    res.reserve_neighbors(GetNumNeighbors());
+    for (auto i : permutation) {
+      res.push_back(GetId(i), GetNeighbors(i), GetDegree(i));
+    }
+    storage_ = res.storage_;
+    begin_ = 0;
+  }
+
+  CsrPartition FilterRecords(const std::vector<bool>& to_keep) const {
+    CsrPartition ret;
+    for (size_t i = 0; i < size_; ++i) {
+      if (to_keep[i]) {
+        ret.push_back(GetId(i), GetNeighbors(i), GetDegree(i));
+      }
+    }
+    return ret;
+  }
+
+  std::shared_ptr<Storage> storage_;
+  size_t begin_ = 0;  // index of the first record of this partition in storage_
+  size_t size_ = 0;
+};
+
+}  // namespace common
+}  // namespace axe
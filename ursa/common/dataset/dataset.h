@@ -15,6 +15,7 @@
 #pragma once
 
 #include <algorithm>
+#include <chrono>
 #include <functional>
 #include <memory>
 #include <string>
@@ -23,9 +24,12 @@
 #include "glog/logging.h"
 
 #include "base/bin_stream.h"
+#include "base/compact_encoding.h"
 #include "common/dataset/abstract_data.h"
 #include "common/dataset/abstract_dataset.h"
 #include "common/dataset/dataset_partition.h"
+#include "common/dataset/external_shuffle_writer.h"
+#include "common/dataset/selection_vector.h"
 #include "common/task.h"
 #include "common/task_context.h"
 #include "common/task_graph.h"
@@ -66,6 +70,26 @@ class Dataset : public AbstractDataset {
     return ret;
   }
 
+  /** Keep the records that satisfy all the predicates.
+   *
+   * The predicates refine one selection vector of the partition in turn, and only the selected records are copied,
+   * once, into the output partition.
+   */
+  template <typename... Predicates>
+  auto Filter(Predicates... predicates) {
+    SanityCheck();
+    auto task = CreateTask("Filter");
+    auto ret = Dataset<Val>::Create(task, task_graph_, parallelism_);
+    RegisterClosure(task->GetId(), [ predicates..., ret = ret.GetId(), id = this->id_ ](TaskContext * tc) {
+      auto partition = tc->GetDatasetPartition<Val>(id);
+      auto selection = SelectionVector::All(partition->size());
+      (partition->Refine(&selection, predicates), ...);
+      tc->InsertDatasetPartition(ret, std::static_pointer_cast<DatasetPartition<Val>>(partition->Compact(selection)));
+    });
+    ReadBy(task);
+    return ret;
+  }
+
   template <typename Lambda, typename OVal>
   auto MapPartitionWith(Dataset<OVal>* other, Lambda lambda) {
     SanityCheck();
@@ -105,7 +129,7 @@ class Dataset : public AbstractDataset {
   void UpdatePartition(Lambda lambda) {
     SanityCheck();
     auto task = CreateTask("UpdatePartition");
-    RegisterClosure(task->GetId(), [&, id = id_ ](TaskContext * tc) {
+    RegisterClosure(task->GetId(), [ lambda, id = id_ ](TaskContext * tc) {
       auto data = tc->GetMutableDatasetPartition<Val>(id);
       lambda(*data);
     });
@@ -141,28 +165,38 @@ class Dataset : public AbstractDataset {
 
     auto message = Dataset<BinStream>::Create(serialize, task_graph_, parallelism_);
     auto shuffled = Dataset<BinStream>::Create(net_task, task_graph_, num_partitions);
+    ShuffleMetrics::Get().RegisterEdge(message.GetId(), shuffled.GetId(), serialize->GetName());
     auto ret = Dataset<Val>::Create(deserialize, task_graph_, num_partitions);
 
-    RegisterClosure(serialize->GetId(), [ key_selector, num_partitions, msg_id = message.GetId(), id = id_ ](TaskContext * tc) {
+    RegisterClosure(serialize->GetId(), [ compressor = compressor_, push_threshold = push_threshold_, key_selector, num_partitions,
+                                          msg_id = message.GetId(), id = id_ ](TaskContext * tc) {
       auto this_partition = tc->GetDatasetPartition<Val>(id);
       auto msg = std::make_shared<DatasetPartition<std::shared_ptr<BinStream>>>(
           CreateMessagePartition(num_partitions, msg_id, tc->GetShardId(), tc->GetInstanceId()));
-      for (auto& record : *this_partition) {
-        *(msg->at(hash(key_selector(record)) % num_partitions)) << record;
-      }
+      auto header_size = msg->at(0)->size();
+      auto start_time = std::chrono::steady_clock::now();
+      std::vector<uint64_t> records(num_partitions, 0);
+      auto partitioner = [&key_selector, &records, num_partitions](const Val& record) {
+        auto dst = hash(key_selector(record)) % num_partitions;
+        ++records[dst];
+        return dst;
+      };
+      ScatterAndPush(tc, *this_partition, partitioner, push_threshold, compressor, header_size, msg_id, msg.get());
+      CompressMessages(compressor, header_size, msg.get());
+      ReportShuffleSend(tc, msg_id, records, *msg, header_size, start_time);
       tc->InsertDatasetPartition(msg_id, msg);
     });
 
-    RegisterClosure(deserialize->GetId(), [ msg_id = shuffled.GetId(), ret_id = ret.GetId(), key_selector ](TaskContext * tc) {
+    RegisterClosure(deserialize->GetId(), [ pushed_id = message.GetId(), msg_id = shuffled.GetId(), ret_id = ret.GetId(),
+                                            key_selector ](TaskContext * tc) {
+      auto start_time = std::chrono::steady_clock::now();
       auto msg = tc->GetDatasetPartition<std::shared_ptr<BinStream>>(msg_id);
+      AppendPushedMessages(tc, pushed_id, msg.get());
+      auto message_bytes = GetMessageBytes(*msg);
+      auto last_sent_us = PrepareMessages(msg.get());
       auto data = std::make_shared<DatasetPartition<Val>>();
-      for (auto& binstream_ptr : *msg) {
-        while (binstream_ptr->size() > 0) {
-          Val val;
-          *binstream_ptr >> val;
-          data->push_back(val);
-        }
-      }
+      DeserializeMessages(*msg, data.get());
+      ReportShuffleReceive(tc, msg_id, data->size(), message_bytes, start_time, last_sent_us);
       tc->InsertDatasetPartition(ret_id, data);
     });
 
@@ -208,34 +242,39 @@ class Dataset : public AbstractDataset {
 
     auto message = Dataset<BinStream>::Create(serialize, task_graph_, parallelism_);
     auto shuffled = Dataset<BinStream>::Create(net_task, task_graph_, num_partitions);
+    ShuffleMetrics::Get().RegisterEdge(message.GetId(), shuffled.GetId(), serialize->GetName());
     auto deserialize_ret = Dataset<Val>::Create(deserialize, task_graph_, num_partitions);
     auto ret = Dataset<Val>::Create(get_processlevel_data, task_graph_, num_partitions);
 
-    RegisterClosure(serialize->GetId(), [ num_partitions, msg_id = message.GetId(), id = id_ ](TaskContext * tc) {
+    RegisterClosure(serialize->GetId(), [ compressor = compressor_, num_partitions, msg_id = message.GetId(), id = id_ ](TaskContext * tc) {
       auto this_partition = tc->GetDatasetPartition<Val>(id);
       auto msg = std::make_shared<DatasetPartition<std::shared_ptr<BinStream>>>(
           CreateMessagePartition(num_partitions, msg_id, tc->GetShardId(), tc->GetInstanceId()));
-      for (auto& record : *this_partition) {
-        (*msg->at(0)) << record;
-      }
+      auto header_size = msg->at(0)->size();
+      auto start_time = std::chrono::steady_clock::now();
+      std::vector<uint64_t> records(num_partitions, 0);
+      SerializeRun(*msg->at(0), this_partition->data(), this_partition->size());
+      records[0] = this_partition->size();
+      CompressMessages(compressor, header_size, msg.get());
+      ReportShuffleSend(tc, msg_id, records, *msg, header_size, start_time);
       tc->InsertDatasetPartition(msg_id, msg);
     });
 
     RegisterClosure(deserialize->GetId(), [ use_sort, key, msg_id = shuffled.GetId(), ret_id = deserialize_ret.GetId() ](TaskContext * tc) {
 
+      auto start_time = std::chrono::steady_clock::now();
       auto msg = tc->GetDatasetPartition<std::shared_ptr<BinStream>>(msg_id);
+      auto message_bytes = GetMessageBytes(*msg);
+      auto last_sent_us = PrepareMessages(msg.get());
       DatasetPartition<Val> data;
       for (auto& binstream_ptr : *msg) {
         if (binstream_ptr->size() == 0) {
           LOG(WARNING) << "fetched empty binstream";
           google::FlushLogFiles(google::WARNING);
         }
-        while (binstream_ptr->size() > 0) {
-          Val val;
-          *binstream_ptr >> val;
-          data.push_back(val);
-        }
       }
+      DeserializeMessages(*msg, &data);
+      ReportShuffleReceive(tc, msg_id, data.size(), message_bytes, start_time, last_sent_us);
 
       if (data.empty()) {
         DLOG(INFO) << "No data received for current shard";
@@ -276,31 +315,40 @@ class Dataset : public AbstractDataset {
 
     auto message = Dataset<BinStream>::Create(serialize, task_graph_, parallelism_);
     auto shuffled = Dataset<BinStream>::Create(net_task, task_graph_, num_partitions);
+    ShuffleMetrics::Get().RegisterEdge(message.GetId(), shuffled.GetId(), serialize->GetName());
     auto ret = Dataset<Val>::Create(deserialize, task_graph_, num_partitions);
 
-    RegisterClosure(serialize->GetId(), [ key_hash, num_partitions, msg_id = message.GetId(), id = id_ ](TaskContext * tc) {
+    RegisterClosure(serialize->GetId(), [ compressor = compressor_, push_threshold = push_threshold_, key_hash, num_partitions,
+                                          msg_id = message.GetId(), id = id_ ](TaskContext * tc) {
       auto this_partition = tc->GetDatasetPartition<Val>(id);
       auto msg = std::make_shared<DatasetPartition<std::shared_ptr<BinStream>>>(
           CreateMessagePartition(num_partitions, msg_id, tc->GetShardId(), tc->GetInstanceId()));
-      for (auto& record : *this_partition) {
-        *(msg->at(key_hash(record) % num_partitions)) << record;
-      }
-
+      auto header_size = msg->at(0)->size();
+      auto start_time = std::chrono::steady_clock::now();
+      std::vector<uint64_t> records(num_partitions, 0);
+      auto partitioner = [&key_hash, &records, num_partitions](const Val& record) {
+        auto dst = key_hash(record) % num_partitions;
+        ++records[dst];
+        return dst;
+      };
+      ScatterAndPush(tc, *this_partition, partitioner, push_threshold, compressor, header_size, msg_id, msg.get());
+
+      CompressMessages(compressor, header_size, msg.get());
+      ReportShuffleSend(tc, msg_id, records, *msg, header_size, start_time);
       tc->InsertDatasetPartition(msg_id, msg);
     });
 
-    RegisterClosure(deserialize->GetId(), [ msg_id = shuffled.GetId(), ret_id = ret.GetId(), key_hash, key, combiner ](TaskContext * tc) {
+    RegisterClosure(deserialize->GetId(), [ pushed_id = message.GetId(), msg_id = shuffled.GetId(), ret_id = ret.GetId(),
+                                            key_hash, key, combiner ](TaskContext * tc) {
       auto time0 = std::chrono::steady_clock::now();
       auto msg = tc->GetDatasetPartition<std::shared_ptr<BinStream>>(msg_id);
+      AppendPushedMessages(tc, pushed_id, msg.get());
+      auto message_bytes = GetMessageBytes(*msg);
+      auto last_sent_us = PrepareMessages(msg.get());
       DatasetPartition<Val> data;
       // Deserialize
-      for (auto& binstream_ptr : *msg) {
-        while (binstream_ptr->size() > 0) {
-          Val val;
-          *binstream_ptr >> val;
-          data.push_back(val);
-        }
-      }
+      DeserializeMessages(*msg, &data);
+      ReportShuffleReceive(tc, msg_id, data.size(), message_bytes, time0, last_sent_us);
 
       if (data.empty()) {
         DLOG(INFO) << "No data received for current shard";
@@ -351,52 +399,82 @@ class Dataset : public AbstractDataset {
 
     auto message = Dataset<BinStream>::Create(serialize, task_graph_, parallelism_);
     auto shuffled = Dataset<BinStream>::Create(net_task, task_graph_, num_partitions);
+    ShuffleMetrics::Get().RegisterEdge(message.GetId(), shuffled.GetId(), serialize->GetName());
     auto ret = Dataset<Val>::Create(deserialize, task_graph_, num_partitions);
 
-    RegisterClosure(serialize->GetId(), [ key_selector, &combiner, num_partitions, msg_id = message.GetId(), id = id_ ](TaskContext * tc) {
+    RegisterClosure(serialize->GetId(), [ compressor = compressor_, memory_limit = shuffle_memory_limit_, push_threshold = push_threshold_,
+                                          key_selector, combiner, num_partitions, msg_id = message.GetId(), id = id_ ](TaskContext * tc) {
       auto this_partition = tc->GetDatasetPartition<Val>(id);
       std::vector<std::vector<Val>> local_buffer(num_partitions);
       auto msg = std::make_shared<DatasetPartition<std::shared_ptr<BinStream>>>(
           CreateMessagePartition(num_partitions, msg_id, tc->GetShardId(), tc->GetInstanceId()));
+      auto header_size = msg->at(0)->size();
+      auto start_time = std::chrono::steady_clock::now();
+      std::vector<uint64_t> records(num_partitions, 0);
+      if (memory_limit > 0) {
+        // Spill sorted and combined runs when the buffered records exceed the limit, then merge-combine the runs from
+        // disk into the messages, so that the map output is not held as records besides the messages. With pushing, the
+        // messages are shipped as they fill up and are not held whole either
+        ExternalShuffleWriter<Val> writer(num_partitions, memory_limit, FLAGS_worker_husky_scratch_dir,
+                                          [key_selector](const Val& a, const Val& b) { return key_selector(a) < key_selector(b); }, combiner);
+        for (auto& record : *this_partition) {
+          writer.Add(hash(key_selector(record)) % num_partitions, record);
+        }
+        writer.Finish([&](size_t dst, const Val* data, size_t n) {
+          SerializeRun(*msg->at(dst), data, n);
+          records[dst] += n;
+          PushFullMessages(tc, push_threshold, compressor, header_size, msg_id, msg.get());
+        });
+        CompressMessages(compressor, header_size, msg.get());
+        ReportShuffleSend(tc, msg_id, records, *msg, header_size, start_time);
+        tc->InsertDatasetPartition(msg_id, msg);
+        return;
+      }
       for (auto& record : *this_partition) {
         local_buffer.at(hash(key_selector(record)) % num_partitions).push_back(record);
       }
 
-      // Combine & serialize
-      for (auto iter = local_buffer.begin(); iter != local_buffer.end(); ++iter) {
-        if (iter->empty()) {
+      // Combine & serialize, all records in local_buffer[dst] are sent to destination dst
+      for (size_t dst = 0; dst < local_buffer.size(); ++dst) {
+        auto& buffer = local_buffer[dst];
+        if (buffer.empty()) {
           continue;
         }
-        std::sort(iter->begin(), iter->end(), [key_selector](const Val& a, const Val& b) { return key_selector(a) < key_selector(b); });
-        auto current_key = key_selector(iter->front());
-        size_t current_idx = 0;
-        for (size_t i = 1; i < iter->size(); ++i) {
-          auto this_key = key_selector((*iter)[i]);
+        std::sort(buffer.begin(), buffer.end(), [key_selector](const Val& a, const Val& b) { return key_selector(a) < key_selector(b); });
+        auto current_key = key_selector(buffer.front());
+        size_t current_idx = 0, count = 0;
+        for (size_t i = 1; i < buffer.size(); ++i) {
+          auto this_key = key_selector(buffer[i]);
           if (this_key == current_key) {
-            combiner((*iter)[current_idx], (*iter)[i]);
+            combiner(buffer[current_idx], buffer[i]);
           } else {
-            *(msg->at(hash(current_key) % num_partitions)) << (*iter)[current_idx];
+            buffer[count++] = buffer[current_idx];
             current_idx = i;
             current_key = this_key;
           }
         }
-        *(msg->at(hash(current_key) % num_partitions)) << (*iter)[current_idx];
+        buffer[count++] = buffer[current_idx];
+        SerializeRun(*msg->at(dst), buffer.data(), count);
+        records[dst] = count;
+        PushFullMessages(tc, push_threshold, compressor, header_size, msg_id, msg.get());
       }
 
+      CompressMessages(compressor, header_size, msg.get());
+      ReportShuffleSend(tc, msg_id, records, *msg, header_size, start_time);
       tc->InsertDatasetPartition(msg_id, msg);
     });
 
-    RegisterClosure(deserialize->GetId(), [ msg_id = shuffled.GetId(), ret_id = ret.GetId(), key_selector, &combiner ](TaskContext * tc) {
+    RegisterClosure(deserialize->GetId(), [ pushed_id = message.GetId(), msg_id = shuffled.GetId(), ret_id = ret.GetId(),
+                                            key_selector, combiner ](TaskContext * tc) {
+      auto start_time = std::chrono::steady_clock::now();
       auto msg = tc->GetDatasetPartition<std::shared_ptr<BinStream>>(msg_id);
+      AppendPushedMessages(tc, pushed_id, msg.get());
+      auto message_bytes = GetMessageBytes(*msg);
+      auto last_sent_us = PrepareMessages(msg.get());
       DatasetPartition<Val> data;
       // Deserialize
-      for (auto& binstream_ptr : *msg) {
-        while (binstream_ptr->size() > 0) {
-          Val val;
-          *binstream_ptr >> val;
-          data.push_back(val);
-        }
-      }
+      DeserializeMessages(*msg, &data);
+      ReportShuffleReceive(tc, msg_id, data.size(), message_bytes, start_time, last_sent_us);
 
       if (data.empty()) {
         DLOG(INFO) << "No data received for current shard";
@@ -433,6 +511,152 @@ class Dataset : public AbstractDataset {
   }
 
  protected:
+  /** Serialize n contiguous records to a message stream, as a compact run if Val opts in to the compact encoding. **/
+  template <typename T = Val>
+  static typename std::enable_if<base::use_compact_encoding<T>::value>::type SerializeRun(BinStream& stream, const Val* data, size_t n) {
+    base::SerializeCompactRun(stream, data, n);
+  }
+
+  template <typename T = Val>
+  static typename std::enable_if<!base::use_compact_encoding<T>::value>::type SerializeRun(BinStream& stream, const Val* data, size_t n) {
+    base::SerializeRange(stream, data, n);
+  }
+
+  /** Scatter records to the message streams, pushing the streams that fill up every kPushBatchSize records. **/
+  template <typename Partitioner>
+  static void ScatterAndPush(TaskContext* tc, const DatasetPartition<Val>& data, Partitioner partitioner, size_t push_threshold,
+                             const std::shared_ptr<base::MessageCompressor>& compressor, size_t header_size, DataIdType msg_id,
+                             DatasetPartition<std::shared_ptr<BinStream>>* msg) {
+    if (!CanPushMessages(push_threshold)) {
+      ScatterToMessages(data.data(), data.size(), partitioner, msg);
+      return;
+    }
+    for (size_t begin = 0; begin < data.size(); begin += kPushBatchSize) {
+      ScatterToMessages(data.data() + begin, std::min(kPushBatchSize, data.size() - begin), partitioner, msg);
+      PushFullMessages(tc, push_threshold, compressor, header_size, msg_id, msg);
+    }
+  }
+
+  static const size_t kPushBatchSize = 4096;
+
+  /** Serialize each record to the message stream of the destination given by partitioner.
+   *
+   * Packable records are counted per destination first, so that each destination stream is grown once and filled in
+   * place instead of growing by sizeof(Val) bytes per record. Records in the compact encoding are bucketed per
+   * destination by index, and each bucket is sorted by its delta-coded key, if any, and written as one run.
+   */
+  template <typename Partitioner, typename T = Val>
+  static typename std::enable_if<base::use_compact_encoding<T>::value>::type ScatterToMessages(
+      const Val* data, size_t n, Partitioner partitioner, DatasetPartition<std::shared_ptr<BinStream>>* msg) {
+    std::vector<std::vector<size_t>> buckets(msg->size());
+    for (size_t i = 0; i < n; ++i) {
+      buckets.at(partitioner(data[i])).push_back(i);
+    }
+    for (size_t dst = 0; dst < buckets.size(); ++dst) {
+      auto& bucket = buckets[dst];
+      if (!bucket.empty()) {
+        base::SortCompactRun(data, bucket.data(), bucket.size());
+        base::SerializeCompactRun(*msg->at(dst), data, bucket.data(), bucket.size());
+      }
+    }
+  }
+
+  template <typename Partitioner, typename T = Val>
+  static typename std::enable_if<base::is_packable<T>::value && !base::use_compact_encoding<T>::value>::type ScatterToMessages(
+      const Val* data, size_t n, Partitioner partitioner, DatasetPartition<std::shared_ptr<BinStream>>* msg) {
+    std::vector<uint32_t> destinations(n);
+    std::vector<size_t> counts(msg->size(), 0);
+    for (size_t i = 0; i < n; ++i) {
+      destinations[i] = partitioner(data[i]);
+      ++counts.at(destinations[i]);
+    }
+    std::vector<char*> cursors(msg->size());
+    for (size_t dst = 0; dst < msg->size(); ++dst) {
+      cursors[dst] = msg->at(dst)->extend(counts[dst] * base::packer<Val>::size);
+    }
+    for (size_t i = 0; i < n; ++i) {
+      cursors[destinations[i]] = base::packer<Val>::pack(cursors[destinations[i]], data[i]);
+    }
+  }
+
+  template <typename Partitioner, typename T = Val>
+  static typename std::enable_if<!base::is_packable<T>::value && !base::use_compact_encoding<T>::value>::type ScatterToMessages(
+      const Val* data, size_t n, Partitioner partitioner, DatasetPartition<std::shared_ptr<BinStream>>* msg) {
+    for (size_t i = 0; i < n; ++i) {
+      *(msg->at(partitioner(data[i]))) << data[i];
+    }
+  }
+
+  /** Append the records in the received message streams to data. Each stream holds a sequence of compact runs. **/
+  template <typename T = Val>
+  static typename std::enable_if<base::use_compact_encoding<T>::value>::type DeserializeMessages(
+      const DatasetPartition<std::shared_ptr<BinStream>>& msg, DatasetPartition<Val>* data) {
+    for (auto& binstream_ptr : msg) {
+      while (binstream_ptr->size() > 0) {
+        base::DeserializeCompactRun<Val>(*binstream_ptr, data);
+      }
+    }
+  }
+
+  /** Append the records in the received message streams to data. Packable records are read in bulk.
+   *
+   * When data is empty and all records arrive in one stream, records whose memory layout is their wire layout are not
+   * copied at all: data becomes a view over the received buffer.
+   */
+  template <typename T = Val>
+  static typename std::enable_if<base::is_packable<T>::value && !base::use_compact_encoding<T>::value>::type DeserializeMessages(
+      const DatasetPartition<std::shared_ptr<BinStream>>& msg, DatasetPartition<Val>* data) {
+    size_t n_records = 0, n_sources = 0;
+    std::shared_ptr<BinStream> source;
+    for (auto& binstream_ptr : msg) {
+      CHECK_EQ(binstream_ptr->size() % base::packer<Val>::size, 0) << "Received message is not a whole number of records";
+      if (binstream_ptr->size() > 0) {
+        n_records += binstream_ptr->size() / base::packer<Val>::size;
+        source = binstream_ptr;
+        ++n_sources;
+      }
+    }
+    if (n_sources == 1 && data->empty() && ViewMessage(source, n_records, data)) {
+      return;
+    }
+    data->reserve(data->size() + n_records);
+    for (auto& binstream_ptr : msg) {
+      auto n = binstream_ptr->size() / base::packer<Val>::size;
+      auto offset = data->size();
+      data->resize(offset + n);
+      base::DeserializeRange(*binstream_ptr, data->data() + offset, n);
+    }
+  }
+
+  /** Make data a zero-copy view over the next n records in source if the stream allows. **/
+  template <typename T = Val>
+  static typename std::enable_if<base::is_memcpy_packable<T>::value, bool>::type ViewMessage(const std::shared_ptr<BinStream>& source, size_t n,
+                                                                                             DatasetPartition<Val>* data) {
+    if (!DatasetPartition<Val>::CanView(*source, n)) {
+      return false;
+    }
+    *data = DatasetPartition<Val>(source, n);
+    return true;
+  }
+
+  template <typename T = Val>
+  static typename std::enable_if<!base::is_memcpy_packable<T>::value, bool>::type ViewMessage(const std::shared_ptr<BinStream>&, size_t,
+                                                                                              DatasetPartition<Val>*) {
+    return false;
+  }
+
+  template <typename T = Val>
+  static typename std::enable_if<!base::is_packable<T>::value && !base::use_compact_encoding<T>::value>::type DeserializeMessages(
+      const DatasetPartition<std::shared_ptr<BinStream>>& msg, DatasetPartition<Val>* data) {
+    for (auto& binstream_ptr : msg) {
+      while (binstream_ptr->size() > 0) {
+        Val val;
+        *binstream_ptr >> val;
+        data->push_back(std::move(val));
+      }
+    }
+  }
+
   Dataset<Val>(TaskGraph* tg) : AbstractDataset(tg) {}
   Dataset<Val>(const std::shared_ptr<Task>& producer, TaskGraph* task_graph, int parallelism = 10) : AbstractDataset(producer, task_graph) {
     DCHECK_EQ(parallelism, producer->GetParallelism());
@@ -14,9 +14,12 @@
 
 #pragma once
 
+#include <cstdint>
+
 #include <algorithm>
 #include <iostream>
 #include <memory>
+#include <new>
 #include <numeric>
 #include <string>
 #include <type_traits>
@@ -25,7 +28,9 @@
 
 #include "glog/logging.h"
 
+#include "base/arena.h"
 #include "base/bin_stream.h"
+#include "base/buffer_allocator.h"
 #include "common/dataset/partition.h"
 #include "common/has_method.h"
 
@@ -123,6 +128,20 @@ class DatasetPartition : public Partition {
    */
   explicit DatasetPartition(size_t size) { resize(size); }
 
+  /** Create an empty partition whose buffers are allocated from an arena.
+   *
+   * Growing the buffer extends it in place while it is the last allocation of the arena. The buffers stay valid after
+   * the arena is rewound or destroyed, and the partition falls back to the heap once the arena is gone. The arena must
+   * be owned by a std::shared_ptr (e.g. TaskContext::GetArena()), otherwise the partition uses the heap.
+   *
+   * @param arena the arena, or nullptr for the heap.
+   */
+  explicit DatasetPartition(base::Arena* arena) {
+    if (arena != nullptr) {
+      Reset(nullptr, 0, BufferDeleter{arena->weak_from_this(), nullptr, 0});
+    }
+  }
+
   /** Construct from a shared pointer of std::vector.
    *
    * Zero-copy constructor, copying the pointer only.
@@ -135,6 +154,30 @@ class DatasetPartition : public Partition {
     capacity_ = size_;
   }
 
+  /** Construct a view over the next n records in a received BinStream.
+   *
+   * Zero-copy constructor: the records stay in the stream buffer, which is kept alive by the partition, and the n
+   * records are consumed from the stream. Val must be a packable type whose memory layout is its wire layout, and the
+   * stream must pass CanView.
+   *
+   * @param bin the source stream.
+   * @param n   the number of records to view.
+   */
+  DatasetPartition(const std::shared_ptr<base::BinStream>& bin, size_t n) {
+    static_assert(base::is_memcpy_packable<Val>::value, "Only records whose memory layout is their wire layout can be viewed in place");
+    CHECK(CanView(*bin, n)) << "Cannot view " << n << " records in place over a stream of " << bin->size() << " bytes";
+    auto records = static_cast<Val*>(bin->pop_front_bytes(n * sizeof(Val)));
+    Reset(records, n, [bin](Val*) {});
+  }
+
+  /** Whether the next n records in bin can be viewed in place, i.e. the stream holds them and is aligned for Val. **/
+  static bool CanView(const base::BinStream& bin, size_t n) {
+    if (!base::is_memcpy_packable<Val>::value || n == 0 || bin.size() < n * sizeof(Val)) {
+      return false;
+    }
+    return reinterpret_cast<uintptr_t>(bin.get_remained_buffer()) % alignof(Val) == 0;
+  }
+
   /* Copy */
 
   /** Copy from a std::vector. **/
@@ -223,7 +266,12 @@ class DatasetPartition : public Partition {
   /** Release the memory. **/
   inline void clear() override {
     Partition::clear();
-    Reset(nullptr, 0, [](Val* data) {});
+    auto deleter = std::get_deleter<BufferDeleter>(ptr_);
+    if (deleter != nullptr) {
+      Reset(nullptr, 0, BufferDeleter{deleter->arena, nullptr, 0});
+    } else {
+      Reset(nullptr, 0, [](Val* data) {});
+    }
   }
 
   inline bool empty() const override { return size_ == 0; }
@@ -316,12 +364,16 @@ class DatasetPartition : public Partition {
     ret->ptr_ = std::shared_ptr<Val>(ptr_, data() + offset);
     ret->size_ = size;
     ret->capacity_ = size;
-    if ((ret->has_null_ = has_null_)) {
-      ret->not_null_.insert(ret->not_null_.end(), not_null_.begin() + offset, not_null_.begin() + offset + size);
-    }
+    ret->SliceNotNull(*this, offset, size);
     return ret;
   }
 
+  /** The arena the buffers are allocated from, or nullptr for the heap. **/
+  std::shared_ptr<base::Arena> GetArena() const {
+    auto deleter = std::get_deleter<BufferDeleter>(ptr_);
+    return deleter == nullptr ? nullptr : deleter->arena.lock();
+  }
+
   /** Get the shared pointer. **/
   inline std::shared_ptr<Val>& GetPtr() { return ptr_; }
   /** Get the const shared pointer. **/
@@ -364,7 +416,7 @@ class DatasetPartition : public Partition {
       res.push_back(at(permutation[i]));
     }
     ptr_ = res.ptr_;
-    Partition::ApplyPermutation(permutation);
+    PermuteNotNull(permutation);
   };
 
   void ApplyPermutation(const std::vector<uint32_t>& permutation) override {
@@ -375,7 +427,7 @@ class DatasetPartition : public Partition {
       res.push_back(at(permutation[i]));
     }
     ptr_ = res.ptr_;
-    Partition::ApplyPermutation(permutation);
+    PermuteNotNull(permutation);
   };
 
   void ApplyFilter(const std::vector<bool>& to_keep) override {
@@ -387,7 +439,7 @@ class DatasetPartition : public Partition {
       }
     }
     resize(cur);
-    Partition::ApplyFilter(to_keep);
+    FilterNotNull(to_keep);
   }
 
   std::shared_ptr<Partition> Filter(const std::vector<bool>& to_keep, size_t size) const override {
@@ -395,26 +447,46 @@ class DatasetPartition : public Partition {
     CHECK_LE(size, size_);
     auto ret = std::make_shared<DatasetPartition<Val>>();
     ret->reserve(size);
-    ret->not_null_.reserve(size);
-    if (has_null_) {
-      ret->has_null_ = has_null_;
-      for (int i = 0; i < size_; ++i) {
-        if (to_keep.at(i)) {
-          ret->push_back(at(i));
-          ret->not_null_.push_back(not_null_[i]);
-        }
-      }
-    } else {
-      for (int i = 0; i < size_; ++i) {
-        if (to_keep.at(i)) {
-          ret->push_back(at(i));
-        }
+    for (int i = 0; i < size_; ++i) {
+      if (to_keep.at(i)) {
+        ret->push_back(at(i));
       }
     }
+    ret->FilterNotNullFrom(*this, to_keep);
     CHECK_EQ(ret->size(), size);
     return ret;
   }
 
+  /** Keep the selected rows whose values satisfy predicate(value). **/
+  template <typename Predicate>
+  void Refine(SelectionVector* selection, Predicate predicate) const {
+    auto values = data();
+    selection->Refine([values, &predicate](SelectionVector::index_type row) { return predicate(values[row]); });
+  }
+
+  /** A new partition of the selected rows, gathered by index. **/
+  std::shared_ptr<Partition> Compact(const SelectionVector& selection) const {
+    auto ret = std::make_shared<DatasetPartition<Val>>();
+    ret->reserve(selection.size());
+    for (auto row : selection) {
+      ret->push_back(at(row));
+    }
+    ret->GatherNotNullFrom(*this, selection.GetRows());
+    return ret;
+  }
+
+  /** Keep only the selected rows, moving them to the front in place. **/
+  void ApplySelection(const SelectionVector& selection) {
+    CHECK_LE(selection.size(), size_);
+    for (size_t i = 0; i < selection.size(); ++i) {
+      if (selection[i] != i) {
+        at(i) = std::move(at(selection[i]));
+      }
+    }
+    GatherNotNullFrom(*this, selection.GetRows());
+    resize(selection.size());
+  }
+
   void AppendPartition(const std::shared_ptr<Partition>& rhs) override {
     CHECK_EQ(rhs->size() * rhs->HasNull(), rhs->GetNotNull().size() * rhs->HasNull());
     CHECK_EQ(size() * HasNull(), GetNotNull().size() * HasNull());
@@ -423,7 +495,7 @@ class DatasetPartition : public Partition {
     auto old_size = size_;
     resize(size_ + ds_ptr->size());
     memcpy(data() + old_size, ds_ptr->data(), ds_ptr->size() * sizeof(Val));
-    AppendNull(rhs);
+    AppendNotNull(*rhs);
     if (has_null_) {
       CHECK_EQ(not_null_.size(), size()) << "old " << old_size << " " << ds_ptr->size() << " ";
     }
@@ -443,6 +515,23 @@ class DatasetPartition : public Partition {
   double GetMemory() const override { return GetMemoryInternal<Val>(0); }
 
  protected:
+  /** Deleter of buffers in raw memory (arena blocks or large buffers of the BufferAllocator): destroys the constructed
+   * values and releases the share of the memory.
+   */
+  struct BufferDeleter {
+    std::weak_ptr<base::Arena> arena;  // empty unless the buffer is in an arena
+    std::shared_ptr<char> block;
+    size_t constructed;
+
+    void operator()(Val* data) {
+      if (!std::is_trivially_destructible<Val>::value) {
+        for (size_t i = 0; i < constructed; ++i) {
+          data[i].~Val();
+        }
+      }
+    }
+  };
+
   /** Reset the current data pointer with a deleter. **/
   template <typename Deleter>
   void Reset(Val* ptr, size_t size, Deleter del) {
@@ -466,17 +555,60 @@ class DatasetPartition : public Partition {
       return;
     }
 
-    GetNewBuffer(size + 5, data(), data() + size_);
+    if (!ExtendArenaBuffer(size + 5)) {
+      GetNewBuffer(size + 5, data(), data() + size_);
+    }
     size_ = size;
   }
 
   template <typename ForwardIt>
   void GetNewBuffer(size_t size, const ForwardIt& first, const ForwardIt& last) {
+    auto arena = GetArena();
+    if (arena != nullptr) {
+      BufferDeleter deleter{arena, nullptr, size};
+      Val* new_data = static_cast<Val*>(arena->AllocateShared(size * sizeof(Val), alignof(Val), &deleter.block));
+      ConstructValues(new_data, size);
+      std::move(first, last, new_data);
+      Reset(new_data, size, std::move(deleter));
+      return;
+    }
+    if (base::BufferAllocator::Get().IsLarge(size * sizeof(Val))) {
+      BufferDeleter deleter{std::weak_ptr<base::Arena>(), base::BufferAllocator::Get().Allocate(size * sizeof(Val)), size};
+      Val* new_data = reinterpret_cast<Val*>(deleter.block.get());
+      ConstructValues(new_data, size);
+      std::move(first, last, new_data);
+      Reset(new_data, size, std::move(deleter));
+      return;
+    }
     Val* new_data = new Val[size];
     std::move(first, last, new_data);
     Reset(new_data, size, [](Val* data) { delete[] data; });
   }
 
+  /** Grow an arena buffer to capacity in place, if it is the last allocation of its arena. **/
+  bool ExtendArenaBuffer(size_t capacity) {
+    auto deleter = std::get_deleter<BufferDeleter>(ptr_);
+    if (deleter == nullptr || deleter->constructed != capacity_) {
+      return false;
+    }
+    auto arena = deleter->arena.lock();
+    if (arena == nullptr || !arena->TryExtend(data(), capacity_ * sizeof(Val), capacity * sizeof(Val))) {
+      return false;
+    }
+    ConstructValues(data() + capacity_, capacity - capacity_);
+    deleter->constructed = capacity_ = capacity;
+    return true;
+  }
+
+  /** Default-initialize n values in raw memory, as new Val[n] does. **/
+  static void ConstructValues(Val* data, size_t n) {
+    if (!std::is_trivially_default_constructible<Val>::value) {
+      for (size_t i = 0; i < n; ++i) {
+        new (data + i) Val;
+      }
+    }
+  }
+
   template <typename SizeT = size_t>
   inline void SetValues(std::enable_if_t<std::is_copy_assignable<Val>::value, SizeT> index, size_t length, const Val& val) {
     std::fill(data() + index, data() + index + length, val);
@@ -0,0 +1,504 @@
+// Copyright 2020 HDL
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "glog/logging.h"
+
+#include "base/bin_stream.h"
+#include "common/dataset/macro.h"
+#include "common/dataset/partition.h"
+#include "common/dataset/string_partition.h"
+
+namespace axe {
+namespace common {
+
+/** The distinct strings of a DictionaryStringPartition. A string is identified by its code, i.e. its position in the
+ * dictionary, and codes never change once assigned. The index refers to the strings in place, which is safe because
+ * StringPartition never moves the strings already written.
+ */
+class StringDictionary {
+ public:
+  using code_type = uint32_t;
+
+  StringDictionary() = default;
+  StringDictionary(const StringDictionary& other) : values_(other.values_) { Reindex(); }
+
+  /** The code of value, adding value to the dictionary if it is new. **/
+  code_type GetOrInsert(const string_view& value) {
+    auto it = index_.find(value);
+    if (it != index_.end()) {
+      return it->second;
+    }
+    CHECK_LT(values_.size(), std::numeric_limits<code_type>::max()) << "[StringDictionary] too many distinct values";
+    code_type code = values_.size();
+    values_.push_back(value);
+    index_.emplace(values_[code], code);
+    return code;
+  }
+
+  /** Look up the code of value. Returns false if value is not in the dictionary. **/
+  bool Find(const string_view& value, code_type* code) const {
+    auto it = index_.find(value);
+    if (it == index_.end()) {
+      return false;
+    }
+    *code = it->second;
+    return true;
+  }
+
+  inline string_view operator[](code_type code) const { return values_[code]; }
+  inline size_t size() const { return values_.size(); }
+  inline const StringPartition& GetValues() const { return values_; }
+
+  /** The rank of each code in the sorted order of the strings, computed once per dictionary size. Only the first call
+   * after the dictionary grows takes the lock.
+   */
+  const std::vector<uint32_t>& GetRanks() const {
+    if (ranked_size_.load(std::memory_order_acquire) == values_.size()) {
+      return ranks_;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (ranks_.size() != values_.size()) {
+      std::vector<uint32_t> order(values_.size());
+      std::iota(order.begin(), order.end(), 0);
+      std::sort(order.begin(), order.end(), [this](uint32_t l, uint32_t r) { return values_[l] < values_[r]; });
+      ranks_.resize(values_.size());
+      for (uint32_t i = 0; i < order.size(); ++i) {
+        ranks_[order[i]] = i;
+      }
+    }
+    ranked_size_.store(ranks_.size(), std::memory_order_release);
+    return ranks_;
+  }
+
+  /** Memory usage in bytes, approximating a hash table node per index entry. **/
+  double GetMemory() const {
+    return values_.GetMemory() + index_.size() * (sizeof(string_view) + sizeof(code_type) + 2 * sizeof(void*)) +
+           index_.bucket_count() * sizeof(void*) + ranks_.capacity() * sizeof(uint32_t);
+  }
+
+ private:
+  void Reindex() {
+    index_.reserve(values_.size());
+    for (code_type code = 0; code < values_.size(); ++code) {
+      index_.emplace(values_[code], code);
+    }
+  }
+
+  StringPartition values_;
+  std::unordered_map<string_view, code_type> index_;
+  mutable std::mutex mutex_;
+  mutable std::vector<uint32_t> ranks_;
+  mutable std::atomic<size_t> ranked_size_{0};  // the dictionary size ranks_ was computed for
+};
+
+class DictionaryStringPartition;
+
+class DictionaryStringPartitionIterator : public PartitionIterator {
+ public:
+  using value_type = string_view;
+  using size_type = size_t;
+
+  DictionaryStringPartitionIterator(size_type pos, const DictionaryStringPartition* dp) : pos_(pos), dp_(dp) {}
+
+  std::pair<const void*, size_t> GetPtr() const override;
+
+  value_type operator*() const;
+
+  void operator++() override { ++pos_; }
+  bool operator==(const DictionaryStringPartitionIterator& rhs) { return pos_ == rhs.pos_; }
+  bool operator!=(const DictionaryStringPartitionIterator& rhs) { return pos_ != rhs.pos_; }
+  bool operator<(const DictionaryStringPartitionIterator& rhs) { return pos_ < rhs.pos_; }
+
+ private:
+  size_type pos_;
+  const DictionaryStringPartition* dp_;
+};
+
+/** Dictionary-encoded partition of strings for low-cardinality columns, e.g. country codes or event types.
+ *
+ * Each row holds the code of its string in a StringDictionary. Equality and grouping run on the codes, and ordering
+ * runs on the ranks of the codes, so Compare and GetSortedIndex never compare the strings of the rows (GetSortedIndex
+ * is a counting sort over the ranks). Slice, Filter and copies share the dictionary, which is copied before a new
+ * string is added to a shared dictionary. AppendPartition merges the dictionaries, remapping each code of the other
+ * partition once rather than looking up every row.
+ *
+ * serialize writes only the strings in use, followed by the codes in the narrowest of 1, 2 and 4 bytes that fits.
+ */
+class DictionaryStringPartition : public Partition {
+ public:
+  using value_type = string_view;
+  using code_type = StringDictionary::code_type;
+  using iterator = DictionaryStringPartitionIterator;
+  using const_iterator = DictionaryStringPartitionIterator;
+
+  DictionaryStringPartition() : dictionary_(std::make_shared<StringDictionary>()) {}
+
+  /** A partition encoding its strings with the given dictionary, e.g. one shared by the partitions of a column. **/
+  explicit DictionaryStringPartition(const std::shared_ptr<StringDictionary>& dictionary) : dictionary_(dictionary) {}
+
+  /** Encode the strings and the null flags of a StringPartition. **/
+  static std::shared_ptr<DictionaryStringPartition> Encode(const StringPartition& strings) {
+    auto ret = std::make_shared<DictionaryStringPartition>();
+    ret->reserve(strings.size());
+    for (auto str : strings) {
+      ret->push_back(str);
+    }
+    if ((ret->has_null_ = strings.HasNull())) {
+      ret->not_null_ = strings.GetNotNull();
+    }
+    return ret;
+  }
+
+  /** Decode into a StringPartition with the same strings and null flags. **/
+  std::shared_ptr<StringPartition> Decode() const {
+    auto ret = std::make_shared<StringPartition>();
+    ret->reserve(codes_.size());
+    for (auto code : codes_) {
+      ret->push_back((*dictionary_)[code]);
+    }
+    if (has_null_) {
+      std::vector<uint32_t> null_idx;
+      for (uint32_t i = 0; i < not_null_.size(); ++i) {
+        if (!not_null_[i]) {
+          null_idx.push_back(i);
+        }
+      }
+      ret->SetNull(null_idx);
+    }
+    return ret;
+  }
+
+  /* Vector-like APIs */
+
+  void reserve(size_t size) override { codes_.reserve(size); }
+
+  /** Resize the array to size elements. If size > size(), append entries with empty string. **/
+  void resize(size_t size) override {
+    if (size > codes_.size()) {
+      codes_.resize(size, GetOrInsert(value_type()));
+    } else {
+      codes_.resize(size);
+    }
+  }
+
+  /** Release the memory. **/
+  void clear() override {
+    Partition::clear();
+    codes_.clear();
+    codes_.shrink_to_fit();
+    dictionary_ = std::make_shared<StringDictionary>();
+  }
+
+  bool empty() const override { return codes_.empty(); }
+  size_t size() const override { return codes_.size(); }
+
+  inline iterator begin() const { return iterator(0, this); }
+  inline iterator end() const { return iterator(codes_.size(), this); }
+
+  inline value_type operator[](size_t i) const { return (*dictionary_)[codes_[i]]; }
+
+  inline value_type at(size_t i) const {
+    if (i >= codes_.size()) {
+      throw std::out_of_range("[DictionaryStringPartition] Index out of range when accessing " + std::to_string(i) +
+                              "-th position. size is " + std::to_string(codes_.size()));
+    }
+    return (*this)[i];
+  }
+
+  void push_back(const char* data, uint32_t length) override { codes_.push_back(GetOrInsert(value_type(data, length))); }
+  void push_back(const std::pair<const void*, size_t>& val) override { push_back((const char*) val.first, val.second); }
+  inline void push_back(const value_type& val) { codes_.push_back(GetOrInsert(val)); }
+  inline void push_back(const std::string& val) { push_back(value_type(val)); }
+
+  /** Append a row by code, which must be a code of the dictionary of this partition. **/
+  inline void push_back_code(code_type code) {
+    DCHECK_LT(code, dictionary_->size());
+    codes_.push_back(code);
+  }
+
+  inline void pop_back() { codes_.pop_back(); }
+
+  void shrink_to_fit() override { codes_.shrink_to_fit(); }
+
+  /* End of vector-like APIs */
+
+  inline const std::vector<code_type>& GetCodes() const { return codes_; }
+  inline code_type GetCode(size_t i) const { return codes_[i]; }
+  inline const std::shared_ptr<StringDictionary>& GetDictionary() const { return dictionary_; }
+
+  std::pair<const void*, size_t> At(size_t pos) override {
+    auto view = (*this)[pos];
+    return {view.data(), view.size()};
+  }
+
+  std::string Print(size_t pos) override {
+    if (IsNull(pos)) {
+      return "NULL";
+    }
+    auto view = at(pos);
+    return std::string(view.data(), view.length());
+  }
+
+  int Compare(size_t lhs, size_t rhs) const override {
+    auto l = codes_.at(lhs), r = codes_.at(rhs);
+    if (l == r) {
+      return 0;
+    }
+    auto& ranks = dictionary_->GetRanks();
+    return ranks[l] < ranks[r] ? -1 : 1;
+  }
+
+  int Compare(size_t pos, const std::pair<const void*, size_t>& rhs) const override {
+    return at(pos).compare(value_type((const char*) rhs.first, rhs.second));
+  }
+
+  void ApplyPermutation(const std::vector<size_t>& permutation) override { ApplyPermutationInner(permutation); }
+  void ApplyPermutation(const std::vector<uint32_t>& permutation) override { ApplyPermutationInner(permutation); }
+
+  std::shared_ptr<Partition> Filter(const std::vector<bool>& to_keep, size_t size) const override {
+    auto ret = std::make_shared<DictionaryStringPartition>(*this);
+    ret->ApplyFilter(to_keep);
+    return ret;
+  }
+
+  void ApplyFilter(const std::vector<bool>& to_keep) override {
+    CHECK_EQ(to_keep.size(), codes_.size()) << "Apply filter vector of size " << to_keep.size() << " to dictionary string partition of size "
+                                            << codes_.size();
+    size_t cur = 0;
+    for (size_t i = 0; i < codes_.size(); ++i) {
+      if (to_keep[i]) {
+        codes_[cur++] = codes_[i];
+      }
+    }
+    codes_.resize(cur);
+    FilterNotNull(to_keep);
+  }
+
+  /** Append a DictionaryStringPartition, merging its dictionary, or a StringPartition. **/
+  void AppendPartition(const std::shared_ptr<Partition>& rhs) override {
+    if (auto sp_ptr = std::dynamic_pointer_cast<StringPartition>(rhs)) {
+      codes_.reserve(codes_.size() + sp_ptr->size());
+      for (auto str : *sp_ptr) {
+        push_back(str);
+      }
+      AppendNotNull(*rhs);
+      return;
+    }
+    auto dp_ptr = std::dynamic_pointer_cast<DictionaryStringPartition>(rhs);
+    if (dp_ptr == nullptr) {
+      throw std::runtime_error("Cannot cast Partition to Dictionary String Partition while appending");
+    }
+    codes_.reserve(codes_.size() + dp_ptr->size());
+    if (dp_ptr->dictionary_ == dictionary_) {
+      codes_.insert(codes_.end(), dp_ptr->codes_.begin(), dp_ptr->codes_.end());
+    } else {
+      auto remap = MergeDictionary(*dp_ptr);
+      for (auto code : dp_ptr->codes_) {
+        codes_.push_back(remap[code]);
+      }
+    }
+    AppendNotNull(*rhs);
+  }
+
+  std::shared_ptr<PartitionIterator> Begin() const override { return std::make_shared<iterator>(0, this); }
+  std::shared_ptr<PartitionIterator> End() const override { return std::make_shared<iterator>(codes_.size(), this); }
+
+  /** Slice sharing the dictionary with this partition. **/
+  std::shared_ptr<Partition> Slice(size_t offset, size_t size) const override {
+    CHECK_LE(offset + size, codes_.size());
+    auto ret = std::make_shared<DictionaryStringPartition>(dictionary_);
+    ret->codes_.assign(codes_.begin() + offset, codes_.begin() + offset + size);
+    ret->SliceNotNull(*this, offset, size);
+    return ret;
+  }
+
+  /** Counting sort of the rows by the ranks of their codes, stable. **/
+  std::vector<uint32_t> GetSortedIndex() const override {
+    auto& ranks = dictionary_->GetRanks();
+    std::vector<uint32_t> start(ranks.size() + 1, 0);
+    for (auto code : codes_) {
+      ++start[ranks[code] + 1];
+    }
+    std::partial_sum(start.begin(), start.end(), start.begin());
+    std::vector<uint32_t> ret(codes_.size());
+    for (uint32_t i = 0; i < codes_.size(); ++i) {
+      ret[start[ranks[codes_[i]]]++] = i;
+    }
+    return ret;
+  }
+
+  /** Memory usage in bytes, including the (possibly shared) dictionary. **/
+  double GetMemory() const override { return codes_.capacity() * sizeof(code_type) + dictionary_->GetMemory(); }
+
+  /** Compact serialization: the strings in use, renumbered by first use, then the codes in 1, 2 or 4 bytes each. **/
+  base::BinStream& serialize(base::BinStream& stream) const {
+    const code_type kUnused = std::numeric_limits<code_type>::max();
+    std::vector<code_type> remap(dictionary_->size(), kUnused);
+    std::vector<code_type> used;
+    std::vector<code_type> codes(codes_.size());
+    for (size_t i = 0; i < codes_.size(); ++i) {
+      auto& code = remap[codes_[i]];
+      if (code == kUnused) {
+        code = used.size();
+        used.push_back(codes_[i]);
+      }
+      codes[i] = code;
+    }
+
+    std::vector<uint32_t> lengths(used.size());
+    uint64_t bytes = 0;
+    for (size_t i = 0; i < used.size(); ++i) {
+      lengths[i] = (*dictionary_)[used[i]].size();
+      bytes += lengths[i];
+    }
+    stream << static_cast<uint64_t>(used.size());
+    base::SerializeRange(stream, lengths.data(), lengths.size());
+    char* dst = stream.extend(bytes);
+    for (auto code : used) {
+      auto view = (*dictionary_)[code];
+      memcpy(dst, view.data(), view.size());
+      dst += view.size();
+    }
+
+    uint8_t width = used.size() <= (1u << 8) ? 1 : (used.size() <= (1u << 16) ? 2 : 4);
+    stream << static_cast<uint64_t>(codes.size()) << width;
+    if (width == 1) {
+      SerializeCodes<uint8_t>(stream, codes);
+    } else if (width == 2) {
+      SerializeCodes<uint16_t>(stream, codes);
+    } else {
+      base::SerializeRange(stream, codes.data(), codes.size());
+    }
+    stream << has_null_;
+    if (has_null_) {
+      auto words = PackBools(not_null_, codes_.size());  // the null flags a word at a time
+      base::SerializeRange(stream, words.data(), words.size());
+    }
+    return stream;
+  }
+
+  base::BinStream& deserialize(base::BinStream& stream) {
+    uint64_t n_values;
+    stream >> n_values;
+    std::vector<uint32_t> lengths(n_values);
+    base::DeserializeRange(stream, lengths.data(), n_values);
+    dictionary_ = std::make_shared<StringDictionary>();
+    auto bytes = std::accumulate(lengths.begin(), lengths.end(), uint64_t(0));
+    auto src = static_cast<const char*>(stream.pop_front_bytes(bytes));
+    for (auto length : lengths) {
+      dictionary_->GetOrInsert(value_type(src, length));
+      src += length;
+    }
+
+    uint64_t size;
+    uint8_t width;
+    stream >> size >> width;
+    codes_.resize(size);
+    if (width == 1) {
+      DeserializeCodes<uint8_t>(stream, &codes_);
+    } else if (width == 2) {
+      DeserializeCodes<uint16_t>(stream, &codes_);
+    } else {
+      base::DeserializeRange(stream, codes_.data(), size);
+    }
+    stream >> has_null_;
+    not_null_.clear();
+    if (has_null_) {
+      std::vector<uint64_t> words(BitmapOps::NumWords(size));
+      base::DeserializeRange(stream, words.data(), words.size());
+      UnpackBools(words.data(), 0, size, &not_null_);
+    }
+    return stream;
+  }
+
+ private:
+  template <typename Index>
+  void ApplyPermutationInner(const std::vector<Index>& permutation) {
+    CHECK(permutation.size() == codes_.size()) << "Size of permutation is not equals to size_";
+    std::vector<code_type> codes(codes_.size());
+    for (size_t i = 0; i < codes.size(); ++i) {
+      codes[i] = codes_[permutation[i]];
+    }
+    codes_ = std::move(codes);
+    PermuteNotNull(permutation);
+  }
+
+  /** Copy the dictionary before adding to it if it is shared with other partitions. **/
+  code_type GetOrInsert(const value_type& value) {
+    code_type code;
+    if (dictionary_.use_count() > 1) {
+      if (dictionary_->Find(value, &code)) {
+        return code;
+      }
+      dictionary_ = std::make_shared<StringDictionary>(*dictionary_);
+    }
+    return dictionary_->GetOrInsert(value);
+  }
+
+  /** Add the strings of the dictionary of other to this dictionary, returning the new code of each code of other. **/
+  std::vector<code_type> MergeDictionary(const DictionaryStringPartition& other) {
+    auto& dictionary = *other.dictionary_;
+    std::vector<code_type> remap(dictionary.size());
+    for (code_type code = 0; code < dictionary.size(); ++code) {
+      remap[code] = GetOrInsert(dictionary[code]);
+    }
+    return remap;
+  }
+
+  template <typename Narrow>
+  static void SerializeCodes(base::BinStream& stream, const std::vector<code_type>& codes) {
+    std::vector<Narrow> narrow(codes.begin(), codes.end());
+    base::SerializeRange(stream, narrow.data(), narrow.size());
+  }
+
+  template <typename Narrow>
+  static void DeserializeCodes(base::BinStream& stream, std::vector<code_type>* codes) {
+    std::vector<Narrow> narrow(codes->size());
+    base::DeserializeRange(stream, narrow.data(), narrow.size());
+    std::copy(narrow.begin(), narrow.end(), codes->begin());
+  }
+
+  std::shared_ptr<StringDictionary> dictionary_;
+  std::vector<code_type> codes_;
+};
+
+inline std::pair<const void*, size_t> DictionaryStringPartitionIterator::GetPtr() const {
+  if (pos_ >= dp_->size()) {
+    return {nullptr, 0};
+  }
+  auto view = (*dp_)[pos_];
+  return {view.data(), view.size()};
+}
+
+inline DictionaryStringPartitionIterator::value_type DictionaryStringPartitionIterator::operator*() const { return (*dp_)[pos_]; }
+
+}  // namespace common
+}  // namespace axe
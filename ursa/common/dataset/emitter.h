@@ -0,0 +1,77 @@
+// Copyright 2020 HDL
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <type_traits>
+#include <utility>
+
+#include "common/dataset/dataset_partition.h"
+
+namespace axe {
+namespace common {
+
+/** Appends the records a user function produces directly to the output partition of the task, instead of having the
+ * function return a partition per call.
+ */
+template <typename Val>
+class Emitter {
+ public:
+  using value_type = Val;
+
+  explicit Emitter(DatasetPartition<Val>* out) : out_(out) {}
+
+  inline void emit(const Val& val) { out_->push_back(val); }
+  inline void emit_move(Val&& val) { out_->push_back(std::move(val)); }
+
+  /** Make room for n more records. **/
+  inline void reserve(size_t n) { out_->reserve(out_->size() + n); }
+
+  inline size_t size() const { return out_->size(); }
+
+ private:
+  DatasetPartition<Val>* out_;
+};
+
+/** The record type of a function taking (arg, Emitter<Val>&), and void for other functions. Only functions with a
+ * single non-template call operator, e.g. lambdas with explicit parameter types, are detected.
+ */
+template <typename Lambda, typename = void>
+struct EmitterValue {
+  using type = void;
+};
+
+template <typename CallOperator>
+struct EmitterValueOf {
+  using type = void;
+};
+
+template <typename C, typename R, typename Arg, typename Val>
+struct EmitterValueOf<R (C::*)(Arg, Emitter<Val>&) const> {
+  using type = Val;
+};
+
+template <typename C, typename R, typename Arg, typename Val>
+struct EmitterValueOf<R (C::*)(Arg, Emitter<Val>&)> {
+  using type = Val;
+};
+
+template <typename Lambda>
+struct EmitterValue<Lambda, std::void_t<decltype(&Lambda::operator())>> : EmitterValueOf<decltype(&Lambda::operator())> {};
+
+template <typename Lambda>
+struct IsEmitterFunction : std::integral_constant<bool, !std::is_void<typename EmitterValue<Lambda>::type>::value> {};
+
+}  // namespace common
+}  // namespace axe
@@ -0,0 +1,278 @@
+// Copyright 2020 HDL
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <queue>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "glog/logging.h"
+
+#include "base/bin_stream.h"
+#include "common/has_method.h"
+
+namespace axe {
+namespace common {
+
+/** Map-side shuffle writer that bounds the memory of buffered map output by spilling runs to local disk.
+ *
+ * Records are buffered per destination. Once the estimated size of the buffers exceeds the memory limit, every
+ * destination buffer is sorted (and combined, if a combiner is given) and written as a run to a spill file in the
+ * scratch directory. Each spill file holds the runs of all destinations in destination order.
+ *
+ * Finish streams the output of each destination to a sink in chunks: the spilled runs and the in-memory buffer are
+ * merged in key order, combining equal keys. The records are then held by the sink only, e.g. serialized in messages.
+ */
+template <typename Val>
+class ExternalShuffleWriter {
+ public:
+  using Less = std::function<bool(const Val&, const Val&)>;
+  using Combiner = std::function<void(Val&, const Val&)>;
+  using Sink = std::function<void(size_t dst, const Val* data, size_t n)>;
+
+  /**
+   * @param num_destinations  number of destination shards
+   * @param memory_limit      bytes of records to buffer before spilling
+   * @param scratch_dir       local directory for spill files
+   * @param less              key order of the runs
+   * @param combiner          combines a record into another of the same key, or nullptr
+   */
+  ExternalShuffleWriter(size_t num_destinations, size_t memory_limit, const std::string& scratch_dir, Less less, Combiner combiner = nullptr)
+      : buffers_(num_destinations), runs_(num_destinations), memory_limit_(memory_limit), scratch_dir_(scratch_dir), less_(less),
+        combiner_(combiner) {
+    CHECK(less_ != nullptr) << "[ExternalShuffleWriter] runs require a key order";
+  }
+
+  ~ExternalShuffleWriter() {
+    for (auto& file : spill_files_) {
+      std::remove(file.c_str());
+    }
+  }
+
+  ExternalShuffleWriter(const ExternalShuffleWriter&) = delete;
+  ExternalShuffleWriter& operator=(const ExternalShuffleWriter&) = delete;
+
+  void Add(size_t dst, const Val& record) {
+    buffers_.at(dst).push_back(record);
+    buffered_bytes_ += EstimateSize(record);
+    if (buffered_bytes_ > memory_limit_) {
+      Spill();
+    }
+  }
+
+  /** Emit the output of every destination to sink, in chunks of at most kChunkSize records. **/
+  void Finish(const Sink& sink) {
+    for (size_t dst = 0; dst < buffers_.size(); ++dst) {
+      auto& buffer = buffers_[dst];
+      SortAndCombine(&buffer);
+      if (runs_[dst].empty()) {
+        if (!buffer.empty()) {
+          sink(dst, buffer.data(), buffer.size());
+        }
+      } else {
+        Merge(dst, sink);
+      }
+      std::vector<Val>().swap(buffer);
+    }
+    buffered_bytes_ = 0;
+  }
+
+  inline size_t GetNumSpills() const { return spill_files_.size(); }
+  inline size_t GetSpilledBytes() const { return spilled_bytes_; }
+
+  static constexpr size_t kBlockSize = 64 * 1024;
+  static constexpr size_t kChunkSize = 4096;
+
+ private:
+  struct Run {
+    size_t file_idx;
+    size_t offset;
+    size_t size;
+  };
+
+  /** Sequential reader of a spilled run, which is a sequence of [size][bytes] blocks of serialized records. **/
+  class RunReader {
+   public:
+    RunReader(const std::string& file, const Run& run) : in_(file, std::ios::binary), remaining_(run.size) {
+      CHECK(in_.is_open()) << "[ExternalShuffleWriter] cannot open spill file " << file;
+      in_.seekg(run.offset);
+    }
+
+    bool Next(Val* val) {
+      while (block_.size() == 0) {
+        if (remaining_ == 0) {
+          return false;
+        }
+        uint64_t block_size;
+        in_.read(reinterpret_cast<char*>(&block_size), sizeof(block_size));
+        std::vector<char> bytes(block_size);
+        in_.read(bytes.data(), block_size);
+        CHECK(in_.good()) << "[ExternalShuffleWriter] truncated spill file";
+        remaining_ -= sizeof(block_size) + block_size;
+        block_ = base::BinStream(std::move(bytes));
+      }
+      block_ >> *val;
+      return true;
+    }
+
+   private:
+    std::ifstream in_;
+    size_t remaining_;
+    base::BinStream block_;
+  };
+
+  template <typename T = Val>
+  static typename std::enable_if<HasGetMemory<T>::value, size_t>::type EstimateSize(const Val& record) {
+    return record.GetMemory();
+  }
+
+  template <typename T = Val>
+  static typename std::enable_if<!HasGetMemory<T>::value, size_t>::type EstimateSize(const Val&) {
+    return sizeof(Val);
+  }
+
+  inline bool Equal(const Val& a, const Val& b) const { return !less_(a, b) && !less_(b, a); }
+
+  void SortAndCombine(std::vector<Val>* buffer) const {
+    if (buffer->empty()) {
+      return;
+    }
+    std::stable_sort(buffer->begin(), buffer->end(), less_);
+    if (combiner_ == nullptr) {
+      return;
+    }
+    size_t count = 0;
+    for (size_t i = 1; i < buffer->size(); ++i) {
+      if (Equal(buffer->at(count), buffer->at(i))) {
+        combiner_(buffer->at(count), buffer->at(i));
+      } else {
+        buffer->at(++count) = std::move(buffer->at(i));
+      }
+    }
+    buffer->resize(count + 1);
+  }
+
+  void Spill() {
+    static std::atomic<size_t> spill_counter{0};
+    auto file = scratch_dir_ + "/shuffle-spill-" + std::to_string(getpid()) + "-" + std::to_string(spill_counter++) + ".run";
+    std::ofstream out(file, std::ios::binary | std::ios::trunc);
+    CHECK(out.is_open()) << "[ExternalShuffleWriter] cannot create spill file " << file;
+    spill_files_.push_back(file);
+
+    size_t offset = 0;
+    base::BinStream block;
+    for (size_t dst = 0; dst < buffers_.size(); ++dst) {
+      auto& buffer = buffers_[dst];
+      if (buffer.empty()) {
+        continue;
+      }
+      SortAndCombine(&buffer);
+      Run run{spill_files_.size() - 1, offset, 0};
+      for (size_t i = 0; i < buffer.size(); ++i) {
+        block << buffer[i];
+        if (block.size() >= kBlockSize || i + 1 == buffer.size()) {
+          uint64_t block_size = block.size();
+          out.write(reinterpret_cast<const char*>(&block_size), sizeof(block_size));
+          out.write(block.get_remained_buffer(), block_size);
+          run.size += sizeof(block_size) + block_size;
+          block.clear();
+        }
+      }
+      runs_[dst].push_back(run);
+      offset += run.size;
+      std::vector<Val>().swap(buffer);
+    }
+    CHECK(out.good()) << "[ExternalShuffleWriter] failed to write spill file " << file;
+    spilled_bytes_ += offset;
+    DLOG(INFO) << "[ExternalShuffleWriter] spilled " << buffered_bytes_ << " bytes of records to " << file << " (" << offset << " bytes)";
+    buffered_bytes_ = 0;
+  }
+
+  /** K-way merge of the sorted spilled runs and the sorted in-memory buffer of dst. **/
+  void Merge(size_t dst, const Sink& sink) {
+    std::vector<std::unique_ptr<RunReader>> readers;
+    for (auto& run : runs_[dst]) {
+      readers.emplace_back(new RunReader(spill_files_[run.file_idx], run));
+    }
+    auto& buffer = buffers_[dst];
+    size_t buffer_pos = 0;
+    // sources [0, readers.size()) are runs, and source readers.size() is the in-memory buffer
+    auto next = [&](size_t source, Val* val) {
+      if (source < readers.size()) {
+        return readers[source]->Next(val);
+      }
+      if (buffer_pos == buffer.size()) {
+        return false;
+      }
+      *val = std::move(buffer[buffer_pos++]);
+      return true;
+    };
+    using Head = std::pair<Val, size_t>;
+    auto greater = [this](const Head& a, const Head& b) { return less_(b.first, a.first) || (!less_(a.first, b.first) && a.second > b.second); };
+    std::priority_queue<Head, std::vector<Head>, decltype(greater)> heads(greater);
+    for (size_t source = 0; source <= readers.size(); ++source) {
+      Val val;
+      if (next(source, &val)) {
+        heads.emplace(std::move(val), source);
+      }
+    }
+
+    std::vector<Val> chunk;
+    chunk.reserve(kChunkSize);
+    while (!heads.empty()) {
+      Head head = heads.top();
+      heads.pop();
+      if (combiner_ != nullptr && !chunk.empty() && Equal(chunk.back(), head.first)) {
+        combiner_(chunk.back(), head.first);
+      } else {
+        if (chunk.size() == kChunkSize) {
+          sink(dst, chunk.data(), chunk.size());
+          chunk.clear();
+        }
+        chunk.push_back(std::move(head.first));
+      }
+      Val val;
+      if (next(head.second, &val)) {
+        heads.emplace(std::move(val), head.second);
+      }
+    }
+    if (!chunk.empty()) {
+      sink(dst, chunk.data(), chunk.size());
+    }
+  }
+
+  std::vector<std::vector<Val>> buffers_;
+  std::vector<std::vector<Run>> runs_;
+  std::vector<std::string> spill_files_;
+  size_t memory_limit_;
+  size_t buffered_bytes_ = 0;
+  size_t spilled_bytes_ = 0;
+  std::string scratch_dir_;
+  Less less_;
+  Combiner combiner_;
+};
+
+}  // namespace common
+}  // namespace axe
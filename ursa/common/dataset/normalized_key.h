@@ -0,0 +1,139 @@
+// Copyright 2020 HDL
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#include <algorithm>
+#include <type_traits>
+#include <vector>
+
+namespace axe {
+namespace common {
+
+/** Order-preserving (normalized) encodings of values as big-endian byte strings: a < b if and only if the encoding
+ * of a is lexicographically less than that of b. A prefix of an encoding is order-preserving as well, but only
+ * decides the order of values whose prefixes differ.
+ */
+struct NormalizedKey {
+  /** Write the sizeof(T)-byte encoding of an integral or floating-point value to dst. **/
+  template <typename T>
+  static typename std::enable_if<std::is_integral<T>::value>::type Encode(T value, uint8_t* dst) {
+    using Unsigned = typename std::make_unsigned<T>::type;
+    auto bits = static_cast<Unsigned>(value);
+    if (std::is_signed<T>::value) {
+      bits ^= Unsigned(1) << (sizeof(T) * 8 - 1);  // flip the sign bit, so negative values come first
+    }
+    StoreBigEndian(bits, dst);
+  }
+
+  template <typename T>
+  static typename std::enable_if<std::is_floating_point<T>::value>::type Encode(T value, uint8_t* dst) {
+    using Bits = typename std::conditional<sizeof(T) == 4, uint32_t, uint64_t>::type;
+    if (value == 0) {
+      value = 0;  // -0.0 equals 0.0
+    }
+    Bits bits;
+    memcpy(&bits, &value, sizeof(T));
+    const Bits sign = Bits(1) << (sizeof(T) * 8 - 1);
+    bits = (bits & sign) ? ~bits : (bits | sign);  // negative values in reverse order, before the positive ones
+    StoreBigEndian(bits, dst);
+  }
+
+  /** Write the first length bytes of a string, zero padded. Strings with equal prefixes need a full comparison. **/
+  static inline void EncodeStringPrefix(const char* data, size_t size, uint8_t* dst, size_t length) {
+    auto n = std::min(size, length);
+    memcpy(dst, data, n);
+    memset(dst + n, 0, length - n);
+  }
+
+  template <typename T>
+  static inline void StoreBigEndian(T value, uint8_t* dst) {
+    for (int i = sizeof(T) - 1; i >= 0; --i) {
+      dst[i] = static_cast<uint8_t>(value);
+      value >>= 8;
+    }
+  }
+
+  static inline uint64_t LoadBigEndian(const uint8_t* src) {
+    uint64_t value;
+    memcpy(&value, src, sizeof(value));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    value = __builtin_bswap64(value);
+#endif
+    return value;
+  }
+};
+
+/** A row and its normalized key of Words 64-bit words, compared word by word and then by row. **/
+template <size_t Words>
+struct NormalizedKeyRecord {
+  uint64_t words[Words];
+  uint32_t row;
+
+  /** Load the key from Words * 8 big-endian bytes. **/
+  inline void Load(const uint8_t* key) {
+    for (size_t i = 0; i < Words; ++i) {
+      words[i] = NormalizedKey::LoadBigEndian(key + i * 8);
+    }
+  }
+
+  inline bool SameKey(const NormalizedKeyRecord& other) const { return std::equal(words, words + Words, other.words); }
+
+  inline bool operator<(const NormalizedKeyRecord& other) const {
+    for (size_t i = 0; i < Words; ++i) {
+      if (words[i] != other.words[i]) {
+        return words[i] < other.words[i];
+      }
+    }
+    return row < other.row;
+  }
+};
+
+/** Sort rows by their normalized keys and return the rows in order. The records are sorted in place, so comparisons
+ * touch only the contiguous keys. If the keys are not exact, each run of rows with equal keys is ordered by
+ * full_compare(lhs_row, rhs_row), a three-way comparison, unless the rows of the run are all equal. Ties are broken
+ * by row, so the sort is stable.
+ */
+template <size_t Words, typename FullCompare>
+std::vector<uint32_t> SortByNormalizedKeys(std::vector<NormalizedKeyRecord<Words>>* records, bool exact, FullCompare full_compare) {
+  std::sort(records->begin(), records->end());
+  std::vector<uint32_t> ret(records->size());
+  for (size_t i = 0; i < ret.size(); ++i) {
+    ret[i] = (*records)[i].row;
+  }
+  if (exact) {
+    return ret;
+  }
+  for (size_t begin = 0, end = 0; begin < ret.size(); begin = end) {
+    for (end = begin + 1; end < ret.size() && (*records)[end].SameKey((*records)[begin]); ++end) {
+    }
+    bool all_equal = true;
+    for (size_t i = begin + 1; i < end && all_equal; ++i) {
+      all_equal = full_compare(ret[begin], ret[i]) == 0;
+    }
+    if (!all_equal) {
+      std::sort(ret.begin() + begin, ret.begin() + end, [&full_compare](uint32_t lhs, uint32_t rhs) {
+        int cmp = full_compare(lhs, rhs);
+        return cmp != 0 ? cmp < 0 : lhs < rhs;
+      });
+    }
+  }
+  return ret;
+}
+
+}  // namespace common
+}  // namespace axe
@@ -25,6 +25,8 @@
 #include "glog/logging.h"
 
 #include "common/dataset/abstract_data.h"
+#include "common/dataset/selection_vector.h"
+#include "common/dataset/validity_bitmap.h"
 
 namespace axe {
 namespace common {
@@ -109,7 +111,97 @@ class Partition : public AbstractData {
 
   void AppendNull(const std::shared_ptr<Partition>& rhs);
 
+  /* Selection vectors. A chain of predicates refines a SelectionVector of the rows, and the selected rows are copied
+   * once, when they leave the task. */
+
+  /** Keep the selected rows that are not null. **/
+  void RefineNotNull(SelectionVector* selection) const {
+    if (has_null_) {
+      CHECK_GE(not_null_.size(), size()) << "Forgot to UpdateNotNull()?";
+      selection->Refine(not_null_);
+    }
+  }
+
+  /** A new partition of the selected rows. **/
+  std::shared_ptr<Partition> Compact(const SelectionVector& selection) const { return Filter(selection.ToMask(size()), selection.size()); }
+
+  /** Keep only the selected rows, in place. **/
+  void ApplySelection(const SelectionVector& selection) { ApplyFilter(selection.ToMask(size())); }
+
+  /** The null flags as a validity bitmap, all valid if the partition has no nulls. **/
+  ValidityBitmap GetValidity() const { return has_null_ ? ValidityBitmap::FromBools(not_null_) : ValidityBitmap(size(), true); }
+
  protected:
+  /* Updates of the null flags, for the partitions that reorder, filter, append or slice their values. They do what
+   * ApplyPermutation, ApplyFilter, AppendNull and the slicing of the null flags do, in a single pass over the flags.
+   * Flags missing past the end of not_null_ count as not null. */
+
+  template <typename Index>
+  void PermuteNotNull(const std::vector<Index>& permutation) { GatherNotNullFrom(*this, permutation); }
+
+  /** Set the null flags to those of rows rows[0], rows[1], ... of src. **/
+  template <typename Index>
+  void GatherNotNullFrom(const Partition& src, const std::vector<Index>& rows) {
+    if (!(has_null_ = src.has_null_)) {
+      not_null_.clear();
+      return;
+    }
+    auto& src_not_null = src.not_null_;
+    std::vector<bool> not_null(rows.size());
+    for (size_t i = 0; i < rows.size(); ++i) {
+      not_null[i] = static_cast<size_t>(rows[i]) >= src_not_null.size() || src_not_null[rows[i]];
+    }
+    not_null_ = std::move(not_null);
+  }
+
+  void FilterNotNull(const std::vector<bool>& to_keep) { FilterNotNullFrom(*this, to_keep); }
+
+  /** Set the null flags to those of the rows of src with to_keep set. **/
+  void FilterNotNullFrom(const Partition& src, const std::vector<bool>& to_keep) {
+    if (!(has_null_ = src.has_null_)) {
+      not_null_.clear();
+      return;
+    }
+    auto& src_not_null = src.not_null_;
+    std::vector<bool> not_null;
+    not_null.reserve(to_keep.size());
+    for (size_t i = 0; i < to_keep.size(); ++i) {
+      if (to_keep[i]) {
+        not_null.push_back(i >= src_not_null.size() || src_not_null[i]);
+      }
+    }
+    not_null_ = std::move(not_null);
+  }
+
+  /** Append the null flags of rhs, whose values are already appended. **/
+  void AppendNotNull(const Partition& rhs) {
+    if (!has_null_ && !rhs.has_null_) {
+      return;
+    }
+    auto old_size = size() - rhs.size();
+    if (!has_null_) {
+      has_null_ = true;
+      not_null_.assign(old_size, true);
+    }
+    not_null_.resize(old_size, true);
+    if (rhs.has_null_) {
+      auto n = std::min(rhs.size(), rhs.not_null_.size());
+      not_null_.insert(not_null_.end(), rhs.not_null_.begin(), rhs.not_null_.begin() + n);
+    }
+    not_null_.resize(size(), true);
+  }
+
+  /** Set the null flags to those of rows [offset, offset + size) of src. **/
+  void SliceNotNull(const Partition& src, size_t offset, size_t size) {
+    if (!(has_null_ = src.has_null_)) {
+      not_null_.clear();
+      return;
+    }
+    auto n = std::min(size, src.not_null_.size() > offset ? src.not_null_.size() - offset : 0);
+    not_null_.assign(src.not_null_.begin() + (n != 0 ? offset : 0), src.not_null_.begin() + (n != 0 ? offset + n : 0));
+    not_null_.resize(size, true);
+  }
+
   bool has_null_ = false;
   std::vector<bool> not_null_;
 };
@@ -0,0 +1,114 @@
+// Copyright 2020 HDL
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstdint>
+
+#include <numeric>
+#include <vector>
+
+#include "glog/logging.h"
+
+#include "common/dataset/validity_bitmap.h"
+
+namespace axe {
+namespace common {
+
+/** The rows of a partition that survive a chain of predicates, in increasing order.
+ *
+ * Predicates refine the selection in place instead of materializing a filtered partition each, and the rows are
+ * copied once by Partition::Compact (or in place by ApplySelection) where they leave the task, e.g. before a shuffle.
+ */
+class SelectionVector {
+ public:
+  using index_type = uint32_t;
+
+  SelectionVector() = default;
+  explicit SelectionVector(std::vector<index_type>&& rows) : rows_(std::move(rows)) {}
+
+  /** Select all the size rows. **/
+  static SelectionVector All(size_t size) {
+    SelectionVector ret;
+    ret.rows_.resize(size);
+    std::iota(ret.rows_.begin(), ret.rows_.end(), 0);
+    return ret;
+  }
+
+  /** Select the rows with mask set, a mask word at a time. **/
+  static SelectionVector FromMask(const std::vector<bool>& mask) {
+    SelectionVector ret;
+    auto words = PackBools(mask, mask.size(), false);
+    ret.rows_.reserve(BitmapOps::Count(words.data(), 0, mask.size()));
+    for (size_t w = 0; w < words.size(); ++w) {
+      for (uint64_t bits = words[w] & BitmapOps::LowMask(mask.size() - w * 64); bits != 0; bits &= bits - 1) {
+        ret.rows_.push_back(w * 64 + __builtin_ctzll(bits));
+      }
+    }
+    return ret;
+  }
+
+  /** Keep the selected rows for which predicate(row) holds. **/
+  template <typename Predicate>
+  void Refine(Predicate predicate) {
+    size_t cur = 0;
+    for (auto row : rows_) {
+      rows_[cur] = row;
+      cur += static_cast<bool>(predicate(row));
+    }
+    rows_.resize(cur);
+  }
+
+  /** Keep the selected rows with mask[row] set. **/
+  void Refine(const std::vector<bool>& mask) {
+    Refine([&mask](index_type row) {
+      DCHECK_LT(row, mask.size());
+      return mask[row];
+    });
+  }
+
+  /** Keep the selected rows that are also selected by other. **/
+  void Intersect(const SelectionVector& other) {
+    auto it = other.rows_.begin();
+    Refine([&it, &other](index_type row) {
+      while (it != other.rows_.end() && *it < row) {
+        ++it;
+      }
+      return it != other.rows_.end() && *it == row;
+    });
+  }
+
+  /** The selection as a mask over size rows. **/
+  std::vector<bool> ToMask(size_t size) const {
+    std::vector<bool> ret(size, false);
+    for (auto row : rows_) {
+      DCHECK_LT(row, size);
+      ret[row] = true;
+    }
+    return ret;
+  }
+
+  inline size_t size() const { return rows_.size(); }
+  inline bool empty() const { return rows_.empty(); }
+  inline index_type operator[](size_t i) const { return rows_[i]; }
+  inline auto begin() const { return rows_.begin(); }
+  inline auto end() const { return rows_.end(); }
+  inline const std::vector<index_type>& GetRows() const { return rows_; }
+
+ private:
+  std::vector<index_type> rows_;
+};
+
+}  // namespace common
+}  // namespace axe
@@ -14,18 +14,25 @@
 
 #pragma once
 
+#include <memory>
 #include <string>
+#include <type_traits>
 #include <utility>
 #include <vector>
 
+#include "base/buffer_allocator.h"
 #include "common/constants.h"
 #include "common/dataset/dataset.h"
 #include "common/dataset/dataset_partition.h"
+#include "common/dataset/emitter.h"
 #include "common/io/input/hdfs_file_splitter.h"
 #include "common/io/input/hdfs_input_block_info.h"
+#include "common/io/input/hdfs_range_file_splitter.h"
 #include "common/io/input/line_inputformat.h"
-#include "common/io/input/nfs_file_splitter.h"
+#include "common/io/input/mmap_file_splitter.h"
 #include "common/io/input/nfs_input_block_info.h"
+#include "common/io/input/nfs_range_file_splitter.h"
+#include "common/io/input/read_ahead_file_splitter.h"
 #include "common/source_data.h"
 
 namespace axe {
@@ -34,6 +41,35 @@ namespace common {
 class SourceDataset : public Dataset<std::string> {
  public:
   explicit SourceDataset(TaskGraph* task_graph) : Dataset<std::string>(task_graph) {}
+
+ protected:
+  struct ReadOptions {
+    int parse_threads = 1;
+    bool keep_order = true;
+    bool mmap = false;
+    size_t read_ahead = 1;  // blocks read ahead, none if 0
+  };
+
+  /** The splitters of the blocks of the source, which are created as their concrete types and destroyed as such by
+   * their shared pointers.
+   */
+  static ReadAheadFileSplitter::Factory SplitterFactory(FS protocol, const ReadOptions& options) {
+    if (protocol == HDFS) {
+      return [] { return std::make_shared<HDFSRangeFileSplitter>(); };
+    }
+    if (options.mmap) {
+      return [] { return std::make_shared<MmapFileSplitter>(); };
+    }
+    return [] { return std::make_shared<NFSRangeFileSplitter>(); };
+  }
+
+  /** The input format of a source task, which reads the blocks ahead of their parsing unless options.read_ahead is 0. **/
+  static LineInputFormat MakeInputFormat(const std::string& url, FS protocol, const ReadOptions& options) {
+    auto factory = SplitterFactory(protocol, options);
+    LineInputFormat input(options.read_ahead == 0 ? factory() : std::make_shared<ReadAheadFileSplitter>(factory, options.read_ahead), url);
+    input.SetParseThreads(options.parse_threads, options.keep_order);
+    return input;
+  }
 };
 
 class TextSourceDataset : public SourceDataset {
@@ -51,6 +87,11 @@ class TextSourceDataset : public SourceDataset {
     SetParallelism(parallelism);
   }
 
+  /** Parse each line with lambda, which either returns a DatasetPartition of the records of the line, or takes the line
+   * and an Emitter<Val>& (e.g. [](std::string_view line, Emitter<int>& out) { out.emit(...); }) and emits the records
+   * directly into the output partition. The line is passed as a std::string_view into the block buffer if lambda takes
+   * one, otherwise as a std::string.
+   */
   template <typename Lambda>
   inline auto FlatMap(Lambda lambda) {
     auto task = CreateTask("FlatMap");
@@ -64,18 +105,53 @@ class TextSourceDataset : public SourceDataset {
     return FlatMapInner(task, lambda);
   }
 
+  /** Parse the blocks of each FlatMap task on threads threads, for sources with few large shards. The lambda must be
+   * safe to call concurrently. The records of a task are in the order of the lines unless !keep_order.
+   */
+  inline TextSourceDataset& SetParseThreads(int threads, bool keep_order = true) {
+    CHECK_GE(threads, 1) << "[TextSourceDataset] at least one parse thread is needed";
+    options_.parse_threads = threads;
+    options_.keep_order = keep_order;
+    return *this;
+  }
+
+  /** Map local and NFS files into memory with MmapFileSplitter instead of reading each block into a buffer. It is off
+   * by default, as a mapped file that is truncated, or whose NFS server fails, kills the task with SIGBUS where a read
+   * fails with an error: only map files that are not modified while the job reads them.
+   */
+  inline TextSourceDataset& SetMmap(bool mmap = true) {
+    options_.mmap = mmap;
+    return *this;
+  }
+
+  /** Read up to depth blocks ahead of the one being parsed, on a background reader thread (see ReadAheadFileSplitter),
+   * or none if depth is 0. The default is 1.
+   */
+  inline TextSourceDataset& SetReadAhead(size_t depth) {
+    options_.read_ahead = depth;
+    return *this;
+  }
+
  private:
+  /** Log the counters of the buffer allocator of the process, which backs the block buffers, at the end of a task. **/
+  static void LogBufferStats(TaskContext* tc) {
+    VLOG(1) << "[TextSourceDataset] " << tc->GetTaskDesc()->DebugString() << " done, buffers: "
+            << base::BufferAllocator::Get().GetStats().DebugString();
+  }
+
   template <typename Lambda>
-  auto FlatMapInner(const std::shared_ptr<Task>& task, Lambda lambda) {
-    auto ret = Dataset<typename decltype(lambda(std::string()))::value_type>::Create(task, task_graph_, GetParallelism());
+  typename std::enable_if<!IsEmitterFunction<Lambda>::value,
+                          Dataset<typename decltype(std::declval<const Lambda&>()(LineType<Lambda>()))::value_type>>::type
+  FlatMapInner(const std::shared_ptr<Task>& task, Lambda lambda) {
+    auto ret = Dataset<typename decltype(lambda(LineType<Lambda>()))::value_type>::Create(task, task_graph_, GetParallelism());
     LOG(INFO) << "protocol " << (protocol_ == HDFS ? "hdfs" : "nfs");
-    RegisterClosure(task->GetId(), [ lambda, url = url_, protocol = protocol_, ret = ret.GetId() ](TaskContext * tc) {
+    RegisterClosure(task->GetId(), [ lambda, url = url_, protocol = protocol_, options = options_, ret = ret.GetId() ](TaskContext * tc) {
       LOG(INFO) << "flatmap =================";
       google::FlushLogFiles(google::INFO);
-      axe::common::LineInputFormat input(url, protocol);
+      auto input = MakeInputFormat(url, protocol, options);
       auto task_desc = tc->GetTaskDesc();
       auto block_desc = SourceData::GetBlockDesc(task_desc);
-      using ret_type = typename decltype(lambda(std::string()))::value_type;
+      using ret_type = typename decltype(lambda(LineType<Lambda>()))::value_type;
       if (block_desc.size() == 0) {
         tc->InsertDatasetPartition(ret, std::make_shared<DatasetPartition<ret_type>>());
         tc->InjectWatermark();
@@ -84,6 +160,31 @@ class TextSourceDataset : public SourceDataset {
       auto data = std::make_shared<DatasetPartition<ret_type>>(input.ReadData(block_desc, lambda));
       tc->InsertDatasetPartition(ret, data);
       tc->InjectWatermark();
+      LogBufferStats(tc);
+    });
+    task_graph_->AddSourceData(SourceData(InputBlockInfo::Create(url_, protocol_), task));
+    return ret;
+  }
+
+  template <typename Lambda>
+  typename std::enable_if<IsEmitterFunction<Lambda>::value, Dataset<typename EmitterValue<Lambda>::type>>::type FlatMapInner(
+      const std::shared_ptr<Task>& task, Lambda lambda) {
+    using ret_type = typename EmitterValue<Lambda>::type;
+    auto ret = Dataset<ret_type>::Create(task, task_graph_, GetParallelism());
+    LOG(INFO) << "protocol " << (protocol_ == HDFS ? "hdfs" : "nfs");
+    RegisterClosure(task->GetId(), [ lambda, url = url_, protocol = protocol_, options = options_, ret = ret.GetId() ](TaskContext * tc) {
+      LOG(INFO) << "flatmap =================";
+      google::FlushLogFiles(google::INFO);
+      auto input = MakeInputFormat(url, protocol, options);
+      auto task_desc = tc->GetTaskDesc();
+      auto block_desc = SourceData::GetBlockDesc(task_desc);
+      auto data = std::make_shared<DatasetPartition<ret_type>>();
+      if (block_desc.size() != 0) {
+        input.ReadDataTo(block_desc, lambda, data.get());
+      }
+      tc->InsertDatasetPartition(ret, data);
+      tc->InjectWatermark();
+      LogBufferStats(tc);
     });
     task_graph_->AddSourceData(SourceData(InputBlockInfo::Create(url_, protocol_), task));
     return ret;
@@ -91,6 +192,7 @@ class TextSourceDataset : public SourceDataset {
 
   std::string url_;
   FS protocol_ = HDFS;
+  ReadOptions options_;
 };
 
 // TODO(tatiana)
@@ -117,12 +219,12 @@ class HdfsSourceDataset : public SourceDataset {
  private:
   template <typename Lambda>
   auto SetMap(const std::shared_ptr<Task>& task, Lambda lambda) {
-    auto ret = Dataset<typename decltype(lambda(std::string()))::value_type>::Create(task, task_graph_, GetParallelism());
+    auto ret = Dataset<typename decltype(lambda(LineType<Lambda>()))::value_type>::Create(task, task_graph_, GetParallelism());
     RegisterClosure(task->GetId(), [ lambda, url = url_, ret = ret.GetId() ](TaskContext * tc) {
-      axe::common::LineInputFormat input(url);
+      auto input = MakeInputFormat(url, HDFS, ReadOptions());
       auto task_desc = tc->GetTaskDesc();
       auto block_desc = SourceData::GetBlockDesc(task_desc);
-      using ret_type = typename decltype(lambda(std::string()))::value_type;
+      using ret_type = typename decltype(lambda(LineType<Lambda>()))::value_type;
       if (block_desc.size() == 0) {
         tc->InsertDatasetPartition(ret, std::make_shared<DatasetPartition<ret_type>>());
         tc->InjectWatermark();
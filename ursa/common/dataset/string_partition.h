@@ -18,6 +18,7 @@
 #include <cstring>
 #include <memory>
 #include <numeric>
+#include <stdexcept>
 #include <string>
 #include <type_traits>
 #include <utility>
@@ -25,7 +26,9 @@
 
 #include "glog/logging.h"
 
+#include "base/buffer_allocator.h"
 #include "common/dataset/macro.h"
+#include "common/dataset/normalized_key.h"
 #include "common/dataset/partition.h"
 
 namespace axe {
@@ -33,12 +36,15 @@ namespace common {
 
 class StringPartition;
 
-class StringPartitionIterator : public PartitionIterator {
+/** Iterator over the strings of a StringPartition. It is not called StringPartitionIterator, as the prebuilt core
+ * library still defines a class of that name for the former 32-bit layout.
+ */
+class SegmentedStringPartitionIterator : public PartitionIterator {
  public:
   using value_type = string_view;
-  using size_type = uint32_t;
+  using size_type = size_t;
 
-  StringPartitionIterator(const size_type pos, const StringPartition* sp);
+  SegmentedStringPartitionIterator(const size_type pos, const StringPartition* sp);
 
   std::pair<const void*, size_t> GetPtr() const override;
 
@@ -47,10 +53,10 @@ class StringPartitionIterator : public PartitionIterator {
   value_type operator*() const;
 
   void operator++() override;
-  bool operator==(const StringPartitionIterator& rhs) { return pos_ == rhs.pos_; }
-  bool operator!=(const StringPartitionIterator& rhs) { return pos_ != rhs.pos_; }
-  bool operator<(const StringPartitionIterator& rhs) { return pos_ < rhs.pos_; }
-  bool operator>(const StringPartitionIterator& rhs) { return pos_ > rhs.pos_; }
+  bool operator==(const SegmentedStringPartitionIterator& rhs) { return pos_ == rhs.pos_; }
+  bool operator!=(const SegmentedStringPartitionIterator& rhs) { return pos_ != rhs.pos_; }
+  bool operator<(const SegmentedStringPartitionIterator& rhs) { return pos_ < rhs.pos_; }
+  bool operator>(const SegmentedStringPartitionIterator& rhs) { return pos_ > rhs.pos_; }
 
  private:
   size_type GetLength() const;
@@ -60,14 +66,26 @@ class StringPartitionIterator : public PartitionIterator {
   const StringPartition* sp_;
 };
 
+/** A partition of strings, stored as offsets into a payload of concatenated strings.
+ *
+ * The offsets are 64-bit, so a partition can hold more than 4 GB of payload. The payload is a list of segments that
+ * grow geometrically and never move: a string is appended to the last segment if it fits, and otherwise starts a new
+ * segment, so appends never copy the strings already written and views into the partition stay valid. A string never
+ * spans two segments. Large segments follow the BufferAllocator policy.
+ */
 class StringPartition : public Partition {
  public:
   using value_type = string_view;
-  using size_type = uint32_t;
-  using iterator = StringPartitionIterator;
-  using const_iterator = StringPartitionIterator;
+  using size_type = size_t;
+  using offset_type = uint64_t;
+  using iterator = SegmentedStringPartitionIterator;
+  using const_iterator = SegmentedStringPartitionIterator;
 
-  friend class StringPartitionIterator;
+  static constexpr size_t kMinSegmentSize = 4096;
+  static constexpr size_t kMaxSegmentSize = 64 * 1024 * 1024;
+  static constexpr size_t kSortPrefixBytes = 16;
+
+  friend class SegmentedStringPartitionIterator;
 
   StringPartition() {
     size_ = 0;
@@ -77,25 +95,48 @@ class StringPartition : public Partition {
   explicit StringPartition(const std::vector<std::string>& vec) {
     size_ = 0;
     offset_.push_back(0);
+    offset_.reserve(vec.size() + 1);
     for (const auto& str : vec) {
       push_back(str);
     }
   }
 
   StringPartition(size_type size, const std::pair<const void*, size_t>& ptr) {
-    size_ = size;
-    offset_.resize(size + 1);
-    data_.resize(size * ptr.second);
-    for (int i = 0; i < size + 1; ++i)
-      offset_[i] = i * ptr.second;
-    for (int i = 0; i < size * ptr.second; ++i) {
-      data_[i] = *((const char*) ptr.first + i % ptr.second);
+    size_ = 0;
+    offset_.push_back(0);
+    offset_.reserve(size + 1);
+    ReservePayload(size * ptr.second);
+    AppendInner(size, value_type((const char*) ptr.first, ptr.second));
+  }
+
+  /** Copies are compacted into a single segment. **/
+  StringPartition(const StringPartition& other) : Partition(other), size_(other.size_), offset_(other.offset_) { CopyPayloadFrom(other); }
+
+  StringPartition& operator=(const StringPartition& other) {
+    if (this != &other) {
+      Partition::operator=(other);
+      size_ = other.size_;
+      offset_ = other.offset_;
+      segments_.clear();
+      CopyPayloadFrom(other);
     }
+    return *this;
   }
 
+  StringPartition(StringPartition&&) = default;
+  StringPartition& operator=(StringPartition&&) = default;
+
   /* Vector-like APIs */
 
-  void reserve(size_t size) override { offset_.reserve(size); }
+  void reserve(size_t size) override { offset_.reserve(size + 1); }
+
+  /** Reserve bytes of payload, so that strings of up to bytes in total are appended to the same segment. **/
+  void ReservePayload(size_t bytes) {
+    if (GetRemainingCapacity() < bytes) {
+      AddSegment(bytes);
+    }
+  }
+
   /** Resize the array to size elements.
    *
    * If size > size_, append size - size_ entries with empty string.
@@ -103,7 +144,7 @@ class StringPartition : public Partition {
    */
   void resize(size_t size, value_type val) {
     if (size < size_) {
-      size_ = size;
+      Truncate(size);
       return;
     }
     AppendInner(size - size_, val);
@@ -115,7 +156,7 @@ class StringPartition : public Partition {
    */
   void resize(size_t size) override {
     if (size < size_) {
-      size_ = size;
+      Truncate(size);
       return;
     }
     AppendInner(size - size_, value_type());
@@ -125,9 +166,9 @@ class StringPartition : public Partition {
   void clear() override {
     Partition::clear();
     offset_.clear();
-    data_.clear();
+    segments_.clear();
     offset_.shrink_to_fit();
-    data_.shrink_to_fit();
+    segments_.shrink_to_fit();
     size_ = 0;
     offset_.push_back(0);
   }
@@ -140,10 +181,7 @@ class StringPartition : public Partition {
   inline iterator end() { return iterator(size_, this); }
   inline const_iterator end() const { return iterator(size_, this); }
 
-  const value_type operator[](size_t i) const {
-    size_type length = offset_[i + 1] - offset_[i];
-    return value_type(data_.data() + offset_[i], length);
-  }
+  const value_type operator[](size_t i) const { return value_type(GetData(offset_[i]), offset_[i + 1] - offset_[i]); }
 
   inline const value_type at(size_t i) const {
     if (i >= size_) {
@@ -153,8 +191,8 @@ class StringPartition : public Partition {
     return (*this)[i];
   }
 
-  void push_back(const char* data, size_type length) override {
-    size_type pre = offset_[size_];
+  void push_back(const char* data, uint32_t length) override {
+    offset_type pre = offset_[size_];
 
     if (length == 0) {
       offset_.push_back(pre);
@@ -162,8 +200,10 @@ class StringPartition : public Partition {
       return;
     }
 
-    data_.resize(pre + length);
-    memcpy(data_.data() + pre, data, length);
+    if (GetRemainingCapacity() < length) {
+      AddSegment(length);
+    }
+    memcpy(GetMutableData(pre), data, length);
     offset_.push_back(pre + length);
     size_++;
   }
@@ -174,28 +214,22 @@ class StringPartition : public Partition {
 
   inline void push_back(const char* data) { push_back(data, strlen(data)); }
 
-  inline void pop_back() {
-    size_--;
-    data_.resize(offset_[size_]);
-    offset_.pop_back();
-  }
+  inline void pop_back() { Truncate(size_ - 1); }
 
   void push_back(const std::pair<const void*, size_t>& val) override { push_back((const char*) val.first, val.second); }
 
+  /** Release the unused offsets and compact the payload into a single segment of the exact size. **/
   void shrink_to_fit() override {
-    offset_.resize(size_ + 1);
-    data_.resize(offset_[size_]);
     offset_.shrink_to_fit();
-    data_.shrink_to_fit();
+    segments_.shrink_to_fit();
+    if (segments_.size() > 1 || (!segments_.empty() && segments_.front().capacity != offset_[size_])) {
+      Compact();
+    }
   }
 
   /* End of vector-like APIs */
 
-  std::pair<const void*, size_t> At(size_t pos) override {
-    size_type offset = offset_[pos];
-    size_type length = offset_[pos + 1] - offset_[pos];
-    return {data_.data() + offset, length};
-  }
+  std::pair<const void*, size_t> At(size_t pos) override { return {GetData(offset_[pos]), offset_[pos + 1] - offset_[pos]}; }
 
   std::string Print(size_t pos) override {
     if (IsNull(pos)) {
@@ -211,27 +245,9 @@ class StringPartition : public Partition {
     return at(pos).compare(value_type((const char*) rhs.first, rhs.second));
   }
 
-  void ApplyPermutation(const std::vector<size_t>& permutation) override {
-    CHECK(permutation.size() == size_) << "Size of permutation is not equals to size_";
-    StringPartition res;
-    for (int i = 0; i < size_; ++i) {
-      res.push_back(at(permutation[i]));
-    }
-    offset_ = std::move(res.offset_);
-    data_ = std::move(res.data_);
-    Partition::ApplyPermutation(permutation);
-  }
+  void ApplyPermutation(const std::vector<size_t>& permutation) override { ApplyPermutationInner(permutation); }
 
-  void ApplyPermutation(const std::vector<uint32_t>& permutation) override {
-    CHECK(permutation.size() == size_) << "Size of permutation is not equals to size_";
-    StringPartition res;
-    for (int i = 0; i < size_; ++i) {
-      res.push_back(at(permutation[i]));
-    }
-    offset_ = std::move(res.offset_);
-    data_ = std::move(res.data_);
-    Partition::ApplyPermutation(permutation);
-  }
+  void ApplyPermutation(const std::vector<uint32_t>& permutation) override { ApplyPermutationInner(permutation); }
 
   std::shared_ptr<Partition> Filter(const std::vector<bool>& to_keep, size_t size) const override {
     auto ret = std::make_shared<StringPartition>(*this);
@@ -241,14 +257,17 @@ class StringPartition : public Partition {
 
   void ApplyFilter(const std::vector<bool>& to_keep) override {
     CHECK_EQ(to_keep.size(), size_) << "Apply filter vector of size " << to_keep.size() << " to string partition of size " << size_;
+    if (segments_.size() > 1) {
+      Compact();
+    }
 
     size_type cur = 0;
-    size_type cur_ptr = 0;
-    for (int i = 0; i < size_; ++i) {
+    offset_type cur_ptr = 0;
+    for (size_t i = 0; i < size_; ++i) {
       if (to_keep.at(i)) {
-        size_type length = offset_.at(i + 1) - offset_.at(i);
+        offset_type length = offset_.at(i + 1) - offset_.at(i);
         if (cur_ptr != offset_.at(i)) {
-          memmove(data_.data() + cur_ptr, data_.data() + offset_.at(i), length);
+          memmove(GetMutableData(cur_ptr), GetData(offset_.at(i)), length);
         }
         offset_[cur++] = cur_ptr;
         cur_ptr += length;
@@ -257,7 +276,7 @@ class StringPartition : public Partition {
     size_ = cur;
     offset_[cur++] = cur_ptr;
     offset_.resize(size_ + 1);
-    Partition::ApplyFilter(to_keep);
+    FilterNotNull(to_keep);
   }
 
   void AppendPartition(const std::shared_ptr<Partition>& rhs) override {
@@ -266,14 +285,16 @@ class StringPartition : public Partition {
       throw std::runtime_error("Cannot cast Partition to String Partition while appending");
     }
 
+    offset_.reserve(size_ + sp_ptr->size_ + 1);
+    ReservePayload(sp_ptr->GetPayloadSize());
     for (auto str : *sp_ptr) {
       push_back(str);
     }
-    AppendNull(rhs);
+    AppendNotNull(*rhs);
   }
 
-  std::shared_ptr<PartitionIterator> Begin() const override { return std::make_shared<StringPartitionIterator>(0, this); }
-  std::shared_ptr<PartitionIterator> End() const override { return std::make_shared<StringPartitionIterator>(size_, this); }
+  std::shared_ptr<PartitionIterator> Begin() const override { return std::make_shared<SegmentedStringPartitionIterator>(0, this); }
+  std::shared_ptr<PartitionIterator> End() const override { return std::make_shared<SegmentedStringPartitionIterator>(size_, this); }
 
   // TODO(tatiana): zero copy slice
   std::shared_ptr<Partition> Slice(size_t offset, size_t size) const override {
@@ -284,8 +305,10 @@ class StringPartition : public Partition {
     ret->size_ = size;
     // copy data
     auto n_bytes = offset_[offset + size] - offset_[offset];
-    ret->data_.resize(n_bytes);
-    std::memcpy(ret->data_.data(), data_.data() + offset_[offset], n_bytes);
+    if (n_bytes != 0) {
+      ret->segments_.push_back(Segment{AllocateSegment(n_bytes), 0, n_bytes});
+      CopyPayload(offset_[offset], offset_[offset + size], ret->segments_.back().data.get());
+    }
     // copy offsets
     ret->offset_.reserve(size + 1);
     auto begin = offset_.begin() + offset;
@@ -294,32 +317,193 @@ class StringPartition : public Partition {
       ret->offset_.push_back(*iter - *begin);
     }
 
-    if ((ret->has_null_ = has_null_)) {
-      ret->not_null_.insert(ret->not_null_.end(), not_null_.begin() + offset, not_null_.begin() + offset + size);
-    }
+    ret->SliceNotNull(*this, offset, size);
     return ret;
   }
 
+  /** Sort by the normalized keys of the first kSortPrefixBytes bytes of the strings, comparing the full strings only
+   * for equal prefixes. The sort is stable.
+   */
   std::vector<uint32_t> GetSortedIndex() const override {
-    std::vector<uint32_t> ret(size_);
-    std::iota(ret.begin(), ret.end(), 0);
-    sort(ret.begin(), ret.end(), [this](const auto& l, const auto& r) { return at(l) < at(r); });
-    return ret;
+    CHECK_LE(size_, UINT32_MAX) << "[StringPartition] too many strings to sort by a 32-bit index";
+    std::vector<NormalizedKeyRecord<kSortPrefixBytes / 8>> records(size_);
+    uint8_t key[kSortPrefixBytes];
+    for (uint32_t i = 0; i < size_; ++i) {
+      auto view = (*this)[i];
+      NormalizedKey::EncodeStringPrefix(view.data(), view.size(), key, kSortPrefixBytes);
+      records[i].Load(key);
+      records[i].row = i;
+    }
+    return SortByNormalizedKeys(&records, false, [this](uint32_t l, uint32_t r) { return (*this)[l].compare((*this)[r]); });
   }
 
+  /** The number of payload bytes of the strings. **/
+  inline offset_type GetPayloadSize() const { return offset_[size_]; }
+  inline size_t GetNumSegments() const { return segments_.size(); }
+
   /** Memory Usage in bytes */
-  double GetMemory() const override { return (data_.size() + offset_.size() * sizeof(size_type)); }
+  double GetMemory() const override {
+    double ret = offset_.size() * sizeof(offset_type);
+    for (auto& segment : segments_) {
+      ret += segment.capacity;
+    }
+    return ret;
+  }
 
  private:
-  void AppendInner(size_type length, const value_type& val) {
-    for (size_type i = 0; i < length; ++i)
+  /** A block of the payload holding the bytes at [base, base + capacity). **/
+  struct Segment {
+    std::shared_ptr<char> data;
+    offset_type base;
+    offset_type capacity;
+  };
+
+  void AppendInner(size_t length, const value_type& val) {
+    ReservePayload(length * val.size());
+    for (size_t i = 0; i < length; ++i)
       push_back(val);
   }
 
+  /** Gather the strings in the order of permutation into a single new segment. **/
+  template <typename Index>
+  void ApplyPermutationInner(const std::vector<Index>& permutation) {
+    CHECK(permutation.size() == size_) << "Size of permutation is not equals to size_";
+    std::vector<offset_type> offset(size_ + 1);
+    offset[0] = 0;
+    for (size_t i = 0; i < size_; ++i) {
+      offset[i + 1] = offset[i] + (offset_[permutation[i] + 1] - offset_[permutation[i]]);
+    }
+    std::vector<Segment> segments;
+    if (offset[size_] != 0) {
+      segments.push_back(Segment{AllocateSegment(offset[size_]), 0, offset[size_]});
+      char* dst = segments.back().data.get();
+      for (size_t i = 0; i < size_; ++i) {
+        memcpy(dst + offset[i], GetData(offset_[permutation[i]]), offset[i + 1] - offset[i]);
+      }
+    }
+    offset_ = std::move(offset);
+    segments_ = std::move(segments);
+    PermuteNotNull(permutation);
+  }
+
+  /** The segment holding the byte at the given offset, or the last segment for the end of the payload. **/
+  inline const Segment& GetSegment(offset_type offset) const {
+    if (offset >= segments_.back().base) {
+      return segments_.back();
+    }
+    auto it = std::upper_bound(segments_.begin(), segments_.end(), offset, [](offset_type offset, const Segment& segment) {
+      return offset < segment.base;
+    });
+    return *(it - 1);
+  }
+
+  /** The end of the bytes written to the i-th segment, i.e. the base of the next one. The tail of a segment that was
+   * too short for the next string stays unused.
+   */
+  inline offset_type GetSegmentEnd(size_t i) const {
+    return i + 1 < segments_.size() ? segments_[i + 1].base : segments_[i].base + segments_[i].capacity;
+  }
+
+  inline const char* GetData(offset_type offset) const {
+    if (segments_.empty()) {
+      return nullptr;
+    }
+    auto& segment = GetSegment(offset);
+    return segment.data.get() + (offset - segment.base);
+  }
+
+  inline char* GetMutableData(offset_type offset) { return const_cast<char*>(GetData(offset)); }
+
+  inline offset_type GetRemainingCapacity() const {
+    return segments_.empty() ? 0 : segments_.back().base + segments_.back().capacity - offset_[size_];
+  }
+
+  static std::shared_ptr<char> AllocateSegment(size_t capacity) {
+    auto& allocator = base::BufferAllocator::Get();
+    return allocator.IsLarge(capacity) ? allocator.Allocate(capacity) : std::shared_ptr<char>(new char[capacity], std::default_delete<char[]>());
+  }
+
+  /** Start a new segment at the end of the payload with room for at least bytes. **/
+  void AddSegment(size_t bytes) {
+    size_t capacity = segments_.empty() ? kMinSegmentSize : std::min<size_t>(segments_.back().capacity * 2, kMaxSegmentSize);
+    capacity = std::max(capacity, bytes);
+    auto data = AllocateSegment(capacity);
+    // the unused tail of the last segment is left empty; a segment that holds nothing is replaced
+    if (!segments_.empty() && segments_.back().base == offset_[size_]) {
+      segments_.pop_back();
+    }
+    segments_.push_back(Segment{std::move(data), offset_[size_], capacity});
+  }
+
+  /** Copy the payload bytes at [begin, end) to dst. **/
+  void CopyPayload(offset_type begin, offset_type end, char* dst) const {
+    for (size_t i = &GetSegment(begin) - segments_.data(); begin < end; ++i) {
+      auto n = std::min(end, GetSegmentEnd(i)) - begin;
+      memcpy(dst, segments_[i].data.get() + (begin - segments_[i].base), n);
+      dst += n;
+      begin += n;
+    }
+  }
+
+  /** Copy the payload of other, whose offsets are already copied, into a single segment. **/
+  void CopyPayloadFrom(const StringPartition& other) {
+    auto bytes = other.GetPayloadSize();
+    if (bytes != 0) {
+      segments_.push_back(Segment{AllocateSegment(bytes), 0, bytes});
+      other.CopyPayload(0, bytes, segments_.back().data.get());
+    }
+  }
+
+  /** Move the payload into a single segment of the exact size. **/
+  void Compact() {
+    auto bytes = GetPayloadSize();
+    std::vector<Segment> segments;
+    segments.swap(segments_);
+    if (bytes == 0) {
+      return;
+    }
+    auto data = AllocateSegment(bytes);
+    for (size_t i = 0; i < segments.size(); ++i) {
+      auto end = i + 1 < segments.size() ? segments[i + 1].base : bytes;
+      memcpy(data.get() + segments[i].base, segments[i].data.get(), end - segments[i].base);
+    }
+    segments_.push_back(Segment{std::move(data), 0, bytes});
+  }
+
+  /** Keep the first size strings and release the segments past their payload. **/
+  void Truncate(size_t size) {
+    size_ = size;
+    offset_.resize(size_ + 1);
+    while (!segments_.empty() && segments_.back().base >= offset_[size_] && (segments_.size() > 1 || offset_[size_] == 0)) {
+      segments_.pop_back();
+    }
+    if (has_null_ && not_null_.size() > size_) {
+      not_null_.resize(size_);
+    }
+  }
+
   size_type size_ = 0;
-  std::vector<size_type> offset_;
-  std::vector<char> data_;
+  std::vector<offset_type> offset_;
+  std::vector<Segment> segments_;
 };
 
+/* SegmentedStringPartitionIterator */
+
+inline SegmentedStringPartitionIterator::SegmentedStringPartitionIterator(const size_type pos, const StringPartition* sp) : pos_(pos), sp_(sp) {}
+
+inline std::pair<const void*, size_t> SegmentedStringPartitionIterator::GetPtr() const { return {GetData(), GetLength()}; }
+
+inline SegmentedStringPartitionIterator::value_type SegmentedStringPartitionIterator::operator*() { return value_type(GetData(), GetLength()); }
+
+inline SegmentedStringPartitionIterator::value_type SegmentedStringPartitionIterator::operator*() const { return value_type(GetData(), GetLength()); }
+
+inline void SegmentedStringPartitionIterator::operator++() { ++pos_; }
+
+inline SegmentedStringPartitionIterator::size_type SegmentedStringPartitionIterator::GetLength() const {
+  return sp_->offset_[pos_ + 1] - sp_->offset_[pos_];
+}
+
+inline const char* SegmentedStringPartitionIterator::GetData() const { return sp_->GetData(sp_->offset_[pos_]); }
+
 }  // namespace common
 }  // namespace axe
@@ -0,0 +1,291 @@
+// Copyright 2020 HDL
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstdint>
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#ifdef __BMI2__
+#include <immintrin.h>
+#endif
+
+#include "glog/logging.h"
+
+namespace axe {
+namespace common {
+
+/** Word-level operations on bitmaps of 64-bit words, where bit i is bit i % 64 of word i / 64. Bits past the end of
+ * a bitmap may hold anything and are never read as part of it.
+ */
+struct BitmapOps {
+  static inline size_t NumWords(size_t bits) { return (bits + 63) / 64; }
+  static inline uint64_t LowMask(size_t n) { return n >= 64 ? ~uint64_t(0) : (uint64_t(1) << n) - 1; }
+
+  static inline bool Get(const uint64_t* words, size_t i) { return (words[i >> 6] >> (i & 63)) & 1; }
+  static inline void Set(uint64_t* words, size_t i, bool value) {
+    if (value) {
+      words[i >> 6] |= uint64_t(1) << (i & 63);
+    } else {
+      words[i >> 6] &= ~(uint64_t(1) << (i & 63));
+    }
+  }
+
+  /** Read the n <= 64 bits starting at bit pos. **/
+  static inline uint64_t Read(const uint64_t* words, size_t pos, size_t n) {
+    size_t w = pos >> 6, shift = pos & 63;
+    uint64_t bits = words[w] >> shift;
+    if (shift != 0 && shift + n > 64) {
+      bits |= words[w + 1] << (64 - shift);
+    }
+    return bits & LowMask(n);
+  }
+
+  /** Write the n <= 64 low bits of bits at bit pos. **/
+  static inline void Write(uint64_t* words, size_t pos, size_t n, uint64_t bits) {
+    size_t w = pos >> 6, shift = pos & 63;
+    uint64_t mask = LowMask(n);
+    bits &= mask;
+    words[w] = (words[w] & ~(mask << shift)) | (bits << shift);
+    if (shift != 0 && shift + n > 64) {
+      words[w + 1] = (words[w + 1] & ~LowMask(shift + n - 64)) | (bits >> (64 - shift));
+    }
+  }
+
+  /** Copy n bits from bit src_pos of src to bit dst_pos of dst, a destination word at a time. **/
+  static void Copy(const uint64_t* src, size_t src_pos, uint64_t* dst, size_t dst_pos, size_t n) {
+    while (n > 0) {
+      size_t chunk = std::min<size_t>(n, 64 - (dst_pos & 63));
+      Write(dst, dst_pos, chunk, Read(src, src_pos, chunk));
+      src_pos += chunk;
+      dst_pos += chunk;
+      n -= chunk;
+    }
+  }
+
+  /** The number of set bits among the n bits starting at bit pos. **/
+  static size_t Count(const uint64_t* words, size_t pos, size_t n) {
+    size_t ret = 0;
+    for (size_t done = 0; done < n; done += 64) {
+      ret += __builtin_popcountll(Read(words, pos + done, std::min<size_t>(n - done, 64)));
+    }
+    return ret;
+  }
+
+  /** dst &= src and dst |= src over n bits, both starting at bit 0. **/
+  static void And(uint64_t* dst, const uint64_t* src, size_t n) {
+    for (size_t w = 0; w < NumWords(n); ++w) {
+      dst[w] &= src[w];
+    }
+  }
+
+  static void Or(uint64_t* dst, const uint64_t* src, size_t n) {
+    for (size_t w = 0; w < NumWords(n); ++w) {
+      dst[w] |= src[w];
+    }
+  }
+
+  /** Bit i of dst is bit permutation[i] of src, assembled a destination word at a time. **/
+  template <typename Index>
+  static void Gather(const uint64_t* src, const std::vector<Index>& permutation, uint64_t* dst) {
+    size_t n = permutation.size();
+    for (size_t w = 0; w < NumWords(n); ++w) {
+      uint64_t word = 0;
+      size_t end = std::min<size_t>(64, n - w * 64);
+      for (size_t j = 0; j < end; ++j) {
+        word |= uint64_t(Get(src, permutation[w * 64 + j])) << j;
+      }
+      dst[w] = word;
+    }
+  }
+
+  /** Pack the bits of src whose bits in mask are set to dst from bit 0, over n bits. Returns the number of bits kept.
+   * Uses PEXT where BMI2 is available.
+   */
+  static size_t Compress(const uint64_t* src, const uint64_t* mask, size_t n, uint64_t* dst) {
+    size_t out = 0;
+    for (size_t w = 0; w < NumWords(n); ++w) {
+      uint64_t keep = mask[w] & LowMask(n - w * 64);
+      if (keep == 0) {
+        continue;
+      }
+#ifdef __BMI2__
+      uint64_t packed = _pext_u64(src[w], keep);
+#else
+      uint64_t packed = 0;
+      size_t k = 0;
+      for (uint64_t rest = keep; rest != 0; rest &= rest - 1) {
+        packed |= ((src[w] >> __builtin_ctzll(rest)) & 1) << k++;
+      }
+#endif
+      size_t count = __builtin_popcountll(keep);
+      Write(dst, out, count, packed);
+      out += count;
+    }
+    return out;
+  }
+};
+
+/** The first n flags of bools packed in the BitmapOps layout, with fill for the flags past the end of bools. The
+ * flags are read through the public std::vector<bool> API, so the result does not depend on how the standard library
+ * stores a vector<bool>.
+ */
+inline std::vector<uint64_t> PackBools(const std::vector<bool>& bools, size_t n, bool fill = true) {
+  std::vector<uint64_t> words(BitmapOps::NumWords(n));
+  size_t avail = std::min(n, bools.size());
+  for (size_t w = 0; w < words.size(); ++w) {
+    uint64_t word = 0;
+    size_t end = std::min<size_t>(64, n - w * 64);
+    for (size_t j = 0; j < end; ++j) {
+      size_t i = w * 64 + j;
+      word |= uint64_t(i < avail ? bools[i] : fill) << j;
+    }
+    words[w] = word;
+  }
+  return words;
+}
+
+/** Set bools to the n bits of words starting at bit pos, a word at a time. **/
+inline void UnpackBools(const uint64_t* words, size_t pos, size_t n, std::vector<bool>* bools) {
+  bools->resize(n);
+  for (size_t done = 0; done < n; done += 64) {
+    size_t end = std::min<size_t>(64, n - done);
+    uint64_t word = BitmapOps::Read(words, pos + done, end);
+    for (size_t j = 0; j < end; ++j) {
+      (*bools)[done + j] = (word >> j) & 1;
+    }
+  }
+}
+
+/** A word-aligned validity bitmap (bit set for a valid, i.e. non-null, row) with bulk operations. Slices share the
+ * words with the source bitmap, which are copied before a shared bitmap is modified.
+ */
+class ValidityBitmap {
+ public:
+  ValidityBitmap() : words_(std::make_shared<std::vector<uint64_t>>()) {}
+
+  explicit ValidityBitmap(size_t size, bool valid = true)
+      : words_(std::make_shared<std::vector<uint64_t>>(BitmapOps::NumWords(size), valid ? ~uint64_t(0) : 0)), size_(size) {}
+
+  static ValidityBitmap FromBools(const std::vector<bool>& bools) {
+    ValidityBitmap ret;
+    *ret.words_ = PackBools(bools, bools.size());
+    ret.size_ = bools.size();
+    return ret;
+  }
+
+  void ToBools(std::vector<bool>* bools) const { UnpackBools(GetWords(), offset_, size_, bools); }
+
+  inline size_t size() const { return size_; }
+  inline bool empty() const { return size_ == 0; }
+  inline bool IsValid(size_t i) const { return BitmapOps::Get(GetWords(), offset_ + i); }
+
+  void SetValid(size_t i, bool valid) {
+    MakeUnique();
+    BitmapOps::Set(words_->data(), i, valid);
+  }
+
+  inline size_t CountValid() const { return BitmapOps::Count(GetWords(), offset_, size_); }
+  inline size_t CountNull() const { return size_ - CountValid(); }
+
+  /** Keep the rows valid in both bitmaps. **/
+  void And(const ValidityBitmap& other) {
+    CHECK_EQ(other.size_, size_) << "[ValidityBitmap] and of bitmaps of different sizes";
+    MakeUnique();
+    auto other_words = other.Aligned();
+    BitmapOps::And(words_->data(), other_words.GetWords(), size_);
+  }
+
+  /** Keep the rows valid in either bitmap. **/
+  void Or(const ValidityBitmap& other) {
+    CHECK_EQ(other.size_, size_) << "[ValidityBitmap] or of bitmaps of different sizes";
+    MakeUnique();
+    auto other_words = other.Aligned();
+    BitmapOps::Or(words_->data(), other_words.GetWords(), size_);
+  }
+
+  /** Zero-copy slice. **/
+  ValidityBitmap Slice(size_t offset, size_t size) const {
+    CHECK_LE(offset + size, size_);
+    ValidityBitmap ret = *this;
+    ret.offset_ = offset_ + offset;
+    ret.size_ = size;
+    return ret;
+  }
+
+  /** Append the bits of other at the current bit offset. **/
+  void Append(const ValidityBitmap& other) {
+    MakeUnique();
+    words_->resize(BitmapOps::NumWords(size_ + other.size_));
+    if (other.size_ != 0) {
+      BitmapOps::Copy(other.GetWords(), other.offset_, words_->data(), size_, other.size_);
+    }
+    size_ += other.size_;
+  }
+
+  /** The bitmap of rows permutation[0], permutation[1], ... **/
+  template <typename Index>
+  ValidityBitmap Gather(const std::vector<Index>& permutation) const {
+    auto aligned = Aligned();
+    ValidityBitmap ret(permutation.size());
+    BitmapOps::Gather(aligned.GetWords(), permutation, ret.words_->data());
+    return ret;
+  }
+
+  /** The bitmap of the rows with to_keep set. **/
+  ValidityBitmap Filter(const std::vector<bool>& to_keep) const {
+    CHECK_EQ(to_keep.size(), size_) << "[ValidityBitmap] filter of size " << to_keep.size() << " on bitmap of size " << size_;
+    auto aligned = Aligned();
+    auto mask = PackBools(to_keep, size_, false);
+    ValidityBitmap ret(BitmapOps::Count(mask.data(), 0, size_));
+    BitmapOps::Compress(aligned.GetWords(), mask.data(), size_, ret.words_->data());
+    return ret;
+  }
+
+  /** The words of the bitmap, starting at bit GetOffset(). **/
+  inline const uint64_t* GetWords() const { return words_->data(); }
+  inline size_t GetOffset() const { return offset_; }
+
+ private:
+  /** This bitmap if it starts at bit 0, otherwise a copy that does. **/
+  ValidityBitmap Aligned() const {
+    if (offset_ == 0) {
+      return *this;
+    }
+    ValidityBitmap ret(size_);
+    BitmapOps::Copy(GetWords(), offset_, ret.words_->data(), 0, size_);
+    return ret;
+  }
+
+  /** Own the words and start at bit 0 before a modification. **/
+  void MakeUnique() {
+    if (words_.use_count() == 1 && offset_ == 0) {
+      return;
+    }
+    *this = Aligned();
+    if (words_.use_count() > 1) {
+      words_ = std::make_shared<std::vector<uint64_t>>(*words_);
+    }
+  }
+
+  std::shared_ptr<std::vector<uint64_t>> words_;
+  size_t offset_ = 0;
+  size_t size_ = 0;
+};
+
+}  // namespace common
+}  // namespace axe
@@ -26,6 +26,7 @@ using axe::base::BinStream;
 using axe::base::Properties;
 
 using axe::common::DatasetPartition;
+using axe::common::Emitter;
 using axe::common::Job;
 using axe::common::ResourcePredictor;
 using axe::common::SourceDataset;
@@ -18,6 +18,7 @@
 #include <string>
 #include <string_view>
 
+#include "base/buffer_allocator.h"
 #include "common/constants.h"
 
 namespace axe {
@@ -29,6 +30,11 @@ class FileSplitter {
   virtual void Load(const std::string& url) = 0;
   virtual std::string FetchBlock(const std::string& fn, size_t offset, bool is_next = false) = 0;
   virtual std::string_view FetchBlockView(const std::string& fn, size_t offset, bool is_next = false) = 0;
+
+  /** Allocate the buffer of an input block following the buffer allocation policy of the worker, i.e. backed by huge
+   * pages and bound to the NUMA node of the calling (consuming) thread when configured.
+   */
+  static std::shared_ptr<char> AllocateBlockBuffer(size_t size) { return base::BufferAllocator::Get().Allocate(size); }
 };
 
 }  // namespace common
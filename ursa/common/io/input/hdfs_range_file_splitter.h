@@ -0,0 +1,98 @@
+// Copyright 2020 HDL
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <fcntl.h>
+
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "glog/logging.h"
+#include "hdfs/hdfs.h"
+
+#include "common/io/hdfs_utils.h"
+#include "common/io/input/hdfs_file_splitter.h"
+#include "common/io/input/range_reader.h"
+
+namespace axe {
+namespace common {
+
+/** HDFSFileSplitter that also reads byte ranges with positional reads, on a connection of its own that is opened on the
+ * first range read. The file of the last range read stays open, so that the windows of a line tail, which are read one
+ * after another, open it once. The ranges are read into a buffer from AllocateBlockBuffer, which grows to the largest
+ * range read. Create it as this type, e.g. with std::make_shared, so that it is destroyed as this type.
+ */
+class HDFSRangeFileSplitter : public HDFSFileSplitter, public RangeReader {
+ public:
+  ~HDFSRangeFileSplitter() { CloseRangeFile(); }
+
+  std::string_view FetchRangeView(const std::string& fn, size_t offset, size_t size) override {
+    if (!OpenRangeFile(fn)) {
+      return std::string_view();
+    }
+    if (range_capacity_ < size) {
+      range_ = AllocateBlockBuffer(size);
+      range_capacity_ = size;
+    }
+    size_t n_read = 0;
+    while (n_read < size) {
+      tSize n = hdfsPread(range_fs_.get(), range_file_, offset + n_read, range_.get() + n_read, size - n_read);
+      if (n <= 0) {
+        break;
+      }
+      n_read += n;
+    }
+    return std::string_view(range_.get(), n_read);
+  }
+
+ private:
+  bool OpenRangeFile(const std::string& fn) {
+    if (range_file_ != NULL && fn == range_file_name_) {
+      return true;
+    }
+    CloseRangeFile();
+    if (range_fs_ == nullptr) {
+      range_fs_ = io::HdfsUtils::ConnectToHDFS();
+      if (range_fs_ == nullptr) {
+        return false;
+      }
+    }
+    range_file_ = hdfsOpenFile(range_fs_.get(), fn.c_str(), O_RDONLY, 0, 0, 0);
+    if (range_file_ == NULL) {
+      LOG(WARNING) << "[HDFSRangeFileSplitter] cannot open " << fn;
+      return false;
+    }
+    range_file_name_ = fn;
+    return true;
+  }
+
+  void CloseRangeFile() {
+    if (range_file_ != NULL) {
+      hdfsCloseFile(range_fs_.get(), range_file_);
+      range_file_ = NULL;
+    }
+    range_file_name_.clear();
+  }
+
+  io::HdfsFsPtr range_fs_;
+  hdfsFile range_file_ = NULL;
+  std::string range_file_name_;
+  std::shared_ptr<char> range_;
+  size_t range_capacity_ = 0;
+};
+
+}  // namespace common
+}  // namespace axe
@@ -14,86 +14,380 @@
 
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
 #include <utility>
 #include <vector>
 
 #include "glog/logging.h"
 
+#include "base/arena.h"
+#include "base/char_scanner.h"
 #include "common/dataset/dataset_partition.h"
+#include "common/dataset/emitter.h"
 #include "common/io/input/hdfs_file_splitter.h"
+#include "common/io/input/hdfs_range_file_splitter.h"
 #include "common/io/input/inputformat_helper.h"
+#include "common/io/input/nfs_range_file_splitter.h"
+#include "common/io/input/range_reader.h"
+#include "common/io/input/read_ahead_file_splitter.h"
 
 namespace axe {
 namespace common {
 
+/** The type of the lines a line executor is called with (followed by Args): a std::string_view into the block buffer
+ * if the executor takes one, so that only a line crossing into the next block is copied, otherwise a std::string copy
+ * of the line.
+ */
+template <typename Lambda, typename... Args>
+using LineType =
+    typename std::conditional<std::is_invocable<const Lambda&, std::string_view, Args...>::value, std::string_view, std::string>::type;
+
 // TODO(tatiana): doc
 class LineInputFormat {
  public:
-  explicit LineInputFormat(const std::string& url, FS protocol = HDFS) { SetSplitter(url, protocol); }
+  /** Read url with the splitter of protocol that also reads ranges, so that the line crossing the end of a block is
+   * completed without reading the whole next block.
+   */
+  explicit LineInputFormat(const std::string& url, FS protocol = HDFS) : LineInputFormat(MakeRangeSplitter(protocol), url) {}
+
+  /** Read url with the given splitter, e.g. a MmapFileSplitter, or a ReadAheadFileSplitter to which the blocks to read
+   * are scheduled. The splitter is held as a shared pointer, which destroys it as the type it was created as.
+   */
+  LineInputFormat(std::shared_ptr<FileSplitter> splitter, const std::string& url) : url_(url), shared_splitter_(std::move(splitter)) {
+    shared_splitter_->Load(url);
+  }
+
+  /** Parse the lines of each block on up to threads threads (including the calling one), each over line-aligned chunks
+   * of the block. With more than one thread, the executor is called from several threads at once whether or
+   * not the order is kept, so it must be thread-safe. The records are in the order of the lines if keep_order, otherwise
+   * in any order, which saves buffering the records of each chunk.
+   */
+  inline void SetParseThreads(size_t threads, bool keep_order = true) {
+    CHECK_GE(threads, 1) << "[LineInputFormat] at least one parse thread is needed";
+    parse_threads_ = threads;
+    keep_order_ = keep_order;
+  }
 
-  template <typename String = std::string, typename Lambda>
+  template <typename Lambda, typename Line = LineType<Lambda>>
   auto ReadData(const std::vector<std::pair<std::string, size_t>>& block_descs, const Lambda& executor) {
-    auto ret = DatasetPartition<typename decltype(executor(std::string()))::value_type>();
+    using Val = typename decltype(executor(Line()))::value_type;
+    auto ret = DatasetPartition<Val>();
+    auto parse = [&executor](const Line& line, DatasetPartition<Val>* out) {
+      auto result = executor(line);
+      if (result.size() != 0) {
+        out->insert(out->size(), result.begin(), result.end());
+      }
+    };
+    if (parse_threads_ > 1) {
+      ParallelForEachLine<Line>(block_descs, [](size_t) {}, parse, &ret);
+    } else {
+      ForEachLine<Line>(block_descs, [](size_t) {}, [&parse, &ret](const Line& line) { parse(line, &ret); });
+    }
+    return ret;
+  }
+
+  /** Read the lines with an executor(line, Emitter<Val>&) that emits its records directly into ret. Before each block
+   * after the first, ret reserves room for the records the block is expected to produce at the rate seen so far.
+   */
+  template <typename Val, typename Lambda, typename Line = LineType<Lambda, Emitter<Val>&>>
+  void ReadDataTo(const std::vector<std::pair<std::string, size_t>>& block_descs, const Lambda& executor, DatasetPartition<Val>* ret) {
+    Emitter<Val> emitter(ret);
+    size_t bytes_read = 0;
+    auto on_block = [ret, &bytes_read](size_t block_size) {
+      if (bytes_read != 0 && ret->size() != 0) {
+        ret->reserve(ret->size() + static_cast<size_t>(static_cast<double>(ret->size()) / bytes_read * block_size));
+      }
+      bytes_read += block_size;
+    };
+    if (parse_threads_ > 1) {
+      auto parse = [&executor](const Line& line, DatasetPartition<Val>* out) {
+        Emitter<Val> out_emitter(out);
+        executor(line, out_emitter);
+      };
+      ParallelForEachLine<Line>(block_descs, on_block, parse, ret);
+    } else {
+      ForEachLine<Line>(block_descs, on_block, [&executor, &emitter](const Line& line) { executor(line, emitter); });
+    }
+  }
+
+  auto& GetSplitter() const { return splitter_; }
+
+  /** The splitter in use, either the one given on construction or the one set by protocol. **/
+  inline FileSplitter* GetFileSplitter() const { return shared_splitter_ != nullptr ? shared_splitter_.get() : splitter_.get(); }
+
+ protected:
+  /** Helper threads of ParallelForEachLine, which run a job for each block in turn. Each thread has an arena of its own
+   * if with_arena, as the task arena is not shared across threads, which is active while the thread runs the jobs.
+   */
+  class ParseWorkers {
+   public:
+    ParseWorkers(size_t n_threads, bool with_arena) {
+      for (size_t t = 1; t <= n_threads; ++t) {
+        threads_.emplace_back([this, t, with_arena] { Loop(t, with_arena); });
+      }
+    }
+
+    ~ParseWorkers() {
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopped_ = true;
+      }
+      job_cv_.notify_all();
+      for (auto& thread : threads_) {
+        thread.join();
+      }
+    }
+
+    ParseWorkers(const ParseWorkers&) = delete;
+    ParseWorkers& operator=(const ParseWorkers&) = delete;
+
+    /** Call job(t) for t from 1 to n on the workers and job(0) on the calling thread, and wait for all the calls. **/
+    void Run(size_t n, const std::function<void(size_t)>& job) {
+      CHECK_LE(n, threads_.size()) << "[ParseWorkers] not enough workers";
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        job_ = &job;
+        n_active_ = n;
+        n_pending_ = n;
+        ++generation_;
+      }
+      job_cv_.notify_all();
+      job(0);
+      std::unique_lock<std::mutex> lock(mutex_);
+      done_cv_.wait(lock, [this] { return n_pending_ == 0; });
+      job_ = nullptr;
+    }
+
+   private:
+    void Loop(size_t t, bool with_arena) {
+      auto arena = with_arena ? std::make_shared<base::Arena>() : nullptr;
+      base::Arena::Activate activate(arena.get());
+      size_t generation = 0;
+      while (true) {
+        const std::function<void(size_t)>* job;
+        {
+          std::unique_lock<std::mutex> lock(mutex_);
+          job_cv_.wait(lock, [this, generation] { return stopped_ || generation_ != generation; });
+          if (stopped_) {
+            return;
+          }
+          generation = generation_;
+          if (t > n_active_) {
+            continue;
+          }
+          job = job_;
+        }
+        (*job)(t);
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (--n_pending_ == 0) {
+          done_cv_.notify_one();
+        }
+      }
+    }
+
+    std::vector<std::thread> threads_;
+    std::mutex mutex_;
+    std::condition_variable job_cv_;
+    std::condition_variable done_cv_;
+    const std::function<void(size_t)>* job_ = nullptr;
+    size_t generation_ = 0;
+    size_t n_active_ = 0;
+    size_t n_pending_ = 0;
+    bool stopped_ = false;
+  };
+
+  /** Call on_block(block size) for each fetched block and on_line(line) for each line starting in the blocks. The line
+   * ends of a block are found in one vectorized pass.
+   */
+  template <typename Line, typename OnBlock, typename OnLine>
+  void ForEachLine(const std::vector<std::pair<std::string, size_t>>& block_descs, OnBlock on_block, OnLine on_line) {
+    ScheduleReadAhead(block_descs);
+    std::vector<size_t> line_ends;
     for (auto& blo : block_descs) {
       // blo : (url, offset)
-      ClearBuffer();
-      bool success = FetchNewBlock(blo.first, blo.second);
+      bool success = FetchBlock(blo.first, blo.second);
       if (success == false) {
         continue;
       }
+      on_block(buffer_.size());
+      line_ends.clear();
+      base::CharScanner::FindAll(buffer_, '\n', &line_ends);
+      auto next_end = line_ends.begin();
 
       if (blo.second == 0) {
         r = -1;
       } else {
-        r = FindNext(buffer_, 0, '\n');
-        if (r == std::string::npos) {
+        if (next_end == line_ends.end()) {
           continue;
         }
+        r = *next_end++;
       }
 
       while (true) {
         // last charater in block
         if (r == buffer_.size() - 1) {
-          // fetch next block
-          buffer_ = splitter_->FetchBlockView(blo.first, blo.second, true);
-          if (!buffer_.empty()) {
-            // directly process the remaing
-            last_part_ = "";
-            HandleNextBlock(blo.first, blo.second);
-            auto res = executor(last_part_);
-            ret.insert(ret.size(), res.begin(), res.end());
+          // the first line of the next block, if any, is completed here
+          last_part_ = "";
+          if (ReadLineTail(blo.first, blo.second + buffer_.size())) {
+            base::Arena::Scope scope(base::Arena::Current());
+            on_line(Line(last_part_));
           }
           break;
         }
 
         l = r + 1;
-        r = FindNext(buffer_, l, '\n');
+        r = next_end != line_ends.end() ? *next_end++ : std::string::npos;
 
         // if the right end does not exist in current block
         if (r == std::string::npos) {
           last_part_ = buffer_.substr(l);
-          // fetch next subBlock
-          buffer_ = splitter_->FetchBlockView(blo.first, blo.second, true);
-          HandleNextBlock(blo.first, blo.second);
-          auto result = executor(last_part_);
-          ret.insert(ret.size(), result.begin(), result.end());
+          ReadLineTail(blo.first, blo.second + buffer_.size());
+          base::Arena::Scope scope(base::Arena::Current());
+          on_line(Line(last_part_));
           break;
         } else {
-          auto result = executor(String(buffer_.substr(l, r - l)));
-          if (result.size() != 0) {
-            ret.insert(ret.size(), result.begin(), result.end());
-          }
+          // temporaries the executor allocates from the task arena are released after each line
+          base::Arena::Scope scope(base::Arena::Current());
+          on_line(Line(buffer_.substr(l, r - l)));
         }
       }
     }
-    return ret;
   }
 
-  auto& GetSplitter() const { return splitter_; }
+  /** As ForEachLine, but parse(line, out) is called on parse_threads_ threads. The lines of a block that end in the
+   * block are split into line-aligned chunks, which the threads take in turn, and the records of each chunk (or of each
+   * thread if !keep_order_) go to an output of its own that is appended to ret once the block is parsed. The line
+   * crossing the block end is completed by ReadLineTail and parsed last on the calling thread. The helper threads, and
+   * their arenas, are created once and parse the chunks of every block.
+   */
+  template <typename Line, typename Val, typename OnBlock, typename Parse>
+  void ParallelForEachLine(const std::vector<std::pair<std::string, size_t>>& block_descs, OnBlock on_block, const Parse& parse,
+                           DatasetPartition<Val>* ret) {
+    ScheduleReadAhead(block_descs);
+    ParseWorkers workers(parse_threads_ - 1, base::Arena::Current() != nullptr);
+    for (auto& blo : block_descs) {
+      if (!FetchBlock(blo.first, blo.second)) {
+        continue;
+      }
+      on_block(buffer_.size());
+      size_t begin = 0;
+      if (blo.second != 0) {  // the first line is completed by the previous block
+        begin = base::CharScanner::FindNext(buffer_, 0, '\n');
+        if (begin == std::string::npos) {
+          continue;
+        }
+        ++begin;
+      }
+      size_t last_end = buffer_.rfind('\n');
+      size_t end = last_end == std::string::npos ? 0 : last_end + 1;
+      if (begin < end) {
+        ParseChunks<Line>(buffer_.substr(begin, end - begin), parse, &workers, ret);
+      }
+
+      last_part_ = buffer_.substr(end);
+      bool ends_line = end == buffer_.size();
+      // a block ending with a line end still completes the first line of the next block
+      if (ReadLineTail(blo.first, blo.second + buffer_.size()) || !ends_line) {
+        base::Arena::Scope scope(base::Arena::Current());
+        parse(Line(last_part_), ret);
+      }
+    }
+  }
+
+  /** Parse the lines of text, which ends with a line end, on the calling thread and up to parse_threads_ - 1 workers. **/
+  template <typename Line, typename Val, typename Parse>
+  void ParseChunks(std::string_view text, const Parse& parse, ParseWorkers* workers, DatasetPartition<Val>* ret) {
+    size_t n_chunks = std::max<size_t>(1, std::min(parse_threads_ * kChunksPerThread, text.size() / kMinChunkBytes));
+    size_t n_threads = std::min(parse_threads_, n_chunks);
+    std::vector<size_t> bounds(n_chunks + 1, text.size());
+    bounds[0] = 0;
+    for (size_t c = 1; c < n_chunks; ++c) {
+      size_t target = std::max(bounds[c - 1], text.size() / n_chunks * c);
+      bounds[c] = target == 0 ? 0 : base::CharScanner::FindNext(text, target - 1, '\n') + 1;
+    }
+
+    // the calling thread parses into ret directly if the order of the records need not be kept
+    std::vector<DatasetPartition<Val>> outputs(keep_order_ ? n_chunks : n_threads);
+    std::atomic<size_t> next_chunk(0);
+    std::function<void(size_t)> work = [&](size_t thread) {
+      std::vector<size_t> line_ends;
+      for (size_t c = next_chunk++; c < n_chunks; c = next_chunk++) {
+        auto chunk = text.substr(bounds[c], bounds[c + 1] - bounds[c]);
+        auto out = keep_order_ ? &outputs[c] : (thread == 0 ? ret : &outputs[thread]);
+        line_ends.clear();
+        base::CharScanner::FindAll(chunk, '\n', &line_ends);
+        size_t l = 0;
+        for (size_t r : line_ends) {
+          base::Arena::Scope scope(base::Arena::Current());
+          parse(Line(chunk.substr(l, r - l)), out);
+          l = r + 1;
+        }
+      }
+    };
+    workers->Run(n_threads - 1, work);
+    for (auto& out : outputs) {
+      if (out.size() != 0) {
+        ret->insert(ret->size(), out.begin(), out.end());
+      }
+    }
+  }
+
+  /** Append to last_part_ the rest of the line crossing block_end, instead of fetching the whole next block: the bytes
+   * after block_end are read in windows from kTailWindowBytes, doubling up to kMaxTailWindowBytes, until a line end or
+   * the end of the file. The splitters LineInputFormat creates are RangeReaders; the bytes are read in blocks with a
+   * splitter given on construction that is not. Returns false if the file ends at block_end. The read may replace the
+   * view of the block.
+   */
+  bool ReadLineTail(const std::string& fn, size_t block_end) {
+    size_t offset = block_end;
+    for (size_t window = kTailWindowBytes;; window = std::min(window * 2, kMaxTailWindowBytes)) {
+      auto range = RangeReader::Read(GetFileSplitter(), fn, offset, window);
+      if (range.empty()) {
+        return offset != block_end;
+      }
+      size_t end = base::CharScanner::FindNext(range, 0, '\n');
+      if (end != std::string::npos) {
+        last_part_.append(range.data(), end);
+        return true;
+      }
+      last_part_.append(range.data(), range.size());
+      offset += range.size();
+    }
+  }
+
+  void ScheduleReadAhead(const std::vector<std::pair<std::string, size_t>>& block_descs) {
+    if (auto read_ahead = dynamic_cast<ReadAheadFileSplitter*>(GetFileSplitter())) {
+      read_ahead->Schedule(block_descs);
+    }
+  }
+
+  static std::shared_ptr<FileSplitter> MakeRangeSplitter(FS protocol) {
+    if (protocol == HDFS) {
+      return std::make_shared<HDFSRangeFileSplitter>();
+    }
+    return std::make_shared<NFSRangeFileSplitter>();
+  }
+
+  /** Fetch the block of url at offset into buffer_. Returns false if there is no such block. **/
+  bool FetchBlock(const std::string& url, size_t offset) {
+    if (shared_splitter_ == nullptr) {
+      ClearBuffer();
+      return FetchNewBlock(url, offset);
+    }
+    last_part_.clear();
+    buffer_ = shared_splitter_->FetchBlockView(url, offset);
+    return !buffer_.empty();
+  }
 
- protected:
   void SetSplitter(const std::string& url, FS protocol);
   void HandleNextBlock(const std::string& url, size_t offset);
   bool FetchNewBlock(const std::string& url, size_t offset);
@@ -105,6 +399,14 @@ class LineInputFormat {
   std::string last_part_;
   std::string url_;
   std::string_view buffer_;
+
+  static constexpr size_t kChunksPerThread = 4;  // to balance the chunks with few or long lines
+  static constexpr size_t kMinChunkBytes = 64 * 1024;
+  static constexpr size_t kTailWindowBytes = 64 * 1024;
+  static constexpr size_t kMaxTailWindowBytes = 16 * 1024 * 1024;
+  size_t parse_threads_ = 1;
+  bool keep_order_ = true;
+  std::shared_ptr<FileSplitter> shared_splitter_;  // the splitter given on construction, if any
 };
 
 }  // namespace common
@@ -0,0 +1,141 @@
+// Copyright 2020 HDL
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "glog/logging.h"
+
+#include "common/io/input/file_splitter.h"
+#include "common/io/input/range_reader.h"
+#include "common/io/input/shared_block_reader.h"
+
+namespace axe {
+namespace common {
+
+/** Splitter of local or NFS files that maps each block into memory instead of reading it into a buffer.
+ *
+ * A fetched block is a view straight into the page cache: there is no copy and no anonymous buffer per block. The
+ * block is advised as read sequentially and needed soon, so the kernel reads it ahead. As with NFSFileSplitter, a
+ * view stays valid until the next fetch, when the previous block is unmapped. A caller that keeps the lines of a block
+ * longer holds GetBlockData(), and the block stays mapped until the last holder drops it. A line crossing into the
+ * next block is copied by LineInputFormat before the next block is fetched.
+ *
+ * Unlike a read, which fails with an error, touching a mapped page that cannot be read raises SIGBUS and kills the
+ * process, e.g. if the file is truncated while it is mapped or if the NFS server fails. Only map files that are not
+ * modified while they are read, see TextSourceDataset::SetMmap.
+ */
+class MmapFileSplitter : public FileSplitter, public RangeReader, public SharedBlockReader {
+ public:
+  explicit MmapFileSplitter(size_t block_size = kNFSBlockSize) : block_size_(block_size) {}
+  ~MmapFileSplitter() { CloseFile(); }
+
+  /** Files are opened when their blocks are fetched. **/
+  void Load(const std::string& url) override {}
+
+  std::string FetchBlock(const std::string& fn, size_t offset, bool is_next = false) override {
+    auto view = FetchBlockView(fn, offset, is_next);
+    return std::string(view.data(), view.size());
+  }
+
+  /** Map the block of file fn at offset, or the block after it if is_next. Returns an empty view past the end of the
+   * file or if the file cannot be mapped.
+   */
+  std::string_view FetchBlockView(const std::string& fn, size_t offset, bool is_next = false) override {
+    if (is_next) {
+      offset += block_size_;
+    }
+    data_.reset();
+    if (!OpenFile(fn) || offset >= file_size_) {
+      return std::string_view();
+    }
+    size_t size = std::min(block_size_, file_size_ - offset);
+    data_ = Map(offset, size);
+    return data_ == nullptr ? std::string_view() : std::string_view(data_.get(), size);
+  }
+
+  /** Map only the given range, which leaves the last fetched block mapped. **/
+  std::string_view FetchRangeView(const std::string& fn, size_t offset, size_t size) override {
+    range_.reset();
+    if (!OpenFile(fn) || offset >= file_size_) {
+      return std::string_view();
+    }
+    size = std::min(size, file_size_ - offset);
+    range_ = Map(offset, size);
+    return range_ == nullptr ? std::string_view() : std::string_view(range_.get(), size);
+  }
+
+  /** The mapping of the last fetched block, which keeps the block mapped while it is held. **/
+  std::shared_ptr<char> GetBlockData() const override { return data_; }
+
+ private:
+  bool OpenFile(const std::string& fn) {
+    if (fd_ >= 0 && fn == file_name_) {
+      return true;
+    }
+    CloseFile();
+    fd_ = open(fn.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd_ < 0) {
+      PLOG(WARNING) << "[MmapFileSplitter] cannot open " << fn;
+      return false;
+    }
+    struct stat st;
+    PCHECK(fstat(fd_, &st) == 0) << "[MmapFileSplitter] cannot stat " << fn;
+    file_size_ = st.st_size;
+    file_name_ = fn;
+    return true;
+  }
+
+  void CloseFile() {
+    if (fd_ >= 0) {
+      close(fd_);  // existing mappings stay valid after the file is closed
+      fd_ = -1;
+    }
+    file_name_.clear();
+    file_size_ = 0;
+  }
+
+  std::shared_ptr<char> Map(size_t offset, size_t size) {
+    static const size_t page_size = sysconf(_SC_PAGESIZE);
+    size_t aligned = offset / page_size * page_size;
+    size_t length = size + (offset - aligned);
+    void* addr = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd_, aligned);
+    if (addr == MAP_FAILED) {
+      PLOG(WARNING) << "[MmapFileSplitter] cannot map " << size << " bytes at " << offset << " of " << file_name_;
+      return nullptr;
+    }
+    madvise(addr, length, MADV_SEQUENTIAL);
+    madvise(addr, length, MADV_WILLNEED);
+    return std::shared_ptr<char>(static_cast<char*>(addr) + (offset - aligned), [addr, length](char*) { munmap(addr, length); });
+  }
+
+  const size_t block_size_;
+  int fd_ = -1;
+  std::string file_name_;
+  size_t file_size_ = 0;
+  std::shared_ptr<char> data_;
+  std::shared_ptr<char> range_;
+};
+
+}  // namespace common
+}  // namespace axe
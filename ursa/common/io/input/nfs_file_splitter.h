@@ -25,7 +25,7 @@ namespace common {
 
 class NFSFileSplitter : public FileSplitter {
  public:
-  explicit NFSFileSplitter(size_t block_size = 128 * 1024 * 1024) : block_size_(block_size) {}
+  explicit NFSFileSplitter(size_t block_size = kNFSBlockSize) : block_size_(block_size) {}
   ~NFSFileSplitter() { file_.close(); }
 
   void Load(const std::string& url) override;
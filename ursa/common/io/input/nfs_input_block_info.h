@@ -17,6 +17,7 @@
 #include <string>
 #include <vector>
 
+#include "common/constants.h"
 #include "common/io/input/input_block_info.h"
 
 namespace axe {
@@ -24,7 +25,7 @@ namespace common {
 
 class NFSInputBlockInfo : public AbstractInputBlockInfo {
  public:
-  explicit NFSInputBlockInfo(const std::string& url, size_t block_size = 128 * 1024 * 1024) : AbstractInputBlockInfo(url), block_size_(block_size) {}
+  explicit NFSInputBlockInfo(const std::string& url, size_t block_size = kNFSBlockSize) : AbstractInputBlockInfo(url), block_size_(block_size) {}
   virtual ~NFSInputBlockInfo() {}
 
   void FetchBlocksInfo() override;
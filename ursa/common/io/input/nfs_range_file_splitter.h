@@ -0,0 +1,96 @@
+// Copyright 2020 HDL
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#pragma once
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "glog/logging.h"
+
+#include "common/constants.h"
+#include "common/io/input/nfs_file_splitter.h"
+#include "common/io/input/range_reader.h"
+
+namespace axe {
+namespace common {
+
+/** NFSFileSplitter that also reads byte ranges with positional reads, e.g. the tail of a line crossing the end of a
+ * block, instead of reading the whole next block. The blocks are read as by NFSFileSplitter. The file of the last range
+ * read stays open, and the ranges are read into a buffer from AllocateBlockBuffer, which grows to the largest range
+ * read. Create it as this type, e.g. with std::make_shared, so that it is destroyed as this type.
+ */
+class NFSRangeFileSplitter : public NFSFileSplitter, public RangeReader {
+ public:
+  explicit NFSRangeFileSplitter(size_t block_size = kNFSBlockSize) : NFSFileSplitter(block_size) {}
+  ~NFSRangeFileSplitter() { CloseRangeFile(); }
+
+  std::string_view FetchRangeView(const std::string& fn, size_t offset, size_t size) override {
+    if (!OpenRangeFile(fn)) {
+      return std::string_view();
+    }
+    if (range_capacity_ < size) {
+      range_ = AllocateBlockBuffer(size);
+      range_capacity_ = size;
+    }
+    size_t n_read = 0;
+    while (n_read < size) {
+      ssize_t n = pread(range_fd_, range_.get() + n_read, size - n_read, offset + n_read);
+      if (n < 0) {
+        PLOG(WARNING) << "[NFSRangeFileSplitter] cannot read " << fn << " at " << offset + n_read;
+      }
+      if (n <= 0) {
+        break;
+      }
+      n_read += n;
+    }
+    return std::string_view(range_.get(), n_read);
+  }
+
+ private:
+  bool OpenRangeFile(const std::string& fn) {
+    if (range_fd_ >= 0 && fn == range_file_name_) {
+      return true;
+    }
+    CloseRangeFile();
+    range_fd_ = open(fn.c_str(), O_RDONLY | O_CLOEXEC);
+    if (range_fd_ < 0) {
+      PLOG(WARNING) << "[NFSRangeFileSplitter] cannot open " << fn;
+      return false;
+    }
+    range_file_name_ = fn;
+    return true;
+  }
+
+  void CloseRangeFile() {
+    if (range_fd_ >= 0) {
+      close(range_fd_);
+      range_fd_ = -1;
+    }
+    range_file_name_.clear();
+  }
+
+  int range_fd_ = -1;
+  std::string range_file_name_;
+  std::shared_ptr<char> range_;
+  size_t range_capacity_ = 0;
+};
+
+}  // namespace common
+}  // namespace axe
@@ -0,0 +1,51 @@
+// Copyright 2020 HDL
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <string>
+#include <string_view>
+
+#include "common/io/input/file_splitter.h"
+
+namespace axe {
+namespace common {
+
+/** Interface of the splitters that read byte ranges of a file, e.g. to complete a line crossing the end of a block
+ * without reading the whole next block. It is kept apart from FileSplitter, whose layout is fixed by the splitters
+ * compiled into the library, and detected with dynamic_cast.
+ */
+class RangeReader {
+ public:
+  /** Read at least size bytes of file fn at offset, or up to the end of the file. The view stays valid until the next
+   * fetch.
+   */
+  virtual std::string_view FetchRangeView(const std::string& fn, size_t offset, size_t size) = 0;
+
+  /** Read the range with splitter if it is a RangeReader, otherwise fetch the block at offset, of which the caller uses
+   * a prefix.
+   */
+  static std::string_view Read(FileSplitter* splitter, const std::string& fn, size_t offset, size_t size) {
+    if (auto reader = dynamic_cast<RangeReader*>(splitter)) {
+      return reader->FetchRangeView(fn, offset, size);
+    }
+    return splitter->FetchBlockView(fn, offset);
+  }
+
+ protected:
+  ~RangeReader() = default;
+};
+
+}  // namespace common
+}  // namespace axe
@@ -0,0 +1,194 @@
+// Copyright 2020 HDL
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "glog/logging.h"
+
+#include "common/constants.h"
+#include "common/io/input/file_splitter.h"
+#include "common/io/input/range_reader.h"
+#include "common/io/input/shared_block_reader.h"
+
+namespace axe {
+namespace common {
+
+/** Splitter that fetches the scheduled blocks ahead of their use on a background reader thread, so that the next blocks
+ * are read while the current one is parsed.
+ *
+ * The reader thread fetches the blocks in turn with one splitter (so one connection, e.g. to HDFS), and keeps up to
+ * depth blocks that are read but not yet used. Their data is held if the splitter is a SharedBlockReader, otherwise the
+ * blocks are copied into buffers of their own on the reader thread. A fetched view stays valid until the next fetch, as
+ * with the other splitters, so at most depth + 1 blocks are buffered. Fetches of blocks that are not scheduled, and
+ * reads of the line crossing a block end, go synchronously to a second splitter, which is only used by the calling
+ * thread.
+ *
+ * FileSplitter has no virtual destructor, so the factory returns shared pointers, which destroy the splitters as the
+ * concrete types they were created as. The same holds for the ReadAheadFileSplitter itself, see LineInputFormat.
+ */
+class ReadAheadFileSplitter : public FileSplitter, public RangeReader {
+ public:
+  using Factory = std::function<std::shared_ptr<FileSplitter>()>;
+
+  explicit ReadAheadFileSplitter(const Factory& factory, size_t depth = 1) : depth_(depth), reader_(factory()), direct_(factory()) {
+    CHECK_GE(depth, 1) << "[ReadAheadFileSplitter] read-ahead depth must be positive";
+    thread_ = std::thread([this] { ReadLoop(); });
+  }
+
+  ~ReadAheadFileSplitter() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopped_ = true;
+    }
+    cv_.notify_all();
+    thread_.join();
+  }
+
+  void Load(const std::string& url) override {
+    Schedule({});
+    reader_->Load(url);
+    direct_->Load(url);
+  }
+
+  /** Fetch the blocks in this order ahead of their FetchBlockView calls. The blocks scheduled before are dropped. **/
+  void Schedule(const std::vector<Block>& blocks) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    ++generation_;
+    cv_.wait(lock, [this] { return !reading_; });
+    schedule_ = blocks;
+    ready_.clear();
+    current_.reset();
+    next_ = 0;
+    launched_ = 0;
+    lock.unlock();
+    cv_.notify_all();
+  }
+
+  std::string FetchBlock(const std::string& fn, size_t offset, bool is_next = false) override {
+    auto view = FetchBlockView(fn, offset, is_next);
+    return std::string(view.data(), view.size());
+  }
+
+  std::string_view FetchBlockView(const std::string& fn, size_t offset, bool is_next = false) override {
+    std::unique_lock<std::mutex> lock(mutex_);
+    auto it = is_next ? schedule_.end() : std::find(schedule_.begin() + next_, schedule_.end(), Block(fn, offset));
+    if (it == schedule_.end()) {
+      lock.unlock();
+      return direct_->FetchBlockView(fn, offset, is_next);
+    }
+    size_t index = it - schedule_.begin();
+    current_.reset();
+    next_ = index;  // the blocks skipped are not read, or dropped once read
+    cv_.notify_all();
+    while (true) {
+      while (!ready_.empty() && ready_.front().index < index) {
+        ready_.pop_front();
+      }
+      if (!ready_.empty()) {
+        break;
+      }
+      cv_.wait(lock);
+    }
+    auto fetched = std::move(ready_.front());
+    ready_.pop_front();
+    next_ = index + 1;
+    cv_.notify_all();
+    current_ = std::move(fetched.data);
+    return fetched.view;
+  }
+
+  /** Ranges are read synchronously, which leaves the scheduled blocks as they are. **/
+  std::string_view FetchRangeView(const std::string& fn, size_t offset, size_t size) override {
+    return RangeReader::Read(direct_.get(), fn, offset, size);
+  }
+
+ private:
+  struct Fetched {
+    size_t index;
+    std::shared_ptr<char> data;  // keeps the view valid
+    std::string_view view;
+  };
+
+  /** Read the scheduled blocks from next_ on while fewer than depth_ of them are read ahead. **/
+  void ReadLoop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+      cv_.wait(lock, [this] { return stopped_ || (std::max(launched_, next_) < std::min(schedule_.size(), next_ + depth_)); });
+      if (stopped_) {
+        return;
+      }
+      launched_ = std::max(launched_, next_);
+      size_t index = launched_++;
+      auto block = schedule_[index];
+      size_t generation = generation_;
+      reading_ = true;
+      lock.unlock();
+      auto fetched = Read(index, block);
+      lock.lock();
+      reading_ = false;
+      if (generation == generation_ && index >= next_) {
+        ready_.push_back(std::move(fetched));
+      }
+      cv_.notify_all();
+    }
+  }
+
+  Fetched Read(size_t index, const Block& block) {
+    Fetched fetched{index, nullptr, reader_->FetchBlockView(block.first, block.second)};
+    if (fetched.view.empty()) {
+      return fetched;
+    }
+    if (auto shared = dynamic_cast<SharedBlockReader*>(reader_.get())) {
+      fetched.data = shared->GetBlockData();
+    } else {
+      fetched.data = AllocateBlockBuffer(fetched.view.size());
+      std::memcpy(fetched.data.get(), fetched.view.data(), fetched.view.size());
+      fetched.view = std::string_view(fetched.data.get(), fetched.view.size());
+    }
+    return fetched;
+  }
+
+  const size_t depth_;
+  std::shared_ptr<FileSplitter> reader_;  // used by the reader thread only
+  std::shared_ptr<FileSplitter> direct_;  // used by the calling thread only
+
+  std::thread thread_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  bool stopped_ = false;
+  bool reading_ = false;
+  size_t generation_ = 0;  // of the schedule, to drop the blocks of an earlier schedule
+
+  std::vector<Block> schedule_;
+  std::deque<Fetched> ready_;    // the blocks read ahead, by index
+  std::shared_ptr<char> current_;  // the data of the block last fetched
+  size_t next_ = 0;                // index of the next scheduled block to be fetched
+  size_t launched_ = 0;            // number of scheduled blocks whose reads have started
+};
+
+}  // namespace common
+}  // namespace axe
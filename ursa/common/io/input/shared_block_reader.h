@@ -0,0 +1,38 @@
+// Copyright 2020 HDL
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#pragma once
+
+#include <memory>
+
+namespace axe {
+namespace common {
+
+/** Interface of the splitters whose fetched blocks may outlive the next fetch: the block last fetched stays valid while
+ * its data is held, e.g. a mapped block that is unmapped when the last holder drops it. ReadAheadFileSplitter holds the
+ * blocks it reads ahead this way, and copies the blocks of the other splitters. As RangeReader, it is kept apart from
+ * FileSplitter and detected with dynamic_cast.
+ */
+class SharedBlockReader {
+ public:
+  /** The data of the block last fetched, which keeps the block valid while it is held. **/
+  virtual std::shared_ptr<char> GetBlockData() const = 0;
+
+ protected:
+  ~SharedBlockReader() = default;
+};
+
+}  // namespace common
+}  // namespace axe
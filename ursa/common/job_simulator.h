@@ -16,7 +16,10 @@
 
 #include <chrono>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "glog/logging.h"
@@ -25,8 +28,13 @@
 #include "gperftools/profiler.h"
 #endif
 
+#include "base/buffer_allocator.h"
+#include "common/instance_id.h"
 #include "common/job_driver.h"
 #include "common/resource_request.h"
+#include "common/shuffle_metrics.h"
+#include "common/task_context.h"
+#include "common/task_graph.h"
 #include "job_manager/simulation_job_manager.h"
 #include "job_process/simulation_job_process.h"
 
@@ -51,8 +59,8 @@ namespace SimulationConnector {
 std::thread AssignTask(MsgQueue* jm_queue, const std::map<std::string, MsgQueue*>& jp_queues, MsgQueue* jm_receive_queue) {
   return std::thread([=]() {
     while (true) {
-      auto payload = jm_queue->WaitAndPop();
-      auto to_scheduler = std::make_shared<BinStream>(*payload);
+      // the popped message is owned by this thread only, so it is consumed in place instead of being copied
+      auto to_scheduler = jm_queue->WaitAndPop();
       common::SchedulerEventType event_type;
       *to_scheduler >> event_type;
       if (event_type == common::SchedulerEventType::SchedulerRequestResource) {
@@ -80,8 +88,7 @@ std::thread AssignTask(MsgQueue* jm_queue, const std::map<std::string, MsgQueue*
 std::thread TaskComplete(MsgQueue* jp_queue, MsgQueue* jm_queue) {
   return std::thread([=]() {
     while (true) {
-      auto payload = jp_queue->WaitAndPop();
-      auto to_worker = std::make_shared<BinStream>(*payload);
+      auto to_worker = jp_queue->WaitAndPop();
       common::WorkerEventType event_type;
       int ms;
       JobIdType job_id;
@@ -125,6 +132,42 @@ std::thread SendTask(MsgQueue* worker_queue, MsgQueue* jp_queue) {
 
 }  // namespace SimulationConnector
 
+/** Delivers the messages that tasks push while running (see TaskContext::PushMessage) to the receiving tasks, as all
+ * job processes of the simulation run in this process. The pushed messages are held per message dataset and
+ * destination shard until the deserialize task of the destination takes them.
+ */
+class SimulationMessageChannel {
+ public:
+  void Push(DataIdType msg_id, ShardIdType dst, const std::shared_ptr<BinStream>& message) {
+    // the header is read here, as by the channel service of the receiver
+    JobProcessEventType event_type;
+    DataIdType header_msg_id;
+    ShardIdType src, header_dst;
+    std::shared_ptr<InstanceId> instance_id;
+    *message >> event_type >> header_msg_id >> src >> instance_id >> header_dst;
+    CHECK(event_type == JobProcessEventType::JPReceiveData) << "Unexpected type " << event_type;
+    CHECK_EQ(header_msg_id, msg_id);
+    CHECK_EQ(header_dst, dst);
+    std::lock_guard<std::mutex> lock(mutex_);
+    pushed_[{msg_id, dst}].push_back(message);
+  }
+
+  std::vector<std::shared_ptr<BinStream>> Take(DataIdType msg_id, ShardIdType dst) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto pos = pushed_.find({msg_id, dst});
+    if (pos == pushed_.end()) {
+      return std::vector<std::shared_ptr<BinStream>>();
+    }
+    auto pushed = std::move(pos->second);
+    pushed_.erase(pos);
+    return pushed;
+  }
+
+ private:
+  std::mutex mutex_;
+  std::map<std::pair<DataIdType, ShardIdType>, std::vector<std::shared_ptr<BinStream>>> pushed_;
+};
+
 class SimulationJob {
  public:
   SimulationJob(int argc, char** argv, uint32_t n_job_processes, const Job& job) {
@@ -164,7 +207,17 @@ class SimulationJob {
     ProfilerStart(FLAGS_gperf.c_str());
 #endif
     TaskGraph task_graph;
-    job.Run(&task_graph, GetConfig(reader));
+    auto config = GetConfig(reader);
+    base::BufferAllocator::Get().Configure(config.get());
+    job.Run(&task_graph, config);
+
+    // shuffle messages pushed by running tasks go to their receivers through this process
+    auto message_channel = std::make_shared<SimulationMessageChannel>();
+    TaskContext::SetMessageChannel(
+        [message_channel](DataIdType msg_id, ShardIdType dst, const std::shared_ptr<BinStream>& message) {
+          message_channel->Push(msg_id, dst, message);
+        },
+        [message_channel](DataIdType msg_id, ShardIdType dst) { return message_channel->Take(msg_id, dst); });
 
     SimulationJobManagerCommEnv jm_comm_env;
     SimulationJobManager job_manager(&jm_comm_env);
@@ -210,6 +263,8 @@ class SimulationJob {
     wait_thread.join();
     auto end_time = std::chrono::high_resolution_clock::now();
     LOG(INFO) << "Simulation job completion time: " << std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time).count() << " ms";
+    ShuffleMetrics::Get().LogSummary();
+    LOG(INFO) << "[BufferAllocator] " << base::BufferAllocator::Get().GetStats().DebugString();
 #ifdef WITH_GPERF
     ProfilerStop();
 #endif
@@ -0,0 +1,234 @@
+// Copyright 2020 HDL
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "glog/logging.h"
+
+#include "common/constants.h"
+
+namespace axe {
+namespace common {
+
+/** Aggregated metrics of one shuffle edge, i.e. one serialize -> network -> deserialize chain in the TaskGraph. **/
+struct ShuffleEdgeSummary {
+  std::string name;                                 // name of the serialize task
+  DataIdType msg_id = 0;                            // message dataset written by the serialize tasks
+  DataIdType shuffled_id = 0;                       // dataset produced by the network task and read by the deserialize tasks
+  std::map<std::pair<ShardIdType, ShardIdType>, std::pair<uint64_t, uint64_t>> pairs;  // (src, dst) -> (records, bytes)
+  std::vector<uint64_t> bytes_per_dst;
+  uint64_t records = 0;
+  uint64_t bytes = 0;
+  double skew = 0;                // coefficient of variation of the bytes received per destination
+  double max_over_mean = 0;       // bytes of the largest destination over the mean
+  double serialize_ms = 0;        // summed over the serialize tasks
+  double max_serialize_ms = 0;
+  double deserialize_ms = 0;      // summed over the deserialize tasks
+  double max_deserialize_ms = 0;
+  double transfer_ms = 0;         // from the last message sent to the start of the deserialize task, summed over shards
+  double max_transfer_ms = 0;
+
+  std::string DebugString() const {
+    std::stringstream ss;
+    ss << name << " (msg " << msg_id << " -> " << shuffled_id << "): " << records << " records, " << bytes << " bytes over " << pairs.size()
+       << " edges, skew " << skew << " (max/mean " << max_over_mean << "), serialize " << serialize_ms << " ms (max " << max_serialize_ms
+       << "), transfer " << transfer_ms << " ms (max " << max_transfer_ms << "), deserialize " << deserialize_ms << " ms (max "
+       << max_deserialize_ms << ")";
+    return ss.str();
+  }
+};
+
+/** Process-wide collector of shuffle metrics, enabled by FLAGS_enable_message_size_report.
+ *
+ * The shuffle operators register their edges while the TaskGraph is built, which happens in every process of a job.
+ * Serialize and deserialize closures report their records, bytes and times; the transfer time is measured from the
+ * send time stamped on the messages to the start of the deserialize task, so it covers the network task and the wait
+ * for scheduling, and includes the clock offset between the machines. Every record is logged at VLOG(1). The summary
+ * of the edges is logged once, by LogSummary or else when the process exits, and covers the shards run by the process.
+ */
+class ShuffleMetrics {
+ public:
+  static ShuffleMetrics& Get() {
+    static ShuffleMetrics metrics;
+    return metrics;
+  }
+
+  /** Register the shuffle edge whose serialize task named name writes msg_id, which the network task turns into shuffled_id. **/
+  void RegisterEdge(DataIdType msg_id, DataIdType shuffled_id, const std::string& name) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    edges_[msg_id] = {shuffled_id, name};
+    if (!exit_hook_) {
+      exit_hook_ = true;
+      std::atexit([] { Get().LogSummary(); });
+    }
+  }
+
+  void RecordSend(DataIdType msg_id, ShardIdType src, const std::vector<uint64_t>& records, const std::vector<uint64_t>& bytes,
+                  double serialize_ms) {
+    CHECK_EQ(records.size(), bytes.size());
+    uint64_t total_records = 0, total_bytes = 0;
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& send = sends_[msg_id];
+    for (ShardIdType dst = 0; dst < records.size(); ++dst) {
+      auto& pair = send.pairs[{src, dst}];
+      pair.first += records[dst];
+      pair.second += bytes[dst];
+      total_records += records[dst];
+      total_bytes += bytes[dst];
+    }
+    send.time.Add(serialize_ms);
+    VLOG(1) << "[ShuffleMetrics] msg " << msg_id << " shard " << src << " sent " << total_records << " records, " << total_bytes << " bytes to "
+            << records.size() << " shards, skew " << Skew(bytes) << ", serialize " << serialize_ms << " ms";
+  }
+
+  void RecordReceive(DataIdType shuffled_id, ShardIdType dst, uint64_t records, uint64_t bytes, double deserialize_ms, double transfer_ms) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& receive = receives_[shuffled_id];
+    receive.time.Add(deserialize_ms);
+    receive.transfer.Add(transfer_ms);
+    VLOG(1) << "[ShuffleMetrics] msg " << shuffled_id << " shard " << dst << " received " << records << " records, " << bytes
+            << " bytes, transfer " << transfer_ms << " ms, deserialize " << deserialize_ms << " ms";
+  }
+
+  /** The registered edges with the records of this process, in the order of their message datasets. **/
+  std::vector<ShuffleEdgeSummary> Summarize() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<ShuffleEdgeSummary> ret;
+    for (auto& id_send : sends_) {
+      ShuffleEdgeSummary edge;
+      edge.msg_id = id_send.first;
+      edge.shuffled_id = edge.msg_id;
+      auto registered = edges_.find(edge.msg_id);
+      if (registered != edges_.end()) {
+        edge.shuffled_id = registered->second.first;
+        edge.name = registered->second.second;
+      }
+      edge.pairs = id_send.second.pairs;
+      for (auto& pair : edge.pairs) {
+        auto dst = pair.first.second;
+        if (edge.bytes_per_dst.size() <= dst) {
+          edge.bytes_per_dst.resize(dst + 1, 0);
+        }
+        edge.bytes_per_dst[dst] += pair.second.second;
+        edge.records += pair.second.first;
+        edge.bytes += pair.second.second;
+      }
+      edge.skew = Skew(edge.bytes_per_dst);
+      edge.max_over_mean = MaxOverMean(edge.bytes_per_dst);
+      edge.serialize_ms = id_send.second.time.total;
+      edge.max_serialize_ms = id_send.second.time.max;
+      auto receive = receives_.find(edge.shuffled_id);
+      if (receive != receives_.end()) {
+        edge.deserialize_ms = receive->second.time.total;
+        edge.max_deserialize_ms = receive->second.time.max;
+        edge.transfer_ms = receive->second.transfer.total;
+        edge.max_transfer_ms = receive->second.transfer.max;
+      }
+      ret.push_back(std::move(edge));
+    }
+    return ret;
+  }
+
+  /** Log the summary of every shuffle edge, with the edges sorted by bytes in descending order. Only the first call
+   * after Clear logs, so that the summary logged at job end is not repeated when the process exits.
+   */
+  void LogSummary() {
+    auto edges = Summarize();
+    if (edges.empty() || logged_.exchange(true)) {
+      return;
+    }
+    std::sort(edges.begin(), edges.end(), [](const ShuffleEdgeSummary& a, const ShuffleEdgeSummary& b) { return a.bytes > b.bytes; });
+    LOG(INFO) << "[ShuffleMetrics] summary of " << edges.size() << " shuffle edges";
+    for (auto& edge : edges) {
+      LOG(INFO) << "[ShuffleMetrics] " << edge.DebugString();
+    }
+  }
+
+  void Clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    sends_.clear();
+    receives_.clear();
+    logged_ = false;
+  }
+
+  /** Coefficient of variation, i.e. standard deviation over mean. **/
+  static double Skew(const std::vector<uint64_t>& sizes) {
+    if (sizes.empty()) {
+      return 0;
+    }
+    double mean = 0, variance = 0;
+    for (auto size : sizes) {
+      mean += size;
+    }
+    mean /= sizes.size();
+    if (mean == 0) {
+      return 0;
+    }
+    for (auto size : sizes) {
+      variance += (size - mean) * (size - mean);
+    }
+    return std::sqrt(variance / sizes.size()) / mean;
+  }
+
+  static double MaxOverMean(const std::vector<uint64_t>& sizes) {
+    uint64_t total = 0, max = 0;
+    for (auto size : sizes) {
+      total += size;
+      max = std::max(max, size);
+    }
+    return total == 0 ? 0 : static_cast<double>(max) * sizes.size() / total;
+  }
+
+ private:
+  struct TimeStat {
+    void Add(double ms) {
+      total += ms;
+      max = std::max(max, ms);
+    }
+    double total = 0;
+    double max = 0;
+  };
+
+  struct SendStat {
+    std::map<std::pair<ShardIdType, ShardIdType>, std::pair<uint64_t, uint64_t>> pairs;
+    TimeStat time;
+  };
+
+  struct ReceiveStat {
+    TimeStat time;
+    TimeStat transfer;
+  };
+
+  ShuffleMetrics() {}
+
+  mutable std::mutex mutex_;
+  std::map<DataIdType, std::pair<DataIdType, std::string>> edges_;  // message dataset -> (shuffled dataset, serialize task name)
+  std::map<DataIdType, SendStat> sends_;
+  std::map<DataIdType, ReceiveStat> receives_;
+  std::atomic<bool> logged_{false};
+  bool exit_hook_ = false;
+};
+
+}  // namespace common
+}  // namespace axe
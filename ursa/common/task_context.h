@@ -14,10 +14,14 @@
 
 #pragma once
 
+#include <functional>
 #include <memory>
+#include <numeric>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
+#include "base/arena.h"
 #include "base/properties.h"
 #include "common/constants.h"
 #include "common/data_memory_record.h"
@@ -37,6 +41,9 @@ using base::Properties;
 
 class TaskContext {
  public:
+  using MessageSink = std::function<void(DataIdType msg_id, ShardIdType dst, const std::shared_ptr<base::BinStream>& message)>;
+  using MessageSource = std::function<std::vector<std::shared_ptr<base::BinStream>>(DataIdType msg_id, ShardIdType dst)>;
+
   explicit TaskContext(const std::shared_ptr<TaskDesc>& task_desc) : task_desc_(task_desc) {}
 
   /** Constructor with data store. **/
@@ -108,15 +115,23 @@ class TaskContext {
     }
     CHECK(data_store_ != nullptr) << "[TaskContext] data_store_ not set";
     auto message_ptr = std::dynamic_pointer_cast<DatasetPartition<std::shared_ptr<base::BinStream>>>(data);
+    // messages pushed before the partition is inserted count toward its size
+    std::vector<double> pushed_memory;
+    auto pushed = pushed_message_memory_.find(data_id);
+    if (message_ptr != nullptr && pushed != pushed_message_memory_.end()) {
+      pushed_memory = std::move(pushed->second);
+      pushed_message_memory_.erase(pushed);
+    }
+    pushed_memory.resize(message_ptr == nullptr ? 0 : message_ptr->size(), 0);
     if (FLAGS_enable_message_size_report && message_ptr != nullptr) {
       std::vector<double> downstream_memory;
       downstream_memory.reserve(message_ptr->size());
-      for (auto& bin : *message_ptr) {
-        downstream_memory.push_back(bin->size());
+      for (size_t i = 0; i < message_ptr->size(); ++i) {
+        downstream_memory.push_back(message_ptr->at(i)->size() + pushed_memory[i]);
       }
       data_memory_.emplace_back(data_id, std::move(downstream_memory));
     } else {
-      data_memory_.emplace_back(data_id, data->GetMemory());
+      data_memory_.emplace_back(data_id, data->GetMemory() + std::accumulate(pushed_memory.begin(), pushed_memory.end(), 0.));
     }
     data_store_->InsertData(data_id, task_desc_->GetShardId(), data);
   }
@@ -166,6 +181,55 @@ class TaskContext {
   inline const auto& GetInjectedWatermark() const { return watermark_; }
   inline const bool HasWatermark() const { return has_watermark_; }
 
+  /** Whether the tasks of this process can push messages, i.e. the process is the job simulator. **/
+  static bool HasMessageChannel() { return DefaultMessageSink() != nullptr; }
+
+  /** Set by the job simulator, which runs the tasks of all job processes and delivers the pushed messages itself,
+   * before any task runs. The sink takes the pushed messages, and the source returns the messages pushed to a
+   * destination shard, which its receiving task takes with TakePushedMessages. Job processes set no channel: their
+   * channel service, in the prebuilt job process library, ships a message partition only after its task completes.
+   */
+  static void SetMessageChannel(const MessageSink& sink, const MessageSource& source) {
+    DefaultMessageSink() = sink;
+    DefaultMessageSource() = source;
+  }
+
+  /** Hand a complete message (with its header) for destination dst to the message channel before the message partition
+   * msg_id is inserted. The receiver accumulates it with the messages of the inserted partition.
+   */
+  void PushMessage(DataIdType msg_id, ShardIdType dst, const std::shared_ptr<base::BinStream>& message) {
+    auto& sink = DefaultMessageSink();
+    CHECK(sink != nullptr) << "[TaskContext] message channel not set";
+    auto& pushed_memory = pushed_message_memory_[msg_id];
+    if (pushed_memory.size() <= dst) {
+      pushed_memory.resize(dst + 1, 0);
+    }
+    pushed_memory[dst] += message->size();
+    sink(msg_id, dst, message);
+  }
+
+  /** Take the messages of the message partition msg_id that were pushed to the shard of this task, with their headers
+   * read. Empty unless a message channel is set.
+   */
+  std::vector<std::shared_ptr<base::BinStream>> TakePushedMessages(DataIdType msg_id) {
+    auto& source = DefaultMessageSource();
+    return source == nullptr ? std::vector<std::shared_ptr<base::BinStream>>() : source(msg_id, task_desc_->GetShardId());
+  }
+
+  /** Bytes pushed so far per destination for the message partition msg_id, which is not inserted yet. **/
+  std::vector<double> GetPushedMessageMemory(DataIdType msg_id) const {
+    auto pos = pushed_message_memory_.find(msg_id);
+    return pos == pushed_message_memory_.end() ? std::vector<double>() : pos->second;
+  }
+
+  /** The arena of the task, created on first use and released with the task context. **/
+  base::Arena* GetArena() {
+    if (arena_ == nullptr) {
+      arena_ = std::make_shared<base::Arena>();
+    }
+    return arena_.get();
+  }
+
   inline void SetConfig(const std::shared_ptr<Properties>& config) { config_ = config; }
   inline const std::string& GetConfig(const std::string& key) { return config_->Get(key); }
 
@@ -180,6 +244,16 @@ class TaskContext {
   const auto& GetDataMemory() const { return data_memory_; }
 
  private:
+  static MessageSink& DefaultMessageSink() {
+    static MessageSink sink = nullptr;
+    return sink;
+  }
+
+  static MessageSource& DefaultMessageSource() {
+    static MessageSource source = nullptr;
+    return source;
+  }
+
   std::shared_ptr<TaskDesc> task_desc_;
   bool has_watermark_ = false;
   InstanceId watermark_;
@@ -187,6 +261,8 @@ class TaskContext {
   std::shared_ptr<Properties> config_;
 
   DataMemory data_memory_;
+  std::unordered_map<DataIdType, std::vector<double>> pushed_message_memory_;  // msg id -> bytes pushed per destination
+  std::shared_ptr<base::Arena> arena_ = nullptr;
 };
 
 }  // namespace common
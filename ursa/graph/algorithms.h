@@ -0,0 +1,166 @@
+// Copyright 2020 HDL
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <algorithm>
+#include <limits>
+
+#include "graph/graph.h"
+
+namespace axe {
+namespace graph {
+
+/** PageRank: rank = (1 - damping) + damping * sum of the rank shares of the in-neighbors. All vertices stay active. **/
+template <typename Id, typename Neighbor = Id>
+class PageRank {
+ public:
+  using Value = double;
+  using Message = double;
+  using Payload = double;  // the rank share per edge
+
+  explicit PageRank(double damping = 0.85) : damping_(damping) {}
+
+  void Init(const CsrVertex<Id, Neighbor>&, Value* value, bool* active) const {
+    *value = 1;
+    *active = true;
+  }
+
+  template <typename Emit>
+  void Scatter(const CsrVertex<Id, Neighbor>& vertex, const Value& value, Emit& emit) const {
+    if (vertex.empty()) {
+      return;
+    }
+    Message share = value / vertex.size();
+    for (auto& neighbor : vertex) {
+      emit(NeighborTraits<Neighbor>::GetId(neighbor), share);
+    }
+  }
+
+  bool MakePayload(const CsrVertex<Id, Neighbor>& vertex, const Value& value, Payload* payload) const {
+    *payload = value / vertex.size();
+    return !vertex.empty();
+  }
+
+  bool EdgeMessage(const Id&, const Payload& payload, const Neighbor&, Message* message) const {
+    *message = payload;
+    return true;
+  }
+
+  static inline void Combine(Message& agg, const Message& message) { agg += message; }
+
+  bool Apply(Id, Value* value, const Message* message) const {
+    *value = (1 - damping_) + damping_ * (message == nullptr ? 0 : *message);
+    return true;
+  }
+
+ private:
+  double damping_;
+};
+
+/** Connected components by label propagation: each vertex takes the minimum id reachable from it. The adjacency lists
+ * must be symmetric, otherwise the labels are propagated along the edge direction only.
+ */
+template <typename Id, typename Neighbor = Id>
+class ConnectedComponents {
+ public:
+  using Value = Id;
+  using Message = Id;
+  using Payload = Id;  // the label
+
+  void Init(const CsrVertex<Id, Neighbor>& vertex, Value* value, bool* active) const {
+    *value = vertex.GetId();
+    *active = true;
+  }
+
+  template <typename Emit>
+  void Scatter(const CsrVertex<Id, Neighbor>& vertex, const Value& value, Emit& emit) const {
+    for (auto& neighbor : vertex) {
+      if (value < NeighborTraits<Neighbor>::GetId(neighbor)) {
+        emit(NeighborTraits<Neighbor>::GetId(neighbor), value);
+      }
+    }
+  }
+
+  bool MakePayload(const CsrVertex<Id, Neighbor>&, const Value& value, Payload* payload) const {
+    *payload = value;
+    return true;
+  }
+
+  bool EdgeMessage(const Id&, const Payload& payload, const Neighbor& neighbor, Message* message) const {
+    *message = payload;
+    return payload < NeighborTraits<Neighbor>::GetId(neighbor);
+  }
+
+  static inline void Combine(Message& agg, const Message& message) { agg = std::min(agg, message); }
+
+  bool Apply(Id, Value* value, const Message* message) const {
+    if (message == nullptr || !(*message < *value)) {
+      return false;
+    }
+    *value = *message;
+    return true;
+  }
+};
+
+/** Single-source shortest paths (Bellman-Ford style). Edge weights come from NeighborTraits, so an unweighted graph
+ * gives hop counts. Unreachable vertices keep an infinite distance.
+ */
+template <typename Id, typename Neighbor = Id>
+class ShortestPaths {
+ public:
+  using Value = double;
+  using Message = double;
+  using Payload = double;  // the distance
+
+  explicit ShortestPaths(Id source) : source_(source) {}
+
+  void Init(const CsrVertex<Id, Neighbor>& vertex, Value* value, bool* active) const {
+    *active = vertex.GetId() == source_;
+    *value = *active ? 0 : std::numeric_limits<double>::infinity();
+  }
+
+  template <typename Emit>
+  void Scatter(const CsrVertex<Id, Neighbor>& vertex, const Value& value, Emit& emit) const {
+    for (auto& neighbor : vertex) {
+      emit(NeighborTraits<Neighbor>::GetId(neighbor), value + NeighborTraits<Neighbor>::GetWeight(neighbor));
+    }
+  }
+
+  bool MakePayload(const CsrVertex<Id, Neighbor>&, const Value& value, Payload* payload) const {
+    *payload = value;
+    return true;
+  }
+
+  bool EdgeMessage(const Id&, const Payload& payload, const Neighbor& neighbor, Message* message) const {
+    *message = payload + NeighborTraits<Neighbor>::GetWeight(neighbor);
+    return true;
+  }
+
+  static inline void Combine(Message& agg, const Message& message) { agg = std::min(agg, message); }
+
+  bool Apply(Id, Value* value, const Message* message) const {
+    if (message == nullptr || *message >= *value) {
+      return false;
+    }
+    *value = *message;
+    return true;
+  }
+
+ private:
+  Id source_;
+};
+
+}  // namespace graph
+}  // namespace axe
@@ -0,0 +1,473 @@
+// Copyright 2020 HDL
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstdint>
+
+#include <algorithm>
+#include <memory>
+#include <numeric>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "glog/logging.h"
+
+#include "base/bin_stream.h"
+#include "common/dataset/csr_partition.h"
+#include "common/dataset/dataset.h"
+#include "common/dataset/dataset_partition.h"
+
+namespace axe {
+namespace graph {
+
+using common::CsrPartition;
+using common::CsrVertex;
+using common::Dataset;
+using common::DatasetPartition;
+
+/** Whether a vertex program supports mirror routing, i.e. declares a Payload type (see Graph::UseMirrors). **/
+template <typename Program>
+struct HasMirrorScatter {
+ private:
+  template <typename T>
+  static constexpr std::true_type check(typename T::Payload*);
+
+  template <typename>
+  static constexpr std::false_type check(...);
+
+  using type = decltype(check<Program>(nullptr));
+
+ public:
+  static constexpr bool value = type::value;
+};
+
+/** Access to the target vertex and the weight of an adjacency list entry. An entry is either a vertex id (weight 1) or
+ * an (id, weight) pair.
+ */
+template <typename Neighbor>
+struct NeighborTraits {
+  static inline const Neighbor& GetId(const Neighbor& neighbor) { return neighbor; }
+  static inline double GetWeight(const Neighbor&) { return 1; }
+};
+
+template <typename Id, typename Weight>
+struct NeighborTraits<std::pair<Id, Weight>> {
+  static inline const Id& GetId(const std::pair<Id, Weight>& neighbor) { return neighbor.first; }
+  static inline double GetWeight(const std::pair<Id, Weight>& neighbor) { return neighbor.second; }
+};
+
+/** The value of a vertex and whether it is active, i.e. scatters in the next superstep. **/
+template <typename Id, typename Value>
+struct VertexState {
+  Id id;
+  Value value;
+  bool active;
+
+  bool operator<(const VertexState& other) const { return id < other.id; }
+  bool operator==(const VertexState& other) const { return id == other.id; }
+};
+
+/** The adjacency lists of the vertices in one partition of a Graph, sorted by vertex id. **/
+template <typename Id, typename Neighbor>
+struct GraphShard {
+  CsrPartition<Id, Neighbor> topology;
+  CsrPartition<Id, uint32_t> routes;  // the partitions holding mirrors of each vertex, empty unless mirrors are built
+
+  // DatasetPartition requires ordered values. Shards are ordered by their first vertex.
+  bool operator<(const GraphShard& other) const { return FirstId() < other.FirstId(); }
+  bool operator==(const GraphShard& other) const { return FirstId() == other.FirstId(); }
+
+  inline Id FirstId() const { return topology.empty() ? Id() : topology.GetId(0); }
+  double GetMemory() const { return topology.GetMemory() + routes.GetMemory(); }
+
+  base::BinStream& serialize(base::BinStream& stream) const { return routes.serialize(topology.serialize(stream)); }
+  base::BinStream& deserialize(base::BinStream& stream) { return routes.deserialize(topology.deserialize(stream)); }
+};
+
+/** The edges from a source vertex into one destination partition, shipped there once when the mirrors are built. **/
+template <typename Id, typename Neighbor>
+struct MirrorRoute {
+  uint32_t dst;
+  Id source;
+  std::vector<Neighbor> edges;
+
+  bool operator<(const MirrorRoute& other) const { return source < other.source; }
+  bool operator==(const MirrorRoute& other) const { return source == other.source; }
+
+  base::BinStream& serialize(base::BinStream& stream) const { return stream << dst << source << edges; }
+  base::BinStream& deserialize(base::BinStream& stream) { return stream >> dst >> source >> edges; }
+};
+
+/** The payload of an active source vertex sent to the mirror of the vertex in partition dst. **/
+template <typename Id, typename Payload>
+struct MirrorMessage {
+  uint32_t dst;
+  Id source;
+  Payload payload;
+
+  bool operator<(const MirrorMessage& other) const { return source < other.source; }
+  bool operator==(const MirrorMessage& other) const { return source == other.source; }
+};
+
+/** Edge-cut partitioned graph with a vertex-centric (Pregel/GAS style) processing API.
+ *
+ * Vertices are hash partitioned by id, the same as ReduceBy partitions messages by target id, and each partition keeps
+ * its adjacency lists in a CsrPartition sorted by id. Run executes a vertex program in supersteps made of the existing
+ * Dataset operators:
+ *
+ *   1. scatter: every active vertex sends messages along its edges (SharedDataMapPartitionWith over the topology and
+ *      the vertex states, which are aligned by position);
+ *   2. combine: messages to the same vertex are combined on both sides of the shuffle (ReduceBy);
+ *   3. apply: each vertex applies its combined message, if any, and decides whether it stays active (a merge join of
+ *      the sorted states and messages in MapPartitionWith).
+ *
+ * A vertex program provides the following members:
+ *
+ *   using Value = ...;    // vertex value, trivially copyable
+ *   using Message = ...;  // message, trivially copyable
+ *   void Init(const CsrVertex<Id, Neighbor>& vertex, Value* value, bool* active) const;
+ *   template <typename Emit> void Scatter(const CsrVertex<Id, Neighbor>& vertex, const Value& value, Emit& emit) const;
+ *       // emit(target_id, message)
+ *   static void Combine(Message& agg, const Message& message);
+ *   bool Apply(Id id, Value* value, const Message* message) const;  // message is nullptr if none; returns active
+ *
+ * The task graph is built before the job runs, so a program runs for a fixed number of supersteps. Once no vertex is
+ * active, the remaining supersteps send no messages; the number of active vertices after each superstep is logged as
+ * the convergence check.
+ *
+ * Mirror routing (UseMirrors) replaces the per-edge shuffle of the scatter step. The topology is static, so a routing
+ * plan is built once on first use: every partition that holds a target of a vertex keeps a mirror of the vertex, i.e.
+ * the edges of the vertex into that partition, and the source partition records where the mirrors of each vertex are.
+ * A superstep then shuffles one payload per (active vertex, mirror) and each mirror expands its payload into messages
+ * along its local edges, which are combined before the apply step without another shuffle. The shuffle volume drops
+ * from the number of edges to the number of mirrors. A program supports mirror routing with the members
+ *
+ *   using Payload = ...;  // what a vertex sends to its mirrors, trivially copyable
+ *   bool MakePayload(const CsrVertex<Id, Neighbor>& vertex, const Value& value, Payload* payload) const;
+ *       // returns whether the vertex sends anything
+ *   bool EdgeMessage(const Id& source, const Payload& payload, const Neighbor& edge, Message* message) const;
+ *       // the message along one edge, returns whether it is sent
+ *
+ * and must send the same messages through both paths.
+ */
+template <typename Id, typename Neighbor = Id>
+class Graph {
+ public:
+  using Shard = GraphShard<Id, Neighbor>;
+  using Vertex = CsrVertex<Id, Neighbor>;
+
+  /** Build a graph from a dataset of records, each holding a vertex id and its adjacency list.
+   *
+   * @param records        the source records, one per vertex
+   * @param id_of          returns the vertex id of a record
+   * @param neighbors_of   returns the adjacency list of a record, as a std::vector<Neighbor>
+   * @param num_partitions the number of graph partitions
+   */
+  template <typename Val, typename IdOf, typename NeighborsOf>
+  static Graph FromRecords(Dataset<Val>* records, IdOf id_of, NeighborsOf neighbors_of, int num_partitions) {
+    auto partitioned = records->PartitionBy(id_of, num_partitions);
+    auto topology = partitioned.MapPartition([id_of, neighbors_of](const DatasetPartition<Val>& data) {
+      std::vector<uint32_t> order(data.size());
+      std::iota(order.begin(), order.end(), 0);
+      std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return id_of(data[a]) < id_of(data[b]); });
+      Shard shard;
+      shard.topology.reserve(data.size());
+      for (auto i : order) {
+        const auto& neighbors = neighbors_of(data[i]);
+        shard.topology.push_back(id_of(data[i]), neighbors.data(), neighbors.size());
+      }
+      DatasetPartition<Shard> ret;
+      ret.push_back(std::move(shard));
+      return ret;
+    });
+    return Graph(std::make_shared<Dataset<Shard>>(topology), num_partitions);
+  }
+
+  Graph(const std::shared_ptr<Dataset<Shard>>& topology, int num_partitions) : topology_(topology), num_partitions_(num_partitions) {}
+
+  inline const std::shared_ptr<Dataset<Shard>>& GetTopology() const { return topology_; }
+  inline int GetNumPartitions() const { return num_partitions_; }
+
+  /** Route the messages of the following runs through mirrors, for programs that support it. The routing plan is built
+   * on first use and reused by every later run on this graph.
+   */
+  inline void UseMirrors(bool use_mirrors) { use_mirrors_ = use_mirrors; }
+
+  /** Run a vertex program for max_supersteps supersteps.
+   *
+   * @param program           the vertex program
+   * @param max_supersteps    the number of supersteps
+   * @param track_convergence whether to log the number of active vertices after each superstep, which costs a ReduceBy
+   *                          and an ApplyRead per superstep
+   * @return the final vertex states, partitioned like the topology and sorted by id
+   */
+  template <typename Program>
+  auto Run(const Program& program, int max_supersteps, bool track_convergence = false) {
+    using State = VertexState<Id, typename Program::Value>;
+    using Update = std::pair<Id, typename Program::Message>;
+
+    auto states = std::make_shared<Dataset<State>>(topology_->MapPartition([program](const DatasetPartition<Shard>& shard) {
+      DatasetPartition<State> ret;
+      if (shard.empty()) {
+        return ret;
+      }
+      ret.reserve(shard.front().topology.size());
+      for (auto vertex : shard.front().topology) {
+        State state{vertex.GetId(), typename Program::Value(), true};
+        program.Init(vertex, &state.value, &state.active);
+        ret.push_back(state);
+      }
+      return ret;
+    }));
+
+    for (int step = 0; step < max_supersteps; ++step) {
+      auto apply = [program](const DatasetPartition<State>& states, const DatasetPartition<Update>& updates) {
+        DatasetPartition<State> ret = states.Copy();
+        size_t idx = 0, dropped = 0;
+        for (auto& state : ret) {
+          for (; idx < updates.size() && updates[idx].first < state.id; ++idx) {
+            ++dropped;
+          }
+          bool matched = idx < updates.size() && updates[idx].first == state.id;
+          state.active = program.Apply(state.id, &state.value, matched ? &updates[idx].second : nullptr);
+          idx += matched;
+        }
+        dropped += updates.size() - idx;
+        LOG_IF(WARNING, dropped != 0) << "[Graph] dropped " << dropped << " messages to vertices without adjacency lists";
+        return ret;
+      };
+
+      auto messages = Scatter(program, states.get());
+      states = std::make_shared<Dataset<State>>(states->MapPartitionWith(&messages, apply));
+      if (track_convergence) {
+        LogActiveVertices(states.get(), step);
+      }
+    }
+    return states;
+  }
+
+ private:
+  /** The combined messages of a superstep, partitioned and sorted by target id like the vertex states. **/
+  template <typename Program, typename State>
+  typename std::enable_if<HasMirrorScatter<Program>::value, Dataset<std::pair<Id, typename Program::Message>>>::type Scatter(
+      const Program& program, Dataset<State>* states) {
+    return use_mirrors_ ? ScatterThroughMirrors(program, states) : ScatterAlongEdges(program, states);
+  }
+
+  template <typename Program, typename State>
+  typename std::enable_if<!HasMirrorScatter<Program>::value, Dataset<std::pair<Id, typename Program::Message>>>::type Scatter(
+      const Program& program, Dataset<State>* states) {
+    LOG_IF(WARNING, use_mirrors_) << "[Graph] the vertex program has no Payload, fall back to scattering along the edges";
+    return ScatterAlongEdges(program, states);
+  }
+
+  template <typename Program, typename State>
+  auto ScatterAlongEdges(const Program& program, Dataset<State>* states) {
+    using Message = typename Program::Message;
+    using Update = std::pair<Id, Message>;
+    auto scatter = [program](const DatasetPartition<Shard>& shard, const DatasetPartition<State>& states) {
+      DatasetPartition<Update> ret;
+      if (shard.empty()) {
+        return ret;
+      }
+      auto& topology = shard.front().topology;
+      CHECK_EQ(topology.size(), states.size()) << "[Graph] vertex states are not aligned with the topology";
+      auto emit = [&ret](const Id& target, const Message& message) { ret.push_back(Update(target, message)); };
+      for (size_t i = 0; i < states.size(); ++i) {
+        if (states[i].active) {
+          program.Scatter(topology[i], states[i].value, emit);
+        }
+      }
+      return ret;
+    };
+    return topology_->SharedDataMapPartitionWith(states, scatter)
+        .ReduceBy([](const Update& update) { return update.first; },
+                  [](Update& agg, const Update& update) { Program::Combine(agg.second, update.second); }, num_partitions_);
+  }
+
+  template <typename Program, typename State>
+  auto ScatterThroughMirrors(const Program& program, Dataset<State>* states) {
+    using Payload = typename Program::Payload;
+    using Message = typename Program::Message;
+    using Update = std::pair<Id, Message>;
+    using Mirrored = MirrorMessage<Id, Payload>;
+    BuildMirrors();
+
+    // one payload per (active vertex, mirror), shuffled to the partition of the mirror
+    auto send = [program](const DatasetPartition<Shard>& shard, const DatasetPartition<State>& states) {
+      DatasetPartition<Mirrored> ret;
+      if (shard.empty()) {
+        return ret;
+      }
+      auto& topology = shard.front().topology;
+      auto& routes = shard.front().routes;
+      CHECK_EQ(routes.size(), states.size()) << "[Graph] vertex states are not aligned with the routing plan";
+      for (size_t i = 0; i < states.size(); ++i) {
+        Payload payload;
+        if (!states[i].active || !program.MakePayload(topology[i], states[i].value, &payload)) {
+          continue;
+        }
+        for (auto dst : routes[i]) {
+          ret.push_back(Mirrored{dst, states[i].id, payload});
+        }
+      }
+      return ret;
+    };
+    auto payloads = routed_topology_->SharedDataMapPartitionWith(states, send)
+                        .RangeReduceBy([](const Mirrored& message) { return message.source; },
+                                       [](const Mirrored& message) { return message.dst; }, [](Mirrored&, const Mirrored&) {}, num_partitions_);
+
+    // expand the payloads along the local edges of the mirrors, both sorted by source id, and combine by target
+    auto expand = [program](const DatasetPartition<Shard>& shard, const DatasetPartition<Mirrored>& payloads) {
+      DatasetPartition<Update> ret;
+      if (shard.empty()) {
+        return ret;
+      }
+      auto& mirrors = shard.front().topology;
+      size_t idx = 0;
+      for (auto& payload : payloads) {
+        for (; idx < mirrors.size() && mirrors.GetId(idx) < payload.source; ++idx) {
+        }
+        CHECK(idx < mirrors.size() && mirrors.GetId(idx) == payload.source) << "[Graph] no mirror for vertex " << payload.source;
+        for (auto& edge : mirrors[idx]) {
+          Message message;
+          if (program.EdgeMessage(payload.source, payload.payload, edge, &message)) {
+            ret.push_back(Update(NeighborTraits<Neighbor>::GetId(edge), message));
+          }
+        }
+      }
+      CombineUpdates<Program>(&ret);
+      return ret;
+    };
+    return mirrors_->SharedDataMapPartitionWith(&payloads, expand);
+  }
+
+  /** Build the routing plan of the mirrors once: the routes of the vertices, kept with the topology, and the mirrors,
+   * i.e. the edges of remote vertices into each partition, sorted by source id.
+   */
+  void BuildMirrors() {
+    if (mirrors_ != nullptr) {
+      return;
+    }
+    using Route = MirrorRoute<Id, Neighbor>;
+    uint32_t num_partitions = num_partitions_;
+    auto partition_of = [num_partitions](const Neighbor& edge) -> uint32_t {
+      return common::hash(NeighborTraits<Neighbor>::GetId(edge)) % num_partitions;
+    };
+
+    routed_topology_ = std::make_shared<Dataset<Shard>>(topology_->MapPartition([partition_of](const DatasetPartition<Shard>& data) {
+      DatasetPartition<Shard> ret;
+      if (data.empty()) {
+        return ret;
+      }
+      Shard shard;
+      shard.topology = data.front().topology;  // shares the adjacency arrays
+      shard.routes.reserve(shard.topology.size());
+      std::vector<uint32_t> dsts;
+      for (auto vertex : shard.topology) {
+        dsts.clear();
+        for (auto& edge : vertex) {
+          dsts.push_back(partition_of(edge));
+        }
+        std::sort(dsts.begin(), dsts.end());
+        dsts.erase(std::unique(dsts.begin(), dsts.end()), dsts.end());
+        shard.routes.push_back(vertex.GetId(), dsts);
+      }
+      ret.push_back(std::move(shard));
+      return ret;
+    }));
+
+    auto routes = topology_->MapPartition([partition_of, num_partitions](const DatasetPartition<Shard>& data) {
+      DatasetPartition<Route> ret;
+      if (data.empty()) {
+        return ret;
+      }
+      std::vector<std::vector<Neighbor>> edges(num_partitions);
+      std::vector<uint32_t> dsts;
+      for (auto vertex : data.front().topology) {
+        for (auto& edge : vertex) {
+          auto dst = partition_of(edge);
+          if (edges[dst].empty()) {
+            dsts.push_back(dst);
+          }
+          edges[dst].push_back(edge);
+        }
+        for (auto dst : dsts) {
+          ret.push_back(Route{dst, vertex.GetId(), std::move(edges[dst])});
+          edges[dst].clear();
+        }
+        dsts.clear();
+      }
+      return ret;
+    });
+    auto mirrors = routes.RangeReduceBy([](const Route& route) { return route.source; }, [](const Route& route) { return route.dst; },
+                                        [](Route&, const Route&) {}, num_partitions_);
+    mirrors_ = std::make_shared<Dataset<Shard>>(mirrors.MapPartition([](const DatasetPartition<Route>& data) {
+      Shard shard;
+      shard.topology.reserve(data.size());
+      for (auto& route : data) {
+        shard.topology.push_back(route.source, route.edges);
+      }
+      DatasetPartition<Shard> ret;
+      ret.push_back(std::move(shard));
+      return ret;
+    }));
+  }
+
+  /** Sort the updates by target id and combine the updates to the same target. **/
+  template <typename Program>
+  static void CombineUpdates(DatasetPartition<std::pair<Id, typename Program::Message>>* updates) {
+    if (updates->empty()) {
+      return;
+    }
+    using Update = std::pair<Id, typename Program::Message>;
+    std::sort(updates->begin(), updates->end(), [](const Update& a, const Update& b) { return a.first < b.first; });
+    size_t count = 0;
+    for (size_t i = 1; i < updates->size(); ++i) {
+      if ((*updates)[i].first == (*updates)[count].first) {
+        Program::Combine((*updates)[count].second, (*updates)[i].second);
+      } else {
+        (*updates)[++count] = (*updates)[i];
+      }
+    }
+    updates->resize(count + 1);
+  }
+
+  template <typename State>
+  static void LogActiveVertices(Dataset<State>* states, int step) {
+    using Count = std::pair<int, uint64_t>;
+    states
+        ->MapPartition([](const DatasetPartition<State>& data) {
+          DatasetPartition<Count> ret;
+          ret.push_back(Count(0, std::count_if(data.begin(), data.end(), [](const State& state) { return state.active; })));
+          return ret;
+        })
+        .ReduceBy([](const Count& count) { return count.first; }, [](Count& agg, const Count& count) { agg.second += count.second; }, 1)
+        .ApplyRead([step](const DatasetPartition<Count>& data) {
+          auto active = data.empty() ? 0 : data.front().second;
+          LOG(INFO) << "[Graph] superstep " << step << ": " << active << " active vertices" << (active == 0 ? ", converged" : "");
+        });
+  }
+
+  std::shared_ptr<Dataset<Shard>> topology_;
+  int num_partitions_;
+  bool use_mirrors_ = false;
+  std::shared_ptr<Dataset<Shard>> routed_topology_;  // the topology with the routes of the mirrors, built on first use
+  std::shared_ptr<Dataset<Shard>> mirrors_;          // the mirrors in each partition, built on first use
+};
+
+}  // namespace graph
+}  // namespace axe